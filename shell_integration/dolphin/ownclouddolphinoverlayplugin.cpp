@@ -22,7 +22,9 @@
 #include <QtNetwork/QLocalSocket>
 #include <KIOCore/kfileitem.h>
 #include <QDir>
+#include <QSet>
 #include <QTimer>
+#include <QVersionNumber>
 #include "ownclouddolphinpluginhelper.h"
 
 class OwncloudDolphinPlugin : public KOverlayIconPlugin
@@ -32,6 +34,8 @@ class OwncloudDolphinPlugin : public KOverlayIconPlugin
 
     typedef QHash<QByteArray, QByteArray> StatusMap;
     StatusMap m_status;
+    // directories whose status was requested at once, kept up to date by the pushes of the client
+    QSet<QByteArray> m_requestedDirectories;
 
 public:
 
@@ -50,7 +54,17 @@ public:
         QDir localPath(url.toLocalFile());
         const QByteArray localFile = localPath.canonicalPath().toUtf8();
 
-        helper->sendCommand(QByteArray("RETRIEVE_FILE_STATUS:" + localFile + "\n"));
+        // the sync folders are not part of a synced directory, ask for them one by one
+        const bool isSyncFolder = helper->paths().contains(QString::fromUtf8(localFile));
+        if (!isSyncFolder && QVersionNumber::fromString(QString::fromUtf8(helper->version())) >= QVersionNumber(1, 2)) {
+            const QByteArray directory = localFile.left(localFile.lastIndexOf('/'));
+            if (!m_requestedDirectories.contains(directory)) {
+                m_requestedDirectories.insert(directory);
+                helper->sendCommand(QByteArray("RETRIEVE_DIRECTORY_STATUS:" + directory + "\n"));
+            }
+        } else {
+            helper->sendCommand(QByteArray("RETRIEVE_FILE_STATUS:" + localFile + "\n"));
+        }
 
         StatusMap::iterator it = m_status.find(localFile);
         if (it != m_status.constEnd()) {
@@ -82,6 +96,12 @@ private:
 
     void slotCommandRecieved(const QByteArray &line) {
 
+        if (line.startsWith("VERSION:")) {
+            // (re)connected, the client doesn't know what we were monitoring
+            m_requestedDirectories.clear();
+            return;
+        }
+
         QList<QByteArray> tokens = line.split(':');
         if (tokens.count() != 3)
             return;
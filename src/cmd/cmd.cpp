@@ -15,11 +15,13 @@
  */
 
 #include "account.h"
+#include "bandwidthmanager.h"
 #include "common/syncjournaldb.h"
 #include "common/version.h"
 #include "configfile.h" // ONLY ACCESS THE STATIC FUNCTIONS!
 #include "httpcredentialstext.h"
 #include "libsync/logger.h"
+#include "libsync/metrics.h"
 #include "libsync/theme.h"
 #include "networkjobs/checkserverjobfactory.h"
 #include "networkjobs/jsonjob.h"
@@ -64,8 +66,9 @@ struct CmdOptions
     QString exclude;
     QString unsyncedfolders;
     int restartTimes = 3;
-    int downlimit = 0;
-    int uplimit = 0;
+    qint64 downlimit = 0;
+    qint64 uplimit = 0;
+    BandwidthSchedule bandwidthSchedule;
 };
 
 struct SyncCTX
@@ -133,6 +136,7 @@ void sync(const SyncCTX &ctx)
     }
 
     SyncOptions opt { QSharedPointer<Vfs>(VfsPluginManager::instance().createVfsFromPlugin(Vfs::Off).release()) };
+    opt.setupParallelism(ctx.account->isHttp2Supported());
     opt.fillFromEnvironmentVariables();
     opt.verifyChunkSizes();
     auto engine = new SyncEngine(
@@ -194,7 +198,7 @@ void sync(const SyncCTX &ctx)
     QObject::connect(engine, &SyncEngine::syncError, engine,
         [](const QString &error) { qWarning() << "Sync error:" << error; });
     engine->setIgnoreHiddenFiles(ctx.options.ignoreHiddenFiles);
-    engine->setNetworkLimits(ctx.options.uplimit, ctx.options.downlimit);
+    BandwidthManager::setGlobalSchedule(ctx.options.bandwidthSchedule, { ctx.options.uplimit, ctx.options.downlimit });
 
 
     // Exclude lists
@@ -320,10 +324,16 @@ CmdOptions parseOptions(const QStringList &app_args)
 
     auto nonInterActiveOption = addOption({ { QStringLiteral("non-interactive") }, QStringLiteral("Do not block execution with interaction") });
     auto maxRetriesOption = addOption({ { QStringLiteral("max-sync-retries") }, QStringLiteral("Retries maximum n times (default to 3)"), QStringLiteral("n") });
-    auto uploadLimitOption = addOption({ { QStringLiteral("uplimit") }, QStringLiteral("Limit the upload speed of files to n KB/s"), QStringLiteral("n") });
-    auto downloadLimitption = addOption({ { QStringLiteral("downlimit") }, QStringLiteral("Limit the download speed of files to n KB/s"), QStringLiteral("n") });
+    auto uploadLimitOption = addOption({ { QStringLiteral("uplimit") }, QStringLiteral("Limit the upload speed of files to n KB/s, 'adaptive' backs off when the network latency grows"), QStringLiteral("n") });
+    auto downloadLimitption = addOption({ { QStringLiteral("downlimit") }, QStringLiteral("Limit the download speed of files to n KB/s, 'adaptive' backs off when the network latency grows"), QStringLiteral("n") });
+    auto bandwidthScheduleOption = addOption({ { QStringLiteral("bandwidth-schedule") },
+        QStringLiteral("Time dependent limits overriding --uplimit and --downlimit, e.g. 'Mon-Fri 08:00-18:00 up=200 down=adaptive; * 22:00-06:00 up=0'"),
+        QStringLiteral("rules") });
     auto syncHiddenFilesOption = addOption({ { QStringLiteral("sync-hidden-files") }, QStringLiteral("Enables synchronization of hidden files") });
 
+    auto metricsOption = addOption({ { QStringLiteral("metrics") },
+        QStringLiteral("Serve metrics in the Prometheus format on [address], either host:port, :port for localhost or the path of a local socket"),
+        QStringLiteral("address") });
     auto logdebugOption = addOption({ { QStringLiteral("logdebug") }, QStringLiteral("More verbose logging") });
 
     parser.addHelpOption();
@@ -389,15 +399,31 @@ CmdOptions parseOptions(const QStringList &app_args)
     if (parser.isSet(maxRetriesOption)) {
         options.restartTimes = parser.value(maxRetriesOption).toInt();
     }
+    const auto parseLimit = [](const QString &value) {
+        return value == QLatin1String("adaptive") ? BandwidthManager::AdaptiveLimit : value.toLongLong() * 1000;
+    };
     if (parser.isSet(uploadLimitOption)) {
-        options.uplimit = parser.value(maxRetriesOption).toInt() * 1000;
+        options.uplimit = parseLimit(parser.value(uploadLimitOption));
     }
     if (parser.isSet(downloadLimitption)) {
-        options.downlimit = parser.value(downloadLimitption).toInt() * 1000;
+        options.downlimit = parseLimit(parser.value(downloadLimitption));
+    }
+    if (parser.isSet(bandwidthScheduleOption)) {
+        auto schedule = BandwidthSchedule::parse(parser.value(bandwidthScheduleOption));
+        if (!schedule) {
+            qCritical() << "Invalid bandwidth schedule:" << schedule.error();
+            qApp->exit(EXIT_FAILURE);
+        } else {
+            options.bandwidthSchedule = *schedule;
+        }
     }
     if (parser.isSet(syncHiddenFilesOption)) {
         options.ignoreHiddenFiles = false;
     }
+    if (parser.isSet(metricsOption) && !Metrics::instance()->listen(parser.value(metricsOption))) {
+        qCritical() << "Failed to serve the metrics on" << parser.value(metricsOption);
+        qApp->exit(EXIT_FAILURE);
+    }
     if (parser.isSet(logdebugOption)) {
         Logger::instance()->setLogFile(QStringLiteral("-"));
         Logger::instance()->setLogDebug(true);
@@ -471,6 +497,7 @@ int main(int argc, char **argv)
                 auto caps = capabilitiesJob->data().value(QStringLiteral("ocs")).toObject().value(QStringLiteral("data")).toObject().value(QStringLiteral("capabilities")).toObject();
                 qDebug() << "Server capabilities" << caps;
                 ctx.account->setCapabilities(caps.toVariantMap());
+                ctx.account->setHttp2Supported(capabilitiesJob->reply()->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool());
 
                 switch (ctx.account->serverSupportLevel()) {
                 case Account::ServerSupportLevel::Supported:
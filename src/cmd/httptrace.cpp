@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Summarizes the http trace written with OWNCLOUD_HTTP_TRACE, see HttpLogger::setTraceFile().
+ *
+ * Each line of the trace is a JSON object of a finished request. "start" is the
+ * time in milliseconds since the epoch, "queue", "connect", "upload", "ttfb",
+ * "transfer" and "total" are durations in microseconds, "sent" and "received"
+ * are bytes.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QTextStream>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// durations from 1 ms to about 1 min, the first and the last bucket are open
+constexpr int HistogramBucketsC = 18;
+
+struct Samples
+{
+    std::vector<qint64> values;
+
+    void add(const QJsonValue &value)
+    {
+        if (!value.isUndefined()) {
+            values.push_back(value.toVariant().toLongLong());
+        }
+    }
+
+    QString percentiles()
+    {
+        if (values.empty()) {
+            return QStringLiteral("-");
+        }
+        std::sort(values.begin(), values.end());
+        const auto at = [this](double p) { return ms(values[std::min<size_t>(values.size() - 1, static_cast<size_t>(p * values.size()))]); };
+        return QStringLiteral("%1 / %2 / %3 / %4").arg(at(0.5), at(0.9), at(0.99), ms(values.back()));
+    }
+
+    static QString ms(qint64 us) { return QString::number(us / 1000.0, 'f', 1); }
+};
+
+struct Endpoint
+{
+    int requests = 0;
+    int errors = 0;
+    qint64 sent = 0;
+    qint64 received = 0;
+    // the time the request bodies were sent and the responses were received
+    qint64 sendTime = 0;
+    qint64 receiveTime = 0;
+    Samples queue;
+    Samples ttfb;
+    Samples transfer;
+    Samples total;
+    std::array<int, HistogramBucketsC> histogram = {};
+
+    void add(const QJsonObject &event)
+    {
+        ++requests;
+        const int status = event.value(QStringLiteral("status")).toInt();
+        if (event.value(QStringLiteral("error")).toInt() != 0 || status >= 400) {
+            ++errors;
+        }
+        const qint64 totalUs = event.value(QStringLiteral("total")).toVariant().toLongLong();
+        const auto duration = [&event, totalUs](const QString &name) {
+            return event.contains(name) ? event.value(name).toVariant().toLongLong() : totalUs;
+        };
+        const qint64 eventSent = event.value(QStringLiteral("sent")).toVariant().toLongLong();
+        if (eventSent > 0) {
+            sent += eventSent;
+            // the body is sent after the connection is established and before the response arrives
+            const qint64 connected = event.value(QStringLiteral("connect")).toVariant().toLongLong();
+            sendTime += std::max<qint64>(0, (event.contains(QStringLiteral("upload")) ? duration(QStringLiteral("upload")) : duration(QStringLiteral("ttfb"))) - connected);
+        }
+        const qint64 eventReceived = event.value(QStringLiteral("received")).toVariant().toLongLong();
+        if (eventReceived > 0) {
+            received += eventReceived;
+            receiveTime += duration(QStringLiteral("transfer"));
+        }
+        queue.add(event.value(QStringLiteral("queue")));
+        ttfb.add(event.value(QStringLiteral("ttfb")));
+        transfer.add(event.value(QStringLiteral("transfer")));
+        total.add(event.value(QStringLiteral("total")));
+        ++histogram[bucket(totalUs)];
+    }
+
+    // powers of two of milliseconds
+    static int bucket(qint64 us)
+    {
+        if (us < 1000) {
+            return 0;
+        }
+        return std::min(HistogramBucketsC - 1, 1 + static_cast<int>(std::log2(us / 1000.0)));
+    }
+
+    static QString bucketName(int bucket)
+    {
+        if (bucket == 0) {
+            return QStringLiteral("< 1 ms");
+        }
+        const qint64 from = qint64(1) << (bucket - 1);
+        if (bucket == HistogramBucketsC - 1) {
+            return QStringLiteral(">= %1 ms").arg(from);
+        }
+        return QStringLiteral("%1 - %2 ms").arg(from).arg(from * 2);
+    }
+
+    static QString throughput(qint64 bytes, qint64 us)
+    {
+        if (us == 0) {
+            return QStringLiteral("-");
+        }
+        // bytes per microsecond are MB/s
+        return QString::number(static_cast<double>(bytes) / us, 'f', 2);
+    }
+    QString uploadThroughput() const { return throughput(sent, sendTime); }
+    QString downloadThroughput() const { return throughput(received, receiveTime); }
+};
+
+QString endpointName(const QJsonObject &event, int depth)
+{
+    const auto segments = event.value(QStringLiteral("path")).toString().split(QLatin1Char('/'), Qt::SkipEmptyParts);
+    return QStringLiteral("%1 /%2").arg(event.value(QStringLiteral("verb")).toString(), segments.mid(0, depth).join(QLatin1Char('/')));
+}
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("httptrace"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Summarizes the latency and the throughput of the requests in an http trace per verb and endpoint.\n"
+                                                    "Record a trace by setting OWNCLOUD_HTTP_TRACE to the name of the trace file."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("The trace files, reads from stdin if none is given."), QStringLiteral("[trace...]"));
+    const QCommandLineOption depthOption(QStringLiteral("depth"), QStringLiteral("The number of path segments that make up an endpoint (default 3)."), QStringLiteral("n"), QStringLiteral("3"));
+    const QCommandLineOption histogramOption(QStringLiteral("histogram"), QStringLiteral("Print a histogram of the latency of each endpoint."));
+    parser.addOption(depthOption);
+    parser.addOption(histogramOption);
+    parser.process(app);
+
+    const int depth = parser.value(depthOption).toInt();
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QMap<QString, Endpoint> endpoints;
+    Endpoint all;
+    qint64 first = std::numeric_limits<qint64>::max();
+    qint64 last = 0;
+    int invalid = 0;
+
+    const auto read = [&](QFile &file) {
+        while (true) {
+            QByteArray line = file.readLine();
+            if (line.isEmpty()) {
+                // the end of the file
+                break;
+            }
+            line = line.trimmed();
+            if (line.isEmpty()) {
+                continue;
+            }
+            const auto event = QJsonDocument::fromJson(line).object();
+            if (event.isEmpty()) {
+                ++invalid;
+                continue;
+            }
+            const qint64 start = event.value(QStringLiteral("start")).toVariant().toLongLong();
+            first = std::min(first, start);
+            last = std::max(last, start + event.value(QStringLiteral("total")).toVariant().toLongLong() / 1000);
+            endpoints[endpointName(event, depth)].add(event);
+            all.add(event);
+        }
+    };
+
+    const auto files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        QFile file;
+        if (!file.open(stdin, QIODevice::ReadOnly)) {
+            err << "Failed to read from stdin" << Qt::endl;
+            return EXIT_FAILURE;
+        }
+        read(file);
+    }
+    for (const auto &name : files) {
+        QFile file(name);
+        if (!file.open(QIODevice::ReadOnly)) {
+            err << "Failed to open " << name << ": " << file.errorString() << Qt::endl;
+            return EXIT_FAILURE;
+        }
+        read(file);
+    }
+    if (invalid) {
+        err << "Skipped " << invalid << " invalid lines" << Qt::endl;
+    }
+    if (all.requests == 0) {
+        err << "No requests in the trace" << Qt::endl;
+        return EXIT_FAILURE;
+    }
+
+    const auto print = [&out, &parser, &histogramOption](const QString &name, Endpoint &endpoint) {
+        out << name << Qt::endl;
+        out << "  requests: " << endpoint.requests << ", errors: " << endpoint.errors << Qt::endl;
+        out << "  sent: " << endpoint.sent << " bytes at " << endpoint.uploadThroughput() << " MB/s, received: " << endpoint.received << " bytes at " << endpoint.downloadThroughput() << " MB/s" << Qt::endl;
+        out << "  p50 / p90 / p99 / max in ms" << Qt::endl;
+        out << "    queue:    " << endpoint.queue.percentiles() << Qt::endl;
+        out << "    ttfb:     " << endpoint.ttfb.percentiles() << Qt::endl;
+        out << "    transfer: " << endpoint.transfer.percentiles() << Qt::endl;
+        out << "    total:    " << endpoint.total.percentiles() << Qt::endl;
+        if (parser.isSet(histogramOption)) {
+            const int max = *std::max_element(endpoint.histogram.cbegin(), endpoint.histogram.cend());
+            for (int i = 0; i < HistogramBucketsC; ++i) {
+                if (endpoint.histogram[i] == 0) {
+                    continue;
+                }
+                const int width = std::max(1, endpoint.histogram[i] * 40 / max);
+                out << "    " << Endpoint::bucketName(i).rightJustified(18) << " " << QString(width, QLatin1Char('#')) << " " << endpoint.histogram[i] << Qt::endl;
+            }
+        }
+        out << Qt::endl;
+    };
+
+    for (auto it = endpoints.begin(); it != endpoints.end(); ++it) {
+        print(it.key(), it.value());
+    }
+    print(QStringLiteral("all requests in %1 s").arg(QString::number((last - first) / 1000.0, 'f', 1)), all);
+    return EXIT_SUCCESS;
+}
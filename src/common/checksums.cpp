@@ -18,12 +18,16 @@
 #include "common/checksums.h"
 #include "asserts.h"
 #include "common/chronoelapsedtimer.h"
+#include "common/syncprofiler.h"
 #include "common/utility.h"
 #include "config.h"
+#include "csync/csync.h"
+#include "csync/vio/csync_vio_local.h"
 #include "filesystembase.h"
 
 #include <QCoreApplication>
 #include <QCryptographicHash>
+#include <QDateTime>
 #include <QLoggingCategory>
 #include <QScopeGuard>
 #include <QtConcurrentRun>
@@ -75,6 +79,15 @@
  *
  * Content checksums are not sent to the server.
  *
+ * Checksum Cache
+ * --------------
+ *
+ * Computing a content checksum requires reading the whole file. The journal
+ * keeps a cache of the content checksums of local files keyed by the file's
+ * inode, size, mtime and ctime. ComputeChecksum consults it when a journal
+ * was passed with setChecksumCache(), so unchanged files are not read again,
+ * for example when resolving conflicts after the file table was lost.
+ *
  * Checksum Algorithms
  * -------------------
  *
@@ -107,6 +120,27 @@ QByteArray calcAdler32(QIODevice *device)
 
     return QByteArray::number(adler, 16);
 }
+
+OCC::Optional<OCC::SyncJournalDb::ChecksumCacheKey> checksumCacheKey(const QString &filePath)
+{
+    csync_file_stat_t stat;
+    if (csync_vio_local_stat(filePath, &stat) != 0 || stat.type != ItemTypeFile) {
+        return {};
+    }
+    return OCC::SyncJournalDb::ChecksumCacheKey { stat.inode, stat.size, stat.modtime, stat.changetime };
+}
+
+// Whether the file did not change between the two stat calls and the checksum may be cached
+bool isCacheable(const OCC::SyncJournalDb::ChecksumCacheKey &before, const OCC::SyncJournalDb::ChecksumCacheKey &after)
+{
+    if (before.inode != after.inode || before.size != after.size || before.modtime != after.modtime || before.changeTime != after.changeTime) {
+        return false;
+    }
+    // The timestamps have a resolution of one second, a write in the same second
+    // as the one we have seen would go unnoticed.
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    return after.modtime < now - 1 && after.changeTime < now - 1;
+}
 }
 
 namespace OCC {
@@ -236,8 +270,25 @@ CheckSums::Algorithm ComputeChecksum::checksumType() const
     return _checksumType;
 }
 
+void ComputeChecksum::setChecksumCache(SyncJournalDb *journal)
+{
+    _journal = journal;
+}
+
 void ComputeChecksum::start(const QString &filePath)
 {
+    if (_journal) {
+        if (const auto key = checksumCacheKey(filePath)) {
+            const auto checksum = _journal->getCachedChecksum(*key, _checksumType);
+            if (!checksum.isEmpty()) {
+                qCInfo(lcChecksums) << "Using cached" << checksumType() << "checksum of" << filePath;
+                // done() is always emitted asynchronously
+                QMetaObject::invokeMethod(
+                    this, [this, checksum] { emit done(_checksumType, checksum); }, Qt::QueuedConnection);
+                return;
+            }
+        }
+    }
     qCInfo(lcChecksums) << "Computing" << checksumType() << "checksum of" << filePath << "in a thread";
     startImpl(std::make_unique<QFile>(filePath));
 }
@@ -263,19 +314,32 @@ void ComputeChecksum::startImpl(std::unique_ptr<QIODevice> device)
 
     // Bug: The thread will keep running even if ComputeChecksum is deleted.
     auto type = checksumType();
-    _watcher.setFuture(QtConcurrent::run([sharedDevice, type]() {
+    const bool useCache = !_journal.isNull();
+    _watcher.setFuture(QtConcurrent::run([sharedDevice, type, useCache]() -> ChecksumResult {
+        auto file = qobject_cast<QFile *>(sharedDevice.data());
+        Optional<SyncJournalDb::ChecksumCacheKey> cacheKey;
+        if (useCache && file) {
+            cacheKey = checksumCacheKey(file->fileName());
+        }
         if (!sharedDevice->open(QIODevice::ReadOnly)) {
-            if (auto file = qobject_cast<QFile *>(sharedDevice.data())) {
+            if (file) {
                 qCWarning(lcChecksums) << "Could not open file" << file->fileName()
                         << "for reading to compute a checksum" << file->errorString();
             } else {
                 qCWarning(lcChecksums) << "Could not open device" << sharedDevice.data()
                         << "for reading to compute a checksum" << sharedDevice->errorString();
             }
-            return QByteArray();
+            return {};
         }
-        auto result = ComputeChecksum::computeNow(sharedDevice.data(), type);
+        ChecksumResult result { ComputeChecksum::computeNow(sharedDevice.data(), type), {} };
         sharedDevice->close();
+        // Only cache the checksum if the file was not modified while we were reading it
+        if (cacheKey && !result.checksum.isEmpty()) {
+            const auto keyAfter = checksumCacheKey(file->fileName());
+            if (keyAfter && isCacheable(*cacheKey, *keyAfter)) {
+                result.cacheKey = cacheKey;
+            }
+        }
         return result;
     }));
 }
@@ -291,8 +355,29 @@ QByteArray ComputeChecksum::computeNowOnFile(const QString &filePath, CheckSums:
     return computeNow(&file, checksumType);
 }
 
+QByteArray ComputeChecksum::computeNowOnFile(const QString &filePath, CheckSums::Algorithm checksumType, SyncJournalDb *journal)
+{
+    const auto key = journal ? checksumCacheKey(filePath) : Optional<SyncJournalDb::ChecksumCacheKey>();
+    if (key) {
+        const auto checksum = journal->getCachedChecksum(*key, checksumType);
+        if (!checksum.isEmpty()) {
+            qCDebug(lcChecksums) << "Using cached" << checksumType << "checksum of" << filePath;
+            return checksum;
+        }
+    }
+    const auto checksum = computeNowOnFile(filePath, checksumType);
+    if (key && !checksum.isEmpty()) {
+        const auto keyAfter = checksumCacheKey(filePath);
+        if (keyAfter && isCacheable(*key, *keyAfter)) {
+            journal->setCachedChecksum(*key, checksumType, checksum);
+        }
+    }
+    return checksum;
+}
+
 QByteArray ComputeChecksum::computeNow(QIODevice *device, CheckSums::Algorithm algorithm)
 {
+    OC_PROFILE_SCOPE("checksum", "compute");
     // const cast to prevent stream to "device"
     const auto log = qScopeGuard([device, algorithm, timer = Utility::ChronoElapsedTimer()] {
         if (auto file = qobject_cast<QFile *>(device)) {
@@ -331,7 +416,11 @@ QByteArray ComputeChecksum::computeNow(QIODevice *device, CheckSums::Algorithm a
 
 void ComputeChecksum::slotCalculationDone()
 {
-    QByteArray checksum = _watcher.future().result();
+    const auto result = _watcher.future().result();
+    const QByteArray &checksum = result.checksum;
+    if (result.cacheKey && _journal) {
+        _journal->setCachedChecksum(*result.cacheKey, _checksumType, checksum);
+    }
     if (!checksum.isNull()) {
         emit done(_checksumType, checksum);
     } else {
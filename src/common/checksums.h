@@ -19,12 +19,14 @@
 #pragma once
 
 #include "checksumalgorithms.h"
+#include "common/syncjournaldb.h"
 #include "ocsynclib.h"
 
 #include <QByteArray>
 #include <QCryptographicHash>
 #include <QFutureWatcher>
 #include <QObject>
+#include <QPointer>
 
 #include <memory>
 
@@ -98,6 +100,14 @@ public:
 
     CheckSums::Algorithm checksumType() const;
 
+    /**
+     * Use the checksum cache of the journal when computing the checksum of a file path.
+     *
+     * If the inode, size, mtime and ctime of the file match a cached entry the
+     * file is not read at all. Newly computed checksums are added to the cache.
+     */
+    void setChecksumCache(SyncJournalDb *journal);
+
     /**
      * Computes the checksum for the given file path.
      *
@@ -125,6 +135,11 @@ public:
      */
     static QByteArray computeNowOnFile(const QString &filePath, CheckSums::Algorithm checksumType);
 
+    /**
+     * Like computeNowOnFile() but consults and updates the checksum cache of \a journal.
+     */
+    static QByteArray computeNowOnFile(const QString &filePath, CheckSums::Algorithm checksumType, SyncJournalDb *journal);
+
 signals:
     void done(CheckSums::Algorithm checksumType, const QByteArray &checksum);
 
@@ -132,12 +147,21 @@ private slots:
     void slotCalculationDone();
 
 private:
+    struct ChecksumResult
+    {
+        QByteArray checksum;
+        // Only set if the file did not change while it was read
+        Optional<SyncJournalDb::ChecksumCacheKey> cacheKey;
+    };
+
     void startImpl(std::unique_ptr<QIODevice> device);
 
     CheckSums::Algorithm _checksumType;
 
+    QPointer<SyncJournalDb> _journal;
+
     // watcher for the checksum calculation thread
-    QFutureWatcher<QByteArray> _watcher;
+    QFutureWatcher<ChecksumResult> _watcher;
 };
 
 /**
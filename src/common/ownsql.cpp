@@ -25,6 +25,7 @@
 
 #include "common/asserts.h"
 #include "common/filesystembase.h"
+#include "common/syncprofiler.h"
 #include "common/utility.h"
 
 #include "ownsql.h"
@@ -332,6 +333,7 @@ bool SqlQuery::exec()
     }
     // Don't do anything for selects, that is how we use the lib :-|
     if (!isSelect() && !isPragma()) {
+        const SyncProfiler::Timer timer("db", _sql);
         for (int n = 0; n < SQLITE_REPEAT_COUNT; ++n) {
             if (lcSql().isDebugEnabled()) {
                 if (!_boundValues.isEmpty()) {
@@ -379,6 +381,7 @@ bool SqlQuery::exec()
 
 auto SqlQuery::next() -> NextResult
 {
+    const SyncProfiler::Timer timer("db", _sql);
     const bool firstStep = !sqlite3_stmt_busy(_stmt);
 
     for (int n = 0; n < SQLITE_REPEAT_COUNT; ++n) {
@@ -97,6 +97,9 @@ public:
 
         GetFileReocrdsWithDirtyPlaceholdersQuery,
 
+        GetCachedChecksumQuery,
+        SetCachedChecksumQuery,
+
         PreparedQueryCount
     };
     PreparedSqlQueryManager() = default;
@@ -490,6 +490,21 @@ bool SyncJournalDb::checkConnect()
         return sqlFail(QStringLiteral("Create table conflicts"), createQuery);
     }
 
+    // create the checksumcache table.
+    // Content checksums of local files, see getCachedChecksum().
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS checksumcache("
+                        "inode INTEGER,"
+                        "filesize INTEGER,"
+                        "modtime INTEGER(8),"
+                        "ctime INTEGER(8),"
+                        "checksumTypeId INTEGER,"
+                        "checksum TEXT,"
+                        "PRIMARY KEY(inode, checksumTypeId)"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail(QStringLiteral("Create table checksumcache"), createQuery);
+    }
+
     createQuery.prepare("CREATE TABLE IF NOT EXISTS version("
                         "major INTEGER(8),"
                         "minor INTEGER(8),"
@@ -1242,6 +1257,70 @@ bool SyncJournalDb::updateFileRecordChecksum(const QString &filename,
     return query->exec();
 }
 
+QByteArray SyncJournalDb::getCachedChecksum(const ChecksumCacheKey &key, CheckSums::Algorithm checksumType)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!key.inode || !checkConnect()) {
+        return {};
+    }
+
+    const int checksumTypeId = mapChecksumType(checksumType);
+    if (!checksumTypeId) {
+        return {};
+    }
+
+    const auto query = _queryManager.get(PreparedSqlQueryManager::GetCachedChecksumQuery, QByteArrayLiteral("SELECT checksum FROM checksumcache"
+                                                                                                            " WHERE inode=?1 AND checksumTypeId=?2"
+                                                                                                            " AND filesize=?3 AND modtime=?4 AND ctime=?5;"),
+        _db);
+    if (!query) {
+        return {};
+    }
+    query->bindValue(1, key.inode);
+    query->bindValue(2, checksumTypeId);
+    query->bindValue(3, key.size);
+    query->bindValue(4, key.modtime);
+    query->bindValue(5, key.changeTime);
+    if (!query->exec()) {
+        return {};
+    }
+    if (!query->next().hasData) {
+        return {};
+    }
+    return query->baValue(0);
+}
+
+void SyncJournalDb::setCachedChecksum(const ChecksumCacheKey &key, CheckSums::Algorithm checksumType, const QByteArray &checksum)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!key.inode || checksum.isEmpty() || !checkConnect()) {
+        return;
+    }
+
+    const int checksumTypeId = mapChecksumType(checksumType);
+    if (!checksumTypeId) {
+        return;
+    }
+
+    // The inode is part of the primary key, a stale entry for a file is replaced
+    const auto query = _queryManager.get(PreparedSqlQueryManager::SetCachedChecksumQuery, QByteArrayLiteral("INSERT OR REPLACE INTO checksumcache "
+                                                                                                            "(inode, filesize, modtime, ctime, checksumTypeId, checksum) "
+                                                                                                            "VALUES (?1, ?2, ?3, ?4, ?5, ?6);"),
+        _db);
+    if (!query) {
+        return;
+    }
+    query->bindValue(1, key.inode);
+    query->bindValue(2, key.size);
+    query->bindValue(3, key.modtime);
+    query->bindValue(4, key.changeTime);
+    query->bindValue(5, checksumTypeId);
+    query->bindValue(6, checksum);
+    query->exec();
+}
+
 Optional<SyncJournalDb::HasHydratedDehydrated> SyncJournalDb::hasHydratedOrDehydratedFiles(const QByteArray &filename)
 {
     QMutexLocker locker(&_mutex);
@@ -1623,6 +1702,17 @@ void SyncJournalDb::deleteStaleFlagsEntries()
     delQuery.exec();
 }
 
+void SyncJournalDb::deleteStaleChecksumCacheEntries()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect())
+        return;
+
+    // The entries are keyed by inode, the inodes of deleted and moved away files are not in the metadata anymore
+    SqlQuery delQuery("DELETE FROM checksumcache WHERE NOT EXISTS (SELECT 1 FROM metadata WHERE metadata.inode = checksumcache.inode);", _db);
+    delQuery.exec();
+}
+
 int SyncJournalDb::errorBlackListEntryCount()
 {
     int re = 0;
@@ -2288,6 +2378,12 @@ bool SyncJournalDb::isOpen() const
     return _db.isOpen();
 }
 
+bool SyncJournalDb::isMetadataTableEmpty() const
+{
+    QMutexLocker lock(&_mutex);
+    return _metadataTableIsEmpty;
+}
+
 void SyncJournalDb::commitInternal(const QString &context, bool startTrans)
 {
     qCDebug(lcDb) << "Transaction commit" << context << (startTrans ? "and starting new transaction" : "");
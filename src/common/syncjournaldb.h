@@ -71,6 +71,27 @@ public:
         const QByteArray &contentChecksum,
         CheckSums::Algorithm contentChecksumType);
 
+    /**
+     * Identifies the on-disk state of a local file for the checksum cache.
+     *
+     * If any of the values differ the cached checksum is considered stale.
+     * changeTime is the ctime of the file and is 0 on platforms that don't provide it.
+     */
+    struct ChecksumCacheKey
+    {
+        quint64 inode = 0;
+        qint64 size = 0;
+        qint64 modtime = 0;
+        qint64 changeTime = 0;
+    };
+
+    /**
+     * Returns the cached content checksum of a local file, or an empty
+     * QByteArray if there is no up to date entry for the key and algorithm.
+     */
+    QByteArray getCachedChecksum(const ChecksumCacheKey &key, CheckSums::Algorithm checksumType);
+    void setCachedChecksum(const ChecksumCacheKey &key, CheckSums::Algorithm checksumType, const QByteArray &checksum);
+
     /// Return value for hasHydratedOrDehydratedFiles()
     struct HasHydratedDehydrated
     {
@@ -151,6 +172,9 @@ public:
     /// Delete flags table entries that have no metadata correspondent
     void deleteStaleFlagsEntries();
 
+    /// Delete checksum cache entries of files that have no metadata correspondent
+    void deleteStaleChecksumCacheEntries();
+
     void avoidRenamesOnNextSync(const QString &path) { avoidRenamesOnNextSync(path.toUtf8()); }
     void avoidRenamesOnNextSync(const QByteArray &path);
 
@@ -223,6 +247,9 @@ public:
     /** Returns whether the db is currently openend. */
     bool isOpen() const;
 
+    /** Returns whether the opened db has no file records, like before the first sync */
+    bool isMetadataTableEmpty() const;
+
     /** Close the database */
     void close();
 
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#include "syncprofiler.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+// the aggregated stats are complete, the trace only keeps that many events
+constexpr size_t maxTraceEventsC = 1000 * 1000;
+
+struct Event
+{
+    const char *category;
+    QByteArray name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+};
+
+struct Stats
+{
+    qint64 count = 0;
+    qint64 total = 0;
+    qint64 max = 0;
+};
+
+using Key = std::pair<QByteArray, QByteArray>;
+
+struct Profile
+{
+    QMutex mutex;
+    std::vector<Event> events;
+    quint64 droppedEvents = 0;
+    std::map<Key, Stats> stats;
+    std::map<Key, qint64> counters;
+};
+
+Profile &profile()
+{
+    static Profile profile;
+    return profile;
+}
+
+// the start of the profile in microseconds of the steady clock
+std::atomic<qint64> epoch = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+
+int threadIndex()
+{
+    static std::atomic<int> next = 1;
+    thread_local const int index = next++;
+    return index;
+}
+
+QByteArray jsonString(const QByteArray &s)
+{
+    QByteArray out;
+    out.reserve(s.size() + 2);
+    out += '"';
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+QString readable(const QByteArray &name)
+{
+    QString out = QString::fromUtf8(name).simplified();
+    if (out.size() > 80) {
+        out = out.left(77) + QStringLiteral("...");
+    }
+    return out;
+}
+}
+
+namespace OCC {
+
+std::atomic<bool> SyncProfiler::_enabled = qEnvironmentVariableIsSet("OWNCLOUD_SYNC_PROFILE");
+
+SyncProfiler::Timer::Timer(const char *category, const QByteArray &name)
+{
+    if (isEnabled()) {
+        _category = category;
+        _name = name;
+        _start = now();
+    }
+}
+
+SyncProfiler::Timer::Timer(Timer &&other) noexcept
+    : _category(other._category)
+    , _name(std::move(other._name))
+    , _start(std::exchange(other._start, -1))
+{
+}
+
+SyncProfiler::Timer &SyncProfiler::Timer::operator=(Timer &&other) noexcept
+{
+    finish();
+    _category = other._category;
+    _name = std::move(other._name);
+    _start = std::exchange(other._start, -1);
+    return *this;
+}
+
+SyncProfiler::Timer::~Timer()
+{
+    finish();
+}
+
+void SyncProfiler::Timer::finish()
+{
+    if (_start >= 0) {
+        record(_category, _name, _start, now());
+        _start = -1;
+    }
+}
+
+void SyncProfiler::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+QString SyncProfiler::traceDirectory()
+{
+    return qEnvironmentVariable("OWNCLOUD_SYNC_PROFILE");
+}
+
+qint64 SyncProfiler::now()
+{
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() - epoch;
+}
+
+void SyncProfiler::record(const char *category, const QByteArray &name, qint64 start, qint64 end)
+{
+    // the timer might have been started before a reset
+    start = std::max<qint64>(start, 0);
+    const qint64 duration = std::max<qint64>(end - start, 0);
+    auto &p = profile();
+    QMutexLocker lock(&p.mutex);
+    auto &stats = p.stats[{ QByteArray::fromRawData(category, qstrlen(category)), name }];
+    ++stats.count;
+    stats.total += duration;
+    stats.max = std::max(stats.max, duration);
+    if (p.events.size() < maxTraceEventsC) {
+        p.events.push_back({ category, name, start, duration, threadIndex() });
+    } else {
+        ++p.droppedEvents;
+    }
+}
+
+void SyncProfiler::count(const char *category, const QByteArray &name, qint64 n)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    auto &p = profile();
+    QMutexLocker lock(&p.mutex);
+    p.counters[{ QByteArray::fromRawData(category, qstrlen(category)), name }] += n;
+}
+
+void SyncProfiler::reset()
+{
+    auto &p = profile();
+    QMutexLocker lock(&p.mutex);
+    p.events.clear();
+    p.droppedEvents = 0;
+    p.stats.clear();
+    p.counters.clear();
+    epoch = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+QString SyncProfiler::report()
+{
+    auto &p = profile();
+    QMutexLocker lock(&p.mutex);
+    std::vector<std::pair<Key, Stats>> sorted(p.stats.cbegin(), p.stats.cend());
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.total > b.second.total; });
+
+    QString out;
+    QTextStream stream(&out);
+    stream << QStringLiteral("Sync profile after %1 ms, %2 events").arg(now() / 1000).arg(p.events.size() + p.droppedEvents);
+    if (p.droppedEvents) {
+        stream << QStringLiteral(" (%1 not in the trace)").arg(p.droppedEvents);
+    }
+    stream << "\n    total ms |    count |   avg ms |   max ms | category name\n";
+    for (const auto &[key, stats] : sorted) {
+        stream << QStringLiteral("%1 | %2 | %3 | %4 | %5 %6\n")
+                      .arg(QString::number(stats.total / 1000.0, 'f', 1), 12)
+                      .arg(stats.count, 8)
+                      .arg(QString::number(stats.total / 1000.0 / stats.count, 'f', 2), 8)
+                      .arg(QString::number(stats.max / 1000.0, 'f', 1), 8)
+                      .arg(QString::fromUtf8(key.first), readable(key.second));
+    }
+    for (const auto &[key, value] : p.counters) {
+        stream << QStringLiteral("%1 %2: %3\n").arg(QString::fromUtf8(key.first), readable(key.second)).arg(value);
+    }
+    return out;
+}
+
+bool SyncProfiler::writeChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    auto &p = profile();
+    QMutexLocker lock(&p.mutex);
+    QByteArray out = QByteArrayLiteral("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto &event : p.events) {
+        if (!first) {
+            out += ",\n";
+        }
+        first = false;
+        out += "{\"name\":" + jsonString(event.name) + ",\"cat\":" + jsonString(event.category) + ",\"ph\":\"X\",\"ts\":" + QByteArray::number(event.start)
+            + ",\"dur\":" + QByteArray::number(event.duration) + ",\"pid\":1,\"tid\":" + QByteArray::number(event.thread) + "}";
+        if (out.size() > 1024 * 1024) {
+            file.write(out);
+            out.clear();
+        }
+    }
+    out += "\n],\"otherData\":{";
+    first = true;
+    for (const auto &[key, value] : p.counters) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        out += jsonString(key.first + ' ' + key.second) + ':' + jsonString(QByteArray::number(value));
+    }
+    out += "}}\n";
+    return file.write(out) == out.size();
+}
+
+}
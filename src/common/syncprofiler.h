@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#pragma once
+
+#include "ocsynclib.h"
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+
+namespace OCC {
+
+/**
+ * @brief Measures where a sync spends its time
+ *
+ * The sync engine, the discovery, the propagator jobs, the journal and the
+ * checksums record the duration of their work with a Timer. While the
+ * profiler is disabled a Timer only checks a flag.
+ *
+ * The durations are summed up per category and name for report(), the single
+ * events can be written as Chrome trace events with writeChromeTrace(), see
+ * chrome://tracing or https://ui.perfetto.dev.
+ *
+ * The profiler is enabled by setting OWNCLOUD_SYNC_PROFILE to the directory the
+ * trace of each sync is written to, or with setEnabled().
+ *
+ * @ingroup libsync
+ */
+class OCSYNC_EXPORT SyncProfiler
+{
+public:
+    class OCSYNC_EXPORT Timer
+    {
+    public:
+        /// The category must be a string literal, the name is shared
+        Timer(const char *category, const QByteArray &name);
+        Timer() = default;
+        Timer(Timer &&other) noexcept;
+        Timer &operator=(Timer &&other) noexcept;
+        ~Timer();
+
+        /// Records the event, does nothing if it already was recorded
+        void finish();
+
+    private:
+        const char *_category = nullptr;
+        QByteArray _name;
+        qint64 _start = -1;
+    };
+
+    static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    /// The directory from OWNCLOUD_SYNC_PROFILE, empty if not set
+    static QString traceDirectory();
+
+    /// Adds n to a counter
+    static void count(const char *category, const QByteArray &name, qint64 n = 1);
+
+    /// Drops the recorded events, the start of a new profile
+    static void reset();
+
+    /// A table of the time spent per category and name, sorted by the time
+    static QString report();
+
+    /// Returns false if the file could not be written
+    static bool writeChromeTrace(const QString &fileName);
+
+private:
+    static void record(const char *category, const QByteArray &name, qint64 start, qint64 end);
+    static qint64 now();
+
+    static std::atomic<bool> _enabled;
+};
+
+}
+
+/// Records the time until the end of the scope
+#define OC_PROFILE_SCOPE(category, name) const OCC::SyncProfiler::Timer ocProfileScope(category, QByteArrayLiteral(name))
@@ -178,6 +178,15 @@ public:
     /// Create a new dehydrated placeholder. Called from PropagateDownload.
     [[nodiscard]] virtual Result<void, QString> createPlaceholder(const SyncFileItem &item) = 0;
 
+    /** Whether new placeholders may be created on a worker thread.
+     *
+     * Then createPlaceholder() and updateMetadata() of new placeholders are
+     * called concurrently for many items and must only touch the filesystem.
+     * The propagator creates the placeholders of a directory in batches and
+     * writes their journal records in one transaction, see PropagatePlaceholders.
+     */
+    virtual bool canCreatePlaceholdersInBatches() const { return false; }
+
     /** Discovery hook: even unchanged files may need UPDATE_METADATA.
      *
      * For instance cfapi vfs wants local hydrated non-placeholder files to
@@ -273,6 +282,7 @@ private:
     std::unique_ptr<VfsSetupParams> _setupParams;
 
     friend class OwncloudPropagator;
+    friend class PropagatePlaceholders;
 };
 
 class OCSYNC_EXPORT VfsPluginManager
@@ -165,6 +165,7 @@ struct OCSYNC_EXPORT csync_file_stat_t
     time_t modtime = 0;
     int64_t size = 0;
     uint64_t inode = 0;
+    time_t changetime = 0; // st_ctime, not filled on Windows. Only used to key the checksum cache.
 
     ItemType type = ItemTypeSkip;
     bool is_hidden = false; // Not saved in the DB, only used during discovery for local files.
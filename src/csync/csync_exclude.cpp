@@ -239,16 +239,19 @@ ExcludedFiles::~ExcludedFiles()
 
 void ExcludedFiles::addExcludeFilePath(const QString &path)
 {
+    QWriteLocker locker(&_lock);
     _excludeFiles.insert(path);
 }
 
 void ExcludedFiles::setExcludeConflictFiles(bool onoff)
 {
+    QWriteLocker locker(&_lock);
     _excludeConflictFiles = onoff;
 }
 
 void ExcludedFiles::addManualExclude(const QString &expr)
 {
+    QWriteLocker locker(&_lock);
     _manualExcludes.append(expr);
     _allExcludes.append(expr);
     prepare();
@@ -256,23 +259,29 @@ void ExcludedFiles::addManualExclude(const QString &expr)
 
 void ExcludedFiles::clearManualExcludes()
 {
-    _manualExcludes.clear();
+    {
+        QWriteLocker locker(&_lock);
+        _manualExcludes.clear();
+    }
     reloadExcludeFiles();
 }
 
 void ExcludedFiles::setWildcardsMatchSlash(bool onoff)
 {
+    QWriteLocker locker(&_lock);
     _wildcardsMatchSlash = onoff;
     prepare();
 }
 
 void ExcludedFiles::setClientVersion(const QVersionNumber &version)
 {
+    QWriteLocker locker(&_lock);
     _clientVersion = version;
 }
 
 bool ExcludedFiles::reloadExcludeFiles()
 {
+    QWriteLocker locker(&_lock);
     _allExcludes.clear();
     bool success = true;
     for (const auto &file : qAsConst(_excludeFiles)) {
@@ -432,6 +441,7 @@ CSYNC_EXCLUDE_TYPE ExcludedFiles::traversalPatternMatch(const QStringRef &path,
 
 CSYNC_EXCLUDE_TYPE ExcludedFiles::fullPatternMatch(const QStringRef &p, ItemType filetype) const
 {
+    QReadLocker locker(&_lock);
     auto match = _csync_excluded_common(p, _excludeConflictFiles);
     if (match != CSYNC_NOT_EXCLUDED)
         return match;
@@ -26,6 +26,7 @@
 #include "csync.h"
 
 #include <QObject>
+#include <QReadWriteLock>
 #include <QRegularExpression>
 #include <QSet>
 #include <QString>
@@ -86,6 +87,9 @@ public:
     /**
      * Checks whether a file or directory should be excluded.
      *
+     * Like isExcludedRemote() this may be called from other threads while the
+     * patterns are reloaded.
+     *
      * @param filePath     the absolute path to the file
      * @param basePath     folder path from which to apply exclude rules, ends with a /
      */
@@ -232,6 +236,10 @@ private:
 
     bool _excludeConflictFiles = true;
 
+    /// Guards all members against changes while fullPatternMatch() runs on another thread,
+    /// every mutator takes it. The traversal matching only runs on the thread of the mutators.
+    mutable QReadWriteLock _lock;
+
     /**
      * Whether * and ? in patterns can match a /
      *
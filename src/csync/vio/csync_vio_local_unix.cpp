@@ -148,6 +148,7 @@ int csync_vio_local_stat(const QString &uri, csync_file_stat_t *buf)
 
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
+  buf->changetime = sb.st_ctime;
   buf->size = sb.st_size;
   return 0;
 }
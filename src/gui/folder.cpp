@@ -82,6 +82,9 @@ auto priorityC()
 }
 
 constexpr int SettingsVersionC = 5;
+
+// thousands of small transfers report their progress many times per second
+constexpr auto progressIntervalC = 200ms;
 }
 
 namespace OCC {
@@ -138,7 +141,21 @@ Folder::Folder(const FolderDefinition &definition,
 
         connect(_engine.data(), &SyncEngine::aboutToRemoveAllFiles,
             this, &Folder::slotAboutToRemoveAllFiles);
+        _progressTimer.setSingleShot(true);
+        _progressTimer.setInterval(progressIntervalC);
+        connect(&_progressTimer, &QTimer::timeout, this, [this] {
+            emit ProgressDispatcher::instance()->progressInfo(this, _engine->progressInfo());
+        });
         connect(_engine.data(), &SyncEngine::transmissionProgress, this, [this](const ProgressInfo &pi) {
+            // The changes of the status and the completed items are forwarded right away,
+            // the progress of the transfers at most once per interval
+            if (pi.isTransferProgressOnly()) {
+                if (!_progressTimer.isActive()) {
+                    _progressTimer.start();
+                }
+                return;
+            }
+            _progressTimer.stop();
             emit ProgressDispatcher::instance()->progressInfo(this, pi);
         });
         connect(_engine.data(), &SyncEngine::itemCompleted,
@@ -264,7 +281,7 @@ SyncOptions Folder::loadSyncOptions()
     opt._confirmExternalStorage = cfgFile.confirmExternalStorage();
     opt._moveFilesToTrash = cfgFile.moveToTrash();
     opt._vfs = _vfs;
-    opt._parallelNetworkJobs = _accountState->account()->isHttp2Supported() ? 20 : 6;
+    opt.setupParallelism(_accountState->account()->isHttp2Supported());
 
     opt._initialChunkSize = cfgFile.chunkSize();
     opt._minChunkSize = cfgFile.minChunkSize();
@@ -739,8 +756,10 @@ void Folder::slotWatchedPathsChanged(const QSet<QString> &paths, ChangeReason re
         if (reason != ChangeReason::UnLock) {
             // Check that the mtime/size actually changed or there was
             // an attribute change (pin state) that caused the notification
+            // The watcher reports directories with many changes instead of their content,
+            // their mtime doesn't reflect that
             bool spurious = false;
-            if (record.isValid() && !FileSystem::fileChanged(path, record._fileSize, record._modtime)) {
+            if (record.isValid() && !record.isDirectory() && !FileSystem::fileChanged(path, record._fileSize, record._modtime)) {
                 spurious = true;
 
                 if (auto pinState = _vfs->pinState(relativePath)) {
@@ -810,6 +829,9 @@ void Folder::implicitlyHydrateFile(const QString &relativepath)
         _vfs->setPinState(relativepath, PinState::Unspecified);
     }
 
+    // Hydrate it before anything else, right away if a sync is running
+    _engine->requestHydration(relativepath, HydrationQueue::Priority::Opened);
+
     // Add to local discovery
     schedulePathForLocalDiscovery(relativepath);
     slotScheduleThisFolder();
@@ -1015,8 +1037,6 @@ void Folder::startSync()
         return;
     }
 
-    setDirtyNetworkLimits();
-
     static std::chrono::milliseconds fullLocalDiscoveryInterval = []() {
         auto interval = ConfigFile().fullLocalDiscoveryInterval();
         QByteArray env = qgetenv("OWNCLOUD_FULL_LOCAL_DISCOVERY_INTERVAL");
@@ -1036,10 +1056,14 @@ void Folder::startSync()
         _engine->setLocalDiscoveryOptions(
             LocalDiscoveryStyle::DatabaseAndFilesystem,
             _localDiscoveryTracker->localDiscoveryPaths());
+        // only skip the inode lookup if the watcher saw every rename since the last sync
+        const bool renamesComplete = _folderWatcher->reportsRenames() && _folderWatcher->isReady() && _localDiscoveryTracker->renameHintsComplete();
+        _engine->setLocalRenameHints(_localDiscoveryTracker->renameHints(), renamesComplete);
         _localDiscoveryTracker->startSyncPartialDiscovery();
     } else {
         qCInfo(lcFolder) << "Forbidding local discovery to read from the database";
         _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        _engine->setLocalRenameHints(_localDiscoveryTracker->renameHints(), false);
         _localDiscoveryTracker->startSyncFullDiscovery();
     }
 
@@ -1050,29 +1074,6 @@ void Folder::startSync()
     emit syncStarted();
 }
 
-void Folder::setDirtyNetworkLimits()
-{
-    Q_ASSERT(isReady());
-    ConfigFile cfg;
-    int downloadLimit = -75; // 75%
-    int useDownLimit = cfg.useDownloadLimit();
-    if (useDownLimit >= 1) {
-        downloadLimit = cfg.downloadLimit() * 1000;
-    } else if (useDownLimit == 0) {
-        downloadLimit = 0;
-    }
-
-    int uploadLimit = -75; // 75%
-    int useUpLimit = cfg.useUploadLimit();
-    if (useUpLimit >= 1) {
-        uploadLimit = cfg.uploadLimit() * 1000;
-    } else if (useUpLimit == 0) {
-        uploadLimit = 0;
-    }
-
-    _engine->setNetworkLimits(uploadLimit, downloadLimit);
-}
-
 void Folder::slotSyncError(const QString &message, ErrorCategory category)
 {
     _syncResult.appendErrorString(message);
@@ -1328,6 +1329,14 @@ void Folder::registerFolderWatcher()
         return;
 
     _folderWatcher.reset(new FolderWatcher(this));
+    connect(_folderWatcher.data(), &FolderWatcher::pathsRenamed, this, [this](const QHash<QString, QString> &renames) {
+        for (auto it = renames.cbegin(); it != renames.cend(); ++it) {
+            if (FileSystem::isChildPathOf(it.key(), path()) && FileSystem::isChildPathOf(it.value(), path())) {
+                _localDiscoveryTracker->addRenameHint(it.key().mid(path().size()), it.value().mid(path().size()));
+            }
+        }
+    });
+    connect(_folderWatcher.data(), &FolderWatcher::renamesMissed, _localDiscoveryTracker.data(), &LocalDiscoveryTracker::setRenameHintsIncomplete);
     connect(_folderWatcher.data(), &FolderWatcher::pathChanged, this,
         [this](const QSet<QString> &paths) { slotWatchedPathsChanged(paths, Folder::ChangeReason::Other); });
     connect(_folderWatcher.data(), &FolderWatcher::lostChanges,
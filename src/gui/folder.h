@@ -270,8 +270,6 @@ public:
 
     void setSyncState(SyncResult::Status state);
 
-    void setDirtyNetworkLimits();
-
     /**
       * Ignore syncing of hidden files or not. This is defined in the
       * folder definition
@@ -545,6 +543,9 @@ private:
 
     QTimer _scheduleSelfTimer;
 
+    // forwards the progress during the propagation in intervals, see transmissionProgress()
+    QTimer _progressTimer;
+
     /**
      * When the same local path is synced to multiple accounts, only one
      * of them can be stored in the settings in a way that's compatible
@@ -17,6 +17,7 @@
 #include "accountmanager.h"
 #include "accountstate.h"
 #include "application.h"
+#include "bandwidthmanager.h"
 #include "common/asserts.h"
 #include "configfile.h"
 #include "filesystem.h"
@@ -116,6 +117,8 @@ FolderMan::FolderMan(QObject *parent)
 
     _socketApi.reset(new SocketApi);
 
+    setDirtyNetworkLimits();
+
     // Set the remote poll interval fixed to 10 seconds.
     // That does not mean that it polls every 10 seconds, but it checks every 10 seconds
     // if one of the folders is due to sync. This means that if the server advertises a
@@ -1061,12 +1064,34 @@ void FolderMan::setDirtyProxy()
 
 void FolderMan::setDirtyNetworkLimits()
 {
-    for (auto *f : qAsConst(_folders)) {
-        // set only in busy folders. Otherwise they read the config anyway.
-        if (f && f->isSyncRunning()) {
-            f->setDirtyNetworkLimits();
-        }
-    }
+    // The configured limits are shared by all folders, running syncs pick them up right away
+    ConfigFile cfg;
+    qint64 downloadLimit = -75; // 75%
+    const int useDownLimit = cfg.useDownloadLimit();
+    if (useDownLimit >= 1) {
+        downloadLimit = cfg.downloadLimit() * 1000;
+    } else if (useDownLimit == 0) {
+        downloadLimit = 0;
+    } else if (useDownLimit == -2) {
+        downloadLimit = BandwidthManager::AdaptiveLimit;
+    }
+
+    qint64 uploadLimit = -75; // 75%
+    const int useUpLimit = cfg.useUploadLimit();
+    if (useUpLimit >= 1) {
+        uploadLimit = cfg.uploadLimit() * 1000;
+    } else if (useUpLimit == 0) {
+        uploadLimit = 0;
+    } else if (useUpLimit == -2) {
+        uploadLimit = BandwidthManager::AdaptiveLimit;
+    }
+
+    auto schedule = BandwidthSchedule::parse(cfg.bandwidthSchedule());
+    if (!schedule) {
+        qCWarning(lcFolderMan) << "Ignoring the invalid bandwidth schedule:" << schedule.error();
+        schedule = BandwidthSchedule();
+    }
+    BandwidthManager::setGlobalSchedule(*schedule, { uploadLimit, downloadLimit });
 }
 
 TrayOverallStatusResult FolderMan::trayOverallStatus(const QVector<Folder *> &folders)
@@ -44,6 +44,9 @@ namespace {
     // minimum delay between progress updates
     constexpr auto progressUpdateTimeOutC = 1s;
 
+    // the number of current files in the progress string
+    constexpr int maxListedFilesC = 5;
+
     const char propertyParentIndexC[] = "oc_parentIndex";
     const char propertyPermissionMap[] = "oc_permissionMap";
 
@@ -997,24 +1000,20 @@ void FolderStatusModel::computeProgress(const ProgressInfo &progress, SubFolderI
     // item if no items are in progress.
     SyncFileItem curItem = progress._lastCompletedItem;
     qint64 curItemProgress = -1; // -1 means finished
-    qint64 biggerItemSize = 0;
-    quint64 estimatedUpBw = 0;
-    quint64 estimatedDownBw = 0;
+    const quint64 estimatedUpBw = progress.estimatedBandwidth(SyncFileItem::Up);
+    const quint64 estimatedDownBw = progress.estimatedBandwidth(SyncFileItem::Down);
     QStringList allFilenames;
-    for (const auto &citm : progress._currentItems) {
-        if (curItemProgress == -1 || (ProgressInfo::isSizeDependent(citm._item)
-                                         && biggerItemSize < citm._item._size)) {
-            curItemProgress = citm._progress.completed();
-            curItem = citm._item;
-            biggerItemSize = citm._item._size;
-        }
-        if (citm._item._direction != SyncFileItem::Up) {
-            estimatedDownBw += progress.fileProgress(citm._item).estimatedBandwidth;
-        } else {
-            estimatedUpBw += progress.fileProgress(citm._item).estimatedBandwidth;
-        }
-        auto fileName = QFileInfo(citm._item._file).fileName();
-        allFilenames.append(tr("'%1'").arg(fileName));
+    // with thousands of small transfers only the biggest ones are looked at and named
+    const auto currentItems = progress.biggestCurrentItems(maxListedFilesC);
+    if (!currentItems.empty()) {
+        curItemProgress = currentItems.front()->_progress.completed();
+        curItem = currentItems.front()->_item;
+    }
+    for (const auto *citm : currentItems) {
+        allFilenames.append(tr("'%1'").arg(QFileInfo(citm->_item._file).fileName()));
+    }
+    if (progress._currentItems.size() > maxListedFilesC) {
+        allFilenames.append(QStringLiteral("\u2026"));
     }
     if (curItemProgress == -1) {
         curItemProgress = curItem._size;
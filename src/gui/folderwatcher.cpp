@@ -17,6 +17,9 @@
 
 #include <stdint.h>
 
+#include <functional>
+#include <map>
+
 #include <QFileInfo>
 #include <QFlags>
 #include <QDir>
@@ -38,7 +41,20 @@
 using namespace std::chrono_literals;
 
 namespace {
-constexpr auto notificationTimeoutC = 1s;
+constexpr std::chrono::milliseconds notificationTimeoutC = 1s;
+// the quiet period grows up to this while bursts of changes arrive
+constexpr std::chrono::milliseconds maximumNotificationTimeoutC = 8s;
+// the changes are reported at the latest after this, even if the burst continues
+constexpr std::chrono::milliseconds maximumNotificationDelayC = 30s;
+// the number of changes that make a burst
+constexpr int burstSizeC = 1000;
+// more changed entries in a directory are reported as the directory
+constexpr int directoryCoalesceThresholdC = 100;
+
+QString parentPath(const QString &path)
+{
+    return path.left(path.lastIndexOf(QLatin1Char('/')));
+}
 }
 
 namespace OCC {
@@ -47,29 +63,11 @@ Q_LOGGING_CATEGORY(lcFolderWatcher, "gui.folderwatcher", QtInfoMsg)
 
 FolderWatcher::FolderWatcher(Folder *folder)
     : QObject(folder)
+    , _quietPeriod(notificationTimeoutC)
     , _folder(folder)
 {
-    _timer.setInterval(notificationTimeoutC);
-    connect(&_timer, &QTimer::timeout, this, [this] {
-        auto paths = std::move(_changeSet);
-        // ------- handle ignores:
-        auto it = paths.begin();
-        while (it != paths.cend()) {
-            // we cause a file change from time to time to check whether the folder watcher works as expected
-            if (!_testNotificationPath.isEmpty() && Utility::fileNamesEqual(*it, _testNotificationPath)) {
-                _testNotificationPath.clear();
-            }
-            if (pathIsIgnored(*it)) {
-                it = paths.erase(it);
-            } else {
-                ++it;
-            }
-        }
-        if (!paths.isEmpty()) {
-            qCInfo(lcFolderWatcher) << "Detected changes in paths:" << paths;
-            emit pathChanged(paths);
-        }
-    });
+    _timer.setSingleShot(true);
+    connect(&_timer, &QTimer::timeout, this, &FolderWatcher::flushChanges);
 }
 
 FolderWatcher::~FolderWatcher()
@@ -78,6 +76,7 @@ FolderWatcher::~FolderWatcher()
 
 void FolderWatcher::init(const QString &root)
 {
+    _root = root.endsWith(QLatin1Char('/')) ? root.chopped(1) : root;
     _d.reset(new FolderWatcherPrivate(this, root));
 }
 
@@ -94,11 +93,32 @@ bool FolderWatcher::pathIsIgnored(const QString &path) const
     return false;
 }
 
+std::function<bool(const QString &)> FolderWatcher::ignoredPathsSnapshot() const
+{
+    if (!_folder) {
+        return [](const QString &path) { return path.isEmpty(); };
+    }
+    // the excludes live as long as the engine of the folder, which outlives the watcher
+    return [excludes = &_folder->syncEngine().excludedFiles(), folderPath = _folder->path(), ignoreHiddenFiles = _folder->ignoreHiddenFiles()](const QString &path) {
+        return path.isEmpty() || (excludes->isExcluded(path, folderPath, ignoreHiddenFiles) && !Utility::isConflictFile(path));
+    };
+}
+
 bool FolderWatcher::isReliable() const
 {
     return _isReliable;
 }
 
+bool FolderWatcher::reportsRenames() const
+{
+    return _d && _d->reportsRenames();
+}
+
+bool FolderWatcher::isReady() const
+{
+    return _d && _d->isReady();
+}
+
 void FolderWatcher::startNotificatonTest(const QString &path)
 {
 #ifdef Q_OS_MAC
@@ -154,12 +174,135 @@ int FolderWatcher::testLinuxWatchCount() const
 #endif
 }
 
+void FolderWatcher::testLinuxHandleEvents(const QByteArray &events)
+{
+#ifdef Q_OS_LINUX
+    _d->handleEvents(events.constData(), static_cast<size_t>(events.size()));
+#else
+    Q_UNUSED(events)
+#endif
+}
+
 void FolderWatcher::changeDetected(const QSet<QString> &paths)
 {
-    _changeSet.unite(paths);
     if (!_timer.isActive()) {
-        _timer.start();
+        _firstChange.start();
+    }
+    _changeSet.unite(paths);
+    // wait for a quiet period, but don't postpone the changes forever
+    if (!_timer.isActive() || std::chrono::milliseconds(_firstChange.elapsed()) < maximumNotificationDelayC) {
+        _timer.start(_quietPeriod);
+    }
+}
+
+void FolderWatcher::renameDetected(const QString &from, const QString &to)
+{
+    const QString origin = _renames.take(from);
+    if (origin != to) {
+        _renames.insert(to, origin.isEmpty() ? from : origin);
+    }
+}
+
+void FolderWatcher::flushChanges()
+{
+    auto paths = std::move(_changeSet);
+    _changeSet.clear();
+    const auto renames = std::move(_renames);
+    _renames.clear();
+
+    if (paths.size() >= burstSizeC) {
+        _quietPeriod = std::min(_quietPeriod * 2, maximumNotificationTimeoutC);
+        qCInfo(lcFolderWatcher) << "Burst of" << paths.size() << "changes, waiting" << _quietPeriod.count() << "ms for the next ones";
+    } else {
+        _quietPeriod = std::max(_quietPeriod / 2, notificationTimeoutC);
+    }
+
+    // ------- handle ignores:
+    auto it = paths.begin();
+    while (it != paths.cend()) {
+        // we cause a file change from time to time to check whether the folder watcher works as expected
+        if (!_testNotificationPath.isEmpty() && Utility::fileNamesEqual(*it, _testNotificationPath)) {
+            _testNotificationPath.clear();
+        }
+        if (pathIsIgnored(*it)) {
+            it = paths.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QHash<QString, QString> renamed;
+    for (auto rename = renames.cbegin(); rename != renames.cend(); ++rename) {
+        if (!pathIsIgnored(rename.key()) && !pathIsIgnored(rename.value())) {
+            renamed.insert(rename.value(), rename.key());
+        }
+    }
+    if (!renamed.isEmpty()) {
+        qCInfo(lcFolderWatcher) << "Detected renames:" << renamed;
+        emit pathsRenamed(renamed);
+    }
+
+    if (!paths.isEmpty()) {
+        const auto changeCount = paths.size();
+        paths = coalesceChanges(std::move(paths), _root, directoryCoalesceThresholdC);
+        if (paths.size() < changeCount) {
+            qCInfo(lcFolderWatcher) << "Detected" << changeCount << "changes, reduced to the paths:" << paths;
+        } else {
+            qCInfo(lcFolderWatcher) << "Detected changes in paths:" << paths;
+        }
+        emit pathChanged(paths);
+    }
+}
+
+QSet<QString> FolderWatcher::coalesceChanges(QSet<QString> paths, const QString &root, int threshold)
+{
+    // group the changes by directory, the deepest directories are handled first so that coalesced ones count for their parent
+    QHash<QString, QStringList> entries;
+    std::map<int, QSet<QString>, std::greater<int>> directoriesByDepth;
+    for (const auto &path : qAsConst(paths)) {
+        const QString parent = parentPath(path);
+        entries[parent].append(path);
+        directoriesByDepth[parent.count(QLatin1Char('/'))].insert(parent);
+    }
+
+    const QString rootSlash = root + QLatin1Char('/');
+    QSet<QString> coalesced;
+    // inserting into a std::map does not invalidate the iterators, parents are visited later
+    for (const auto &level : directoriesByDepth) {
+        for (const auto &directory : level.second) {
+            const auto &children = entries[directory];
+            if (children.size() <= threshold || !directory.startsWith(rootSlash)) {
+                continue;
+            }
+            for (const auto &child : children) {
+                paths.remove(child);
+            }
+            coalesced.insert(directory);
+            if (!paths.contains(directory)) {
+                paths.insert(directory);
+                const QString parent = parentPath(directory);
+                entries[parent].append(directory);
+                directoriesByDepth[level.first - 1].insert(parent);
+            }
+        }
+    }
+    if (coalesced.isEmpty()) {
+        return paths;
+    }
+
+    // a coalesced directory is discovered completely, its remaining changes are redundant
+    for (auto it = paths.begin(); it != paths.end();) {
+        QString ancestor = parentPath(*it);
+        while (ancestor.size() > root.size() && !coalesced.contains(ancestor)) {
+            ancestor = parentPath(ancestor);
+        }
+        if (ancestor.size() > root.size()) {
+            it = paths.erase(it);
+        } else {
+            ++it;
+        }
     }
+    return paths;
 }
 
 } // namespace OCC
@@ -26,6 +26,9 @@
 #include <QStringList>
 #include <QTimer>
 
+#include <chrono>
+#include <functional>
+
 
 namespace OCC {
 
@@ -41,6 +44,12 @@ class Folder;
  * for changes in the local file system. Changes are signalled
  * through the pathChanged() signal.
  *
+ * The changes are reported once no new ones arrived for a while. The quiet
+ * period grows while large bursts of changes arrive, like a checkout or a
+ * build, and shrinks again afterwards. A directory with many changed entries
+ * is reported instead of the entries, renames that the platform reports as
+ * such are additionally signalled through pathsRenamed().
+ *
  * @ingroup gui
  */
 
@@ -60,6 +69,12 @@ public:
     /* Check if the path is ignored. */
     bool pathIsIgnored(const QString &path) const;
 
+    /**
+     * Returns a check like pathIsIgnored() that doesn't use the folder, it
+     * keeps the exclude settings of now and may be called from any thread.
+     */
+    std::function<bool(const QString &)> ignoredPathsSnapshot() const;
+
     /**
      * Returns false if the folder watcher can't be trusted to capture all
      * notifications.
@@ -69,6 +84,16 @@ public:
      */
     bool isReliable() const;
 
+    /**
+     * Whether the platform reports renames, if so pathsRenamed() reports all
+     * renames as long as the watcher is reliable and ready, except when
+     * renamesMissed() is emitted.
+     */
+    bool reportsRenames() const;
+
+    /// Whether the watcher watches the whole folder, the linux watches are registered in the background
+    bool isReady() const;
+
     /**
      * Triggers a change in the path and verifies a notification arrives.
      *
@@ -80,11 +105,34 @@ public:
     /// For testing linux behavior only
     int testLinuxWatchCount() const;
 
+    /// For testing linux behavior only, handles the raw inotify events as if they were read
+    void testLinuxHandleEvents(const QByteArray &events);
+
+    /**
+     * Replaces the changed entries of a directory with the directory if there
+     * are more than threshold of them, bottom up. Paths below a reported
+     * directory are dropped, root itself is never reported.
+     */
+    static QSet<QString> coalesceChanges(QSet<QString> paths, const QString &root, int threshold);
+
 signals:
     /** Emitted when one of the watched directories or one
      *  of the contained files is changed. */
     void pathChanged(const QSet<QString> &path);
 
+    /**
+     * Emitted right before pathChanged() with the renames among the changes,
+     * it maps the old to the new path. Chains of renames are combined.
+     */
+    void pathsRenamed(const QHash<QString, QString> &renames);
+
+    /**
+     * Emitted if renames might not have been reported by pathsRenamed(), if
+     * only one side of a move was seen or the first watches were registered
+     * only now.
+     */
+    void renamesMissed();
+
     /**
      * Emitted if some notifications were lost.
      *
@@ -105,13 +153,23 @@ protected slots:
     // called from the implementations to indicate a change in path
     void changeDetected(const QSet<QString> &paths);
 
+    // called from the implementations for a rename, the paths must be passed to changeDetected() too
+    void renameDetected(const QString &from, const QString &to);
+
 private slots:
     void startNotificationTestWhenReady();
 
 private:
+    void flushChanges();
+
     QScopedPointer<FolderWatcherPrivate> _d;
+    QString _root;
     QTimer _timer;
+    std::chrono::milliseconds _quietPeriod;
+    QElapsedTimer _firstChange;
     QSet<QString> _changeSet;
+    // new path to the path before the first rename
+    QHash<QString, QString> _renames;
     Folder *_folder;
     bool _isReliable = true;
 
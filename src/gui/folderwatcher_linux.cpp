@@ -15,12 +15,19 @@
 #include "config.h"
 
 #include <cerrno>
+#include <climits>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/fanotify.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "folder.h"
 #include "folderwatcher_linux.h"
 
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QObject>
 #include <QStringList>
 #include <QVarLengthArray>
@@ -32,6 +39,33 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
     , _parent(p)
     , _folder(path)
 {
+    if (fanotifyInit()) {
+        _fanotify = true;
+        qCInfo(lcFolderWatcher) << "Using fanotify to watch" << path;
+        _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
+        connect(_socket.data(), &QSocketNotifier::activated, this, &FolderWatcherPrivate::fanotifyReadEvents);
+        return;
+    }
+
+    inotifyInit();
+}
+
+FolderWatcherPrivate::~FolderWatcherPrivate()
+{
+    _stopRegistration = true;
+    _registrationThread.waitForDone();
+    _socket.reset();
+    if (_fd != -1) {
+        close(_fd);
+    }
+    if (_mountFd != -1) {
+        close(_mountFd);
+    }
+}
+
+void FolderWatcherPrivate::inotifyInit()
+{
+    _registrationThread.setMaxThreadCount(1);
     _fd = inotify_init();
     if (_fd != -1) {
         _socket.reset(new QSocketNotifier(_fd, QSocketNotifier::Read));
@@ -40,7 +74,145 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
         qCWarning(lcFolderWatcher) << "notify_init() failed: " << strerror(errno);
     }
 
-    QMetaObject::invokeMethod(this, "slotAddFolderRecursive", Q_ARG(QString, path));
+    slotAddFolderRecursive(_folder);
+}
+
+bool FolderWatcherPrivate::fanotifyInit()
+{
+#ifdef FAN_REPORT_DFID_NAME
+    if (qEnvironmentVariableIsSet("OWNCLOUD_NO_FANOTIFY")) {
+        return false;
+    }
+    // reporting the directory and the name needs no file descriptor per event, only the fid groups support create, delete and move
+    const int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE);
+    if (fd == -1) {
+        qCInfo(lcFolderWatcher) << "fanotify is not available, using inotify:" << strerror(errno);
+        return false;
+    }
+    const QByteArray encodedPath = QFile::encodeName(_folder);
+    // a mark on the whole filesystem needs CAP_SYS_ADMIN, a mount mark can't report the directory events
+    const uint64_t mask = FAN_CLOSE_WRITE | FAN_ATTRIB | FAN_CREATE | FAN_DELETE | FAN_MOVE | FAN_ONDIR;
+    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, encodedPath.constData()) == -1) {
+        qCInfo(lcFolderWatcher) << "Could not add a fanotify mark, using inotify:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    _mountFd = open(encodedPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    _canonicalFolder = QFileInfo(_folder).canonicalFilePath();
+    // the events only carry file handles, resolving them needs CAP_DAC_READ_SEARCH
+    alignas(file_handle) char probeData[sizeof(file_handle) + MAX_HANDLE_SZ];
+    auto *probe = reinterpret_cast<file_handle *>(probeData);
+    probe->handle_bytes = MAX_HANDLE_SZ;
+    int mountId;
+    if (_mountFd == -1 || _canonicalFolder.isEmpty() || name_to_handle_at(_mountFd, "", probe, &mountId, AT_EMPTY_PATH) == -1
+        || fanotifyDirectoryPath(probe) != _canonicalFolder) {
+        qCInfo(lcFolderWatcher) << "Could not resolve fanotify file handles, using inotify:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+    _fd = fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FolderWatcherPrivate::fanotifyFallBack()
+{
+    _fanotify = false;
+    // called from the notifier's signal
+    _socket->setEnabled(false);
+    _socket.take()->deleteLater();
+    close(_fd);
+    _fd = -1;
+    if (_mountFd != -1) {
+        close(_mountFd);
+        _mountFd = -1;
+    }
+    inotifyInit();
+}
+
+QString FolderWatcherPrivate::fanotifyDirectoryPath(file_handle *handle) const
+{
+    const int fd = open_by_handle_at(_mountFd, handle, O_PATH | O_CLOEXEC);
+    if (fd == -1) {
+        // ESTALE: the directory is already gone
+        return {};
+    }
+    char path[PATH_MAX];
+    const ssize_t len = readlink(QByteArrayLiteral("/proc/self/fd/").append(QByteArray::number(fd)).constData(), path, sizeof(path));
+    close(fd);
+    if (len <= 0) {
+        return {};
+    }
+    return QFile::decodeName(QByteArray(path, static_cast<int>(len)));
+}
+
+void FolderWatcherPrivate::fanotifyReadEvents()
+{
+#ifdef FAN_REPORT_DFID_NAME
+    alignas(fanotify_event_metadata) char buffer[64 * 1024];
+    QHash<QByteArray, QString> directories;
+    QSet<QString> paths;
+
+    forever {
+        ssize_t len = read(_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            // EAGAIN, all events are read
+            break;
+        }
+        for (auto *metadata = reinterpret_cast<const fanotify_event_metadata *>(buffer); FAN_EVENT_OK(metadata, len);
+             metadata = FAN_EVENT_NEXT(metadata, len)) {
+            if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+                qCWarning(lcFolderWatcher) << "Unexpected fanotify version" << metadata->vers << "using inotify";
+                // the rest of the events can't be parsed, report what was read and let the next sync look at everything
+                if (!paths.isEmpty()) {
+                    _parent->changeDetected(paths);
+                }
+                emit _parent->lostChanges();
+                fanotifyFallBack();
+                return;
+            }
+            if (metadata->mask & FAN_Q_OVERFLOW) {
+                qCWarning(lcFolderWatcher) << "The fanotify queue overflowed";
+                emit _parent->lostChanges();
+                continue;
+            }
+            const auto *info = reinterpret_cast<const fanotify_event_info_fid *>(metadata + 1);
+            if (metadata->event_len < sizeof(*metadata) + sizeof(*info) || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                continue;
+            }
+            auto *handle = reinterpret_cast<file_handle *>(const_cast<unsigned char *>(info->handle));
+            const QByteArray fileName(reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes));
+
+            // Filter out journal changes - redundant with filtering in FolderWatcher::pathIsIgnored.
+            if (fileName.startsWith("._sync_")
+                || fileName.startsWith(".csync_journal.db")
+                || fileName.startsWith(".sync_")) {
+                continue;
+            }
+
+            // the whole filesystem is watched, the handles of a batch mostly point to the same few directories
+            const QByteArray handleKey(reinterpret_cast<const char *>(handle), sizeof(file_handle) + handle->handle_bytes);
+            auto it = directories.find(handleKey);
+            if (it == directories.end()) {
+                it = directories.insert(handleKey, fanotifyDirectoryPath(handle));
+            }
+            const QString &directory = *it;
+            if (directory.isEmpty()) {
+                continue;
+            }
+            if (directory != _canonicalFolder && !directory.startsWith(_canonicalFolder + QLatin1Char('/'))) {
+                continue;
+            }
+            paths.insert(_folder + directory.mid(_canonicalFolder.size()) + QLatin1Char('/') + QFile::decodeName(fileName));
+        }
+    }
+    if (!paths.isEmpty()) {
+        _parent->changeDetected(paths);
+    }
+#endif
 }
 
 // attention: result list passed by reference!
@@ -54,76 +226,137 @@ bool FolderWatcherPrivate::findFoldersBelow(const QDir &dir, QStringList &fullLi
         return false;
     }
 
-    const QDir::Filters filter = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks | QDir::Hidden;
-
-    bool ok = true;
-    for (const QString &path : dir.entryList({ QStringLiteral("*") }, filter)) {
-        const QString fullPath(dir.path() + QLatin1String("/") + path);
+    QStringList subFolders;
+    bool ok = listFoldersIn(dir.path(), subFolders);
+    for (const QString &fullPath : qAsConst(subFolders)) {
         fullList.append(fullPath);
         ok &= findFoldersBelow(QDir(fullPath), fullList);
     }
     return ok;
 }
 
-void FolderWatcherPrivate::inotifyRegisterPath(const QString &path)
+bool FolderWatcherPrivate::listFoldersIn(const QString &path, QStringList &list)
 {
-    if (path.isEmpty()) {
-        return;
+    // readdir usually knows the type, unlike QDir it needs no stat per entry
+    const QByteArray encodedPath = QFile::encodeName(path);
+    DIR *dir = opendir(encodedPath.constData());
+    if (!dir) {
+        return false;
     }
-
-    int wd = inotify_add_watch(_fd, path.toUtf8().constData(),
-        IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
-    if (wd != -1) {
-        _watchToPath.insert(wd, path);
-        _pathToWatch.insert(path, wd);
-    } else {
-        // If we're running out of memory or inotify watches, become unreliable.
-        if (_parent->_isReliable && (errno == ENOMEM || errno == ENOSPC)) {
-            _parent->_isReliable = false;
-            emit _parent->becameUnreliable(
-                tr("This problem usually happens when the inotify watches are exhausted. "
-                   "Check the FAQ for details."));
+    while (const auto *entry = readdir(dir)) {
+        if (qstrcmp(entry->d_name, ".") == 0 || qstrcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat sb;
+            isDir = lstat(QByteArray(encodedPath + '/' + entry->d_name).constData(), &sb) == 0 && S_ISDIR(sb.st_mode);
+        }
+        if (isDir) {
+            list.append(path + QLatin1Char('/') + QFile::decodeName(entry->d_name));
         }
     }
+    closedir(dir);
+    return true;
 }
 
 void FolderWatcherPrivate::slotAddFolderRecursive(const QString &path)
 {
-    if (_pathToWatch.contains(path)) {
+    if (_fd == -1 || _pathToWatch.contains(path)) {
         return;
     }
 
-    int subdirCount = 0;
     qCDebug(lcFolderWatcher) << "(+) Watcher:" << path;
+    ++_pendingRegistrations;
+    _registrationThread.start([this, root = QDir(path).absolutePath(), isIgnored = _parent->ignoredPathsSnapshot()] { registerWatches(root, isIgnored); });
+}
 
-    QDir inPath(path);
-    inotifyRegisterPath(inPath.absolutePath());
+void FolderWatcherPrivate::registerWatches(const QString &root, const std::function<bool(const QString &)> &isIgnored)
+{
+    // report the watches in batches, the events of the first directories can be handled while the rest is registered
+    constexpr int batchSize = 1000;
+    QElapsedTimer duration;
+    duration.start();
+
+    QVector<Watch> batch;
+    QStringList todo = { root };
+    int count = 0;
+    int error = 0;
+    while (!todo.isEmpty() && !_stopRegistration) {
+        const QString path = todo.takeLast();
+        // neither watch nor descend into ignored directories, big ignored trees would use up the watches
+        if (path != root && isIgnored(path)) {
+            qCDebug(lcFolderWatcher) << "* Not adding" << path;
+            continue;
+        }
+        // watch before listing, directories created in between are reported by the parent
+        const int wd = inotify_add_watch(_fd, QFile::encodeName(path).constData(),
+            IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_ONLYDIR);
+        if (wd == -1) {
+            // If we're running out of memory or inotify watches, registering the rest is pointless
+            if (errno == ENOMEM || errno == ENOSPC) {
+                error = errno;
+                break;
+            }
+            continue;
+        }
+        batch.append({ wd, path });
+        ++count;
+        if (!listFoldersIn(path, todo)) {
+            qCWarning(lcFolderWatcher).nospace() << "Could not list the sub folders of '" << path << "'";
+        }
 
-    QStringList allSubfolders;
-    if (!findFoldersBelow(QDir(path), allSubfolders)) {
-        qCWarning(lcFolderWatcher).nospace() << "Could not traverse all sub folders of '"
-                                             << path << "'";
+        if (batch.size() >= batchSize) {
+            QMetaObject::invokeMethod(this, [this, batch = std::move(batch)] { watchesRegistered(batch, false, 0); }, Qt::QueuedConnection);
+            batch.clear();
+        }
     }
+    qCInfo(lcFolderWatcher) << "Registered" << count << "watches for" << root << "in" << duration.elapsed() << "ms";
+    QMetaObject::invokeMethod(this, [this, batch = std::move(batch), error] { watchesRegistered(batch, true, error); }, Qt::QueuedConnection);
+}
 
-    for (const auto &subfolder : qAsConst(allSubfolders)) {
-        QDir folder(subfolder);
-        if (folder.exists() && !_pathToWatch.contains(folder.absolutePath())) {
-            ++subdirCount;
-            if (_parent->pathIsIgnored(subfolder)) {
-                qCDebug(lcFolderWatcher) << "* Not adding" << folder.path();
+void FolderWatcherPrivate::watchesRegistered(const QVector<Watch> &watches, bool done, int error)
+{
+    QSet<QString> paths;
+    for (const auto &watch : watches) {
+        const auto bufferedEvents = _bufferedEvents.take(watch.wd);
+        const auto known = _watchToPath.constFind(watch.wd);
+        if (known != _watchToPath.cend()) {
+            if (*known == watch.path) {
                 continue;
             }
-            inotifyRegisterPath(folder.absolutePath());
-        } else {
-            qCDebug(lcFolderWatcher) << "    `-> discarded:" << folder.path();
+            // the same directory was registered under its old name before a move
+            _pathToWatch.remove(*known);
+        }
+        _watchToPath.insert(watch.wd, watch.path);
+        _pathToWatch.insert(watch.path, watch.wd);
+        for (const auto &event : bufferedEvents) {
+            handleEvent(watch.path, event.mask, event.cookie, event.fileName, paths);
         }
     }
-
-    if (subdirCount > 0) {
-        qCDebug(lcFolderWatcher) << "    `-> and" << subdirCount << "subdirectories";
+    if (!paths.isEmpty()) {
+        _parent->changeDetected(paths);
     }
 
-    qCDebug(lcFolderWatcher) << "    --- Finished scanning" << path;
+    if (error && _parent->_isReliable) {
+        _parent->_isReliable = false;
+        emit _parent->becameUnreliable(
+            tr("This problem usually happens when the inotify watches are exhausted. "
+               "Check the FAQ for details."));
+    }
+    if (done && --_pendingRegistrations == 0) {
+        if (!_bufferedEvents.isEmpty()) {
+            // events of watches that were removed in the meantime
+            qCDebug(lcFolderWatcher) << "Discarding the events of" << _bufferedEvents.size() << "unknown watches";
+            _bufferedEvents.clear();
+            emit _parent->renamesMissed();
+        }
+        if (!_initiallyRegistered) {
+            // the renames in the directories that were not watched yet were missed
+            _initiallyRegistered = true;
+            emit _parent->renamesMissed();
+        }
+    }
 }
 
 void FolderWatcherPrivate::slotReceivedNotification(int fd)
@@ -152,22 +385,39 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
             break;
         }
     }
+    if (len <= 0) {
+        return;
+    }
+    handleEvents(buffer.constData(), static_cast<size_t>(len));
+}
 
+void FolderWatcherPrivate::handleEvents(const char *buffer, size_t len)
+{
     QSet<QString> paths;
     // iterate over events in buffer
-    struct inotify_event *event = nullptr;
+    const struct inotify_event *event = nullptr;
     for (size_t bytePosition = 0; // start at the beginning of the buffer
-         bytePosition + sizeof(inotify_event) < static_cast<unsigned>(len); // check that we still have at least sizeof(inotify_event) left in the buffer
+         bytePosition + sizeof(inotify_event) <= len; // check that we still have at least sizeof(inotify_event) left in the buffer
          bytePosition += sizeof(inotify_event) + (event ? event->len : 0)) { // skip over the header and event-payload
 
         // cast into an inotify_event
-        event = reinterpret_cast<struct inotify_event *>(&buffer[bytePosition]);
+        event = reinterpret_cast<const struct inotify_event *>(&buffer[bytePosition]);
 
         if (event == nullptr) {
             qCDebug(lcFolderWatcher) << "NULL event";
             continue;
         }
 
+        if (event->mask & IN_Q_OVERFLOW) {
+            // the kernel dropped events, moves can't be paired anymore and changes are missing
+            qCWarning(lcFolderWatcher) << "inotify event queue overflowed";
+            _movedFrom.clear();
+            _movedFromPreviousRead.clear();
+            emit _parent->renamesMissed();
+            emit _parent->lostChanges();
+            continue;
+        }
+
         if (event->len == 0 || event->wd <= -1) {
             continue;
         }
@@ -181,23 +431,57 @@ void FolderWatcherPrivate::slotReceivedNotification(int fd)
             continue;
         }
 
-        const QString p = _watchToPath[event->wd] + QLatin1Char('/') + QString::fromUtf8(fileName);
-        paths.insert(p);
-
-        if ((event->mask & (IN_MOVED_TO | IN_CREATE))
-            && QFileInfo(p).isDir()
-            && !_parent->pathIsIgnored(p)) {
-            slotAddFolderRecursive(p);
-        }
-        if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
-            removeFoldersBelow(p);
+        const auto it = _watchToPath.constFind(event->wd);
+        if (it == _watchToPath.cend()) {
+            // the registration thread did not report the watch yet
+            if (_pendingRegistrations > 0) {
+                _bufferedEvents[event->wd].append({ event->mask, event->cookie, fileName });
+            }
+            continue;
         }
+        handleEvent(*it, event->mask, event->cookie, fileName, paths);
+    }
+    // moves whose target did not arrive are moves out of the folder, or their target was missed
+    if (!_movedFromPreviousRead.isEmpty()) {
+        emit _parent->renamesMissed();
     }
+    _movedFromPreviousRead = std::move(_movedFrom);
+    _movedFrom.clear();
     if (!paths.isEmpty()) {
         _parent->changeDetected(paths);
     }
 }
 
+void FolderWatcherPrivate::handleEvent(const QString &directory, uint32_t mask, uint32_t cookie, const QByteArray &fileName, QSet<QString> &paths)
+{
+    const QString p = directory + QLatin1Char('/') + QFile::decodeName(fileName);
+    paths.insert(p);
+
+    if (mask & IN_MOVED_FROM) {
+        _movedFrom.insert(cookie, p);
+    } else if (mask & IN_MOVED_TO) {
+        QString from = _movedFrom.take(cookie);
+        if (from.isEmpty()) {
+            from = _movedFromPreviousRead.take(cookie);
+        }
+        if (!from.isEmpty()) {
+            _parent->renameDetected(from, p);
+        } else {
+            // moved into the folder, or the source was missed
+            emit _parent->renamesMissed();
+        }
+    }
+
+    if ((mask & (IN_MOVED_TO | IN_CREATE))
+        && QFileInfo(p).isDir()
+        && !_parent->pathIsIgnored(p)) {
+        slotAddFolderRecursive(p);
+    }
+    if (mask & (IN_MOVED_FROM | IN_DELETE)) {
+        removeFoldersBelow(p);
+    }
+}
+
 void FolderWatcherPrivate::removeFoldersBelow(const QString &path)
 {
     auto it = _pathToWatch.find(path);
@@ -20,15 +20,31 @@
 #include <QSocketNotifier>
 #include <QHash>
 #include <QDir>
+#include <QThreadPool>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
 
 #include "folderwatcher.h"
 
 class QTimer;
+struct file_handle;
 
 namespace OCC {
 
 /**
- * @brief Linux (inotify) API implementation of FolderWatcher
+ * @brief Linux (fanotify or inotify) API implementation of FolderWatcher
+ *
+ * If permitted, a fanotify mark on the filesystem of the folder reports all
+ * changes below it without a watch per directory. That needs CAP_SYS_ADMIN
+ * and CAP_DAC_READ_SEARCH, without them or if OWNCLOUD_NO_FANOTIFY is set one
+ * inotify watch is registered for every directory.
+ *
+ * The inotify watches are registered on a background thread, events of
+ * watches that are not known to the gui thread yet are buffered until the
+ * registration reports them.
+ *
  * @ingroup gui
  */
 class FolderWatcherPrivate : public QObject
@@ -37,21 +53,48 @@ class FolderWatcherPrivate : public QObject
 public:
     FolderWatcherPrivate() {}
     FolderWatcherPrivate(FolderWatcher *p, const QString &path);
+    ~FolderWatcherPrivate() override;
 
+    /// fanotify needs no watches, 0 is returned in that case
     int testWatchCount() const { return _pathToWatch.size(); }
 
-    /// On linux the watcher is ready when the ctor finished.
-    constexpr bool isReady() const { return true; }
+    /// The watcher is ready once all inotify watches are registered.
+    bool isReady() const { return _pendingRegistrations == 0; }
+
+    /// Only inotify reports the moves with a cookie
+    bool reportsRenames() const { return !_fanotify; }
+
+    /// Handles the inotify events read into buffer
+    void handleEvents(const char *buffer, size_t len);
 
 protected slots:
     void slotReceivedNotification(int fd);
     void slotAddFolderRecursive(const QString &path);
 
 protected:
+    struct Watch
+    {
+        int wd;
+        QString path;
+    };
+
     bool findFoldersBelow(const QDir &dir, QStringList &fullList);
-    void inotifyRegisterPath(const QString &path);
+    /// Appends the directories directly below path, without following symlinks
+    static bool listFoldersIn(const QString &path, QStringList &list);
     void removeFoldersBelow(const QString &path);
 
+    // runs on the registration thread, isIgnored is a snapshot of the excludes, see FolderWatcher::ignoredPathsSnapshot()
+    void registerWatches(const QString &root, const std::function<bool(const QString &)> &isIgnored);
+    void watchesRegistered(const QVector<Watch> &watches, bool done, int error);
+    void handleEvent(const QString &directory, uint32_t mask, uint32_t cookie, const QByteArray &fileName, QSet<QString> &paths);
+
+    void inotifyInit();
+    bool fanotifyInit();
+    void fanotifyReadEvents();
+    /// Replaces the fanotify mark with inotify watches
+    void fanotifyFallBack();
+    QString fanotifyDirectoryPath(file_handle *handle) const;
+
 private:
     FolderWatcher *_parent;
 
@@ -59,7 +102,29 @@ private:
     QHash<int, QString> _watchToPath;
     QMap<QString, int> _pathToWatch;
     QScopedPointer<QSocketNotifier> _socket;
-    int _fd;
+    int _fd = -1;
+
+    struct BufferedEvent
+    {
+        uint32_t mask;
+        uint32_t cookie;
+        QByteArray fileName;
+    };
+    // a single thread, the registrations of a tree and a directory moved into it are not interleaved
+    QThreadPool _registrationThread;
+    std::atomic<bool> _stopRegistration { false };
+    int _pendingRegistrations = 0;
+    bool _initiallyRegistered = false;
+    QHash<int, QVector<BufferedEvent>> _bufferedEvents;
+
+    // the sources of moves by their cookie, the target usually follows right after but might be in the next read
+    QHash<uint32_t, QString> _movedFrom;
+    QHash<uint32_t, QString> _movedFromPreviousRead;
+
+    // fanotify reports canonical paths, they are mapped back to _folder
+    bool _fanotify = false;
+    QString _canonicalFolder;
+    int _mountFd = -1;
 };
 }
 
@@ -41,6 +41,9 @@ public:
     /// On OSX the watcher is ready when the ctor finished.
     constexpr bool isReady() const { return true; }
 
+    /// FSEvents doesn't tell which paths belong together
+    constexpr bool reportsRenames() const { return false; }
+
 private:
     FolderWatcher *_parent;
 
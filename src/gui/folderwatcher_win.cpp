@@ -120,6 +120,7 @@ WatcherThread::WatchChanges WatcherThread::watchChanges(size_t fileNotifyBufferS
 void WatcherThread::processEntries(FILE_NOTIFY_INFORMATION *curEntry)
 {
     QSet<QString> paths;
+    QString renamedFrom;
     while (curEntry) {
         const size_t fileNameBufferSize = 4096;
         TCHAR fileNameBuffer[fileNameBufferSize];
@@ -158,12 +159,31 @@ void WatcherThread::processEntries(FILE_NOTIFY_INFORMATION *curEntry)
             paths.insert(longfile);
         }
 
+        // the new name follows the old one
+        if (curEntry->Action == FILE_ACTION_RENAMED_OLD_NAME) {
+            if (!renamedFrom.isEmpty()) {
+                Q_EMIT renamesMissed();
+            }
+            renamedFrom = longfile;
+        } else if (curEntry->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+            if (!renamedFrom.isEmpty()) {
+                Q_EMIT renamed(renamedFrom, longfile);
+                renamedFrom.clear();
+            } else {
+                Q_EMIT renamesMissed();
+            }
+        }
+
         if (curEntry->NextEntryOffset == 0) {
             break;
         }
         // FILE_NOTIFY_INFORMATION has no fixed size and the offset is in bytes therefor we first need to cast to char
         curEntry = reinterpret_cast<FILE_NOTIFY_INFORMATION *>(reinterpret_cast<char *>(curEntry) + curEntry->NextEntryOffset);
     }
+    if (!renamedFrom.isEmpty()) {
+        // the new name is in the next buffer
+        Q_EMIT renamesMissed();
+    }
     if (!paths.isEmpty()) {
         Q_EMIT changed(paths);
     }
@@ -232,6 +252,8 @@ FolderWatcherPrivate::FolderWatcherPrivate(FolderWatcher *p, const QString &path
     _thread.reset(new WatcherThread(this, path));
     // we are using connects instead of directly emitting on p as we need to cross thread borders
     connect(_thread.get(), &WatcherThread::changed, _parent, &FolderWatcher::changeDetected, Qt::QueuedConnection);
+    connect(_thread.get(), &WatcherThread::renamed, _parent, &FolderWatcher::renameDetected, Qt::QueuedConnection);
+    connect(_thread.get(), &WatcherThread::renamesMissed, _parent, &FolderWatcher::renamesMissed, Qt::QueuedConnection);
     connect(_thread.get(), &WatcherThread::lostChanges, _parent, &FolderWatcher::lostChanges, Qt::QueuedConnection);
     _thread->start();
 }
@@ -51,6 +51,8 @@ protected:
 
 signals:
     void changed(const QSet<QString> &path);
+    void renamed(const QString &from, const QString &to);
+    void renamesMissed();
     void lostChanges();
 
 private:
@@ -79,6 +81,8 @@ public:
         return _ready;
     }
 
+    bool reportsRenames() const { return true; }
+
 private:
     FolderWatcher *_parent;
     QScopedPointer<WatcherThread> _thread;
@@ -73,9 +73,11 @@ NetworkSettings::NetworkSettings(QWidget *parent)
     connect(_ui->uploadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->noUploadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->autoUploadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
+    connect(_ui->adaptiveUploadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->downloadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->noDownloadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->autoDownloadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
+    connect(_ui->adaptiveDownloadLimitRadioButton, &QAbstractButton::clicked, this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->downloadSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &NetworkSettings::saveBWLimitSettings);
     connect(_ui->uploadSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &NetworkSettings::saveBWLimitSettings);
 
@@ -136,6 +138,8 @@ void NetworkSettings::loadBWLimitSettings()
         _ui->downloadLimitRadioButton->setChecked(true);
     } else if (useDownloadLimit == 0) {
         _ui->noDownloadLimitRadioButton->setChecked(true);
+    } else if (useDownloadLimit == -2) {
+        _ui->adaptiveDownloadLimitRadioButton->setChecked(true);
     } else {
         _ui->autoDownloadLimitRadioButton->setChecked(true);
     }
@@ -146,6 +150,8 @@ void NetworkSettings::loadBWLimitSettings()
         _ui->uploadLimitRadioButton->setChecked(true);
     } else if (useUploadLimit == 0) {
         _ui->noUploadLimitRadioButton->setChecked(true);
+    } else if (useUploadLimit == -2) {
+        _ui->adaptiveUploadLimitRadioButton->setChecked(true);
     } else {
         _ui->autoUploadLimitRadioButton->setChecked(true);
     }
@@ -195,6 +201,8 @@ void NetworkSettings::saveBWLimitSettings()
         cfgFile.setUseDownloadLimit(0);
     } else if (_ui->autoDownloadLimitRadioButton->isChecked()) {
         cfgFile.setUseDownloadLimit(-1);
+    } else if (_ui->adaptiveDownloadLimitRadioButton->isChecked()) {
+        cfgFile.setUseDownloadLimit(-2);
     }
     cfgFile.setDownloadLimit(_ui->downloadSpinBox->value());
 
@@ -204,6 +212,8 @@ void NetworkSettings::saveBWLimitSettings()
         cfgFile.setUseUploadLimit(0);
     } else if (_ui->autoUploadLimitRadioButton->isChecked()) {
         cfgFile.setUseUploadLimit(-1);
+    } else if (_ui->adaptiveUploadLimitRadioButton->isChecked()) {
+        cfgFile.setUseUploadLimit(-2);
     }
     cfgFile.setUploadLimit(_ui->uploadSpinBox->value());
 
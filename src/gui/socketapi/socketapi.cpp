@@ -37,7 +37,9 @@
 #include "syncfileitem.h"
 #include "theme.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <QBitArray>
 #include <QUrl>
 #include <QMetaMethod>
@@ -70,13 +72,19 @@
 #endif
 
 
+using namespace std::chrono_literals;
+
 // This is the version that is returned when the client asks for the VERSION.
 // The first number should be changed if there is an incompatible change that breaks old clients.
 // The second number should be changed when there are new features.
-#define MIRALL_SOCKET_API_VERSION "1.1"
+#define MIRALL_SOCKET_API_VERSION "1.2"
 
 namespace {
 
+// The status pushes of a listener are sent in batches, at most 2000 per second
+constexpr auto PushInterval = 100ms;
+constexpr int MaxPushesPerInterval = 200;
+
 const QString unregisterpathMessageC()
 {
     return QStringLiteral("UNREGISTER_PATH");
@@ -114,6 +122,38 @@ Q_LOGGING_CATEGORY(lcSocketApi, "gui.socketapi", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcPublicLink, "gui.socketapi.publiclink", QtInfoMsg)
 
 void SocketListener::sendMessage(const QString &message, bool doWait) const
+{
+    if (!_outbox.empty()) {
+        qCDebug(lcSocketApi) << "Waiting for a reply to send" << message;
+        _outbox.push_back({ 0, message, true });
+        return;
+    }
+    writeMessage(message, doWait);
+}
+
+quint64 SocketListener::reserveReply()
+{
+    _outbox.push_back({ ++_lastReplyId, {}, false });
+    return _lastReplyId;
+}
+
+void SocketListener::sendReservedReply(quint64 id, const QString &message)
+{
+    auto it = std::find_if(_outbox.begin(), _outbox.end(), [id](const OutgoingMessage &m) { return m.replyId == id; });
+    if (!OC_ENSURE(it != _outbox.end())) {
+        return;
+    }
+    it->message = message;
+    it->ready = true;
+    while (!_outbox.empty() && _outbox.front().ready) {
+        if (!_outbox.front().message.isEmpty()) {
+            writeMessage(_outbox.front().message, false);
+        }
+        _outbox.pop_front();
+    }
+}
+
+void SocketListener::writeMessage(const QString &message, bool doWait) const
 {
     if (!socket) {
         qCInfo(lcSocketApi) << "Not sending message to dead socket:" << message;
@@ -136,6 +176,41 @@ void SocketListener::sendMessage(const QString &message, bool doWait) const
     }
 }
 
+SocketListener::PushResult SocketListener::queueStatusPushIfDirectoryMonitored(const QString &path, const QString &message, uint systemDirectoryHash)
+{
+    if (!_monitoredDirectoriesBloomFilter.isHashMaybeStored(systemDirectoryHash)) {
+        return PushResult::NotMonitored;
+    }
+    auto it = _queuedPushes.find(path);
+    if (it != _queuedPushes.end()) {
+        it.value() = message;
+        return PushResult::Merged;
+    }
+    if (_queuedPushOrder.size() >= MaxQueuedPushes) {
+        // the entries of the directory are pushed again once the queue drained
+        _droppedDirectories.insert(path.left(path.lastIndexOf(QLatin1Char('/'))));
+        return PushResult::Dropped;
+    }
+    _queuedPushes.insert(path, message);
+    _queuedPushOrder.push_back(path);
+    return PushResult::Queued;
+}
+
+int SocketListener::flushStatusPushes(int maxMessages)
+{
+    if (hasReservedReplies()) {
+        // a reply computed before might be older than the queued pushes
+        return 0;
+    }
+    int sent = 0;
+    while (sent < maxMessages && !_queuedPushOrder.empty()) {
+        sendMessage(_queuedPushes.take(_queuedPushOrder.front()));
+        _queuedPushOrder.pop_front();
+        ++sent;
+    }
+    return sent;
+}
+
 SocketApi::SocketApi(QObject *parent)
     : QObject(parent)
 {
@@ -176,6 +251,11 @@ SocketApi::SocketApi(QObject *parent)
     // folder watcher
     connect(FolderMan::instance(), &FolderMan::folderSyncStateChange, this, &SocketApi::slotUpdateFolderView);
 
+    _workerPool.setMaxThreadCount(1);
+
+    _pushTimer.setSingleShot(true);
+    connect(&_pushTimer, &QTimer::timeout, this, &SocketApi::slotFlushStatusPushes);
+
     // Now we're ready to start the native shell integration:
     Utility::startShellIntegration();
 }
@@ -183,6 +263,7 @@ SocketApi::SocketApi(QObject *parent)
 SocketApi::~SocketApi()
 {
     qCDebug(lcSocketApi) << "dtor";
+    _workerPool.waitForDone();
     _localServer.close();
     // All remaining sockets will be destroyed with _localServer, their parent
     OC_ASSERT(_listeners.isEmpty() || _listeners.first()->socket->parent() == &_localServer);
@@ -207,7 +288,9 @@ void SocketApi::slotNewConnection()
         socket->deleteLater();
     });
     connect(socket, &SocketApiSocket::destroyed, this, [socket, this] {
-        _listeners.remove(socket);
+        if (const auto listener = _listeners.take(socket)) {
+            _pushStats.dropped += listener->queuedStatusPushes();
+        }
     });
     OC_ASSERT(socket->readAll().isEmpty());
 
@@ -358,6 +441,9 @@ void SocketApi::slotRegisterPath(Folder *folder)
 
 void SocketApi::slotUnregisterPath(Folder *folder)
 {
+    // the folder is about to be deleted, the queries might still use it
+    _workerPool.waitForDone();
+
     if (!_registeredFolders.contains(folder))
         return;
 
@@ -412,6 +498,17 @@ void SocketApi::broadcastMessage(const QString &msg, bool doWait)
     }
 }
 
+void SocketApi::sendReplyFromWorker(SocketListener *listener, std::function<QString()> &&reply)
+{
+    // the messages sent to the listener in the meantime, like newer status pushes, wait for the reply
+    const quint64 id = listener->reserveReply();
+    _workerPool.start([this, listener = listener->sharedFromThis(), id, reply = std::move(reply)] {
+        const QString message = reply();
+        QMetaObject::invokeMethod(
+            this, [listener, id, message] { listener->sendReservedReply(id, message); }, Qt::QueuedConnection);
+    });
+}
+
 void SocketApi::processShareRequest(const QString &localFile, SocketListener *listener, ShareDialogStartPage startPage)
 {
     auto theme = Theme::instance();
@@ -458,8 +555,56 @@ void SocketApi::broadcastStatusPushMessage(const QString &systemPath, SyncFileSt
     QString msg = buildMessage(QStringLiteral("STATUS"), systemPath, fileStatus.toSocketAPIString());
     Q_ASSERT(!systemPath.endsWith(QLatin1Char('/')));
     uint directoryHash = qHash(systemPath.left(systemPath.lastIndexOf(QLatin1Char('/'))));
+    bool queued = false;
+    for (const auto &listener : qAsConst(_listeners)) {
+        switch (listener->queueStatusPushIfDirectoryMonitored(systemPath, msg, directoryHash)) {
+        case SocketListener::PushResult::NotMonitored:
+            break;
+        case SocketListener::PushResult::Queued:
+            ++_pushStats.queued;
+            queued = true;
+            break;
+        case SocketListener::PushResult::Merged:
+            ++_pushStats.merged;
+            break;
+        case SocketListener::PushResult::Dropped:
+            ++_pushStats.dropped;
+            break;
+        }
+    }
+    if (queued) {
+        scheduleStatusPushes();
+    }
+}
+
+void SocketApi::scheduleStatusPushes()
+{
+    if (_pushTimer.isActive()) {
+        return;
+    }
+    // the pushes that arrive in the same event loop iteration are sent together
+    const auto sinceLastFlush = _lastPushFlush.isValid() ? std::chrono::milliseconds(_lastPushFlush.elapsed()) : PushInterval;
+    _pushTimer.start(std::max(PushInterval - sinceLastFlush, 0ms));
+}
+
+void SocketApi::slotFlushStatusPushes()
+{
+    _lastPushFlush.start();
+    bool pending = false;
     for (const auto &listener : qAsConst(_listeners)) {
-        listener->sendMessageIfDirectoryMonitored(msg, directoryHash);
+        _pushStats.sent += listener->flushStatusPushes(MaxPushesPerInterval);
+        if (listener->hasQueuedStatusPushes()) {
+            pending = true;
+        } else {
+            pushDroppedDirectories(listener.data());
+        }
+    }
+    if (pending) {
+        _pushTimer.start(PushInterval);
+    } else if (_pushStats.merged != _loggedPushStats.merged || _pushStats.dropped != _loggedPushStats.dropped) {
+        qCInfo(lcSocketApi) << "Sent" << _pushStats.sent - _loggedPushStats.sent << "status pushes, merged"
+                            << _pushStats.merged - _loggedPushStats.merged << "and dropped" << _pushStats.dropped - _loggedPushStats.dropped;
+        _loggedPushStats = _pushStats;
     }
 }
 
@@ -471,23 +616,71 @@ void SocketApi::command_RETRIEVE_FOLDER_STATUS(const QString &argument, SocketLi
 
 void SocketApi::command_RETRIEVE_FILE_STATUS(const QString &argument, SocketListener *listener)
 {
-    QString statusString;
-
     auto fileData = FileData::get(argument);
     if (!fileData.folder) {
         // this can happen in offline mode e.g.: nothing to worry about
-        statusString = SyncFileStatus(SyncFileStatus::StatusNone).toSocketAPIString();
-    } else {
-        // The user probably visited this directory in the file shell.
-        // Let the listener know that it should now send status pushes for sibblings of this file.
-        QString directory = fileData.localPath.left(fileData.localPath.lastIndexOf(QLatin1Char('/')));
-        listener->registerMonitoredDirectory(qHash(directory));
+        const QString statusString = SyncFileStatus(SyncFileStatus::StatusNone).toSocketAPIString();
+        listener->sendMessage(QStringLiteral("STATUS:") % statusString % QLatin1Char(':') % QDir::toNativeSeparators(argument));
+        return;
+    }
 
-        statusString = fileData.syncFileStatus().toSocketAPIString();
+    // The user probably visited this directory in the file shell.
+    // Let the listener know that it should now send status pushes for sibblings of this file.
+    QString directory = fileData.localPath.left(fileData.localPath.lastIndexOf(QLatin1Char('/')));
+    listener->registerMonitoredDirectory(qHash(directory));
+
+    auto *statusTracker = &fileData.folder->syncEngine().syncFileStatusTracker();
+    sendReplyFromWorker(listener, [statusTracker, relativePath = fileData.folderRelativePath, argument] {
+        const QString statusString = statusTracker->cachedFileStatus(relativePath).toSocketAPIString();
+        return QString(QStringLiteral("STATUS:") % statusString % QLatin1Char(':') % QDir::toNativeSeparators(argument));
+    });
+}
+
+void SocketApi::command_RETRIEVE_DIRECTORY_STATUS(const QString &argument, SocketListener *listener)
+{
+    const QString nativeDirectory = QDir::toNativeSeparators(argument);
+    const auto fileData = FileData::get(argument);
+    if (!fileData.folder) {
+        listener->sendMessage(QStringLiteral("DIRECTORY_STATUS:BEGIN:") % nativeDirectory % QStringLiteral("\nDIRECTORY_STATUS:END:") % nativeDirectory);
+        return;
     }
 
-    const QString message = QStringLiteral("STATUS:") % statusString % QLatin1Char(':') % QDir::toNativeSeparators(argument);
-    listener->sendMessage(message);
+    // Status pushes for the entries are wanted from now on
+    listener->registerMonitoredDirectory(qHash(fileData.localPath));
+
+    auto *statusTracker = &fileData.folder->syncEngine().syncFileStatusTracker();
+    sendReplyFromWorker(listener, [statusTracker, fileData, nativeDirectory] {
+        return QString(QStringLiteral("DIRECTORY_STATUS:BEGIN:") % nativeDirectory % QLatin1Char('\n') % entryStatusMessages(statusTracker, fileData)
+            % QStringLiteral("DIRECTORY_STATUS:END:") % nativeDirectory);
+    });
+}
+
+QString SocketApi::entryStatusMessages(SyncFileStatusTracker *statusTracker, const FileData &fileData)
+{
+    QString messages;
+    const QDir directory(fileData.localPath);
+    const auto entries = directory.entryList(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    for (const auto &entry : entries) {
+        const QString relativePath = fileData.isSyncFolder() ? entry : QString(fileData.folderRelativePath % QLatin1Char('/') % entry);
+        messages += QStringLiteral("STATUS:") % statusTracker->cachedFileStatus(relativePath).toSocketAPIString() % QLatin1Char(':')
+            % QDir::toNativeSeparators(directory.filePath(entry)) % QLatin1Char('\n');
+    }
+    qCDebug(lcSocketApi) << "Sending the status of" << entries.size() << "entries of" << fileData.localPath;
+    return messages;
+}
+
+void SocketApi::pushDroppedDirectories(SocketListener *listener)
+{
+    const auto directories = listener->takeDroppedDirectories();
+    for (const auto &directory : directories) {
+        const auto fileData = FileData::get(directory);
+        if (!fileData.folder) {
+            continue;
+        }
+        qCInfo(lcSocketApi) << "Pushing the status of the entries of" << directory << "again, their pushes were dropped";
+        auto *statusTracker = &fileData.folder->syncEngine().syncFileStatusTracker();
+        sendReplyFromWorker(listener, [statusTracker, fileData] { return entryStatusMessages(statusTracker, fileData); });
+    }
 }
 
 void SocketApi::command_SHARE(const QString &localFile, SocketListener *listener)
@@ -685,6 +878,7 @@ void SocketApi::command_MAKE_AVAILABLE_LOCALLY(const QString &filesArg, SocketLi
 
         // Update the pin state on all items
         data.folder->vfs().setPinState(data.folderRelativePath, PinState::AlwaysLocal);
+        data.folder->syncEngine().requestHydration(data.folderRelativePath, HydrationQueue::Priority::Pinned);
 
         // Trigger sync
         data.folder->schedulePathForLocalDiscovery(data.folderRelativePath);
@@ -704,6 +898,7 @@ void SocketApi::command_MAKE_ONLINE_ONLY(const QString &filesArg, SocketListener
 
         // Update the pin state on all items
         data.folder->vfs().setPinState(data.folderRelativePath, PinState::OnlineOnly);
+        data.folder->syncEngine().cancelHydration(data.folderRelativePath);
 
         // Trigger sync
         data.folder->schedulePathForLocalDiscovery(data.folderRelativePath);
@@ -946,7 +1141,7 @@ SyncFileStatus SocketApi::FileData::syncFileStatus() const
 {
     if (!folder)
         return SyncFileStatus::StatusNone;
-    return folder->syncEngine().syncFileStatusTracker().fileStatus(folderRelativePath);
+    return folder->syncEngine().syncFileStatusTracker().cachedFileStatus(folderRelativePath);
 }
 
 SyncJournalFileRecord SocketApi::FileData::journalRecord() const
@@ -22,6 +22,10 @@
 
 #include "config.h"
 
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QTimer>
+
 #if defined(Q_OS_MAC)
 #include "socketapisocket_mac.h"
 #else
@@ -39,6 +43,7 @@ namespace OCC {
 class SyncFileStatus;
 class Folder;
 class SocketListener;
+class SyncFileStatusTracker;
 class SocketApiJob;
 class SocketApiJobV2;
 
@@ -70,6 +75,7 @@ signals:
 private slots:
     void slotNewConnection();
     void slotReadSocket();
+    void slotFlushStatusPushes();
 
     static void copyUrlToClipboard(const QUrl &link);
     static void emailPrivateLink(const QUrl &link);
@@ -104,12 +110,35 @@ private:
 
     void broadcastMessage(const QString &msg, bool doWait = false);
 
+    /**
+     * Computes the reply on the worker thread and sends it from the GUI thread.
+     *
+     * Used for the status queries which might wait for the journal while a sync
+     * is running, reply must not touch GUI objects.
+     */
+    void sendReplyFromWorker(SocketListener *listener, std::function<QString()> &&reply);
+
+    /// The STATUS lines of the entries of a directory, called on the worker
+    static QString entryStatusMessages(SyncFileStatusTracker *statusTracker, const FileData &fileData);
+
+    /// Pushes the status of the entries of the directories whose pushes the listener dropped
+    void pushDroppedDirectories(SocketListener *listener);
+
     // opens share dialog, sends reply
     void processShareRequest(const QString &localFile, SocketListener *listener, ShareDialogStartPage startPage);
 
     Q_INVOKABLE void command_RETRIEVE_FOLDER_STATUS(const QString &argument, SocketListener *listener);
     Q_INVOKABLE void command_RETRIEVE_FILE_STATUS(const QString &argument, SocketListener *listener);
 
+    /** Send the status of all entries of a directory at once. (added in version 1.2)
+     * argument is the directory
+     * Reply with DIRECTORY_STATUS:BEGIN:[Directory]
+     * followed by a STATUS:[Status]:[Path] line for every entry, like the reply of RETRIEVE_FILE_STATUS,
+     * and ends with DIRECTORY_STATUS:END:[Directory]
+     * The lines are sent in a single message.
+     */
+    Q_INVOKABLE void command_RETRIEVE_DIRECTORY_STATUS(const QString &argument, SocketListener *listener);
+
     Q_INVOKABLE void command_VERSION(const QString &argument, SocketListener *listener);
 
     Q_INVOKABLE void command_SHARE_MENU_TITLE(const QString &argument, SocketListener *listener);
@@ -162,6 +191,27 @@ private:
     QSet<AccountPtr> _registeredAccounts;
     QMap<SocketApiSocket *, QSharedPointer<SocketListener>> _listeners;
     SocketApiServer _localServer;
+
+    // Answers the status queries, a single thread keeps the order of their replies
+    QThreadPool _workerPool;
+
+    /**
+     * The status pushes are queued per listener and sent at a limited rate,
+     * a sync of many files would flood the socket and the file manager.
+     */
+    void scheduleStatusPushes();
+    QTimer _pushTimer;
+    QElapsedTimer _lastPushFlush;
+
+    struct PushStats
+    {
+        quint64 queued = 0;
+        quint64 sent = 0;
+        quint64 merged = 0;
+        quint64 dropped = 0;
+    };
+    PushStats _pushStats;
+    PushStats _loggedPushStats;
 };
 }
 
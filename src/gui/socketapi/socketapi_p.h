@@ -23,8 +23,13 @@
 
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QSharedPointer>
 
+#include <deque>
 #include <memory>
+#include <utility>
+#include <QHash>
+#include <QSet>
 #include <QTimer>
 
 namespace OCC {
@@ -57,9 +62,12 @@ private:
     QBitArray hashBits;
 };
 
-class SocketListener
+class SocketListener : public QEnableSharedFromThis<SocketListener>
 {
 public:
+    /// The number of distinct paths a listener may have queued status pushes for
+    static constexpr size_t MaxQueuedPushes = 10000;
+
     QPointer<QIODevice> socket;
 
     explicit SocketListener(QIODevice *_socket)
@@ -67,6 +75,7 @@ public:
     {
     }
 
+    /** Sends the message, after the replies that were reserved before */
     void sendMessage(const QString &message, bool doWait = false) const;
     void sendWarning(const QString &message, bool doWait = false) const
     {
@@ -77,19 +86,69 @@ public:
         sendMessage(QStringLiteral("ERROR:") + message, doWait);
     }
 
-    void sendMessageIfDirectoryMonitored(const QString &message, uint systemDirectoryHash) const
-    {
-        if (_monitoredDirectoriesBloomFilter.isHashMaybeStored(systemDirectoryHash))
-            sendMessage(message, false);
-    }
+    /**
+     * Reserves the place of a reply that is computed on another thread.
+     *
+     * The messages sent in the meantime wait for it, so the replies and the
+     * status pushes arrive in the order they were issued.
+     */
+    quint64 reserveReply();
+    /// Sends the reserved reply and the messages waiting for it
+    void sendReservedReply(quint64 id, const QString &message);
+    bool hasReservedReplies() const { return !_outbox.empty(); }
 
     void registerMonitoredDirectory(uint systemDirectoryHash)
     {
         _monitoredDirectoriesBloomFilter.storeHash(systemDirectoryHash);
     }
 
+    enum class PushResult {
+        NotMonitored,
+        Queued,
+        // replaced a queued push for the same path
+        Merged,
+        // the queue is full
+        Dropped
+    };
+
+    /**
+     * Queues a status push if the directory is monitored.
+     * A push for a path that is still queued replaces the queued one.
+     */
+    PushResult queueStatusPushIfDirectoryMonitored(const QString &path, const QString &message, uint systemDirectoryHash);
+
+    /**
+     * Sends up to maxMessages queued pushes in their order, returns how many were sent.
+     * While replies are reserved the pushes stay queued and are merged.
+     */
+    int flushStatusPushes(int maxMessages);
+
+    bool hasQueuedStatusPushes() const { return !_queuedPushOrder.empty(); }
+    size_t queuedStatusPushes() const { return _queuedPushOrder.size(); }
+
+    /// The directories of the dropped pushes, the status of their entries must be pushed again
+    QSet<QString> takeDroppedDirectories() { return std::exchange(_droppedDirectories, {}); }
+
 private:
+    void writeMessage(const QString &message, bool doWait) const;
+
     BloomFilter _monitoredDirectoriesBloomFilter;
+
+    struct OutgoingMessage
+    {
+        // 0 for messages that wait for a reserved reply
+        quint64 replyId;
+        QString message;
+        bool ready;
+    };
+    // a reserved reply that is not sent yet and the messages behind it
+    mutable std::deque<OutgoingMessage> _outbox;
+    quint64 _lastReplyId = 0;
+
+    // The queued pushes by path and the order of the paths
+    QHash<QString, QString> _queuedPushes;
+    std::deque<QString> _queuedPushOrder;
+    QSet<QString> _droppedDirectories;
 };
 
 class ListenerClosure : public QObject
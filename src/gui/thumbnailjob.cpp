@@ -23,6 +23,7 @@ ThumbnailJob::ThumbnailJob(const QString &path, AccountPtr account, QObject *par
 {
     Q_ASSERT(path.startsWith(QLatin1Char('/')));
     setForceIgnoreCredentialFailure(true);
+    setCoalescingEnabled(true);
 }
 
 void ThumbnailJob::start()
@@ -33,8 +33,10 @@
 #include "common/asserts.h"
 #include "networkjobs.h"
 #include "account.h"
+#include "adaptivebandwidthlimiter.h"
 #include "owncloudpropagator.h"
 #include "httplogger.h"
+#include "requestcoalescer.h"
 
 #include "creds/abstractcredentials.h"
 
@@ -45,6 +47,41 @@ using namespace std::chrono_literals;
 
 namespace {
 constexpr int MaxRetryCount = 5;
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 3, 0)
+// QNAM opens that many connections per host and queues the other HTTP/1 requests
+constexpr int MaxConnectionsPerHost = 6;
+
+QHash<QString, int> &repliesInFlight()
+{
+    static QHash<QString, int> replies;
+    return replies;
+}
+
+// Counts a reply as in flight until it finished or is deleted
+class InFlightReply : public QObject
+{
+public:
+    InFlightReply(const QString &host, QNetworkReply *reply)
+        : QObject(reply)
+        , _host(host)
+    {
+        ++repliesInFlight()[_host];
+        connect(reply, &QNetworkReply::finished, this, &QObject::deleteLater);
+    }
+
+    ~InFlightReply() override
+    {
+        auto it = repliesInFlight().find(_host);
+        if (--*it == 0) {
+            repliesInFlight().erase(it);
+        }
+    }
+
+private:
+    QString _host;
+};
+#endif
 }
 
 
@@ -173,10 +210,39 @@ void AbstractNetworkJob::sendRequest(const QByteArray &verb,
     _request.setTransferTimeout(duration_cast<milliseconds>(_timeout).count());
 
     if (!isAuthenticationJob() && _account->jobQueue()->enqueue(this)) {
+        if (!_queueTimer.isValid()) {
+            _queueTimer.start();
+        }
         return;
     }
+    if (_queueTimer.isValid()) {
+        _request.setAttribute(HttpLogger::QueueTimeAttribute, _queueTimer.nsecsElapsed() / 1000);
+        _queueTimer.invalidate();
+    } else {
+        _request.setAttribute(HttpLogger::QueueTimeAttribute, {});
+    }
 
-    auto reply = _account->sendRawRequest(verb, _request.url(), _request, requestBody);
+    auto reply = _coalescingEnabled ? RequestCoalescer::instance()->sendRequest(_account, verb, _request, requestBody)
+                                    : _account->sendRawRequest(verb, _request.url(), _request, requestBody);
+    _rttTimer.invalidate();
+    const bool coalesced = RequestCoalescer::isCoalesced(reply);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    if (!requestBody && !coalesced) {
+        // requests without a body are answered right away, used to detect a congested link
+        // QNAM might queue the request until a connection is free, measure from when it was written
+        connect(reply, &QNetworkReply::requestSent, this, [this] { _rttTimer.start(); });
+    }
+#else
+    if (!coalesced) {
+        const QString host = _request.url().host();
+        // requests without a body are answered right away, used to detect a congested link
+        // Qt 5 doesn't report when QNAM sent a queued request, skip the requests that might have waited for a connection
+        if (!requestBody && repliesInFlight().value(host) < MaxConnectionsPerHost) {
+            _rttTimer.start();
+        }
+        new InFlightReply(host, reply);
+    }
+#endif
 
     if (_requestBody) {
         _requestBody->setParent(this);
@@ -193,6 +259,12 @@ void AbstractNetworkJob::adoptRequest(QPointer<QNetworkReply> reply)
     _request = _reply->request();
 
     connect(_reply, &QNetworkReply::finished, this, &AbstractNetworkJob::slotFinished);
+    connect(_reply, &QNetworkReply::metaDataChanged, this, [this] {
+        if (_rttTimer.isValid()) {
+            AdaptiveBandwidthLimiter::instance()->addRttSample(_request.url().host(), milliseconds(_rttTimer.elapsed()));
+            _rttTimer.invalidate();
+        }
+    });
 
     newReplyHook(_reply);
 }
@@ -218,7 +290,13 @@ void AbstractNetworkJob::slotFinished()
     }
 
     // get the Date timestamp from reply
-    _responseTimestamp = _reply->rawHeader("Date");
+    // The items of a sync keep it, the responses of the same second share one copy
+    static thread_local QByteArray lastResponseTimestamp;
+    const QByteArray responseTimestamp = _reply->rawHeader("Date");
+    if (responseTimestamp != lastResponseTimestamp) {
+        lastResponseTimestamp = responseTimestamp;
+    }
+    _responseTimestamp = lastResponseTimestamp;
 
     if (!reply()->attribute(QNetworkRequest::RedirectionTargetAttribute).isNull() && !(isAuthenticationJob() || reply()->request().hasRawHeader(QByteArrayLiteral("OC-Connection-Validator")))) {
         Q_EMIT _account->unknownConnectionState();
@@ -416,6 +494,11 @@ void AbstractNetworkJob::setCacheLoadControl(QNetworkRequest::CacheLoadControl c
     _cacheLoadControl = cacheLoadControl;
 }
 
+void AbstractNetworkJob::setCoalescingEnabled(bool enabled)
+{
+    _coalescingEnabled = enabled;
+}
+
 } // namespace OCC
 
 QDebug operator<<(QDebug debug, const OCC::AbstractNetworkJob *job)
@@ -149,6 +149,12 @@ public:
      */
     void setCacheLoadControl(QNetworkRequest::CacheLoadControl cacheLoadControl);
 
+    /**
+     * Share the reply with identical requests of other jobs that are in flight at the same time.
+     * Only for GET and PROPFIND requests whose reply is evaluated in finished(), see RequestCoalescer.
+     */
+    void setCoalescingEnabled(bool enabled);
+
 signals:
     /** Emitted on network error.
      *
@@ -234,11 +240,17 @@ private:
 
     // by default, we don't intend to store responses in the cache (if one is set in the account's access manager)
     bool _storeInCache = false;
+    bool _coalescingEnabled = false;
     // we use Qt's default cache load behavior unless the user explicitly requests a different behavior
     std::optional<QNetworkRequest::CacheLoadControl> _cacheLoadControl = std::nullopt;
 
     QNetworkRequest::Priority _priority = QNetworkRequest::NormalPriority;
 
+    // measures the time from sending a request without body until its headers arrived
+    QElapsedTimer _rttTimer;
+    // while the request waits in the JobQueue, reported in the http trace
+    QElapsedTimer _queueTimer;
+
     friend QDebug(::operator<<)(QDebug debug, const AbstractNetworkJob *job);
 };
 
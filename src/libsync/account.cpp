@@ -20,6 +20,7 @@
 #include "creds/abstractcredentials.h"
 #include "creds/credentialmanager.h"
 #include "graphapi/spacesmanager.h"
+#include "metrics.h"
 #include "networkjobs.h"
 #include "networkjobs/resources.h"
 #include "theme.h"
@@ -75,6 +76,9 @@ Account::Account(const QUuid &uuid, QObject *parent)
     const QString resourcesCacheDir = QStringLiteral("%1/resources/").arg(_cacheDirectory);
     QDir().mkpath(resourcesCacheDir);
     _resourcesCache = new ResourcesCache(resourcesCacheDir, this);
+
+    Metrics::instance()->addGauge(this, "owncloud_job_queue_size", "The requests waiting for the account to be connected",
+        { { "account", _uuid.toString(QUuid::WithoutBraces) } }, [this] { return _jobQueue.size(); });
 }
 
 AccountPtr Account::create(const QUuid &uuid)
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "adaptivebandwidthlimiter.h"
+
+#include <QLoggingCategory>
+
+#include <algorithm>
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcAdaptiveBandwidth, "sync.bandwidthshaper.adaptive", QtInfoMsg)
+
+AdaptiveBandwidthLimiter *AdaptiveBandwidthLimiter::instance()
+{
+    static AdaptiveBandwidthLimiter *instance = new AdaptiveBandwidthLimiter(BandwidthShaper::instance(), BandwidthShaper::instance());
+    return instance;
+}
+
+AdaptiveBandwidthLimiter::AdaptiveBandwidthLimiter(BandwidthShaper *shaper, QObject *parent)
+    : QObject(parent)
+    , _shaper(shaper)
+{
+    _updateTimer.setInterval(UpdateInterval);
+    connect(&_updateTimer, &QTimer::timeout, this, [this] { update(); });
+}
+
+AdaptiveBandwidthLimiter::DirectionState &AdaptiveBandwidthLimiter::state(BandwidthShaper::Direction direction)
+{
+    return _states[static_cast<int>(direction)];
+}
+
+const AdaptiveBandwidthLimiter::DirectionState &AdaptiveBandwidthLimiter::state(BandwidthShaper::Direction direction) const
+{
+    return _states[static_cast<int>(direction)];
+}
+
+void AdaptiveBandwidthLimiter::setEnabled(BandwidthShaper::Direction direction, bool enabled)
+{
+    auto &s = state(direction);
+    if (s.enabled == enabled) {
+        return;
+    }
+    qCInfo(lcAdaptiveBandwidth) << "Adaptive limit for" << direction << (enabled ? "enabled" : "disabled");
+    s.enabled = enabled;
+    s.rate = MaximumRate;
+    // a limit is needed even if it is never reached, it lets the shaper measure the throughput
+    _shaper->setLimit(_shaper->root(direction), enabled ? s.rate : 0);
+
+    if (std::any_of(std::begin(_states), std::end(_states), [](const auto &other) { return other.enabled; })) {
+        _updateTimer.start();
+    } else {
+        _updateTimer.stop();
+    }
+}
+
+bool AdaptiveBandwidthLimiter::isEnabled(BandwidthShaper::Direction direction) const
+{
+    return state(direction).enabled;
+}
+
+qint64 AdaptiveBandwidthLimiter::currentRate(BandwidthShaper::Direction direction) const
+{
+    return state(direction).rate;
+}
+
+void AdaptiveBandwidthLimiter::addRttSample(const QString &host, milliseconds rtt, Clock::time_point now)
+{
+    auto &stats = _hosts[host];
+    // like TCP, weight the new sample with 1/8
+    stats.smoothed = stats.minima.empty() ? rtt : (7 * stats.smoothed + rtt) / 8;
+    stats.lastSample = now;
+
+    if (stats.minima.empty() || now - stats.minima.back().first >= 1min) {
+        stats.minima.emplace_back(now, rtt);
+    } else {
+        stats.minima.back().second = std::min(stats.minima.back().second, rtt);
+    }
+    stats.minima.erase(std::remove_if(stats.minima.begin(), stats.minima.end(), [now](const auto &m) { return now - m.first > BaselineWindow; }),
+        stats.minima.end());
+}
+
+milliseconds AdaptiveBandwidthLimiter::queueingDelay(Clock::time_point now) const
+{
+    milliseconds delay = {};
+    for (const auto &stats : _hosts) {
+        if (stats.minima.empty() || now - stats.lastSample > SampleTimeout) {
+            continue;
+        }
+        const auto baseline = std::min_element(stats.minima.cbegin(), stats.minima.cend(), [](const auto &a, const auto &b) {
+            return a.second < b.second;
+        })->second;
+        delay = std::max(delay, stats.smoothed - baseline);
+    }
+    return delay;
+}
+
+void AdaptiveBandwidthLimiter::update(Clock::time_point now)
+{
+    const auto delay = queueingDelay(now);
+    const bool congested = delay > TargetDelay;
+
+    for (auto direction : { BandwidthShaper::Direction::Upload, BandwidthShaper::Direction::Download }) {
+        auto &s = state(direction);
+        if (!s.enabled) {
+            continue;
+        }
+        auto *root = _shaper->root(direction);
+        const qint64 throughput = _shaper->throughput(root);
+        if (congested) {
+            // only back off the directions that are actually transferring
+            if (throughput > 0 && now - s.lastBackOff >= BackOffHold) {
+                s.rate = std::max(MinimumRate, std::min(s.rate, throughput) * 3 / 4);
+                s.lastBackOff = now;
+                qCInfo(lcAdaptiveBandwidth) << "Queueing delay of" << delay.count() << "ms, reducing the" << direction << "limit to" << s.rate << "B/s";
+            }
+        } else {
+            s.rate = std::min(MaximumRate, s.rate + std::max(s.rate / 20, MinimumRate));
+        }
+        _shaper->setLimit(root, s.rate);
+    }
+}
+
+}
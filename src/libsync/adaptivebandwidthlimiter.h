@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "bandwidthshaper.h"
+#include "owncloudlib.h"
+
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+#include <chrono>
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Limits the bandwidth based on the latency of the network
+ *
+ * When the sync saturates the link, the queues of the router fill up and the
+ * round trip time of all other requests grows. That is what makes video calls
+ * stutter while a big upload is running.
+ *
+ * The limiter collects the round trip times of small requests, keeps the
+ * minimum of the last BaselineWindow as baseline per host and compares it to
+ * the smoothed current value. If the difference, the queueing delay, exceeds
+ * TargetDelay the limit of the enabled directions is reduced to 3/4 of the
+ * measured throughput. Otherwise it is increased slowly until MaximumRate,
+ * so an otherwise idle link is used completely.
+ *
+ * The limit is applied to the root nodes of the BandwidthShaper.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT AdaptiveBandwidthLimiter : public QObject
+{
+    Q_OBJECT
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto UpdateInterval = std::chrono::seconds(1);
+    static constexpr auto BaselineWindow = std::chrono::minutes(10);
+    static constexpr auto TargetDelay = std::chrono::milliseconds(100);
+    /// Hosts without samples for that long are not taken into account
+    static constexpr auto SampleTimeout = std::chrono::seconds(10);
+    /// Don't back off again before the previous reduction had an effect
+    static constexpr auto BackOffHold = std::chrono::seconds(3);
+
+    static constexpr qint64 MinimumRate = 16 * 1024;
+    static constexpr qint64 MaximumRate = 1024 * 1024 * 1024;
+
+    static AdaptiveBandwidthLimiter *instance();
+
+    explicit AdaptiveBandwidthLimiter(BandwidthShaper *shaper, QObject *parent = nullptr);
+
+    void setEnabled(BandwidthShaper::Direction direction, bool enabled);
+    bool isEnabled(BandwidthShaper::Direction direction) const;
+
+    /// The rate currently applied to the direction, only meaningful if it is enabled
+    qint64 currentRate(BandwidthShaper::Direction direction) const;
+
+    /**
+     * Reports the time it took host to answer a request without a body.
+     */
+    void addRttSample(const QString &host, std::chrono::milliseconds rtt, Clock::time_point now = Clock::now());
+
+    /**
+     * The largest queueing delay of all hosts with recent samples.
+     */
+    std::chrono::milliseconds queueingDelay(Clock::time_point now = Clock::now()) const;
+
+    /**
+     * Adjusts the limits, called every UpdateInterval and public for the tests.
+     */
+    void update(Clock::time_point now = Clock::now());
+
+private:
+    struct HostStats
+    {
+        // the minimum per minute for the last BaselineWindow
+        std::vector<std::pair<Clock::time_point, std::chrono::milliseconds>> minima;
+        std::chrono::milliseconds smoothed = {};
+        Clock::time_point lastSample;
+    };
+
+    struct DirectionState
+    {
+        bool enabled = false;
+        qint64 rate = MaximumRate;
+        Clock::time_point lastBackOff;
+    };
+
+    DirectionState &state(BandwidthShaper::Direction direction);
+    const DirectionState &state(BandwidthShaper::Direction direction) const;
+
+    BandwidthShaper *_shaper;
+    QHash<QString, HostStats> _hosts;
+    DirectionState _states[2];
+    QTimer _updateTimer;
+};
+
+}
@@ -13,222 +13,162 @@
  */
 
 #include "owncloudpropagator.h"
+#include "account.h"
+#include "adaptivebandwidthlimiter.h"
+#include "metrics.h"
 #include "propagatedownload.h"
 #include "propagateupload.h"
 #include "propagatorjobs.h"
 #include "common/utility.h"
 
 #include <QLoggingCategory>
-#include <QTimer>
 #include <QObject>
+#include <QTimer>
+
+using namespace std::chrono_literals;
 
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcBandwidthManager, "sync.bandwidthmanager", QtInfoMsg)
 
-// Because of the many layers of buffering inside Qt (and probably the OS and the network)
-// we cannot lower this value much more. If we do, the estimated bw will be very high
-// because the buffers fill fast while the actual network algorithms are not relevant yet.
-static qint64 relativeLimitMeasuringTimerIntervalMsec = 1000 * 2;
-// See also WritingState in http://code.woboq.org/qt5/qtbase/src/network/access/qhttpprotocolhandler.cpp.html#_ZN20QHttpProtocolHandler11sendRequestEv
-
 // FIXME At some point:
 //  * Register device only after the QNR received its metaDataChanged() signal
 //  * Incorporate Qt buffer fill state (it's a negative absolute delta).
 //  * Incorporate SSL overhead (percentage)
-//  * For relative limiting, do less measuring and more delaying+giving quota
-//  * For relative limiting, smoothen measurements
 
 BandwidthManager::BandwidthManager(OwncloudPropagator *p)
     : QObject(p)
-    , _propagator(p)
-    , _relativeLimitCurrentMeasuredDevice(nullptr)
-    , _relativeUploadLimitProgressAtMeasuringRestart(0)
     , _currentUploadLimit(0)
-    , _relativeLimitCurrentMeasuredJob(nullptr)
     , _currentDownloadLimit(0)
 {
-    // absolute uploads/downloads
-    QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
-
-    // Relative uploads
-    QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadMeasuringTimerExpired);
-    _relativeUploadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeUploadMeasuringTimer.start();
-    _relativeUploadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeUploadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadDelayTimerExpired);
-    _relativeUploadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
+    auto *shaper = BandwidthShaper::instance();
+    const QString accountKey = p->account()->uuid().toString(QUuid::WithoutBraces);
+    const QString folderKey = p->localPath();
+    _uploadNode = shaper->addNode(shaper->groupNode(shaper->root(BandwidthShaper::Direction::Upload), accountKey), folderKey);
+    _downloadNode = shaper->addNode(shaper->groupNode(shaper->root(BandwidthShaper::Direction::Download), accountKey), folderKey);
 
-    // Relative downloads
-    QObject::connect(&_relativeDownloadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadMeasuringTimerExpired);
-    _relativeDownloadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeDownloadMeasuringTimer.start();
-    _relativeDownloadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeDownloadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadDelayTimerExpired);
-    _relativeDownloadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
+    auto *metrics = Metrics::instance();
+    const QByteArray help = QByteArrayLiteral("The throughput of the limited transfers of the folder in bytes per second");
+    metrics->addGauge(this, "owncloud_bandwidth_throughput_bytes", help, { { "folder", folderKey }, { "direction", QStringLiteral("Up") } },
+        [node = _uploadNode] { return BandwidthShaper::instance()->throughput(node); });
+    metrics->addGauge(this, "owncloud_bandwidth_throughput_bytes", help, { { "folder", folderKey }, { "direction", QStringLiteral("Down") } },
+        [node = _downloadNode] { return BandwidthShaper::instance()->throughput(node); });
 }
 
 BandwidthManager::~BandwidthManager()
 {
-}
-
-void BandwidthManager::registerUploadDevice(UploadDevice *p)
-{
-    _absoluteUploadDeviceList.push_back(p);
-    _relativeUploadDeviceList.push_back(p);
-    QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
-
-    if (usingAbsoluteUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(false);
-    } else if (usingRelativeUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(true);
-    } else {
-        p->setBandwidthLimited(false);
-        p->setChoked(false);
+    // the jobs are below the folder nodes and removed with them
+    auto *shaper = BandwidthShaper::instance();
+    shaper->removeNode(_uploadNode);
+    shaper->removeNode(_downloadNode);
+}
+
+namespace {
+    struct GlobalSchedule
+    {
+        BandwidthSchedule schedule;
+        BandwidthSchedule::Limits defaults;
+        QTimer *timer = nullptr;
+    };
+
+    GlobalSchedule &globalSchedule()
+    {
+        static GlobalSchedule schedule;
+        return schedule;
+    }
+
+    void applyGlobalLimit(BandwidthShaper::Direction direction, qint64 limit)
+    {
+        const bool adaptive = limit == BandwidthManager::AdaptiveLimit;
+        AdaptiveBandwidthLimiter::instance()->setEnabled(direction, adaptive);
+        if (!adaptive) {
+            auto *shaper = BandwidthShaper::instance();
+            shaper->setLimit(shaper->root(direction), limit);
+        }
     }
-}
 
-void BandwidthManager::unregisterUploadDevice(QObject *o)
-{
-    auto p = reinterpret_cast<UploadDevice *>(o); // note, we might already be in the ~QObject
-    _absoluteUploadDeviceList.remove(p);
-    _relativeUploadDeviceList.remove(p);
-    if (p == _relativeLimitCurrentMeasuredDevice) {
-        _relativeLimitCurrentMeasuredDevice = nullptr;
-        _relativeUploadLimitProgressAtMeasuringRestart = 0;
+    void applyGlobalSchedule()
+    {
+        auto &global = globalSchedule();
+        const auto now = QDateTime::currentDateTime();
+        const auto limits = global.schedule.limitsAt(now, global.defaults);
+        qCInfo(lcBandwidthManager) << "Global bandwidth limits (up/down)" << limits.upload << limits.download;
+        applyGlobalLimit(BandwidthShaper::Direction::Upload, limits.upload);
+        applyGlobalLimit(BandwidthShaper::Direction::Download, limits.download);
+
+        const auto next = global.schedule.nextChange(now);
+        if (next.isValid()) {
+            // The timer does not advance while the computer is suspended, check again regularly.
+            // Add a second to be sure we are past the change.
+            global.timer->start(std::min<qint64>(now.msecsTo(next) + 1000, std::chrono::milliseconds(5min).count()));
+        } else {
+            global.timer->stop();
+        }
     }
 }
 
-void BandwidthManager::registerDownloadJob(GETFileJob *j)
+void BandwidthManager::setGlobalLimits(qint64 upload, qint64 download)
 {
-    _downloadJobList.push_back(j);
-    connect(j, &GETFileJob::aboutToFinishSignal, this, [j, this] {
-        unregisterDownloadJob(j);
-    });
-
-    if (usingAbsoluteDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(false);
-    } else if (usingRelativeDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(true);
-    } else {
-        j->setBandwidthLimited(false);
-        j->setChoked(false);
-    }
+    setGlobalSchedule({}, { upload, download });
 }
 
-void BandwidthManager::unregisterDownloadJob(GETFileJob *j)
+void BandwidthManager::setGlobalSchedule(const BandwidthSchedule &schedule, const BandwidthSchedule::Limits &defaults)
 {
-    j->setChoked(false);
-    j->setBandwidthLimited(false);
-    _downloadJobList.remove(j);
-    if (_relativeLimitCurrentMeasuredJob == j) {
-        _relativeLimitCurrentMeasuredJob = nullptr;
-        _relativeDownloadLimitProgressAtMeasuringRestart = 0;
+    auto &global = globalSchedule();
+    if (!global.timer) {
+        global.timer = new QTimer(BandwidthShaper::instance());
+        global.timer->setSingleShot(true);
+        QObject::connect(global.timer, &QTimer::timeout, global.timer, &applyGlobalSchedule);
     }
+    global.schedule = schedule;
+    global.defaults = defaults;
+    applyGlobalSchedule();
 }
 
-void BandwidthManager::relativeUploadMeasuringTimerExpired()
+void BandwidthManager::registerUploadDevice(UploadDevice *p)
 {
-    if (!usingRelativeUploadLimit() || _relativeUploadDeviceList.empty()) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
-        return;
-    }
-    if (_relativeLimitCurrentMeasuredDevice == nullptr) {
-        qCDebug(lcBandwidthManager) << "No device set, just waiting 1 sec";
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
+    if (_jobs.count(p)) {
         return;
     }
-
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.size() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                               + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeUploadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeUploadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredDevice->_readWithProgress << _relativeLimitCurrentMeasuredDevice->_read
-                                << qAbs(_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                       - _relativeLimitCurrentMeasuredDevice->_read)
-                                << ")";
-
-    qint64 uploadLimitPercent = -_currentUploadLimit;
-    // don't use too extreme values
-    uploadLimitPercent = qMin(uploadLimitPercent, qint64(90));
-    uploadLimitPercent = qMax(qint64(10), uploadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / uploadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << uploadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any upload to timeout
-    _relativeUploadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeUploadDelayTimer.start();
-
-    auto deviceCount = _relativeUploadDeviceList.size();
-    qint64 quotaPerDevice = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) / deviceCount + 1.0;
-    for (auto *ud : _relativeUploadDeviceList) {
-        ud->setBandwidthLimited(true);
-        ud->setChoked(false);
-        ud->giveBandwidthQuota(quotaPerDevice);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerDevice / 1024.0 << "kB to" << ud;
-    }
-    _relativeLimitCurrentMeasuredDevice = nullptr;
+    QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
+    _jobs[p] = BandwidthShaper::instance()->addJob(_uploadNode,
+        { [p](bool limited) { p->setBandwidthLimited(limited); },
+            [p](qint64 quota) { p->giveBandwidthQuota(quota); },
+            [p] { return p->_bandwidthQuota; } });
 }
 
-void BandwidthManager::relativeUploadDelayTimerExpired()
+void BandwidthManager::unregisterUploadDevice(QObject *o)
 {
-    // Switch to measuring state
-    _relativeUploadMeasuringTimer.start(); // always start to continue the cycle
-
-    if (!usingRelativeUploadLimit()) {
-        return; // oh, not actually needed
+    // note, we might already be in the ~QObject
+    auto it = _jobs.find(o);
+    if (it != _jobs.end()) {
+        BandwidthShaper::instance()->removeNode(it->second);
+        _jobs.erase(it);
     }
+}
 
-    if (_relativeUploadDeviceList.empty()) {
+void BandwidthManager::registerDownloadJob(GETFileJob *j)
+{
+    if (_jobs.count(j)) {
         return;
     }
+    connect(j, &GETFileJob::aboutToFinishSignal, this, [j, this] {
+        unregisterDownloadJob(j);
+    });
+    _jobs[j] = BandwidthShaper::instance()->addJob(_downloadNode,
+        { [j](bool limited) { j->setBandwidthLimited(limited); },
+            [j](qint64 quota) { j->giveBandwidthQuota(quota); },
+            [j] { return j->bandwidthQuota(); } });
+}
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.size() << "Starting measuring";
-
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredDevice = _relativeUploadDeviceList.front();
-    _relativeUploadDeviceList.pop_front();
-    _relativeUploadDeviceList.push_back(_relativeLimitCurrentMeasuredDevice);
-
-    _relativeUploadLimitProgressAtMeasuringRestart = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                                         + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    _relativeLimitCurrentMeasuredDevice->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredDevice->setChoked(false);
-
-    // choke all other UploadDevices
-    for (auto *ud : qAsConst(_relativeUploadDeviceList)) {
-        if (ud != _relativeLimitCurrentMeasuredDevice) {
-            ud->setBandwidthLimited(true);
-            ud->setChoked(true);
-        }
+void BandwidthManager::unregisterDownloadJob(GETFileJob *j)
+{
+    auto it = _jobs.find(j);
+    if (it != _jobs.end()) {
+        BandwidthShaper::instance()->removeNode(it->second);
+        _jobs.erase(it);
     }
-
-    // now we're in measuring state
+    j->setBandwidthLimited(false);
 }
 
 qint64 BandwidthManager::currentUploadLimit() const
@@ -241,113 +181,8 @@ void BandwidthManager::setCurrentUploadLimit(qint64 newUploadLimit)
     if (newUploadLimit != _currentUploadLimit) {
         qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
         _currentUploadLimit = newUploadLimit;
-        for (auto *ud : _relativeUploadDeviceList) {
-            if (newUploadLimit == 0) {
-                ud->setBandwidthLimited(false);
-                ud->setChoked(false);
-            } else if (newUploadLimit > 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(false);
-            } else if (newUploadLimit < 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(true);
-            }
-        }
-    }
-}
-
-// for downloads:
-void BandwidthManager::relativeDownloadMeasuringTimerExpired()
-{
-    if (!usingRelativeDownloadLimit() || _downloadJobList.empty()) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
-    }
-    if (_relativeLimitCurrentMeasuredJob == nullptr) {
-        qCDebug(lcBandwidthManager) << "No job set, just waiting 1 sec";
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
-    }
-
-    qCDebug(lcBandwidthManager) << _downloadJobList.size() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeDownloadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeDownloadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-
-    qint64 downloadLimitPercent = -_currentDownloadLimit;
-    // don't use too extreme values
-    downloadLimitPercent = qMin(downloadLimitPercent, qint64(90));
-    downloadLimitPercent = qMax(qint64(10), downloadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / downloadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << downloadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any download to timeout
-    _relativeDownloadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeDownloadDelayTimer.start();
-
-    auto jobCount = _downloadJobList.size();
-    qint64 quota = relativeLimitProgressDifference * (downloadLimitPercent / 100.0);
-    if (quota > 20 * 1024) {
-        qCInfo(lcBandwidthManager) << "ADJUSTING QUOTA FROM " << quota << " TO " << quota - 20 * 1024;
-        quota -= 20 * 1024;
-    }
-    qint64 quotaPerJob = quota / jobCount + 1.0;
-    for (auto *gfj : _downloadJobList) {
-        gfj->setBandwidthLimited(true);
-        gfj->setChoked(false);
-        gfj->giveBandwidthQuota(quotaPerJob);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerJob / 1024.0 << "kB to" << gfj;
-    }
-    _relativeLimitCurrentMeasuredDevice = nullptr;
-}
-
-void BandwidthManager::relativeDownloadDelayTimerExpired()
-{
-    // Switch to measuring state
-    _relativeDownloadMeasuringTimer.start(); // always start to continue the cycle
-
-    if (!usingRelativeDownloadLimit()) {
-        return; // oh, not actually needed
-    }
-
-    if (_downloadJobList.empty()) {
-        qCDebug(lcBandwidthManager) << _downloadJobList.size() << "No jobs?";
-        return;
+        BandwidthShaper::instance()->setLimit(_uploadNode, newUploadLimit);
     }
-
-    qCDebug(lcBandwidthManager) << _downloadJobList.size() << "Starting measuring";
-
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredJob = _downloadJobList.front();
-    _downloadJobList.pop_front();
-    _downloadJobList.push_back(_relativeLimitCurrentMeasuredJob);
-
-    _relativeDownloadLimitProgressAtMeasuringRestart = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    _relativeLimitCurrentMeasuredJob->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredJob->setChoked(false);
-
-    // choke all other download jobs
-    for (auto *gfj : _downloadJobList) {
-        if (gfj != _relativeLimitCurrentMeasuredJob) {
-            gfj->setBandwidthLimited(true);
-            gfj->setChoked(true);
-        }
-    }
-
-    // now we're in measuring state
 }
 
 qint64 BandwidthManager::currentDownloadLimit() const
@@ -360,40 +195,7 @@ void BandwidthManager::setCurrentDownloadLimit(qint64 newDownloadLimit)
     if (newDownloadLimit != _currentDownloadLimit) {
         qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
         _currentDownloadLimit = newDownloadLimit;
-        for (auto *j : _downloadJobList) {
-            if (usingAbsoluteDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(false);
-            } else if (usingRelativeDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(true);
-            } else {
-                j->setBandwidthLimited(false);
-                j->setChoked(false);
-            }
-        }
-    }
-}
-
-// end downloads
-
-void BandwidthManager::absoluteLimitTimerExpired()
-{
-    if (usingAbsoluteUploadLimit() && !_absoluteUploadDeviceList.empty()) {
-        qint64 quotaPerDevice = _currentUploadLimit / _absoluteUploadDeviceList.size();
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.size() << _currentUploadLimit;
-        for (auto *device : qAsConst(_absoluteUploadDeviceList)) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
-        }
-    }
-    if (usingAbsoluteDownloadLimit() && !_downloadJobList.empty()) {
-        qint64 quotaPerJob = _currentDownloadLimit / _downloadJobList.size();
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.size() << _currentDownloadLimit;
-        for (auto *j : _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << j;
-        }
+        BandwidthShaper::instance()->setLimit(_downloadNode, newDownloadLimit);
     }
 }
 }
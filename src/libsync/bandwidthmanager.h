@@ -15,11 +15,14 @@
 #ifndef BANDWIDTHMANAGER_H
 #define BANDWIDTHMANAGER_H
 
+#include "bandwidthschedule.h"
+#include "bandwidthshaper.h"
+
 #include <QObject>
-#include <QTimer>
 #include <QIODevice>
 
-#include <list>
+#include <limits>
+#include <unordered_map>
 
 namespace OCC {
 
@@ -29,9 +32,15 @@ class OwncloudPropagator;
 
 /**
  * @brief The BandwidthManager class
+ *
+ * Registers the transfers of a propagator with the process wide BandwidthShaper.
+ * The propagator is a folder node below the node of its account, the limits set
+ * here only apply to this folder. Use setGlobalLimits() for limits shared by all
+ * folders.
+ *
  * @ingroup libsync
  */
-class BandwidthManager : public QObject
+class OWNCLOUDSYNC_EXPORT BandwidthManager : public QObject
 {
     Q_OBJECT
 public:
@@ -50,6 +59,24 @@ public:
     qint64 currentUploadLimit() const;
     void setCurrentUploadLimit(qint64 newCurrentUploadLimit);
 
+    /// Selects the AdaptiveBandwidthLimiter for the global limit
+    static constexpr qint64 AdaptiveLimit = std::numeric_limits<qint64>::min();
+
+    /**
+     * Sets the limits shared by all folders of all accounts.
+     *
+     * Positive values are bytes per second, negative values a percentage
+     * of the measured throughput and 0 means no limit. AdaptiveLimit adapts
+     * the limit to the latency of the network.
+     */
+    static void setGlobalLimits(qint64 upload, qint64 download);
+
+    /**
+     * Like setGlobalLimits() but the limits of the schedule take precedence
+     * over the defaults while one of its rules applies.
+     */
+    static void setGlobalSchedule(const BandwidthSchedule &schedule, const BandwidthSchedule::Limits &defaults);
+
 public slots:
     void registerUploadDevice(UploadDevice *);
     void unregisterUploadDevice(QObject *);
@@ -57,50 +84,13 @@ public slots:
     void registerDownloadJob(GETFileJob *);
     void unregisterDownloadJob(GETFileJob *);
 
-    void absoluteLimitTimerExpired();
-
-    void relativeUploadMeasuringTimerExpired();
-    void relativeUploadDelayTimerExpired();
-
-    void relativeDownloadMeasuringTimerExpired();
-    void relativeDownloadDelayTimerExpired();
-
 private:
-    // FIXME this timer and this variable should be replaced
-    // by the propagator emitting the changed limit values to us as signal
-    OwncloudPropagator *_propagator;
+    BandwidthShaper::Node *_uploadNode;
+    BandwidthShaper::Node *_downloadNode;
 
-    // for absolute up/down bw limiting
-    QTimer _absoluteLimitTimer;
+    std::unordered_map<QObject *, BandwidthShaper::Node *> _jobs;
 
-    // FIXME merge these two lists
-    std::list<UploadDevice *> _absoluteUploadDeviceList;
-    std::list<UploadDevice *> _relativeUploadDeviceList;
-
-    QTimer _relativeUploadMeasuringTimer;
-
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeUploadDelayTimer;
-
-    // the device measured
-    UploadDevice *_relativeLimitCurrentMeasuredDevice;
-
-    // for measuring how much progress we made at start
-    qint64 _relativeUploadLimitProgressAtMeasuringRestart;
     qint64 _currentUploadLimit;
-
-    std::list<GETFileJob *> _downloadJobList;
-    QTimer _relativeDownloadMeasuringTimer;
-
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeDownloadDelayTimer;
-
-    // the device measured
-    GETFileJob *_relativeLimitCurrentMeasuredJob;
-
-    // for measuring how much progress we made at start
-    qint64 _relativeDownloadLimitProgressAtMeasuringRestart;
-
     qint64 _currentDownloadLimit;
 };
 }
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "bandwidthschedule.h"
+#include "bandwidthmanager.h"
+
+#include <QRegularExpression>
+
+namespace OCC {
+
+namespace {
+    constexpr int MinutesPerDay = 24 * 60;
+
+    Optional<int> parseDay(const QString &name)
+    {
+        static const QStringList days = { QStringLiteral("mon"), QStringLiteral("tue"), QStringLiteral("wed"), QStringLiteral("thu"),
+            QStringLiteral("fri"), QStringLiteral("sat"), QStringLiteral("sun") };
+        const int day = days.indexOf(name.toLower());
+        if (day < 0) {
+            return {};
+        }
+        return day;
+    }
+
+    Result<std::bitset<7>, QString> parseDays(const QString &spec)
+    {
+        std::bitset<7> days;
+        if (spec == QLatin1Char('*')) {
+            days.set();
+            return days;
+        }
+        for (const auto &part : spec.split(QLatin1Char(','))) {
+            const auto range = part.split(QLatin1Char('-'));
+            if (range.size() > 2) {
+                return QStringLiteral("Invalid day range '%1'").arg(part);
+            }
+            const auto first = parseDay(range.first());
+            const auto last = parseDay(range.last());
+            if (!first || !last) {
+                return QStringLiteral("Invalid day '%1'").arg(part);
+            }
+            // ranges like Fri-Mon wrap around the week
+            for (int day = *first;; day = (day + 1) % 7) {
+                days.set(day);
+                if (day == *last) {
+                    break;
+                }
+            }
+        }
+        return days;
+    }
+
+    Optional<int> parseMinutes(const QString &spec)
+    {
+        const auto parts = spec.split(QLatin1Char(':'));
+        if (parts.size() != 2) {
+            return {};
+        }
+        bool okHours, okMinutes;
+        const int hours = parts[0].toInt(&okHours);
+        const int minutes = parts[1].toInt(&okMinutes);
+        if (!okHours || !okMinutes || hours < 0 || minutes < 0 || minutes >= 60) {
+            return {};
+        }
+        const int result = hours * 60 + minutes;
+        if (result > MinutesPerDay) {
+            return {};
+        }
+        return result;
+    }
+
+    Result<qint64, QString> parseLimit(const QString &spec)
+    {
+        if (spec == QLatin1String("none")) {
+            return qint64(0);
+        }
+        if (spec == QLatin1String("adaptive")) {
+            return BandwidthManager::AdaptiveLimit;
+        }
+        bool ok;
+        if (spec.endsWith(QLatin1Char('%'))) {
+            const qint64 percent = spec.chopped(1).toLongLong(&ok);
+            if (!ok || percent <= 0 || percent > 100) {
+                return QStringLiteral("Invalid percentage '%1'").arg(spec);
+            }
+            return -percent;
+        }
+        const qint64 kbytes = spec.toLongLong(&ok);
+        if (!ok || kbytes < 0) {
+            return QStringLiteral("Invalid limit '%1'").arg(spec);
+        }
+        return kbytes * 1000;
+    }
+
+    Result<BandwidthSchedule::Rule, QString> parseRule(const QString &spec)
+    {
+        static const QRegularExpression whitespace(QStringLiteral("\\s+"));
+        const auto tokens = spec.split(whitespace, Qt::SkipEmptyParts);
+        if (tokens.size() < 3) {
+            return QStringLiteral("Expected days, a time range and limits in '%1'").arg(spec);
+        }
+
+        BandwidthSchedule::Rule rule;
+        auto days = parseDays(tokens[0]);
+        if (!days) {
+            return days.error();
+        }
+        rule.days = *days;
+
+        const auto times = tokens[1].split(QLatin1Char('-'));
+        const auto start = times.size() == 2 ? parseMinutes(times[0]) : Optional<int>();
+        const auto end = times.size() == 2 ? parseMinutes(times[1]) : Optional<int>();
+        if (!start || !end || *start == MinutesPerDay || *start == *end) {
+            return QStringLiteral("Invalid time range '%1'").arg(tokens[1]);
+        }
+        rule.start = *start;
+        rule.end = *end;
+
+        for (const auto &token : tokens.mid(2)) {
+            const int separator = token.indexOf(QLatin1Char('='));
+            const auto key = token.left(separator);
+            auto limit = parseLimit(token.mid(separator + 1));
+            if (separator < 0 || !limit) {
+                return separator < 0 ? QStringLiteral("Expected up=limit or down=limit instead of '%1'").arg(token) : limit.error();
+            }
+            if (key == QLatin1String("up")) {
+                rule.upload = *limit;
+            } else if (key == QLatin1String("down")) {
+                rule.download = *limit;
+            } else {
+                return QStringLiteral("Unknown direction '%1'").arg(key);
+            }
+        }
+        return rule;
+    }
+}
+
+Result<BandwidthSchedule, QString> BandwidthSchedule::parse(const QString &spec)
+{
+    static const QRegularExpression separator(QStringLiteral("[;\\n]"));
+    BandwidthSchedule schedule;
+    for (const auto &ruleSpec : spec.split(separator, Qt::SkipEmptyParts)) {
+        if (ruleSpec.trimmed().isEmpty()) {
+            continue;
+        }
+        auto rule = parseRule(ruleSpec.trimmed());
+        if (!rule) {
+            return rule.error();
+        }
+        schedule._rules.push_back(*rule);
+    }
+    return schedule;
+}
+
+const BandwidthSchedule::Rule *BandwidthSchedule::ruleAt(const QDateTime &time) const
+{
+    const int day = time.date().dayOfWeek() - 1;
+    const int previousDay = (day + 6) % 7;
+    const int minute = time.time().hour() * 60 + time.time().minute();
+    for (const auto &rule : _rules) {
+        if (rule.start < rule.end) {
+            if (rule.days.test(day) && minute >= rule.start && minute < rule.end) {
+                return &rule;
+            }
+        } else if ((rule.days.test(day) && minute >= rule.start) || (rule.days.test(previousDay) && minute < rule.end)) {
+            // the rule wraps around midnight, the end belongs to the next day
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+BandwidthSchedule::Limits BandwidthSchedule::limitsAt(const QDateTime &time, const Limits &defaults) const
+{
+    const auto *rule = ruleAt(time);
+    if (!rule) {
+        return defaults;
+    }
+    return { rule->upload ? *rule->upload : defaults.upload, rule->download ? *rule->download : defaults.download };
+}
+
+QDateTime BandwidthSchedule::nextChange(const QDateTime &time) const
+{
+    QDateTime next;
+    // the rules repeat every week
+    for (int i = 0; i <= 7; ++i) {
+        const auto date = time.date().addDays(i);
+        for (const auto &rule : _rules) {
+            for (int minute : { rule.start, rule.end }) {
+                const QDateTime candidate = minute == MinutesPerDay ? QDateTime(date.addDays(1), QTime(0, 0)) : QDateTime(date, QTime(minute / 60, minute % 60));
+                if (candidate > time && (!next.isValid() || candidate < next)) {
+                    next = candidate;
+                }
+            }
+        }
+    }
+    return next;
+}
+
+}
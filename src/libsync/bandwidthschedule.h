@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+#include "common/result.h"
+
+#include <QDateTime>
+#include <QString>
+
+#include <bitset>
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Time of day dependent bandwidth limits
+ *
+ * A schedule is a list of rules separated by ';' or new lines, the first
+ * matching rule wins:
+ *
+ *     Mon-Fri 08:00-18:00 up=200 down=2000; * 22:00-06:00 up=0 down=0
+ *
+ * The days are a comma separated list of days or day ranges, '*' matches
+ * every day. The time range may wrap around midnight, "24:00" is the end of
+ * the day.
+ *
+ * The limits are in KB/s like in the settings, 0 or "none" is no limit, "75%"
+ * is a percentage of the measured throughput and "adaptive" backs off when
+ * the latency of the network grows, see AdaptiveBandwidthLimiter.
+ * A direction that is not mentioned in a rule uses the default limit.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT BandwidthSchedule
+{
+public:
+    /**
+     * Limits in the encoding of the BandwidthShaper: positive values are bytes
+     * per second, negative values a percentage and 0 is no limit.
+     * BandwidthManager::AdaptiveLimit selects the adaptive limit.
+     */
+    struct Limits
+    {
+        qint64 upload = 0;
+        qint64 download = 0;
+
+        bool operator==(const Limits &other) const { return upload == other.upload && download == other.download; }
+        bool operator!=(const Limits &other) const { return !(*this == other); }
+    };
+
+    struct Rule
+    {
+        // Monday is 0
+        std::bitset<7> days;
+        // minutes since midnight, end is exclusive and might be 24 * 60
+        int start = 0;
+        int end = 24 * 60;
+        Optional<qint64> upload;
+        Optional<qint64> download;
+    };
+
+    static Result<BandwidthSchedule, QString> parse(const QString &spec);
+
+    bool isEmpty() const { return _rules.empty(); }
+    const std::vector<Rule> &rules() const { return _rules; }
+
+    /** The limits at the given local time */
+    Limits limitsAt(const QDateTime &time, const Limits &defaults) const;
+
+    /** The next time after time when a rule starts or ends, invalid if there are no rules */
+    QDateTime nextChange(const QDateTime &time) const;
+
+private:
+    const Rule *ruleAt(const QDateTime &time) const;
+
+    std::vector<Rule> _rules;
+};
+
+}
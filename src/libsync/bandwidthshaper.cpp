@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "bandwidthshaper.h"
+
+#include "common/asserts.h"
+
+#include <QLoggingCategory>
+#include <QMetaEnum>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+using namespace std::chrono_literals;
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcBandwidthShaper, "sync.bandwidthshaper", QtInfoMsg)
+
+namespace {
+    // Large enough to never be reached, small enough to sum up a few of them
+    constexpr qint64 Unlimited = std::numeric_limits<qint64>::max() / 1024;
+
+    qint64 saturatingAdd(qint64 a, qint64 b)
+    {
+        return std::min(Unlimited, a + b);
+    }
+}
+
+class BandwidthShaper::Node
+{
+public:
+    Node *parent = nullptr;
+    QString key;
+    std::vector<std::unique_ptr<Node>> children;
+    // whether the node is removed once it has no children
+    bool autoRemove = false;
+
+    // only set for jobs
+    Job job;
+    bool isJob = false;
+    bool jobLimited = false;
+    qint64 lastQuota = 0;
+
+    qint64 limit = 0;
+    // the effective rate in bytes per second, 0 is unlimited
+    qint64 rate = 0;
+    qint64 tokens = 0;
+
+    // for relative limits
+    qint64 measuredRate = 0;
+    bool probing = false;
+    std::chrono::milliseconds probeStart = {};
+    std::chrono::milliseconds nextProbe = {};
+    qint64 probeBytes = 0;
+
+    // the bytes transferred in the last interval
+    qint64 usage = 0;
+    // smoothed bytes per second, only measured while the jobs below are limited
+    qint64 throughput = 0;
+    // the bytes this subtree can use in the current interval
+    qint64 capacity = 0;
+
+    bool isRoot() const { return !parent; }
+
+    qint64 charge()
+    {
+        if (isJob) {
+            usage = 0;
+            if (jobLimited) {
+                usage = std::max<qint64>(0, lastQuota - job.remainingQuota());
+            }
+            return usage;
+        }
+        usage = std::accumulate(children.cbegin(), children.cend(), qint64(0), [](qint64 sum, const auto &child) {
+            return sum + child->charge();
+        });
+        if (rate > 0) {
+            tokens -= usage;
+        }
+        if (probing) {
+            probeBytes += usage;
+        }
+        return usage;
+    }
+
+    void updateRate(std::chrono::milliseconds now)
+    {
+        if (limit >= 0) {
+            rate = limit;
+            probing = false;
+            return;
+        }
+        if (probing && now - probeStart >= ProbeDuration) {
+            const qint64 measured = probeBytes * 1000 / std::max<qint64>(1, (now - probeStart).count());
+            // smoothen the measurements, a single probe might have been demand limited
+            measuredRate = measuredRate > 0 ? (measuredRate + measured) / 2 : measured;
+            probing = false;
+            // if nothing was transferred, try again right away
+            nextProbe = measured > 0 ? now + ProbeInterval : now;
+            tokens = 0;
+            qCDebug(lcBandwidthShaper) << "Measured" << measured << "B/s on" << key << "estimate" << measuredRate;
+        }
+        if (!probing && now >= nextProbe) {
+            probing = true;
+            probeStart = now;
+            probeBytes = 0;
+        }
+        rate = probing ? 0 : std::max<qint64>(1, measuredRate * std::min<qint64>(-limit, 100) / 100);
+    }
+
+    void refill(std::chrono::milliseconds elapsed, std::chrono::milliseconds now)
+    {
+        if (isJob) {
+            return;
+        }
+        updateRate(now);
+        if (elapsed.count() > 0) {
+            throughput = (3 * throughput + usage * 1000 / elapsed.count()) / 4;
+        }
+        if (rate > 0) {
+            const qint64 burst = std::max(rate * BurstDuration.count() / 1000, MinimumJobQuota);
+            tokens = std::min(tokens + rate * elapsed.count() / 1000, burst);
+        }
+        for (const auto &child : children) {
+            child->refill(elapsed, now);
+        }
+    }
+
+    qint64 computeCapacity()
+    {
+        if (isJob) {
+            // Jobs that used their quota get twice as much next time,
+            // that way the leftovers of idle jobs are redistributed.
+            capacity = jobLimited ? std::max(MinimumJobQuota, 2 * usage) : 0;
+            return capacity;
+        }
+        const qint64 childCapacity = std::accumulate(children.cbegin(), children.cend(), qint64(0), [](qint64 sum, const auto &child) {
+            return saturatingAdd(sum, child->computeCapacity());
+        });
+        const qint64 own = rate > 0 ? std::max<qint64>(0, tokens) : Unlimited;
+        capacity = std::min(own, childCapacity);
+        return capacity;
+    }
+
+    void distribute(qint64 budget)
+    {
+        if (isJob) {
+            if (jobLimited) {
+                lastQuota = budget;
+                job.giveQuota(budget);
+            }
+            return;
+        }
+        // max-min fair share: satisfy the smallest demands first and split the rest equally
+        std::vector<Node *> sorted;
+        sorted.reserve(children.size());
+        for (const auto &child : children) {
+            sorted.push_back(child.get());
+        }
+        std::sort(sorted.begin(), sorted.end(), [](Node *a, Node *b) { return a->capacity < b->capacity; });
+        qint64 remaining = budget;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            auto *child = sorted[i];
+            const qint64 share = remaining >= Unlimited ? Unlimited : remaining / qint64(sorted.size() - i);
+            const qint64 given = std::min(child->capacity, share);
+            child->distribute(given);
+            if (remaining < Unlimited) {
+                remaining -= given;
+            }
+        }
+    }
+
+    bool hasLimitedJobs() const
+    {
+        if (isJob) {
+            return jobLimited;
+        }
+        return std::any_of(children.cbegin(), children.cend(), [](const auto &child) { return child->hasLimitedJobs(); });
+    }
+};
+
+BandwidthShaper *BandwidthShaper::instance()
+{
+    static BandwidthShaper *instance = new BandwidthShaper;
+    return instance;
+}
+
+BandwidthShaper::BandwidthShaper(QObject *parent)
+    : QObject(parent)
+{
+    for (auto direction : { Direction::Upload, Direction::Download }) {
+        auto &root = _roots[static_cast<int>(direction)];
+        root.reset(new Node);
+        root->key = QString::fromUtf8(QMetaEnum::fromType<Direction>().valueToKey(static_cast<int>(direction)));
+    }
+
+    _refillTimer.setInterval(RefillInterval);
+    connect(&_refillTimer, &QTimer::timeout, this, [this] {
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - _lastTick);
+        _lastTick = now;
+        // don't hand out a huge amount of tokens if the event loop was blocked
+        tick(std::clamp(elapsed, 0ms, std::chrono::milliseconds(BurstDuration)));
+    });
+}
+
+BandwidthShaper::~BandwidthShaper()
+{
+}
+
+BandwidthShaper::Node *BandwidthShaper::root(Direction direction) const
+{
+    return _roots[static_cast<int>(direction)].get();
+}
+
+BandwidthShaper::Node *BandwidthShaper::groupNode(Node *parent, const QString &key)
+{
+    OC_ENFORCE(parent && !parent->isJob);
+    auto it = std::find_if(parent->children.cbegin(), parent->children.cend(), [&key](const auto &child) {
+        return !child->isJob && child->key == key;
+    });
+    if (it != parent->children.cend()) {
+        return it->get();
+    }
+    auto node = addNode(parent, key);
+    node->autoRemove = true;
+    return node;
+}
+
+BandwidthShaper::Node *BandwidthShaper::addNode(Node *parent, const QString &key)
+{
+    OC_ENFORCE(parent && !parent->isJob);
+    auto node = new Node;
+    node->parent = parent;
+    node->key = key;
+    parent->children.emplace_back(node);
+    return node;
+}
+
+BandwidthShaper::Node *BandwidthShaper::addJob(Node *parent, const Job &job)
+{
+    OC_ENFORCE(parent && !parent->isJob);
+    auto node = new Node;
+    node->parent = parent;
+    node->isJob = true;
+    node->job = job;
+    parent->children.emplace_back(node);
+
+    bool limitedAbove = false;
+    for (auto *n = parent; n; n = n->parent) {
+        limitedAbove |= n->limit != 0;
+    }
+    updateJobLimited(node, limitedAbove);
+    return node;
+}
+
+void BandwidthShaper::removeNode(Node *node)
+{
+    OC_ENFORCE(node && !node->isRoot());
+    auto *parent = node->parent;
+    auto &siblings = parent->children;
+    siblings.erase(std::remove_if(siblings.begin(), siblings.end(), [node](const auto &child) { return child.get() == node; }), siblings.end());
+
+    // remove group nodes that are no longer needed
+    if (parent->autoRemove && parent->children.empty() && parent->limit == 0) {
+        removeNode(parent);
+    }
+}
+
+void BandwidthShaper::setLimit(Node *node, qint64 limit)
+{
+    OC_ENFORCE(node && !node->isJob);
+    if (node->limit == limit) {
+        return;
+    }
+    qCDebug(lcBandwidthShaper) << "Bandwidth limit of" << node->key << "changed" << node->limit << limit;
+    // keep the bucket when only the rate changes, the adaptive limit changes it all the time
+    const bool modeChanged = node->limit == 0 || limit == 0 || (node->limit < 0) != (limit < 0);
+    node->limit = limit;
+    if (modeChanged) {
+        node->tokens = 0;
+        node->measuredRate = 0;
+        node->probing = false;
+        node->nextProbe = _now;
+    }
+
+    bool limitedAbove = false;
+    for (auto *n = node->parent; n; n = n->parent) {
+        limitedAbove |= n->limit != 0;
+    }
+    updateJobLimited(node, limitedAbove);
+}
+
+qint64 BandwidthShaper::limit(const Node *node) const
+{
+    return node->limit;
+}
+
+qint64 BandwidthShaper::effectiveRate(const Node *node) const
+{
+    return node->rate;
+}
+
+qint64 BandwidthShaper::throughput(const Node *node) const
+{
+    return node->throughput;
+}
+
+void BandwidthShaper::tick(std::chrono::milliseconds elapsed)
+{
+    _now += elapsed;
+    bool hasLimitedJobs = false;
+    for (const auto &root : _roots) {
+        root->charge();
+        root->refill(elapsed, _now);
+        root->computeCapacity();
+        root->distribute(root->capacity);
+        hasLimitedJobs |= root->hasLimitedJobs();
+    }
+    if (!hasLimitedJobs) {
+        _refillTimer.stop();
+    }
+}
+
+void BandwidthShaper::updateJobLimited(Node *node, bool limitedAbove)
+{
+    const bool limited = limitedAbove || node->limit != 0;
+    if (node->isJob) {
+        if (node->jobLimited != limited) {
+            node->jobLimited = limited;
+            node->lastQuota = 0;
+            node->job.setLimited(limited);
+            if (limited) {
+                // wait for the next interval
+                node->job.giveQuota(0);
+            }
+        }
+        if (limited) {
+            scheduleTimer();
+        }
+        return;
+    }
+    for (const auto &child : node->children) {
+        updateJobLimited(child.get(), limited);
+    }
+}
+
+void BandwidthShaper::scheduleTimer()
+{
+    if (!_refillTimer.isActive()) {
+        _lastTick = std::chrono::steady_clock::now();
+        _refillTimer.start();
+    }
+}
+
+}
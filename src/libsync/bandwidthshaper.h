@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QObject>
+#include <QTimer>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Process wide hierarchical token bucket bandwidth shaper
+ *
+ * There is one tree per direction: global -> account -> folder -> job.
+ * Every node has a limit: positive values are bytes per second, negative
+ * values are a percentage of the measured throughput of that node and 0
+ * means unlimited.
+ *
+ * Every RefillInterval the buckets are refilled and the available tokens are
+ * handed down the tree. Each node splits its share fairly between its children
+ * (max-min fairness), so two folders of the same account share the account
+ * and global limits instead of each getting the full limit.
+ *
+ * Jobs are only charged for what they actually transferred, unused quota is
+ * not lost. The amount of tokens a bucket can accumulate is capped to
+ * BurstDuration worth of traffic.
+ *
+ * Relative limits are implemented by periodically letting the node run
+ * unlimited for ProbeDuration to measure the available throughput.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT BandwidthShaper : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Direction {
+        Upload,
+        Download
+    };
+    Q_ENUM(Direction)
+
+    static constexpr auto RefillInterval = std::chrono::milliseconds(50);
+    static constexpr auto BurstDuration = std::chrono::milliseconds(250);
+    static constexpr auto ProbeDuration = std::chrono::seconds(1);
+    static constexpr auto ProbeInterval = std::chrono::seconds(10);
+
+    /// The minimal quota handed to a transferring job in one interval
+    static constexpr qint64 MinimumJobQuota = 4 * 1024;
+
+    /**
+     * The interface to a job that transfers data.
+     */
+    struct Job
+    {
+        /// Sets whether the job needs to respect the quota at all
+        std::function<void(bool)> setLimited;
+        /// Replaces the quota of the job
+        std::function<void(qint64)> giveQuota;
+        /// Returns the part of the last quota that was not used yet
+        std::function<qint64()> remainingQuota;
+    };
+
+    class Node;
+
+    static BandwidthShaper *instance();
+
+    explicit BandwidthShaper(QObject *parent = nullptr);
+    ~BandwidthShaper() override;
+
+    Node *root(Direction direction) const;
+
+    /**
+     * Returns the child of parent with the given key, creates it if needed.
+     *
+     * These nodes are shared and removed automatically once their last child
+     * is removed, unless a limit was set on them.
+     */
+    Node *groupNode(Node *parent, const QString &key);
+
+    /// Adds a node below parent, remove it with removeNode() once it is no longer needed
+    Node *addNode(Node *parent, const QString &key);
+
+    /// Adds a job below parent, remove it with removeNode() once it is done
+    Node *addJob(Node *parent, const Job &job);
+
+    /// Removes the node and everything below it
+    void removeNode(Node *node);
+
+    void setLimit(Node *node, qint64 limit);
+    qint64 limit(const Node *node) const;
+
+    /**
+     * The current rate of the node in bytes per second.
+     *
+     * For relative limits this is the measured throughput times the percentage,
+     * 0 means unlimited.
+     */
+    qint64 effectiveRate(const Node *node) const;
+
+    /**
+     * The smoothed throughput of the node in bytes per second.
+     *
+     * Transfers are only accounted while a limit applies to them.
+     */
+    qint64 throughput(const Node *node) const;
+
+    /**
+     * Charges the jobs for their transfers, refills the buckets and hands out new quota.
+     *
+     * This is called by the timer every RefillInterval and public for the tests.
+     */
+    void tick(std::chrono::milliseconds elapsed);
+
+private:
+    void updateJobLimited(Node *node, bool limitedAbove);
+    void scheduleTimer();
+
+    std::unique_ptr<Node> _roots[2];
+    QTimer _refillTimer;
+    std::chrono::steady_clock::time_point _lastTick;
+    std::chrono::milliseconds _now = {};
+};
+
+}
@@ -83,6 +83,7 @@ const QString useUploadLimitC() { return QStringLiteral("BWLimit/useUploadLimit"
 const QString useDownloadLimitC() { return QStringLiteral("BWLimit/useDownloadLimit"); }
 const QString uploadLimitC() { return QStringLiteral("BWLimit/uploadLimit"); }
 const QString downloadLimitC() { return QStringLiteral("BWLimit/downloadLimit"); }
+const QString bandwidthScheduleC() { return QStringLiteral("BWLimit/schedule"); }
 
 const QString newBigFolderSizeLimitC() { return QStringLiteral("newBigFolderSizeLimit"); }
 const QString useNewBigFolderSizeLimitC() { return QStringLiteral("useNewBigFolderSizeLimit"); }
@@ -692,6 +693,16 @@ void ConfigFile::setDownloadLimit(int kbytes)
     setValue(downloadLimitC(), kbytes);
 }
 
+QString ConfigFile::bandwidthSchedule() const
+{
+    return getValue(bandwidthScheduleC()).toString();
+}
+
+void ConfigFile::setBandwidthSchedule(const QString &schedule)
+{
+    setValue(bandwidthScheduleC(), schedule);
+}
+
 QPair<bool, qint64> ConfigFile::newBigFolderSizeLimit() const
 {
     auto defaultValue = Theme::instance()->newBigFolderSizeLimit();
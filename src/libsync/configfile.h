@@ -133,7 +133,7 @@ public:
     QString proxyUser() const;
     QString proxyPassword() const;
 
-    /** 0: no limit, 1: manual, >0: automatic */
+    /** 0: no limit, 1: manual, -1: automatic, -2: adapt to the network latency */
     int useUploadLimit() const;
     int useDownloadLimit() const;
     void setUseUploadLimit(int);
@@ -143,6 +143,9 @@ public:
     int downloadLimit() const;
     void setUploadLimit(int kbytes);
     void setDownloadLimit(int kbytes);
+    /** Time dependent limits, see BandwidthSchedule for the format */
+    QString bandwidthSchedule() const;
+    void setBandwidthSchedule(const QString &schedule);
     /** [checked, size in MB] **/
     QPair<bool, qint64> newBigFolderSizeLimit() const;
     void setNewBigFolderSizeLimit(bool isChecked, qint64 mbytes);
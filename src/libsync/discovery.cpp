@@ -39,6 +39,7 @@ Q_LOGGING_CATEGORY(lcDisco, "sync.discovery", QtInfoMsg)
 void ProcessDirectoryJob::start()
 {
     qCInfo(lcDisco) << "STARTING" << _currentFolder._server << _queryServer << _currentFolder._local << _queryLocal;
+    _profileTimer = SyncProfiler::Timer("discovery", QByteArrayLiteral("directory"));
 
     if (_queryServer == NormalQuery) {
         _serverJob = startAsyncServerQuery();
@@ -68,6 +69,13 @@ void ProcessDirectoryJob::start()
 void ProcessDirectoryJob::process()
 {
     OC_ASSERT(_localQueryDone && _serverQueryDone);
+    OC_PROFILE_SCOPE("discovery", "process");
+
+    // The listings succeeded, the instruction of the directory is final
+    if (_dirItem && _discoveryData->_emitDirectoriesFirst) {
+        _dirItemEmitted = true;
+        emit _discoveryData->itemDiscovered(_dirItem);
+    }
 
     // Build lookup tables for local, remote and db entries.
     // For suffix-virtual files, the key will normally be the base file name
@@ -314,6 +322,7 @@ bool ProcessDirectoryJob::handleExcluded(const QString &path, const QString &loc
             break;
         }
     }
+    item->_errorString = _discoveryData->internedMessage(item->_errorString);
 
     _childIgnored = true;
     emit _discoveryData->itemDiscovered(item);
@@ -383,12 +392,12 @@ void ProcessDirectoryJob::processFile(const PathTuple &path,
 
 // Compute the checksum of the given file and assign the result in item->_checksumHeader
 // Returns true if the checksum was successfully computed
-static bool computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item)
+static bool computeLocalChecksum(const QByteArray &header, const QString &path, const SyncFileItemPtr &item, SyncJournalDb *journal)
 {
     const auto checksumHeader = ChecksumHeader::parseChecksumHeader(header);
     if (checksumHeader.isValid()) {
         // TODO: compute async?
-        QByteArray checksum = ComputeChecksum::computeNowOnFile(path, checksumHeader.type());
+        QByteArray checksum = ComputeChecksum::computeNowOnFile(path, checksumHeader.type(), journal);
         if (!checksum.isEmpty()) {
             item->_checksumHeader = ChecksumHeader(checksumHeader.type(), checksum).makeChecksumHeader();
             return true;
@@ -406,8 +415,12 @@ void ProcessDirectoryJob::processFileAnalyzeRemoteInfo(
     item->_remotePerm = serverEntry.remotePerm;
     item->_type = serverEntry.isDirectory ? ItemTypeDirectory : ItemTypeFile;
     item->_etag = serverEntry.etag;
-    item->_directDownloadUrl = serverEntry.directDownloadUrl;
-    item->_directDownloadCookies = serverEntry.directDownloadCookies;
+    if (!serverEntry.directDownloadUrl.isEmpty()) {
+        auto *directDownload = new SyncFileItem::DirectDownload;
+        directDownload->url = serverEntry.directDownloadUrl;
+        directDownload->cookies = serverEntry.directDownloadCookies;
+        item->_directDownload = SyncFileItem::DirectDownloadPtr(directDownload);
+    }
 
     // Check for missing server data
     {
@@ -821,7 +834,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
             // check #4754 #4755
             bool isEmlFile = path._original.endsWith(QLatin1String(".eml"), Qt::CaseInsensitive);
             if (isEmlFile && dbEntry._fileSize == localEntry.size && !dbEntry._checksumHeader.isEmpty()) {
-                if (computeLocalChecksum(dbEntry._checksumHeader, _discoveryData->_localDir + path._local, item)
+                if (computeLocalChecksum(dbEntry._checksumHeader, _discoveryData->_localDir + path._local, item, _discoveryData->_statedb)
                         && item->_checksumHeader == dbEntry._checksumHeader) {
                     qCInfo(lcDisco) << "NOTE: Checksums are identical, file did not actually change: " << path._local;
                     item->_instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
@@ -872,9 +885,25 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
         }
     };
 
-    // Check if it is a move
+    // Check if it is a move, the folder watcher might already know where it came from
     OCC::SyncJournalFileRecord base;
-    if (!_discoveryData->_statedb->getFileRecordByInode(localEntry.inode, &base)) {
+    const QString renameHint = _discoveryData->_localRenameHints.value(path._local);
+    bool lookupInode = !_discoveryData->_localRenameHintsComplete;
+    if (!renameHint.isEmpty()) {
+        if (!_discoveryData->_statedb->getFileRecord(renameHint, &base)) {
+            dbError();
+            return;
+        }
+        if (base.isValid() && base._inode == localEntry.inode) {
+            qCDebug(lcDisco) << "Using the rename hint" << renameHint << "->" << path._local;
+            lookupInode = false;
+        } else {
+            // for example a suffix virtual file, the db knows it without the suffix
+            base = {};
+            lookupInode = true;
+        }
+    }
+    if (lookupInode && !_discoveryData->_statedb->getFileRecordByInode(localEntry.inode, &base)) {
         dbError();
         return;
     }
@@ -912,7 +941,7 @@ void ProcessDirectoryJob::processFileAnalyzeLocalInfo(
 
         // Verify the checksum where possible
         if (!base._checksumHeader.isEmpty() && item->_type == ItemTypeFile && base._type == ItemTypeFile) {
-            if (computeLocalChecksum(base._checksumHeader, _discoveryData->_localDir + path._original, item)) {
+            if (computeLocalChecksum(base._checksumHeader, _discoveryData->_localDir + path._original, item, _discoveryData->_statedb)) {
                 qCInfo(lcDisco) << "checking checksum of potential rename " << path._original << item->_checksumHeader << base._checksumHeader;
                 if (item->_checksumHeader != base._checksumHeader) {
                     qCInfo(lcDisco) << "Not a move, checksums differ";
@@ -1325,8 +1354,7 @@ void ProcessDirectoryJob::subJobFinished()
     _childIgnored |= job->_childIgnored;
     _childModified |= job->_childModified;
 
-    if (job->_dirItem)
-        emit _discoveryData->itemDiscovered(job->_dirItem);
+    job->reportFinished();
 
     int count = _runningJobs.removeAll(job);
     OC_ASSERT(count == 1);
@@ -1357,6 +1385,7 @@ int ProcessDirectoryJob::processSubJobs(int nbJobs)
                 _dirItem->_instruction = CSYNC_INSTRUCTION_NONE;
             }
         }
+        _profileTimer.finish();
         emit finished();
     }
 
@@ -1377,6 +1406,17 @@ int ProcessDirectoryJob::processSubJobs(int nbJobs)
     return started;
 }
 
+void ProcessDirectoryJob::reportFinished()
+{
+    if (!_dirItem)
+        return;
+    if (_dirItemEmitted) {
+        emit _discoveryData->directoryFinished(_dirItem->destination());
+    } else {
+        emit _discoveryData->itemDiscovered(_dirItem);
+    }
+}
+
 void ProcessDirectoryJob::dbError()
 {
     Q_EMIT _discoveryData->fatalError(tr("Error while reading the database"));
@@ -88,6 +88,13 @@ public:
     /** Start up to nbJobs, return the number of job started; emit finished() when done */
     int processSubJobs(int nbJobs);
 
+    /** Reports the finished job to the discovery phase
+     *
+     * Emits the item of the directory, or directoryFinished() if the item
+     * was emitted before the contents, see DiscoveryPhase::_emitDirectoriesFirst.
+     */
+    void reportFinished();
+
     SyncFileItemPtr _dirItem;
 
 private:
@@ -259,6 +266,9 @@ private:
      */
     int _pendingAsyncJobs = 0;
 
+    // from start() until finished()
+    SyncProfiler::Timer _profileTimer;
+
     /** The queued and running jobs for subdirectories.
      *
      * The jobs are enqueued while processind directory entries and
@@ -273,6 +283,7 @@ private:
     bool _childModified = false; // the directory contains modified item what would prevent deletion
     bool _childIgnored = false; // The directory contains ignored item that would prevent deletion
     PinState _pinState = PinState::Unspecified; // The directory's pin-state, see computePinState()
+    bool _dirItemEmitted = false; // _dirItem was emitted before the contents, see DiscoveryPhase::_emitDirectoriesFirst
 
 signals:
     void finished();
@@ -203,14 +203,23 @@ QPair<bool, QString> DiscoveryPhase::findAndCancelDeletedJob(const QString &orig
     return { result, oldEtag };
 }
 
+QString DiscoveryPhase::internedMessage(const QString &message)
+{
+    const auto it = _internedMessages.constFind(message);
+    if (it != _internedMessages.cend()) {
+        return *it;
+    }
+    _internedMessages.insert(message);
+    return message;
+}
+
 void DiscoveryPhase::startJob(ProcessDirectoryJob *job)
 {
     OC_ENFORCE(!_currentRootJob);
     connect(job, &ProcessDirectoryJob::finished, this, [this, job] {
         OC_ENFORCE(_currentRootJob == sender());
         _currentRootJob = nullptr;
-        if (job->_dirItem)
-            emit itemDiscovered(job->_dirItem);
+        job->reportFinished();
         job->deleteLater();
 
         // Once the main job has finished recurse here to execute the remaining
@@ -236,8 +245,19 @@ void DiscoveryPhase::setSelectiveSyncWhiteList(const QSet<QString> &list)
     _selectiveSyncWhiteList = {list.cbegin(), list.cend()};
 }
 
+void DiscoveryPhase::setPaused(bool paused)
+{
+    if (_paused == paused)
+        return;
+    _paused = paused;
+    if (!paused)
+        scheduleMoreJobs();
+}
+
 void DiscoveryPhase::scheduleMoreJobs()
 {
+    if (_paused)
+        return;
     auto limit = qMax(1, _syncOptions._parallelNetworkJobs);
     if (_currentRootJob && _currentlyActiveJobs < limit) {
         _currentRootJob->processSubJobs(limit - _currentlyActiveJobs);
@@ -261,6 +281,7 @@ DiscoverySingleLocalDirectoryJob::DiscoverySingleLocalDirectoryJob(const Account
 
 // Use as QRunnable
 void DiscoverySingleLocalDirectoryJob::run() {
+    OC_PROFILE_SCOPE("discovery", "local listing");
     QString localPath = _localPath;
     if (localPath.endsWith(QLatin1Char('/'))) // Happens if _currentFolder._local.isEmpty()
         localPath.chop(1);
@@ -335,6 +356,7 @@ DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &accou
 
 void DiscoverySingleDirectoryJob::start()
 {
+    _profileTimer = SyncProfiler::Timer("discovery", QByteArrayLiteral("remote listing"));
     // Start the actual HTTP job
     _proFindJob = new PropfindJob(_account, _baseUrl, _subPath, PropfindJob::Depth::One, this);
 
@@ -464,6 +486,7 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(const QString &fi
 
 void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
 {
+    _profileTimer.finish();
     if (!_ignoredFirst) {
         // This is a sanity check, if we haven't _ignoredFirst then it means we never received any directoryListingIteratedSlot
         // which means somehow the server XML was bogus
@@ -482,6 +505,7 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithoutErrorSlot()
 
 void DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
 {
+    _profileTimer.finish();
     QString contentType = r->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     QString msg = r->errorString();
@@ -25,8 +25,10 @@
 #include <QWaitCondition>
 #include <QRunnable>
 #include <deque>
+#include <set>
 #include "syncoptions.h"
 #include "syncfileitem.h"
+#include "common/syncprofiler.h"
 
 #include "csync/csync_exclude.h"
 
@@ -148,6 +150,7 @@ private:
     // If set, the discovery will finish with an error
     QString _error;
     QPointer<PropfindJob> _proFindJob;
+    SyncProfiler::Timer _profileTimer;
 
 public:
     QByteArray _dataFingerprint;
@@ -204,6 +207,7 @@ class DiscoveryPhase : public QObject
     bool isRenamed(const QString &p) const { return _renamedItemsLocal.contains(p) || _renamedItemsRemote.contains(p); }
 
     int _currentlyActiveJobs = 0;
+    bool _paused = false;
 
     // both must contain a sorted list
     std::set<QString> _selectiveSyncBlackList;
@@ -238,6 +242,14 @@ class DiscoveryPhase : public QObject
      */
     QPair<bool, QString> findAndCancelDeletedJob(const QString &originalPath);
 
+    /** Returns the message shared with the earlier items that have the same one.
+     *
+     * The reasons for ignoring a file are the same for many of them.
+     */
+    QString internedMessage(const QString &message);
+
+    QSet<QString> _internedMessages;
+
 public:
     // input
     DiscoveryPhase(const AccountPtr &account, const SyncOptions &options, const QUrl &baseUrl, QObject *parent = nullptr)
@@ -259,8 +271,29 @@ public:
     bool _ignoreHiddenFiles = false;
     std::function<bool(const QString &)> _shouldDiscoverLocaly;
 
+    /** Renames reported by the folder watcher, maps the new to the old local path.
+     *
+     * The db record of the old path is used as move candidate instead of looking
+     * up the inode. If complete is set, the watcher reported all renames since the
+     * last sync and a new local item without hint is not looked up at all.
+     */
+    QHash<QString, QString> _localRenameHints;
+    bool _localRenameHintsComplete = false;
+
+    /** Emit the item of a directory before its contents and directoryFinished() after them.
+     *
+     * Allows to propagate while the discovery runs. Only valid if the instructions
+     * of the directories don't depend on their contents, that is without removals
+     * and type changes, see SyncEngine::canStreamPropagation().
+     */
+    bool _emitDirectoriesFirst = false;
+
     void startJob(ProcessDirectoryJob *);
 
+    /** Stops starting the jobs for further directories, the running ones continue */
+    void setPaused(bool paused);
+    bool isPaused() const { return _paused; }
+
     void setSelectiveSyncBlackList(const QSet<QString> &list);
     void setSelectiveSyncWhiteList(const QSet<QString> &list);
 
@@ -276,6 +309,8 @@ public:
 signals:
     void fatalError(const QString &errorString);
     void itemDiscovered(const SyncFileItemPtr &item);
+    /// With _emitDirectoriesFirst, all the items below the directory were discovered
+    void directoryFinished(const QString &path);
     void finished();
 
     // A new folder was discovered and was not synced because of the confirmation feature
@@ -33,6 +33,8 @@ const auto mountpointC = QLatin1String("mountpoint");
 Drives::Drives(const AccountPtr &account, QObject *parent)
     : JsonJob(account, account->url(), QStringLiteral("/graph/v1.0/me/drives"), "GET", {}, {}, parent)
 {
+    // the spaces are polled by every folder of the account
+    setCoalescingEnabled(true);
 }
 
 Drives::~Drives() { }
@@ -20,6 +20,15 @@
 #include <QRegularExpression>
 #include <QLoggingCategory>
 #include <QBuffer>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+
+#include <atomic>
+#include <memory>
+#include <optional>
 
 
 using namespace std::chrono;
@@ -100,6 +109,128 @@ void logHttp(const QByteArray &verb, const QString &url, const QByteArray &id, c
     stream << "]";
     qCInfo(lcNetworkHttp) << msg;
 }
+
+class HttpTrace
+{
+public:
+    static HttpTrace &instance()
+    {
+        static HttpTrace trace;
+        return trace;
+    }
+
+    bool isEnabled() const { return _enabled; }
+
+    void setFile(const QString &fileName)
+    {
+        QMutexLocker lock(&_mutex);
+        _file.close();
+        _enabled = false;
+        if (fileName.isEmpty()) {
+            return;
+        }
+        _file.setFileName(fileName);
+        if (!_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qCWarning(lcNetworkHttp) << "Failed to open the http trace" << fileName << _file.errorString();
+            return;
+        }
+        _enabled = true;
+    }
+
+    void write(const QJsonObject &event)
+    {
+        QMutexLocker lock(&_mutex);
+        if (_file.isOpen()) {
+            _file.write(QJsonDocument(event).toJson(QJsonDocument::Compact) + '\n');
+            // a line is small, don't lose the events of a crash
+            _file.flush();
+        }
+    }
+
+private:
+    HttpTrace()
+    {
+        const QString fileName = qEnvironmentVariable("OWNCLOUD_HTTP_TRACE");
+        if (!fileName.isEmpty()) {
+            setFile(fileName);
+        }
+    }
+
+    QMutex _mutex;
+    QFile _file;
+    std::atomic<bool> _enabled = false;
+};
+
+// the times are in microseconds since the request was handed to the access manager
+struct RequestTiming
+{
+    qint64 start = QDateTime::currentMSecsSinceEpoch();
+    OCC::Utility::ChronoElapsedTimer timer;
+    std::optional<qint64> encrypted;
+    std::optional<qint64> uploaded;
+    std::optional<qint64> firstByte;
+    qint64 sent = 0;
+    qint64 received = 0;
+
+    qint64 elapsed() const { return duration_cast<microseconds>(timer.duration()).count(); }
+};
+
+void traceRequest(QNetworkReply *reply, QNetworkAccessManager::Operation operation, QIODevice *device)
+{
+    auto timing = std::make_shared<RequestTiming>();
+    timing->sent = device ? device->size() : 0;
+
+    QObject::connect(reply, &QNetworkReply::encrypted, reply, [timing] { timing->encrypted = timing->elapsed(); });
+    QObject::connect(reply, &QNetworkReply::uploadProgress, reply, [timing](qint64 sent, qint64 total) {
+        if (total > 0 && sent == total && !timing->uploaded) {
+            timing->uploaded = timing->elapsed();
+        }
+    });
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, reply, [timing] {
+        if (!timing->firstByte) {
+            timing->firstByte = timing->elapsed();
+        }
+    });
+    QObject::connect(reply, &QNetworkReply::downloadProgress, reply, [timing](qint64 received, qint64) { timing->received = received; });
+    QObject::connect(reply, &QNetworkReply::finished, reply, [reply, operation, timing] {
+        const qint64 total = timing->elapsed();
+        const auto request = reply->request();
+        QJsonObject event {
+            { QStringLiteral("id"), QString::fromUtf8(request.rawHeader(XRequestId())) },
+            { QStringLiteral("originalId"), QString::fromUtf8(request.rawHeader(QByteArrayLiteral("Original-Request-ID"))) },
+            { QStringLiteral("verb"), QString::fromUtf8(OCC::HttpLogger::requestVerb(operation, request)) },
+            { QStringLiteral("host"), request.url().host() },
+            { QStringLiteral("path"), request.url().path() },
+            { QStringLiteral("status"), reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() },
+            { QStringLiteral("error"), static_cast<int>(reply->error()) },
+            { QStringLiteral("start"), timing->start },
+            { QStringLiteral("total"), total },
+            { QStringLiteral("sent"), timing->sent },
+            { QStringLiteral("received"), std::max(timing->received, reply->header(QNetworkRequest::ContentLengthHeader).toLongLong()) },
+        };
+        const auto queueTime = request.attribute(OCC::HttpLogger::QueueTimeAttribute);
+        if (queueTime.isValid()) {
+            event.insert(QStringLiteral("queue"), queueTime.toLongLong());
+        }
+        if (timing->encrypted) {
+            event.insert(QStringLiteral("connect"), *timing->encrypted);
+        }
+        if (timing->uploaded) {
+            event.insert(QStringLiteral("upload"), *timing->uploaded);
+        }
+        if (timing->firstByte) {
+            event.insert(QStringLiteral("ttfb"), *timing->firstByte);
+            event.insert(QStringLiteral("transfer"), total - *timing->firstByte);
+        }
+        if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool()) {
+            event.insert(QStringLiteral("http2"), true);
+        }
+        if (reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool()) {
+            event.insert(QStringLiteral("cached"), true);
+        }
+        HttpTrace::instance().write(event);
+    });
+}
 }
 
 
@@ -107,6 +238,9 @@ namespace OCC {
 
 void HttpLogger::logRequest(QNetworkReply *reply, QNetworkAccessManager::Operation operation, QIODevice *device)
 {
+    if (HttpTrace::instance().isEnabled()) {
+        traceRequest(reply, operation, device);
+    }
     if (!lcNetworkHttp().isInfoEnabled()) {
         return;
     }
@@ -137,6 +271,11 @@ void HttpLogger::logRequest(QNetworkReply *reply, QNetworkAccessManager::Operati
     });
 }
 
+void HttpLogger::setTraceFile(const QString &fileName)
+{
+    HttpTrace::instance().setFile(fileName);
+}
+
 QByteArray HttpLogger::requestVerb(QNetworkAccessManager::Operation operation, const QNetworkRequest &request)
 {
     switch (operation) {
@@ -22,6 +22,21 @@ namespace OCC {
 namespace HttpLogger {
     void OWNCLOUDSYNC_EXPORT logRequest(QNetworkReply *reply, QNetworkAccessManager::Operation operation, QIODevice *device);
 
+    /**
+     * The time in microseconds the request waited in the JobQueue, set by AbstractNetworkJob
+     */
+    constexpr auto QueueTimeAttribute = static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 1);
+
+    /**
+     * Writes the timing of each finished request as a line of JSON to fileName,
+     * an empty name stops the trace.
+     *
+     * The trace can also be enabled with the environment variable OWNCLOUD_HTTP_TRACE.
+     * Unlike the log it contains no headers or data, it is meant for the analysis of
+     * the performance with the httptrace tool.
+     */
+    void OWNCLOUDSYNC_EXPORT setTraceFile(const QString &fileName);
+
     /**
     * Helper to construct the HTTP verb used in the request
     */
@@ -18,6 +18,8 @@
 
 #include <QLoggingCategory>
 
+#include <utility>
+
 using namespace OCC;
 
 Q_LOGGING_CATEGORY(lcLocalDiscoveryTracker, "sync.localdiscoverytracker", QtInfoMsg)
@@ -32,10 +34,22 @@ void LocalDiscoveryTracker::addTouchedPath(const QString &relativePath)
     _localDiscoveryPaths.insert(relativePath);
 }
 
+void LocalDiscoveryTracker::addRenameHint(const QString &fromRelativePath, const QString &toRelativePath)
+{
+    qCDebug(lcLocalDiscoveryTracker) << "inserted rename" << fromRelativePath << toRelativePath;
+    const QString origin = _renameHints.take(fromRelativePath);
+    if (origin != toRelativePath) {
+        _renameHints.insert(toRelativePath, origin.isEmpty() ? fromRelativePath : origin);
+    }
+}
+
 void LocalDiscoveryTracker::startSyncFullDiscovery()
 {
     _localDiscoveryPaths.clear();
     _previousLocalDiscoveryPaths.clear();
+    _previousRenameHints = std::move(_renameHints);
+    _renameHints.clear();
+    _previousRenameHintsComplete = std::exchange(_renameHintsComplete, true);
     qCDebug(lcLocalDiscoveryTracker) << "full discovery";
 }
 
@@ -50,6 +64,9 @@ void LocalDiscoveryTracker::startSyncPartialDiscovery()
 
     _previousLocalDiscoveryPaths = std::move(_localDiscoveryPaths);
     _localDiscoveryPaths.clear();
+    _previousRenameHints = std::move(_renameHints);
+    _renameHints.clear();
+    _previousRenameHintsComplete = std::exchange(_renameHintsComplete, true);
 }
 
 const std::set<QString> &LocalDiscoveryTracker::localDiscoveryPaths() const
@@ -57,6 +74,17 @@ const std::set<QString> &LocalDiscoveryTracker::localDiscoveryPaths() const
     return _localDiscoveryPaths;
 }
 
+const QHash<QString, QString> &LocalDiscoveryTracker::renameHints() const
+{
+    return _renameHints;
+}
+
+void LocalDiscoveryTracker::setRenameHintsIncomplete()
+{
+    qCDebug(lcLocalDiscoveryTracker) << "renames might be missing";
+    _renameHintsComplete = false;
+}
+
 void LocalDiscoveryTracker::slotItemCompleted(const SyncFileItemPtr &item)
 {
     // For successes, we want to wipe the file from the list to ensure we don't
@@ -106,6 +134,13 @@ void LocalDiscoveryTracker::slotItemCompleted(const SyncFileItemPtr &item)
 
     _localDiscoveryPaths.insert(item->_file);
     qCDebug(lcLocalDiscoveryTracker) << "inserted error item" << item->_file;
+    if (!item->_renameTarget.isEmpty()) {
+        // the rename will be retried
+        const QString origin = _previousRenameHints.value(item->_renameTarget);
+        if (!origin.isEmpty()) {
+            _renameHints.insert(item->_renameTarget, origin);
+        }
+    }
 }
 
 void LocalDiscoveryTracker::slotSyncFinished(bool success)
@@ -118,7 +153,16 @@ void LocalDiscoveryTracker::slotSyncFinished(bool success)
         // C++17: Could use std::set::merge().
         _localDiscoveryPaths.insert(
             _previousLocalDiscoveryPaths.begin(), _previousLocalDiscoveryPaths.end());
+        for (auto it = _previousRenameHints.cbegin(); it != _previousRenameHints.cend(); ++it) {
+            // newer renames of the same path win
+            if (!_renameHints.contains(it.key())) {
+                _renameHints.insert(it.key(), it.value());
+            }
+        }
+        _renameHintsComplete = _renameHintsComplete && _previousRenameHintsComplete;
         qCDebug(lcLocalDiscoveryTracker) << "sync failed, keeping last sync's local discovery path list";
     }
     _previousLocalDiscoveryPaths.clear();
+    _previousRenameHints.clear();
+    _previousRenameHintsComplete = true;
 }
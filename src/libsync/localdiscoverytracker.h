@@ -19,6 +19,7 @@
 #include <set>
 #include <QObject>
 #include <QByteArray>
+#include <QHash>
 #include <QSharedPointer>
 
 namespace OCC {
@@ -59,6 +60,12 @@ public:
      */
     void addTouchedPath(const QString &relativePath);
 
+    /** Adds a rename reported by the file watcher, relative paths like addTouchedPath().
+     *
+     * Chains of renames are combined, the paths must be added as touched paths too.
+     */
+    void addRenameHint(const QString &fromRelativePath, const QString &toRelativePath);
+
     /** Call when a sync run starts that rediscovers all local files */
     void startSyncFullDiscovery();
 
@@ -68,6 +75,15 @@ public:
     /** Access list of files that shall be locally rediscovered. */
     const std::set<QString> &localDiscoveryPaths() const;
 
+    /** The renames since the last sync, maps the new to the old path. */
+    const QHash<QString, QString> &renameHints() const;
+
+    /** Call when the watcher might have missed renames, renameHints() are incomplete until the next sync */
+    void setRenameHintsIncomplete();
+
+    /** Whether renameHints() are all the renames since the last sync */
+    bool renameHintsComplete() const { return _renameHintsComplete; }
+
 public slots:
     /**
      * Success and failure of sync items adjust what the next sync is
@@ -96,6 +112,12 @@ private:
      * again when the sync is done to make sure everything is retried.
      */
     std::set<QString> _previousLocalDiscoveryPaths;
+
+    /// Like the discovery paths, the renames of a failing sync are kept for the next one
+    QHash<QString, QString> _renameHints;
+    QHash<QString, QString> _previousRenameHints;
+    bool _renameHintsComplete = true;
+    bool _previousRenameHintsComplete = true;
 };
 
 } // namespace OCC
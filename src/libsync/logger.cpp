@@ -22,7 +22,9 @@
 #include <QtConcurrent>
 #include <QtGlobal>
 
+#include <chrono>
 #include <iostream>
+#include <utility>
 
 #include <zlib.h>
 
@@ -32,10 +34,25 @@
 #include <comdef.h>
 #endif
 
+using namespace std::chrono_literals;
+
 namespace {
 constexpr int crashLogSizeC = 20;
 constexpr int maxLogSizeC = 1024 * 1024 * 100; // 100 MiB
 constexpr int minLogsToKeepC = 5;
+// the number of messages that can wait for the writer, must be a power of two
+constexpr size_t logQueueSizeC = 16 * 1024;
+
+// the time at the start of loggerPattern()
+const auto timeFormatC = QStringLiteral("yy-MM-dd hh:mm:ss:zzz");
+
+// with a pattern from the environment we don't know where the time is,
+// such messages are formatted by the calling thread
+bool hasCustomPattern()
+{
+    static const bool custom = qEnvironmentVariableIsSet("QT_MESSAGE_PATTERN");
+    return custom;
+}
 
 #ifdef Q_OS_WIN
 bool isDebuggerPresent()
@@ -51,11 +68,113 @@ bool isDebuggerPresent()
 }
 namespace OCC {
 
+struct LogMessage
+{
+    QtMsgType type = QtDebugMsg;
+    // the time of the call
+    qint64 time = 0;
+    // copies, the context of a message doesn't need to outlive the call
+    QByteArray category;
+    QByteArray function;
+    QString message;
+    // the message was formatted by the calling thread
+    bool formatted = false;
+
+    QString format() const
+    {
+        if (formatted) {
+            return message;
+        }
+        const QMessageLogContext ctx(nullptr, 0, function.isEmpty() ? nullptr : function.constData(), category.constData());
+        QString out = qFormatLogMessage(type, ctx, message);
+        if (!hasCustomPattern()) {
+            // qFormatLogMessage uses the current time
+            out.replace(0, timeFormatC.size(), QDateTime::fromMSecsSinceEpoch(time).toString(timeFormatC));
+        }
+        return out;
+    }
+};
+
+/**
+ * A bounded multi producer single consumer queue of log messages.
+ *
+ * Each slot has a sequence number that tells whether it is free for the
+ * producer of a position or holds a message for the consumer, see
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+class LogQueue
+{
+public:
+    explicit LogQueue(size_t capacity)
+        : _slots(new Slot[capacity])
+        , _mask(capacity - 1)
+    {
+        Q_ASSERT((capacity & _mask) == 0);
+        for (size_t i = 0; i < capacity; ++i) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// Returns false if the queue is full
+    bool push(LogMessage &&message)
+    {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = _slots[pos & _mask];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.message = std::move(message);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the consumer didn't free the slot yet
+                return false;
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Only one thread at a time may consume
+    bool pop(LogMessage &message)
+    {
+        Slot &slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return false;
+        }
+        message = std::move(slot.message);
+        slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+        ++_head;
+        return true;
+    }
+
+    bool isEmpty() const { return _slots[_head & _mask].sequence.load(std::memory_order_acquire) != _head + 1; }
+
+    /// The number of messages that were pushed so far
+    quint64 pushed() const { return _tail.load(); }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        LogMessage message;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    const size_t _mask;
+    alignas(64) std::atomic<size_t> _tail = 0;
+    alignas(64) size_t _head = 0;
+};
+
 Logger *Logger::instance()
 {
     static auto *log = [] {
         auto log = new Logger;
         qAddPostRoutine([] {
+            Logger::instance()->stopWriter();
             Logger::instance()->close();
             delete Logger::instance();
         });
@@ -67,9 +186,11 @@ Logger *Logger::instance()
 Logger::Logger(QObject *parent)
     : QObject(parent)
     , _maxLogFiles(std::max(ConfigFile().automaticDeleteOldLogs(), minLogsToKeepC))
+    , _queue(new LogQueue(logQueueSizeC))
 {
     qSetMessagePattern(loggerPattern());
     _crashLog.resize(crashLogSizeC);
+    startWriter();
 #ifndef NO_MSG_HANDLER
     qInstallMessageHandler([](QtMsgType type, const QMessageLogContext &ctx, const QString &message) {
             Logger::instance()->doLog(type, ctx, message);
@@ -82,11 +203,12 @@ Logger::~Logger()
 #ifndef NO_MSG_HANDLER
     qInstallMessageHandler(0);
 #endif
+    stopWriter();
 }
 
 QString Logger::loggerPattern()
 {
-    return QStringLiteral("%{time yy-MM-dd hh:mm:ss:zzz} [ %{type} %{category} ]%{if-debug}\t[ %{function} ]%{endif}:\t%{message}");
+    return QStringLiteral("%{time %1} [ %{type} %{category} ]%{if-debug}\t[ %{function} ]%{endif}:\t%{message}").arg(timeFormatC);
 }
 
 bool Logger::isLoggingToFile() const
@@ -97,21 +219,14 @@ bool Logger::isLoggingToFile() const
 
 void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString &message)
 {
-    const QString msg = qFormatLogMessage(type, ctx, message) + QLatin1Char('\n');
-    {
-        QMutexLocker lock(&_mutex);
-        _crashLogIndex = (_crashLogIndex + 1) % crashLogSizeC;
-        _crashLog[_crashLogIndex] = msg;
-        if (_logstream) {
-            (*_logstream) << msg;
-            if (_doFileFlush)
-                _logstream->flush();
-        }
-#if defined(Q_OS_WIN)
-        if (isDebuggerPresent()) {
-            OutputDebugStringW(reinterpret_cast<const wchar_t *>(msg.utf16()));
-        }
-#endif
+    if (type == QtFatalMsg || !_writerRunning) {
+        // the messages before must be in the log and in the crash log
+        flush();
+        const QString msg = qFormatLogMessage(type, ctx, message) + QLatin1Char('\n');
+        // raised while the writer thread writes, it already holds _mutex
+        const bool onWriter = _writerRunning && std::this_thread::get_id() == _writer.get_id();
+        QMutexLocker lock(onWriter ? nullptr : &_mutex);
+        writeMessage(msg);
         if (type == QtFatalMsg) {
             dumpCrashLog();
             close();
@@ -119,21 +234,147 @@ void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString
             // Make application terminate in a way that can be caught by the crash reporter
             Utility::crash();
 #endif
+        } else if (_logstream && _doFileFlush) {
+            _logstream->flush();
         }
-        if (!_logDirectory.isEmpty()) {
-            if (_logFile.size() > maxLogSizeC) {
-                rotateLog();
-            }
+        return;
+    }
+
+    LogMessage msg;
+    msg.type = type;
+    if (hasCustomPattern()) {
+        msg.message = qFormatLogMessage(type, ctx, message);
+        msg.formatted = true;
+    } else {
+        msg.time = QDateTime::currentMSecsSinceEpoch();
+        msg.category = ctx.category;
+        if (type == QtDebugMsg) {
+            msg.function = ctx.function;
         }
+        msg.message = message;
+    }
+    if (!_queue->push(std::move(msg))) {
+        ++_droppedMessages;
+        return;
+    }
+    // pairs with the fence in runWriter(), either the writer sees the message or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_writerSleeping) {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        _writerWakeUp.notify_one();
     }
 }
 
+void Logger::writeMessage(const QString &msg)
+{
+    _crashLogIndex = (_crashLogIndex + 1) % crashLogSizeC;
+    _crashLog[_crashLogIndex] = msg;
+    if (_logstream) {
+        (*_logstream) << msg;
+    }
+#if defined(Q_OS_WIN)
+    if (isDebuggerPresent()) {
+        OutputDebugStringW(reinterpret_cast<const wchar_t *>(msg.utf16()));
+    }
+#endif
+}
+
+void Logger::writeQueuedMessages()
+{
+    LogMessage msg;
+    bool written = false;
+    while (_queue->pop(msg)) {
+        writeMessage(msg.format() + QLatin1Char('\n'));
+        ++_writtenMessages;
+        written = true;
+    }
+
+    const quint64 dropped = _droppedMessages;
+    if (dropped != _reportedDrops) {
+        LogMessage report;
+        report.type = QtWarningMsg;
+        report.time = QDateTime::currentMSecsSinceEpoch();
+        report.category = QByteArrayLiteral("sync.logger");
+        report.message = QStringLiteral("Dropped %1 log messages, the log queue was full").arg(dropped - _reportedDrops);
+        writeMessage(report.format() + QLatin1Char('\n'));
+        _reportedDrops = dropped;
+        written = true;
+    }
+
+    if (written && _logstream) {
+        if (_doFileFlush) {
+            _logstream->flush();
+        }
+        if (!_logDirectory.isEmpty() && _logFile.size() > maxLogSizeC) {
+            rotateLog();
+        }
+    }
+}
+
+void Logger::startWriter()
+{
+    _stopWriter = false;
+    _writerRunning = true;
+    _writer = std::thread([this] { runWriter(); });
+}
+
+void Logger::stopWriter()
+{
+    if (!_writerRunning) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_writerMutex);
+        _stopWriter = true;
+        _writerWakeUp.notify_one();
+    }
+    _writer.join();
+    _writerRunning = false;
+
+    // the messages that came in while the writer stopped
+    QMutexLocker lock(&_mutex);
+    writeQueuedMessages();
+}
+
+void Logger::runWriter()
+{
+    while (true) {
+        {
+            QMutexLocker lock(&_mutex);
+            writeQueuedMessages();
+        }
+
+        std::unique_lock<std::mutex> lock(_writerMutex);
+        _messagesWritten.notify_all();
+        if (_stopWriter) {
+            return;
+        }
+        _writerSleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_queue->isEmpty()) {
+            _writerWakeUp.wait_for(lock, 1s);
+        }
+        _writerSleeping = false;
+    }
+}
+
+void Logger::flush()
+{
+    if (!_writerRunning || std::this_thread::get_id() == _writer.get_id()) {
+        return;
+    }
+    const quint64 pushed = _queue->pushed();
+    std::unique_lock<std::mutex> lock(_writerMutex);
+    _writerWakeUp.notify_one();
+    _messagesWritten.wait(lock, [&] { return _writtenMessages >= pushed || !_writerRunning; });
+}
+
 void Logger::open(const QString &name)
 {
     bool openSucceeded = false;
     if (name == QLatin1Char('-')) {
         attacheToConsole();
-        setLogFlush(true);
+        _doFileFlush = true;
         openSucceeded = _logFile.open(stdout, QIODevice::WriteOnly);
     } else {
         _logFile.setFileName(name);
@@ -176,17 +417,21 @@ void Logger::setLogFile(const QString &name)
 
 void Logger::setMaxLogFiles(int i)
 {
-    _maxLogFiles = std::max(i, std::max(ConfigFile().automaticDeleteOldLogs(), minLogsToKeepC));
+    const int maxLogFiles = std::max(i, std::max(ConfigFile().automaticDeleteOldLogs(), minLogsToKeepC));
+    QMutexLocker locker(&_mutex);
+    _maxLogFiles = maxLogFiles;
 }
 
 void Logger::setLogDir(const QString &dir)
 {
+    QMutexLocker locker(&_mutex);
     _logDirectory = dir;
     rotateLog();
 }
 
 void Logger::setLogFlush(bool flush)
 {
+    QMutexLocker locker(&_mutex);
     _doFileFlush = flush;
 }
 
@@ -23,12 +23,26 @@
 #include <QSet>
 #include <QTextStream>
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "owncloudlib.h"
 
 namespace OCC {
 
+class LogQueue;
+
 /**
  * @brief The Logger class
+ *
+ * doLog() only puts the message into a bounded lock-free queue, the formatting,
+ * the writing, the rotation of the log file and the crash log are done by a
+ * writer thread. If the queue is full the message is dropped, the writer
+ * reports the number of dropped messages in the log.
+ *
  * @ingroup libsync
  */
 class OWNCLOUDSYNC_EXPORT Logger : public QObject
@@ -82,6 +96,12 @@ public:
     }
     void setLogRules(const QSet<QString> &rules);
 
+    /** Blocks until the messages that were logged before are written */
+    void flush();
+
+    /** The number of messages that were dropped because the queue was full */
+    quint64 droppedMessages() const { return _droppedMessages; }
+
 private:
     Logger(QObject *parent = nullptr);
     ~Logger() override;
@@ -92,6 +112,13 @@ private:
     void close();
     void dumpCrashLog();
 
+    void startWriter();
+    void stopWriter();
+    void runWriter();
+    // these require _mutex
+    void writeMessage(const QString &msg);
+    void writeQueuedMessages();
+
     QFile _logFile;
     bool _doFileFlush = false;
     bool _logDebug = false;
@@ -105,6 +132,19 @@ private:
     bool _consoleIsAttached = false;
 
     int _maxLogFiles;
+
+    std::unique_ptr<LogQueue> _queue;
+    std::thread _writer;
+    std::atomic<bool> _writerRunning = false;
+    std::atomic<bool> _writerSleeping = false;
+    std::atomic<bool> _stopWriter = false;
+    std::atomic<quint64> _droppedMessages = 0;
+    std::atomic<quint64> _writtenMessages = 0;
+    quint64 _reportedDrops = 0;
+    // wakes the writer and the threads waiting in flush()
+    std::mutex _writerMutex;
+    std::condition_variable _writerWakeUp;
+    std::condition_variable _messagesWritten;
 };
 
 } // namespace OCC
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "metrics.h"
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+#include <QRegularExpression>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace {
+// a scrape is a single GET, anything larger is not a scrape
+constexpr int maxRequestSizeC = 8 * 1024;
+
+QByteArray formatLabels(const OCC::Metrics::Labels &labels)
+{
+    QByteArray out;
+    for (const auto &[name, value] : labels) {
+        if (!out.isEmpty()) {
+            out += ',';
+        }
+        QByteArray escaped = value.toUtf8();
+        escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+        out += name + "=\"" + escaped + '"';
+    }
+    return out;
+}
+
+QByteArray series(const QByteArray &name, const QByteArray &labels, const QByteArray &extraLabel = {})
+{
+    if (labels.isEmpty() && extraLabel.isEmpty()) {
+        return name;
+    }
+    if (labels.isEmpty() || extraLabel.isEmpty()) {
+        return name + '{' + labels + extraLabel + '}';
+    }
+    return name + '{' + labels + ',' + extraLabel + '}';
+}
+
+QByteArray number(double value)
+{
+    return QByteArray::number(value, 'g', 15);
+}
+}
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcMetrics, "sync.metrics", QtInfoMsg)
+
+std::atomic<bool> Metrics::_enabled = qEnvironmentVariableIsSet("OWNCLOUD_METRICS_ADDRESS");
+
+Metrics::Histogram::Histogram(const std::vector<double> &buckets)
+    : _buckets(buckets)
+    , _counts(new std::atomic<quint64>[buckets.size() + 1])
+{
+    for (size_t i = 0; i <= _buckets.size(); ++i) {
+        _counts[i] = 0;
+    }
+}
+
+void Metrics::Histogram::observe(double value)
+{
+    const auto bucket = std::lower_bound(_buckets.cbegin(), _buckets.cend(), value) - _buckets.cbegin();
+    _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    double sum = _sum.load(std::memory_order_relaxed);
+    while (!_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) { }
+}
+
+std::vector<quint64> Metrics::Histogram::counts() const
+{
+    std::vector<quint64> out(_buckets.size() + 1);
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = _counts[i].load(std::memory_order_relaxed);
+    }
+    return out;
+}
+
+const std::vector<double> &Metrics::durationBuckets()
+{
+    static const std::vector<double> buckets = { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300, 600 };
+    return buckets;
+}
+
+Metrics *Metrics::instance()
+{
+    static Metrics *instance = [] {
+        auto *metrics = new Metrics;
+        const QString address = qEnvironmentVariable("OWNCLOUD_METRICS_ADDRESS");
+        if (!address.isEmpty() && QCoreApplication::instance()) {
+            // the server belongs to the thread of the event loop
+            QTimer::singleShot(0, QCoreApplication::instance(), [metrics, address] { metrics->listen(address); });
+        }
+        return metrics;
+    }();
+    return instance;
+}
+
+void Metrics::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+Metrics::Family &Metrics::family(const QByteArray &name, const QByteArray &help, Type type)
+{
+    auto it = _families.find(name);
+    if (it == _families.end()) {
+        it = _families.emplace(name, Family{ type, help, {}, {}, {} }).first;
+    }
+    Q_ASSERT(it->second.type == type);
+    return it->second;
+}
+
+Metrics::Counter *Metrics::counter(const QByteArray &name, const QByteArray &help, const Labels &labels)
+{
+    QMutexLocker lock(&_mutex);
+    auto &counter = family(name, help, Type::Counter).counters[formatLabels(labels)];
+    if (!counter) {
+        counter.reset(new Counter);
+    }
+    return counter.get();
+}
+
+Metrics::Histogram *Metrics::histogram(const QByteArray &name, const QByteArray &help, const std::vector<double> &buckets, const Labels &labels)
+{
+    QMutexLocker lock(&_mutex);
+    auto &histogram = family(name, help, Type::Histogram).histograms[formatLabels(labels)];
+    if (!histogram) {
+        histogram.reset(new Histogram(buckets));
+    }
+    return histogram.get();
+}
+
+void Metrics::addGauge(QObject *context, const QByteArray &name, const QByteArray &help, const Labels &labels, std::function<double()> &&value)
+{
+    {
+        QMutexLocker lock(&_mutex);
+        family(name, help, Type::Gauge).gauges.emplace(formatLabels(labels), Gauge{ context, std::move(value) });
+    }
+    QObject::connect(context, &QObject::destroyed, [this, context] { removeGauges(context); });
+}
+
+void Metrics::removeGauges(QObject *context)
+{
+    QMutexLocker lock(&_mutex);
+    for (auto &[name, family] : _families) {
+        for (auto it = family.gauges.begin(); it != family.gauges.end();) {
+            if (it->second.context == context) {
+                it = family.gauges.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+QByteArray Metrics::exposition()
+{
+    QMutexLocker lock(&_mutex);
+    QByteArray out;
+    for (const auto &[name, family] : _families) {
+        if (family.counters.empty() && family.histograms.empty() && family.gauges.empty()) {
+            continue;
+        }
+        out += "# HELP " + name + ' ' + family.help + '\n';
+        switch (family.type) {
+        case Type::Counter:
+            out += "# TYPE " + name + " counter\n";
+            for (const auto &[labels, counter] : family.counters) {
+                out += series(name, labels) + ' ' + QByteArray::number(counter->value()) + '\n';
+            }
+            break;
+        case Type::Gauge:
+            out += "# TYPE " + name + " gauge\n";
+            for (const auto &[labels, gauge] : family.gauges) {
+                out += series(name, labels) + ' ' + number(gauge.value()) + '\n';
+            }
+            break;
+        case Type::Histogram:
+            out += "# TYPE " + name + " histogram\n";
+            for (const auto &[labels, histogram] : family.histograms) {
+                const auto counts = histogram->counts();
+                quint64 cumulative = 0;
+                for (size_t i = 0; i < counts.size(); ++i) {
+                    cumulative += counts[i];
+                    const QByteArray le = i < histogram->buckets().size() ? number(histogram->buckets()[i]) : QByteArrayLiteral("+Inf");
+                    out += series(name + "_bucket", labels, "le=\"" + le + '"') + ' ' + QByteArray::number(cumulative) + '\n';
+                }
+                out += series(name + "_sum", labels) + ' ' + number(histogram->sum()) + '\n';
+                out += series(name + "_count", labels) + ' ' + QByteArray::number(cumulative) + '\n';
+            }
+            break;
+        }
+    }
+    return out;
+}
+
+bool Metrics::listen(const QString &address)
+{
+    delete _server;
+    _server = nullptr;
+
+    static const QRegularExpression hostPort(QStringLiteral("^(.*):(\\d+)$"));
+    const auto match = hostPort.match(address);
+    if (match.hasMatch()) {
+        QString host = match.captured(1);
+        if (host.startsWith(QLatin1Char('[')) && host.endsWith(QLatin1Char(']'))) {
+            host = host.mid(1, host.size() - 2);
+        }
+        QHostAddress hostAddress(host);
+        if (host.isEmpty() || host == QLatin1String("localhost")) {
+            hostAddress = QHostAddress::LocalHost;
+        } else if (hostAddress.isNull()) {
+            qCWarning(lcMetrics) << "Invalid metrics address" << address;
+            return false;
+        } else if (!hostAddress.isLoopback()) {
+            // the metrics contain paths and account names, they are not served to the network
+            qCWarning(lcMetrics) << "The metrics are only served on a loopback address, not on" << address;
+            return false;
+        }
+        auto *server = new QTcpServer(QCoreApplication::instance());
+        if (!server->listen(hostAddress, match.captured(2).toUShort())) {
+            qCWarning(lcMetrics) << "Failed to listen on" << address << server->errorString();
+            delete server;
+            return false;
+        }
+        QObject::connect(server, &QTcpServer::newConnection, server, [this, server] {
+            while (auto *socket = server->nextPendingConnection()) {
+                serve(socket, [socket] { socket->disconnectFromHost(); });
+                QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+        _server = server;
+    } else {
+        auto *server = new QLocalServer(QCoreApplication::instance());
+        // a stale socket of a crashed instance
+        QLocalServer::removeServer(address);
+        // the metrics contain paths and account names, other users of a terminal server must not read them
+        server->setSocketOptions(QLocalServer::UserAccessOption);
+        if (!server->listen(address)) {
+            qCWarning(lcMetrics) << "Failed to listen on" << address << server->errorString();
+            delete server;
+            return false;
+        }
+        QObject::connect(server, &QLocalServer::newConnection, server, [this, server] {
+            while (auto *socket = server->nextPendingConnection()) {
+                serve(socket, [socket] { socket->disconnectFromServer(); });
+                QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+        _server = server;
+    }
+    qCInfo(lcMetrics) << "Serving the metrics on" << address;
+    setEnabled(true);
+    return true;
+}
+
+void Metrics::serve(QIODevice *socket, const std::function<void()> &close)
+{
+    auto request = std::make_shared<QByteArray>();
+    QObject::connect(socket, &QIODevice::readyRead, socket, [this, socket, close, request] {
+        const auto respond = [socket, &close](const QByteArray &response) {
+            // ignore anything the client sends after the request
+            QObject::disconnect(socket, &QIODevice::readyRead, nullptr, nullptr);
+            socket->write(response);
+            close();
+        };
+        *request += socket->readAll();
+        if (request->size() > maxRequestSizeC) {
+            respond("HTTP/1.1 413 Payload Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
+        if (!request->contains("\r\n\r\n")) {
+            return;
+        }
+        const auto requestLine = request->left(request->indexOf("\r\n")).split(' ');
+        if (requestLine.size() != 3 || requestLine[0] != "GET" || (requestLine[1] != "/metrics" && requestLine[1] != "/")) {
+            respond("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            return;
+        }
+        const QByteArray body = exposition();
+        respond("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: " + QByteArray::number(body.size())
+            + "\r\nConnection: close\r\n\r\n" + body);
+    });
+}
+
+}
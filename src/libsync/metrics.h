@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class QIODevice;
+
+namespace OCC {
+
+/**
+ * @brief Counters, histograms and gauges in the Prometheus text format
+ *
+ * The sync engine, the propagator, the accounts and the bandwidth manager feed
+ * the metrics, listen() publishes them on a local socket to be scraped with
+ * GET /metrics.
+ *
+ * Counters and histograms are atomics that are only updated while isEnabled(),
+ * gauges are callbacks that are only evaluated when the metrics are scraped.
+ * The metrics are enabled by listen(), which is called with the address in
+ * OWNCLOUD_METRICS_ADDRESS, or with setEnabled().
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT Metrics
+{
+public:
+    /// The names and the values of the labels of a series
+    using Labels = std::vector<std::pair<QByteArray, QString>>;
+
+    class OWNCLOUDSYNC_EXPORT Counter
+    {
+    public:
+        void increment(qint64 n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+        qint64 value() const { return _value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<qint64> _value = 0;
+    };
+
+    class OWNCLOUDSYNC_EXPORT Histogram
+    {
+    public:
+        /// The buckets are the inclusive upper bounds, the +Inf bucket is added implicitly
+        explicit Histogram(const std::vector<double> &buckets);
+
+        void observe(double value);
+
+        const std::vector<double> &buckets() const { return _buckets; }
+        /// The number of observations in each bucket, not cumulative, the last one is +Inf
+        std::vector<quint64> counts() const;
+        double sum() const { return _sum.load(std::memory_order_relaxed); }
+
+    private:
+        const std::vector<double> _buckets;
+        std::unique_ptr<std::atomic<quint64>[]> _counts;
+        std::atomic<double> _sum = 0;
+    };
+
+    /// Durations from 10 ms to 10 min in seconds
+    static const std::vector<double> &durationBuckets();
+
+    static Metrics *instance();
+
+    static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+
+    /// The counter is created on the first call and stays valid, so it can be cached
+    Counter *counter(const QByteArray &name, const QByteArray &help, const Labels &labels = {});
+    Histogram *histogram(const QByteArray &name, const QByteArray &help, const std::vector<double> &buckets, const Labels &labels = {});
+
+    /**
+     * Adds a gauge that is evaluated with the metrics in the thread of the
+     * server, it is removed when the context is destroyed. The value must not
+     * call into Metrics.
+     */
+    void addGauge(QObject *context, const QByteArray &name, const QByteArray &help, const Labels &labels, std::function<double()> &&value);
+
+    /// All metrics in the Prometheus text exposition format, version 0.0.4
+    QByteArray exposition();
+
+    /**
+     * Serves the metrics over http.
+     *
+     * The address is either host:port with a loopback host, :port for localhost,
+     * or the path of a local socket, see QLocalServer. Must be called from a
+     * thread with an event loop. Returns false if the address is invalid, not
+     * a loopback address or in use.
+     *
+     * Only the user can connect to the local socket. The loopback port is open
+     * to every user of the machine, prefer the local socket on machines that
+     * are shared, like terminal servers.
+     */
+    bool listen(const QString &address);
+
+private:
+    Metrics() = default;
+
+    enum class Type {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    struct Gauge
+    {
+        QObject *context;
+        std::function<double()> value;
+    };
+
+    struct Family
+    {
+        Type type;
+        QByteArray help;
+        // the series by their formatted labels
+        std::map<QByteArray, std::unique_ptr<Counter>> counters;
+        std::map<QByteArray, std::unique_ptr<Histogram>> histograms;
+        std::multimap<QByteArray, Gauge> gauges;
+    };
+
+    Family &family(const QByteArray &name, const QByteArray &help, Type type);
+    void removeGauges(QObject *context);
+    void serve(QIODevice *socket, const std::function<void()> &close);
+
+    QMutex _mutex;
+    std::map<QByteArray, Family> _families;
+    QObject *_server = nullptr;
+
+    static std::atomic<bool> _enabled;
+};
+
+}
@@ -242,6 +242,8 @@ PropfindJob::PropfindJob(AccountPtr account, const QUrl &url, const QString &pat
     // and really want this to be done first (no matter what internal scheduling QNAM uses).
     // Also possibly useful for avoiding false timeouts.
     setPriority(QNetworkRequest::HighPriority);
+    // the etag and the folder listings are requested from several places
+    setCoalescingEnabled(true);
 }
 
 void PropfindJob::setProperties(const QList<QByteArray> &properties)
@@ -347,6 +349,7 @@ AvatarJob::AvatarJob(AccountPtr account, const QString &userId, int size, QObjec
     : AbstractNetworkJob(account, account->url(), QStringLiteral("remote.php/dav/avatars/%1/%2.png").arg(userId, QString::number(size)), parent)
 {
     setStoreInCache(true);
+    setCoalescingEnabled(true);
 }
 
 void AvatarJob::start()
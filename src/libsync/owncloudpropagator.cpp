@@ -21,7 +21,10 @@
 #include "common/utility.h"
 #include "discoveryphase.h"
 #include "filesystem.h"
+#include "metrics.h"
+#include "progressdispatcher.h"
 #include "propagatedownload.h"
+#include "propagateplaceholders.h"
 #include "propagateremotedelete.h"
 #include "propagateremotemkdir.h"
 #include "propagateremotemove.h"
@@ -44,6 +47,8 @@
 #include <QTimerEvent>
 #include <qmath.h>
 
+#include <algorithm>
+
 using namespace std::chrono_literals;
 
 namespace OCC {
@@ -51,6 +56,13 @@ namespace OCC {
 Q_LOGGING_CATEGORY(lcPropagator, "sync.propagator", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcDirectory, "sync.propagator.directory", QtInfoMsg)
 
+namespace {
+    QString parentPath(const QString &path)
+    {
+        return path.left(std::max(path.lastIndexOf(QLatin1Char('/')), 0));
+    }
+}
+
 qint64 criticalFreeSpaceLimit()
 {
     qint64 value = 50 * 1000 * 1000LL;
@@ -84,11 +96,10 @@ OwncloudPropagator::~OwncloudPropagator()
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_bandwidthManager || !_syncOptions._parallelNetworkJobs) {
-        // disable parallelism when there is a network limit.
+    if (!_syncOptions._parallelNetworkJobs) {
         return 1;
     }
-    return qMin(3, qCeil(_syncOptions._parallelNetworkJobs / 2.));
+    return qBound(1, _syncOptions._parallelTransferJobs, qCeil(_syncOptions._parallelNetworkJobs / 2.));
 }
 
 /* The maximum number of active jobs in parallel  */
@@ -107,6 +118,17 @@ PropagateItemJob::~PropagateItemJob()
         // we might risk end up with dangling pointer in the list which may cause crashes.
         p->_activeJobList.removeAll(this);
     }
+    releaseBulkSlot();
+}
+
+void PropagateItemJob::releaseBulkSlot()
+{
+    if (_countedAsBulk) {
+        _countedAsBulk = false;
+        if (auto p = propagator()) {
+            p->_runningBulkJobs--;
+        }
+    }
 }
 
 bool PropagateItemJob::scheduleSelfOrChild()
@@ -117,6 +139,15 @@ bool PropagateItemJob::scheduleSelfOrChild()
     qCInfo(lcPropagator) << "Starting" << _item->_instruction << "propagation of" << _item->destination() << "by" << this;
 
     _state = Running;
+    if (SyncProfiler::isEnabled()) {
+        const char *name = metaObject()->className();
+        _profileTimer = SyncProfiler::Timer("propagator", QByteArray::fromRawData(name, qstrlen(name)));
+    }
+    if (propagator()->syncOptions()._http2 && isBulkTransfer()) {
+        // counted from the start, uploads only become active after computing the checksums
+        _countedAsBulk = true;
+        propagator()->_runningBulkJobs++;
+    }
     if (thread() != QApplication::instance()->thread()) {
         QMetaObject::invokeMethod(this, &PropagateItemJob::start); // We could be in a different thread (neon jobs)
     } else {
@@ -230,6 +261,8 @@ void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &error
     // Duplicate calls to done() are a logic error
     OC_ENFORCE(_state != Finished);
     _state = Finished;
+    releaseBulkSlot();
+    _profileTimer.finish();
 
     _item->_status = statusArg;
 
@@ -284,6 +317,18 @@ void PropagateItemJob::done(SyncFileItem::Status statusArg, const QString &error
         Q_UNREACHABLE();
     }
 
+    if (Metrics::isEnabled()) {
+        auto *metrics = Metrics::instance();
+        metrics->counter("owncloud_propagated_items_total", "The items completed by the propagator",
+                   { { "job", QString::fromLatin1(metaObject()->className()) }, { "status", Utility::enumToString(_item->_status) } })
+            ->increment();
+        if (_item->_status == SyncFileItem::Success && ProgressInfo::isSizeDependent(*_item)) {
+            metrics->counter("owncloud_propagated_bytes_total", "The size of the files transferred by the propagator",
+                       { { "direction", Utility::enumToString(_item->_direction) } })
+                ->increment(_item->_size);
+        }
+    }
+
     if (_item->hasErrorStatus())
         qCWarning(lcPropagator) << "Could not complete propagation of" << _item->destination() << "by" << this << "with status" << _item->_status << "and error:" << _item->_errorString;
     else
@@ -400,7 +445,8 @@ void OwncloudPropagator::start(SyncFileItemSet &&items)
     // are grouped together, and that an action on the directory itself preceeds the actions for
     // its child items.
 
-    _rootJob.reset(new PropagateRootDirectory(this));
+    createRootJob();
+    auto &hydrations = _rootJob->hydrations();
 
     // The algorithm could be done recursively, but the implementation is done iteratively in order
     // to prevent us running out of stack space. So the next 3 variables are used to maintain the
@@ -433,6 +479,10 @@ void OwncloudPropagator::start(SyncFileItemSet &&items)
     // See the `else` statment in the second step.
     QString maybeConflictDirectory;
 
+    // The new virtual files of a directory are created in batches, the batch
+    // that still takes items for each directory.
+    QHash<PropagateDirectory *, PropagatePlaceholders *> placeholderJobs;
+
     for (const auto &item : qAsConst(items)) {
         // First check if this is an item in a directory which is going to be removed.
         if (currentRemoveDirectoryJob && FileSystem::isChildPathOf(item->_file, currentRemoveDirectoryJob->path())) {
@@ -492,6 +542,22 @@ void OwncloudPropagator::start(SyncFileItemSet &&items)
             directories.pop();
         }
 
+        // Hydrations don't wait for their directories, unless one of them changes
+        if (HydrationQueue::isHydration(*item)
+            && std::all_of(directories.cbegin(), directories.cend(), [](const auto &dir) {
+                   const auto instruction = dir.second->item()->_instruction;
+                   return instruction == CSYNC_INSTRUCTION_NONE || instruction == CSYNC_INSTRUCTION_UPDATE_METADATA;
+               })) {
+            hydrations.append(item);
+            continue;
+        }
+        _touchedDirectories.insert(parentPath(item->_file));
+        _touchedDirectories.insert(parentPath(item->destination()));
+        if (item->isDirectory() && item->_instruction != CSYNC_INSTRUCTION_NONE && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA) {
+            _changedDirectories.insert(item->_file);
+            _changedDirectories.insert(item->destination());
+        }
+
         // The last step is to add a subtask for the item. There are 4 cases covered here:
         // a type change vs. a removal, and a file vs. a directory.
         if (item->isDirectory()) {
@@ -539,6 +605,14 @@ void OwncloudPropagator::start(SyncFileItemSet &&items)
                 // will delete directories, so defer execution
                 currentRemoveDirectoryJob = createJob(item);
                 _rootJob->addDeleteJob(currentRemoveDirectoryJob);
+            } else if (PropagatePlaceholders::canPropagate(this, *item)) {
+                auto *dir = directories.top().second;
+                auto *&placeholders = placeholderJobs[dir];
+                if (!placeholders || placeholders->isFull()) {
+                    placeholders = new PropagatePlaceholders(this, dir->path());
+                    dir->appendJob(placeholders);
+                }
+                placeholders->append(item);
             } else {
                 directories.top().second->appendTask(item);
             }
@@ -557,16 +631,147 @@ void OwncloudPropagator::start(SyncFileItemSet &&items)
     scheduleNextJob();
 }
 
+void OwncloudPropagator::createRootJob()
+{
+    _rootJob.reset(new PropagateRootDirectory(this));
+    auto &hydrations = _rootJob->hydrations();
+    connect(&hydrations, &HydrationQueue::progressChanged, this, &OwncloudPropagator::hydrationProgress);
+    for (const auto &[path, priority] : Utility::asKeyValueRange(_hydrationRequests)) {
+        hydrations.addRequest(path, priority);
+    }
+    _hydrationRequests.clear();
+}
+
+void OwncloudPropagator::startAppending()
+{
+    createRootJob();
+    _rootJob->setOpen(true);
+    _openDirectories.insert(QString(), _rootJob.data());
+    _appending = true;
+
+    connect(_rootJob.data(), &PropagatorJob::finished, this, &OwncloudPropagator::emitFinished);
+
+    _jobScheduled = false;
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::append(SyncFileItemSet &&items)
+{
+    OC_ASSERT(_appending);
+
+    // The new virtual files of a directory are created in batches, see start()
+    QHash<PropagateDirectory *, PropagatePlaceholders *> placeholderJobs;
+
+    // Hydrations don't wait for their directories, unless one of them changes
+    const auto parentsUnchanged = [this](const QString &path) {
+        for (QString parent = parentPath(path); !parent.isEmpty(); parent = parentPath(parent)) {
+            auto *dir = _openDirectories.value(parent).data();
+            if (dir && dir->item()->_instruction != CSYNC_INSTRUCTION_NONE && dir->item()->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (const auto &item : qAsConst(items)) {
+        // The job of the nearest parent takes the item, unchanged directories have none.
+        // Nothing inside a skipped item is processed, like inside CONFLICT items in start().
+        PropagateDirectory *dir = nullptr;
+        for (QString path = parentPath(item->destination());; path = parentPath(path)) {
+            if (_skippedPaths.contains(path)) {
+                break;
+            }
+            if (auto it = _openDirectories.constFind(path); it != _openDirectories.cend()) {
+                dir = it->data();
+                break;
+            }
+            if (path.isEmpty()) {
+                break;
+            }
+        }
+        if (!dir || dir->_state == PropagatorJob::Finished) {
+            qCInfo(lcPropagator) << "Skipping job inside a skipped or failed directory" << item->_file << item->_instruction;
+            item->_instruction = CSYNC_INSTRUCTION_NONE;
+            continue;
+        }
+        if (item->_instruction == CSYNC_INSTRUCTION_REMOVE || item->_instruction == CSYNC_INSTRUCTION_RENAME
+            || item->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) {
+            // they depend on the items of other directories, whose jobs might have run already
+            qCInfo(lcPropagator) << "Leaving" << item->_file << item->_instruction << "for the next sync";
+            _skippedPaths.insert(item->_file);
+            _skippedPaths.insert(item->destination());
+            item->_instruction = CSYNC_INSTRUCTION_NONE;
+            _anotherSyncNeeded = true;
+            continue;
+        }
+        if (item->_instruction == CSYNC_INSTRUCTION_CONFLICT) {
+            // the conflict handling is likely to rename it
+            _skippedPaths.insert(item->_file);
+        }
+
+        if (HydrationQueue::isHydration(*item) && parentsUnchanged(item->destination())) {
+            _rootJob->hydrations().append(item);
+            continue;
+        }
+        _touchedDirectories.insert(parentPath(item->_file));
+        if (item->isDirectory() && item->_instruction != CSYNC_INSTRUCTION_NONE && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA) {
+            _changedDirectories.insert(item->_file);
+        }
+
+        if (item->isDirectory()) {
+            auto *subDir = new PropagateDirectory(this, item);
+            subDir->setOpen(true);
+            dir->appendJob(subDir);
+            _openDirectories.insert(item->destination(), subDir);
+        } else if (PropagatePlaceholders::canPropagate(this, *item)) {
+            auto *&placeholders = placeholderJobs[dir];
+            if (!placeholders || placeholders->isFull()) {
+                placeholders = new PropagatePlaceholders(this, dir->path());
+                dir->appendJob(placeholders);
+            }
+            placeholders->append(item);
+        } else {
+            dir->appendTask(item);
+        }
+    }
+    scheduleNextJob();
+}
+
+void OwncloudPropagator::closeDirectory(const QString &path)
+{
+    if (auto dir = _openDirectories.take(path)) {
+        dir->setOpen(false);
+    }
+}
+
+void OwncloudPropagator::finishAppending()
+{
+    _appending = false;
+    // the discovery reported all the directories, unless it was aborted
+    for (const auto &dir : qAsConst(_openDirectories)) {
+        if (dir) {
+            dir->setOpen(false);
+        }
+    }
+    _openDirectories.clear();
+    _skippedPaths.clear();
+}
+
 const SyncOptions &OwncloudPropagator::syncOptions() const
 {
     return _syncOptions;
 }
 
 Result<QString, bool> OwncloudPropagator::localFileNameClash(const QString &relFile)
+{
+    return localFileNameClash(_localDir, relFile);
+}
+
+Result<QString, bool> OwncloudPropagator::localFileNameClash(const QString &localDir, const QString &relFile)
 {
     OC_ASSERT(!relFile.isEmpty());
     if (!relFile.isEmpty() && Utility::fsCasePreserving()) {
-        const QFileInfo fileInfo(_localDir + relFile);
+        const QFileInfo fileInfo(localDir + relFile);
         qCDebug(lcPropagator) << "CaseClashCheck for " << fileInfo.filePath();
 #ifdef Q_OS_MAC
         if (!fileInfo.exists()) {
@@ -663,6 +868,28 @@ void OwncloudPropagator::scheduleNextJobImpl()
 
     _jobScheduled = false;
 
+    if (_appending && _activeJobList.isEmpty()) {
+        // nothing runs, the remaining jobs might wait for items that are not appended yet
+        if (_rootJob->scheduleSelfOrChild()) {
+            scheduleNextJob();
+        } else {
+            emit waitingForItems();
+        }
+        return;
+    }
+
+    if (_syncOptions._http2) {
+        // All requests share one connection: only limit the jobs that are transferring a lot of data,
+        // the small ones are cheap and would otherwise wait behind them. The composite jobs skip the
+        // bulk transfers while isBulkTransferLimitReached().
+        if (_activeJobList.count() < hardMaximumActiveJob()) {
+            if (_rootJob->scheduleSelfOrChild()) {
+                scheduleNextJob();
+            }
+        }
+        return;
+    }
+
     if (_activeJobList.count() < maximumActiveTransferJob()) {
         if (_rootJob->scheduleSelfOrChild()) {
             scheduleNextJob();
@@ -795,7 +1022,7 @@ bool OwncloudPropagator::createConflict(const SyncFileItemPtr &item,
     // Create a new upload job if the new conflict file should be uploaded
     if (account()->capabilities().uploadConflictFiles()) {
         if (composite && !QFileInfo(conflictFilePath).isDir()) {
-            SyncFileItemPtr conflictItem = SyncFileItemPtr(new SyncFileItem);
+            auto conflictItem = SyncFileItemPtr::create();
             conflictItem->_file = conflictFileName;
             conflictItem->_type = ItemTypeFile;
             conflictItem->_direction = SyncFileItem::Up;
@@ -835,6 +1062,50 @@ Result<Vfs::ConvertToPlaceholderResult, QString> OwncloudPropagator::updatePlace
     return syncOptions()._vfs->updateMetadata(item, fileName, replacesFile);
 }
 
+void OwncloudPropagator::addHydrationRequest(const QString &path, HydrationQueue::Priority priority)
+{
+    if (_rootJob) {
+        _rootJob->hydrations().addRequest(path, priority);
+    } else {
+        _hydrationRequests.insert(path, priority);
+    }
+}
+
+void OwncloudPropagator::cancelHydrationRequest(const QString &path)
+{
+    if (_rootJob) {
+        _rootJob->hydrations().cancelRequest(path);
+    } else {
+        _hydrationRequests.remove(path);
+    }
+}
+
+bool OwncloudPropagator::hydrate(const SyncFileItemPtr &item)
+{
+    // while appending the jobs for the file or its parents might still come
+    if (!_rootJob || _abortRequested || _appending || !_rootJob->hydrations().isOpen()) {
+        return false;
+    }
+    auto &hydrations = _rootJob->hydrations();
+    if (hydrations.contains(item->_file)) {
+        return true;
+    }
+    // don't interfere with other jobs for the file or its parents
+    if (_touchedDirectories.contains(parentPath(item->_file))) {
+        return false;
+    }
+    for (QString path = parentPath(item->_file); !path.isEmpty(); path = parentPath(path)) {
+        if (_changedDirectories.contains(path)) {
+            return false;
+        }
+    }
+    qCInfo(lcPropagator) << "Adding the hydration of" << item->_file << "to the running sync";
+    emit newItem(item);
+    hydrations.append(item);
+    scheduleNextJob();
+    return true;
+}
+
 Result<Vfs::ConvertToPlaceholderResult, QString> OwncloudPropagator::updateMetadata(const SyncFileItem &item)
 {
     const QString fsPath = fullLocalPath(item.destination());
@@ -898,6 +1169,15 @@ void PropagatorCompositeJob::appendJob(PropagatorJob *job)
     _jobsToDo.append(job);
 }
 
+void PropagatorCompositeJob::setOpen(bool open)
+{
+    _open = open;
+    if (!open) {
+        // finish if there is nothing left to do
+        propagator()->scheduleNextJob();
+    }
+}
+
 bool PropagatorCompositeJob::scheduleSelfOrChild()
 {
     if (_state == Finished) {
@@ -925,22 +1205,42 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
         }
     }
 
-    // Now it's our turn, check if we have something left to do.
-    // First, convert a task to a job if necessary
-    while (_jobsToDo.empty() && !_tasksToDo.empty()) {
-        const SyncFileItemPtr nextTask = *_tasksToDo.begin();
-        _tasksToDo.erase(_tasksToDo.begin());
-        PropagatorJob *job = propagator()->createJob(nextTask);
-        if (!job) {
-            qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
-            continue;
-        }
-        appendJob(job);
-        break;
+    // Now it's our turn, the transfers that were skipped before come first
+    if (!_deferredJobs.isEmpty() && !propagator()->isBulkTransferLimitReached()) {
+        PropagatorJob *nextJob = _deferredJobs.takeFirst();
+        _runningJobs.append(nextJob);
+        return possiblyRunNextJob(nextJob);
     }
-    // Then run the next job
-    if (!_jobsToDo.isEmpty()) {
+
+    // Check if we have something left to do.
+    while (true) {
+        // First, convert a task to a job if necessary
+        while (_jobsToDo.empty() && !_tasksToDo.empty()) {
+            const SyncFileItemPtr nextTask = *_tasksToDo.begin();
+            _tasksToDo.erase(_tasksToDo.begin());
+            PropagatorJob *job = propagator()->createJob(nextTask);
+            if (!job) {
+                qCWarning(lcDirectory) << "Useless task found for file" << nextTask->destination() << "instruction" << nextTask->_instruction;
+                continue;
+            }
+            appendJob(job);
+            break;
+        }
+        if (_jobsToDo.isEmpty()) {
+            break;
+        }
         PropagatorJob *nextJob = _jobsToDo.first();
+        if (nextJob->isBulkTransfer() && propagator()->isBulkTransferLimitReached()) {
+            // the cheaper jobs behind it run in the meantime
+            _jobsToDo.remove(0);
+            _deferredJobs.append(nextJob);
+            continue;
+        }
+        if (!_deferredJobs.isEmpty() && nextJob->parallelism() != FullParallelism) {
+            // it must not overtake the deferred transfers
+            break;
+        }
+        // Then run the next job
         _jobsToDo.remove(0);
         _runningJobs.append(nextJob);
         return possiblyRunNextJob(nextJob);
@@ -948,7 +1248,7 @@ bool PropagatorCompositeJob::scheduleSelfOrChild()
 
     // If neither us or our children had stuff left to do we could hang. Make sure
     // we mark this job as finished so that the propagator can schedule a new one.
-    if (_jobsToDo.isEmpty() && _tasksToDo.empty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _deferredJobs.isEmpty() && _tasksToDo.empty() && _runningJobs.isEmpty() && !_open) {
         // Our parent jobs are already iterating over their running jobs, post to the event loop
         // to avoid removing ourself from that list while they iterate.
         QMetaObject::invokeMethod(this, &PropagatorCompositeJob::finalize, Qt::QueuedConnection);
@@ -983,7 +1283,7 @@ void PropagatorCompositeJob::slotSubJobFinished(SyncFileItem::Status status)
         break;
     }
 
-    if (_jobsToDo.isEmpty() && _tasksToDo.empty() && _runningJobs.isEmpty()) {
+    if (_jobsToDo.isEmpty() && _deferredJobs.isEmpty() && _tasksToDo.empty() && _runningJobs.isEmpty() && !_open) {
         finalize();
     } else {
         propagator()->scheduleNextJob();
@@ -1150,11 +1450,12 @@ void PropagateDirectory::slotSubJobsFinished(const SyncFileItem::Status status)
 }
 
 PropagateRootDirectory::PropagateRootDirectory(OwncloudPropagator *propagator)
-    : PropagateDirectory(propagator, SyncFileItemPtr([] {
-        auto f = new SyncFileItem;
+    : PropagateDirectory(propagator, [] {
+        auto f = SyncFileItemPtr::create();
         f->_file = QLatin1Char('/');
         return f;
-    }()))
+    }())
+    , _hydrations(propagator)
     , _dirDeletionJobs(propagator, path())
 {
     connect(&_dirDeletionJobs, &PropagatorJob::finished, this, &PropagateRootDirectory::slotDirDeletionJobsFinished);
@@ -1176,29 +1477,38 @@ void PropagateRootDirectory::abort(PropagatorJob::AbortType abortType)
 
     if (abortType == AbortType::Asynchronous) {
         struct AbortsFinished {
+            bool hydrationsFinished = false;
             bool subJobsFinished = false;
             bool dirDeletionFinished = false;
+
+            bool all() const { return hydrationsFinished && subJobsFinished && dirDeletionFinished; }
         };
         auto abortStatus = QSharedPointer<AbortsFinished>(new AbortsFinished);
 
+        connect(&_hydrations, &HydrationQueue::abortFinished, this, [this, abortStatus]() {
+            abortStatus->hydrationsFinished = true;
+            if (abortStatus->all())
+                emit abortFinished();
+        });
         connect(&_subJobs, &PropagatorCompositeJob::abortFinished, this, [this, abortStatus]() {
             abortStatus->subJobsFinished = true;
-            if (abortStatus->subJobsFinished && abortStatus->dirDeletionFinished)
+            if (abortStatus->all())
                 emit abortFinished();
         });
         connect(&_dirDeletionJobs, &PropagatorCompositeJob::abortFinished, this, [this, abortStatus]() {
             abortStatus->dirDeletionFinished = true;
-            if (abortStatus->subJobsFinished && abortStatus->dirDeletionFinished)
+            if (abortStatus->all())
                 emit abortFinished();
         });
     }
+    _hydrations.abort(abortType);
     _subJobs.abort(abortType);
     _dirDeletionJobs.abort(abortType);
 }
 
 qint64 PropagateRootDirectory::committedDiskSpace() const
 {
-    return _subJobs.committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
+    return _hydrations.committedDiskSpace() + _subJobs.committedDiskSpace() + _dirDeletionJobs.committedDiskSpace();
 }
 
 bool PropagateRootDirectory::scheduleSelfOrChild()
@@ -1207,14 +1517,20 @@ bool PropagateRootDirectory::scheduleSelfOrChild()
         return false;
     }
 
+    // the hydrations the user waits for go first
+    if (_hydrations.scheduleSelfOrChild()) {
+        return true;
+    }
+
     if (PropagateDirectory::scheduleSelfOrChild()) {
         return true;
     }
 
-    // Important: Finish _subJobs before scheduling any deletes.
-    if (_subJobs._state != Finished) {
+    // Important: Finish the hydrations and _subJobs before scheduling any deletes.
+    if (_subJobs._state != Finished || !_hydrations.isIdle()) {
         return false;
     }
+    _hydrations.close();
 
     return _dirDeletionJobs.scheduleSelfOrChild();
 }
@@ -1258,6 +1574,9 @@ void PropagateRootDirectory::slotSubJobsFinished(SyncFileItem::Status status)
 void PropagateRootDirectory::slotDirDeletionJobsFinished(SyncFileItem::Status status)
 {
     _state = Finished;
+    if (_status == SyncFileItem::NoStatus) {
+        _status = _hydrations.errorStatus();
+    }
     emit finished(_status != SyncFileItem::NoStatus ? _status : status);
 }
 
@@ -1268,6 +1587,202 @@ void PropagateRootDirectory::addDeleteJob(PropagatorJob *job)
 
 // ================================================================================
 
+HydrationQueue::HydrationQueue(OwncloudPropagator *propagator)
+    : PropagatorJob(propagator, QString())
+{
+}
+
+bool HydrationQueue::isHydration(const SyncFileItem &item)
+{
+    return item._type == ItemTypeVirtualFileDownload && item._direction == SyncFileItem::Down
+        && (item._instruction == CSYNC_INSTRUCTION_SYNC || item._instruction == CSYNC_INSTRUCTION_NEW);
+}
+
+QString HydrationQueue::requestFor(const QString &path) const
+{
+    for (QString candidate = path; !candidate.isEmpty();) {
+        if (_requests.contains(candidate)) {
+            return candidate;
+        }
+        candidate.truncate(std::max(candidate.lastIndexOf(QLatin1Char('/')), 0));
+    }
+    // the request for the whole folder
+    const QString root = QStringLiteral("/");
+    return _requests.contains(root) ? root : QString();
+}
+
+void HydrationQueue::addProgress(const QString &request, const SyncFileItem &item, int files, int completedFiles)
+{
+    if (!_requests.contains(request)) {
+        return;
+    }
+    auto &progress = _progress[request];
+    progress.files += files;
+    progress.size += files * item._size;
+    progress.completedFiles += completedFiles;
+    progress.completedSize += completedFiles * item._size;
+    emit progressChanged(request, progress);
+}
+
+void HydrationQueue::addRequest(const QString &path, Priority priority)
+{
+    const QString request = path.isEmpty() ? QStringLiteral("/") : path;
+    qCInfo(lcPropagator) << "Hydration request for" << request << priority;
+    _requests[request] = priority;
+
+    // requeue the hydrations that now belong to the request
+    std::vector<Entry> moved;
+    for (auto it = _queue.begin(); it != _queue.end();) {
+        if (requestFor(it->second.item->_file) == it->second.request && it->first.first == _requests.value(it->second.request, Priority::Pinned)) {
+            ++it;
+            continue;
+        }
+        moved.push_back(std::move(it->second));
+        it = _queue.erase(it);
+    }
+    for (auto &entry : moved) {
+        const QString newRequest = requestFor(entry.item->_file);
+        if (newRequest != entry.request) {
+            addProgress(entry.request, *entry.item, -1, 0);
+            addProgress(newRequest, *entry.item, 1, 0);
+            entry.request = newRequest;
+        }
+        _queue.emplace(nextKey(newRequest), std::move(entry));
+    }
+}
+
+int HydrationQueue::cancelRequest(const QString &path)
+{
+    const QString request = path.isEmpty() ? QStringLiteral("/") : path;
+    if (!_requests.remove(request)) {
+        return 0;
+    }
+    _progress.remove(request);
+
+    std::vector<SyncFileItemPtr> dropped;
+    for (auto it = _queue.begin(); it != _queue.end();) {
+        if (it->second.request == request) {
+            dropped.push_back(it->second.item);
+            it = _queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    qCInfo(lcPropagator) << "Canceled the hydration request for" << request << "dropped" << dropped.size() << "queued items";
+    for (const auto &item : dropped) {
+        // complete the item like a job would, without doing anything
+        QScopedPointer<PropagateItemJob> job(propagator()->createJob(item));
+        item->_instruction = CSYNC_INSTRUCTION_NONE;
+        job->_state = Running;
+        job->done(SyncFileItem::NoStatus, tr("The download was canceled"));
+    }
+    if (!dropped.empty()) {
+        propagator()->scheduleNextJob();
+    }
+    return static_cast<int>(dropped.size());
+}
+
+Optional<HydrationQueue::Progress> HydrationQueue::progress(const QString &request) const
+{
+    const auto it = _progress.find(request.isEmpty() ? QStringLiteral("/") : request);
+    if (it == _progress.cend()) {
+        return {};
+    }
+    return *it;
+}
+
+void HydrationQueue::append(const SyncFileItemPtr &item)
+{
+    const QString request = requestFor(item->_file);
+    addProgress(request, *item, 1, 0);
+    _queue.emplace(nextKey(request), Entry { item, request });
+}
+
+bool HydrationQueue::contains(const QString &path) const
+{
+    const auto matches = [&path](const Entry &entry) { return entry.item->_file == path; };
+    return std::any_of(_queue.cbegin(), _queue.cend(), [&](const auto &it) { return matches(it.second); })
+        || std::any_of(_running.cbegin(), _running.cend(), matches);
+}
+
+bool HydrationQueue::scheduleSelfOrChild()
+{
+    if (_state == NotYetStarted) {
+        _state = Running;
+    }
+    if (_queue.empty() || propagator()->_abortRequested) {
+        return false;
+    }
+    auto it = _queue.begin();
+    if (propagator()->isBulkTransferLimitReached()) {
+        // Only the files the user opened may exceed the limit of the bulk transfers, like in
+        // PropagatorCompositeJob the small hydrations behind the big ones still run. The queue
+        // is only searched a bit ahead, it is scheduled again whenever a job finishes.
+        constexpr int maxLookAhead = 64;
+        int lookedAt = 0;
+        while (it != _queue.end() && it->first.first != Priority::Opened && it->second.item->_size >= propagator()->smallFileSize()) {
+            if (++lookedAt == maxLookAhead) {
+                return false;
+            }
+            ++it;
+        }
+        if (it == _queue.end()) {
+            return false;
+        }
+    }
+    auto entry = std::move(it->second);
+    _queue.erase(it);
+    auto *job = propagator()->createJob(entry.item);
+    connect(job, &PropagatorJob::finished, this, &HydrationQueue::slotJobFinished);
+    _running.insert(job, std::move(entry));
+    return job->scheduleSelfOrChild();
+}
+
+void HydrationQueue::slotJobFinished(SyncFileItem::Status status)
+{
+    PropagatorJob *job = static_cast<PropagatorJob *>(sender());
+    job->deleteLater();
+    const auto entry = _running.take(job);
+    if (entry.item->hasErrorStatus()) {
+        _errorStatus = status;
+    }
+    addProgress(entry.request, *entry.item, 0, 1);
+    propagator()->scheduleNextJob();
+}
+
+void HydrationQueue::abort(PropagatorJob::AbortType abortType)
+{
+    if (_running.isEmpty()) {
+        if (abortType == AbortType::Asynchronous) {
+            emit abortFinished();
+        }
+        return;
+    }
+    _abortsCount = _running.size();
+    const auto jobs = _running.keys();
+    for (auto *job : jobs) {
+        if (abortType == AbortType::Asynchronous) {
+            connect(job, &PropagatorJob::abortFinished, this, [this] {
+                if (--_abortsCount == 0) {
+                    emit abortFinished();
+                }
+            });
+        }
+        job->abort(abortType);
+    }
+}
+
+qint64 HydrationQueue::committedDiskSpace() const
+{
+    qint64 needed = 0;
+    for (auto it = _running.cbegin(); it != _running.cend(); ++it) {
+        needed += it.key()->committedDiskSpace();
+    }
+    return needed;
+}
+
+// ================================================================================
+
 QString OwncloudPropagator::fullRemotePath(const QString &tmp_file_name) const
 {
     // TODO: should this be part of the _item (SyncFileItemPtr)?
@@ -23,6 +23,10 @@
 #include <QPointer>
 #include <QIODevice>
 #include <QMutex>
+#include <QSet>
+
+#include <map>
+#include <set>
 
 #include "csync.h"
 #include "syncfileitem.h"
@@ -30,6 +34,7 @@
 #include "bandwidthmanager.h"
 #include "accountfwd.h"
 #include "syncoptions.h"
+#include "common/syncprofiler.h"
 
 namespace OCC {
 
@@ -99,6 +104,12 @@ public:
      */
     virtual bool isLikelyFinishedQuickly() { return false; }
 
+    /**
+     * For the uploads and downloads of big files, with HTTP/2 only
+     * OwncloudPropagator::maximumActiveTransferJob() of them run in parallel.
+     */
+    virtual bool isBulkTransfer() { return false; }
+
     /** The space that the running jobs need to complete but don't actually use yet.
      *
      * Note that this does *not* include the disk space that's already
@@ -168,6 +179,7 @@ protected:
 
     SyncFileItemPtr _item;
     friend class PropagateDirectory;
+    friend class HydrationQueue;
 
 public:
     PropagateItemJob(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
@@ -181,6 +193,15 @@ public:
     const SyncFileItem &item() const { return *_item.data(); }
 public slots:
     virtual void start() = 0;
+
+private:
+    void releaseBulkSlot();
+
+    // whether the job is counted in OwncloudPropagator::_runningBulkJobs
+    bool _countedAsBulk = false;
+
+    // from the start until done()
+    SyncProfiler::Timer _profileTimer;
 };
 
 /**
@@ -195,7 +216,7 @@ public:
 
     ~PropagatorCompositeJob() override
     {
-        // Don't delete jobs in _jobsToDo and _runningJobs: they have parents
+        // Don't delete jobs in _jobsToDo, _deferredJobs and _runningJobs: they have parents
         // that will be responsible for cleanup. Deleting them here would risk
         // deleting something that has already been deleted by a shared parent.
     }
@@ -209,6 +230,13 @@ public:
     bool scheduleSelfOrChild() override;
     JobParallelism parallelism() override;
 
+    /** While open the job doesn't finish when it runs out of jobs, more may be appended.
+     *
+     * See OwncloudPropagator::startAppending().
+     */
+    void setOpen(bool open);
+    bool isOpen() const { return _open; }
+
     /*
      * Abort synchronously or asynchronously - some jobs
      * require to be finished without immediete abort (abort on job might
@@ -252,10 +280,14 @@ private slots:
 
 private:
     QVector<PropagatorJob *> _jobsToDo;
-    SyncFileItemSet _tasksToDo;
+    // bulk transfers that were skipped while OwncloudPropagator::isBulkTransferLimitReached()
+    QVector<PropagatorJob *> _deferredJobs;
+    // sorted, in a streamed sync the tasks of a directory come in several batches
+    std::set<SyncFileItemPtr> _tasksToDo;
     QVector<PropagatorJob *> _runningJobs;
     QMap<QString, SyncFileItem::Status> _errorPaths; // NoStatus,  or NormalError / SoftError if there was an error
     quint64 _abortsCount = 0;
+    bool _open = false;
 };
 
 /**
@@ -283,6 +315,11 @@ public:
         _subJobs.appendTask(item);
     }
 
+    void setOpen(bool open)
+    {
+        _subJobs.setOpen(open);
+    }
+
     bool scheduleSelfOrChild() override;
     JobParallelism parallelism() override;
     void abort(PropagatorJob::AbortType abortType) override
@@ -319,6 +356,113 @@ private slots:
     virtual void slotSubJobsFinished(const SyncFileItem::Status status);
 };
 
+/**
+ * @brief Propagates the hydrations of virtual files before the other work of a sync
+ * @ingroup libsync
+ *
+ * The downloads of virtual files don't wait for the jobs of their directories,
+ * they are started in the order of their priority as soon as the propagator
+ * has a free slot.
+ *
+ * A request is a path and a priority, for example a file the user opened or a
+ * folder that was made available locally. The hydrations below the path get
+ * the priority of the most specific request, the ones without a request are
+ * handled as Pinned. The progress of each request is reported with
+ * progressChanged().
+ *
+ * Requests can be added and canceled while the sync is running, single files
+ * can be added while the queue is open, see OwncloudPropagator::hydrate().
+ */
+class OWNCLOUDSYNC_EXPORT HydrationQueue : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /// From the most to the least urgent
+    enum class Priority {
+        /// The user wants to access the file's data
+        Opened,
+        /// The file or one of its parents is pinned to be available locally
+        Pinned,
+        /// The file is likely needed soon
+        Prefetch
+    };
+    Q_ENUM(Priority)
+
+    struct Progress
+    {
+        int files = 0;
+        int completedFiles = 0;
+        qint64 size = 0;
+        qint64 completedSize = 0;
+
+        bool isFinished() const { return completedFiles == files; }
+    };
+
+    explicit HydrationQueue(OwncloudPropagator *propagator);
+
+    /// Whether the item is the download of a virtual file
+    static bool isHydration(const SyncFileItem &item);
+
+    /** Adds a request for the hydration of path and everything below it.
+     *
+     * The queued hydrations of the request are moved to its priority.
+     */
+    void addRequest(const QString &path, Priority priority);
+
+    /** Removes the request and drops its hydrations that didn't start yet.
+     *
+     * The dropped items are completed without a status, the running ones
+     * are finished. Returns the number of dropped items.
+     */
+    int cancelRequest(const QString &path);
+
+    Optional<Progress> progress(const QString &request) const;
+
+    void append(const SyncFileItemPtr &item);
+
+    /// Whether a hydration of the path is queued or running
+    bool contains(const QString &path) const;
+
+    /// No hydrations are added after close()
+    bool isOpen() const { return _state != Finished; }
+    bool isIdle() const { return _queue.empty() && _running.isEmpty(); }
+    void close() { _state = Finished; }
+
+    /// The status of the last failed hydration, NoStatus if all succeeded
+    SyncFileItem::Status errorStatus() const { return _errorStatus; }
+
+    bool scheduleSelfOrChild() override;
+    void abort(PropagatorJob::AbortType abortType) override;
+    qint64 committedDiskSpace() const override;
+
+signals:
+    void progressChanged(const QString &request, const HydrationQueue::Progress &progress);
+
+private slots:
+    void slotJobFinished(SyncFileItem::Status status);
+
+private:
+    struct Entry
+    {
+        SyncFileItemPtr item;
+        QString request;
+    };
+    // ordered by priority, then by the time they were added
+    using Key = std::pair<Priority, quint64>;
+
+    QString requestFor(const QString &path) const;
+    Key nextKey(const QString &request) { return { _requests.value(request, Priority::Pinned), _sequence++ }; }
+    void addProgress(const QString &request, const SyncFileItem &item, int files, int completedFiles);
+
+    QMap<QString, Priority> _requests;
+    QHash<QString, Progress> _progress;
+    std::map<Key, Entry> _queue;
+    QHash<PropagatorJob *, Entry> _running;
+    quint64 _sequence = 0;
+    SyncFileItem::Status _errorStatus = SyncFileItem::NoStatus;
+    int _abortsCount = 0;
+};
+
 /**
  * @brief Propagate the root directory, and all its sub entries.
  * @ingroup libsync
@@ -340,11 +484,15 @@ public:
 
     void addDeleteJob(PropagatorJob *job);
 
+    HydrationQueue &hydrations() { return _hydrations; }
+
 private slots:
     void slotSubJobsFinished(SyncFileItem::Status status) override;
     void slotDirDeletionJobsFinished(SyncFileItem::Status status);
 
 private:
+    // scheduled before _subJobs, _dirDeletionJobs wait for them
+    HydrationQueue _hydrations;
     PropagatorCompositeJob _dirDeletionJobs;
     SyncFileItem::Status _status = SyncFileItem::NoStatus;
 };
@@ -403,6 +551,30 @@ public:
 
     void start(SyncFileItemSet &&_syncedItems);
 
+    /** Starts a propagation of items that are appended while it runs.
+     *
+     * The items come in batches with append(), the propagation finishes once
+     * finishAppending() was called and all of them are done.
+     */
+    void startAppending();
+
+    /** Adds a batch of items to a propagation started with startAppending().
+     *
+     * A directory must come before its contents, in the same or in an earlier
+     * batch, and takes items until closeDirectory(). Only new and changed items
+     * can be appended: removals, renames and type changes are skipped and left
+     * for another sync.
+     */
+    void append(SyncFileItemSet &&items);
+
+    /// No more items are appended below the directory
+    void closeDirectory(const QString &path);
+
+    /// No more items are appended at all
+    void finishAppending();
+
+    bool isAppending() const { return _appending; }
+
     const SyncOptions &syncOptions() const;
 
     QPointer<BandwidthManager> _bandwidthManager;
@@ -417,6 +589,9 @@ public:
      */
     QList<PropagateItemJob *> _activeJobList;
 
+    /** The number of running bulk transfers, only counted with HTTP/2, see PropagatorJob::isBulkTransfer() */
+    int _runningBulkJobs = 0;
+
     /** We detected that another sync is required after this one */
     bool _anotherSyncNeeded;
 
@@ -436,6 +611,9 @@ public:
     /* the maximum number of jobs using bandwidth (uploads or downloads, in parallel) */
     int maximumActiveTransferJob();
 
+    /** With HTTP/2 no more bulk transfers may start, the other jobs still can */
+    bool isBulkTransferLimitReached() { return _syncOptions._http2 && _runningBulkJobs >= maximumActiveTransferJob(); }
+
     /** The size to use for upload chunks.
      *
      * Will be dynamically adjusted after each chunk upload finishes
@@ -454,6 +632,9 @@ public:
      */
     Result<QString, bool> localFileNameClash(const QString &relfile);
 
+    /// Like above for a sync folder at localDir, may be used from other threads
+    static Result<QString, bool> localFileNameClash(const QString &localDir, const QString &relFile);
+
     /** Check whether a file is properly accessible for upload.
      *
      * It is possible to create files with filenames that differ
@@ -536,6 +717,20 @@ public:
      * Will also trigger a Vfs::updateMetadata.
      */
     Result<Vfs::ConvertToPlaceholderResult, QString> updatePlaceholder(const SyncFileItem &item, const QString &fileName, const QString &replacesFile);
+
+    /** Adds a request to the HydrationQueue, before start() it applies to the items of this sync. */
+    void addHydrationRequest(const QString &path, HydrationQueue::Priority priority);
+
+    /** Cancels a request of the HydrationQueue, see HydrationQueue::cancelRequest(). */
+    void cancelHydrationRequest(const QString &path);
+
+    /** Adds the hydration of a virtual file to the running propagation.
+     *
+     * This is only possible if no other job of this sync works on the file or
+     * on its directory. Returns false if the item has to wait for the next sync.
+     */
+    bool hydrate(const SyncFileItemPtr &item);
+
 private slots:
 
     void abortTimeout()
@@ -575,9 +770,29 @@ signals:
     void insufficientLocalStorage();
     void insufficientRemoteStorage();
 
+    void hydrationProgress(const QString &request, const HydrationQueue::Progress &progress);
+
+    /** While appending, all the appended items are propagated or wait for their directory.
+     *
+     * The directories that are still open may get more items.
+     */
+    void waitingForItems();
+
 private:
+    void createRootJob();
+
     AccountPtr _account;
     QScopedPointer<PropagateRootDirectory> _rootJob;
+    // while appending, the directories that take more items by their destination, the root is ""
+    QHash<QString, QPointer<PropagateDirectory>> _openDirectories;
+    // while appending, the items whose contents are skipped
+    QSet<QString> _skippedPaths;
+    bool _appending = false;
+    QMap<QString, HydrationQueue::Priority> _hydrationRequests;
+    // the parent directories of the items of this sync and the directories that are changed by it,
+    // hydrate() must not interfere with their jobs
+    QSet<QString> _touchedDirectories;
+    QSet<QString> _changedDirectories;
     SyncOptions _syncOptions;
     bool _jobScheduled = false;
 
@@ -18,6 +18,8 @@
 #include <QMetaType>
 #include <QCoreApplication>
 
+#include <algorithm>
+
 namespace OCC {
 
 ProgressDispatcher *ProgressDispatcher::_instance = nullptr;
@@ -133,11 +135,15 @@ void ProgressInfo::reset()
     _status = None;
 
     _currentItems.clear();
+    _currentItemsBySize.clear();
+    _estimatedUpBandwidth = 0;
+    _estimatedDownBandwidth = 0;
     _currentDiscoveredRemoteFolder.clear();
     _currentDiscoveredLocalFolder.clear();
     _sizeProgress = Progress();
     _fileProgress = Progress();
     _totalSizeOfCompletedJobs = 0;
+    _completedSizeOfCurrentJobs = 0;
 
     // Historically, these starting estimates were way lower, but that lead
     // to gross overestimation of ETA when a good estimate wasn't available.
@@ -163,6 +169,11 @@ bool ProgressInfo::isUpdatingEstimates() const
     return _updateEstimatesTimer.isActive();
 }
 
+bool ProgressInfo::isTransferProgressOnly() const
+{
+    return _status == Propagation && isUpdatingEstimates() && _lastCompletedItem.isEmpty();
+}
+
 static bool shouldCountProgress(const SyncFileItem &item)
 {
     const auto instruction = item._instruction;
@@ -178,6 +189,12 @@ static bool shouldCountProgress(const SyncFileItem &item)
     return true;
 }
 
+// The key of the item in _currentItemsBySize
+static qint64 sizeKey(const SyncFileItem &item)
+{
+    return ProgressInfo::isSizeDependent(item) ? item._size : -1;
+}
+
 void ProgressInfo::adjustTotalsForFile(const SyncFileItem &item)
 {
     if (!shouldCountProgress(item)) {
@@ -196,14 +213,9 @@ void ProgressInfo::updateTotalsForFile(const SyncFileItem &item, qint64 newSize)
         return;
     }
 
-    if (!_currentItems.contains(item._file)) {
-        _sizeProgress._total += newSize - item._size;
-    } else {
-        _sizeProgress._total += newSize - _currentItems[item._file]._progress._total;
-    }
-
-    setProgressItem(item, 0);
-    _currentItems[item._file]._progress._total = newSize;
+    auto &progress = setCurrentItemProgress(item, 0)._progress;
+    _sizeProgress._total += newSize - progress._total;
+    progress._total = newSize;
 }
 
 qint64 ProgressInfo::totalFiles() const
@@ -238,10 +250,19 @@ void ProgressInfo::setProgressComplete(const SyncFileItem &item)
     }
 
     _fileProgress.setCompleted(_fileProgress._completed + item._affectedItems);
-    if (ProgressInfo::isSizeDependent(item)) {
-        _totalSizeOfCompletedJobs += _currentItems[item._file]._progress._total;
+    const auto it = _currentItems.find(item._file);
+    if (it != _currentItems.end()) {
+        if (isSizeDependent(it->_item)) {
+            _completedSizeOfCurrentJobs -= it->_progress._completed;
+        }
+        if (isSizeDependent(item)) {
+            _totalSizeOfCompletedJobs += it->_progress._total;
+        }
+        const qint64 bandwidth = it->_progress.estimates().estimatedBandwidth;
+        (it->_item._direction != SyncFileItem::Up ? _estimatedDownBandwidth : _estimatedUpBandwidth) -= bandwidth;
+        _currentItemsBySize.erase({ sizeKey(it->_item), item._file });
+        _currentItems.erase(it);
     }
-    _currentItems.remove(item._file);
     recomputeCompletedSize();
     _lastCompletedItem = item;
 }
@@ -252,15 +273,27 @@ void ProgressInfo::setProgressItem(const SyncFileItem &item, qint64 completed)
         return;
     }
 
-    if (!_currentItems.contains(item._file)) {
-        _currentItems[item._file]._item = item;
-        _currentItems[item._file]._progress._total = item._size;
+    setCurrentItemProgress(item, completed);
+}
+
+ProgressInfo::ProgressItem &ProgressInfo::setCurrentItemProgress(const SyncFileItem &item, qint64 completed)
+{
+    auto it = _currentItems.find(item._file);
+    if (it == _currentItems.end()) {
+        it = _currentItems.insert(item._file, ProgressItem { item, Progress() });
+        it->_progress._total = item._size;
+        _currentItemsBySize.emplace(sizeKey(item), item._file);
+    }
+    const qint64 previous = it->_progress._completed;
+    it->_progress.setCompleted(completed);
+    if (isSizeDependent(it->_item)) {
+        _completedSizeOfCurrentJobs += it->_progress._completed - previous;
     }
-    _currentItems[item._file]._progress.setCompleted(completed);
     recomputeCompletedSize();
 
     // This seems dubious!
     _lastCompletedItem = SyncFileItem();
+    return *it;
 }
 
 ProgressInfo::Estimates ProgressInfo::totalProgress() const
@@ -338,9 +371,25 @@ bool ProgressInfo::trustEta() const
     return totalProgress().estimatedEta < 100 * optimisticEta();
 }
 
+std::vector<const ProgressInfo::ProgressItem *> ProgressInfo::biggestCurrentItems(size_t count) const
+{
+    std::vector<const ProgressItem *> items;
+    items.reserve(std::min(count, _currentItemsBySize.size()));
+    for (auto it = _currentItemsBySize.cbegin(); it != _currentItemsBySize.cend() && items.size() < count; ++it) {
+        items.push_back(&_currentItems.find(it->second).value());
+    }
+    return items;
+}
+
+quint64 ProgressInfo::estimatedBandwidth(SyncFileItem::Direction direction) const
+{
+    return std::max<qint64>(0, direction != SyncFileItem::Up ? _estimatedDownBandwidth : _estimatedUpBandwidth);
+}
+
 ProgressInfo::Estimates ProgressInfo::fileProgress(const SyncFileItem &item) const
 {
-    return _currentItems[item._file]._progress.estimates();
+    const auto it = _currentItems.constFind(item._file);
+    return it != _currentItems.cend() ? it->_progress.estimates() : Progress().estimates();
 }
 
 void ProgressInfo::updateEstimates()
@@ -349,10 +398,14 @@ void ProgressInfo::updateEstimates()
     _fileProgress.update();
 
     // Update progress of all running items.
+    _estimatedUpBandwidth = 0;
+    _estimatedDownBandwidth = 0;
     QMutableHashIterator<QString, ProgressItem> it(_currentItems);
     while (it.hasNext()) {
         it.next();
         it.value()._progress.update();
+        const qint64 bandwidth = it.value()._progress.estimates().estimatedBandwidth;
+        (it.value()._item._direction != SyncFileItem::Up ? _estimatedDownBandwidth : _estimatedUpBandwidth) += bandwidth;
     }
 
     _maxFilesPerSecond = qMax(_fileProgress._progressPerSec,
@@ -363,12 +416,7 @@ void ProgressInfo::updateEstimates()
 
 void ProgressInfo::recomputeCompletedSize()
 {
-    qint64 r = _totalSizeOfCompletedJobs;
-    for (const auto &i : qAsConst(_currentItems)) {
-        if (isSizeDependent(i._item))
-            r += i._progress._completed;
-    }
-    _sizeProgress.setCompleted(r);
+    _sizeProgress.setCompleted(_totalSizeOfCompletedJobs + _completedSizeOfCurrentJobs);
 }
 
 ProgressInfo::Estimates ProgressInfo::Progress::estimates() const
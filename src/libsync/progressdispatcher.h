@@ -25,6 +25,10 @@
 
 #include "syncfileitem.h"
 
+#include <functional>
+#include <set>
+#include <vector>
+
 #include "csync/csync_exclude.h"
 
 namespace OCC {
@@ -88,6 +92,15 @@ public:
      */
     bool isUpdatingEstimates() const;
 
+    /**
+     * Whether the report only updates the progress of the running transfers
+     * and may be skipped if another one follows soon.
+     *
+     * Reports with a _lastCompletedItem or outside of the propagation are
+     * never pure progress updates.
+     */
+    bool isTransferProgressOnly() const;
+
     /**
      * Increase the file and size totals by the amount indicated in item.
      */
@@ -197,6 +210,21 @@ public:
     };
     QHash<QString, ProgressItem> _currentItems;
 
+    /**
+     * At most count of the current items, the size dependent ones with the
+     * biggest size first.
+     *
+     * With thousands of running transfers a report only looks at these
+     * instead of walking all _currentItems.
+     */
+    std::vector<const ProgressItem *> biggestCurrentItems(size_t count) const;
+
+    /**
+     * The sum of the estimated bandwidths of the current uploads, or of the
+     * current downloads, as of the last estimate update.
+     */
+    quint64 estimatedBandwidth(SyncFileItem::Direction direction) const;
+
     SyncFileItem _lastCompletedItem;
 
     // Used during local and remote update phase
@@ -241,10 +269,13 @@ private slots:
     void updateEstimates();
 
 private:
-    // Sets the completed size by summing finished jobs with the progress
-    // of active ones.
+    // Sets the completed size from the finished jobs and the progress
+    // of the active ones.
     void recomputeCompletedSize();
 
+    // Adds the item to the current ones if needed, keeps the running totals
+    ProgressItem &setCurrentItemProgress(const SyncFileItem &item, qint64 completed);
+
     // Triggers the update() slot every second once propagation started.
     QTimer _updateEstimatesTimer;
 
@@ -253,6 +284,16 @@ private:
 
     // All size from completed jobs only.
     qint64 _totalSizeOfCompletedJobs;
+    // The completed size of the current size dependent items, updated with
+    // each of them instead of summing them up for each progress report
+    qint64 _completedSizeOfCurrentJobs;
+
+    // The keys of _currentItems with the size dependent ones by size, the
+    // others with -1, biggest first
+    std::set<std::pair<qint64, QString>, std::greater<>> _currentItemsBySize;
+    // The sums of the bandwidth estimates of the current items, see updateEstimates()
+    qint64 _estimatedUpBandwidth;
+    qint64 _estimatedDownBandwidth;
 
     // The fastest observed rate of files per second in this sync.
     double _maxFilesPerSecond;
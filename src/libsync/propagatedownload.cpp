@@ -192,7 +192,7 @@ void GETFileJob::start()
 
     sendRequest("GET", req);
 
-    qCDebug(lcGetJob) << _bandwidthManager << _bandwidthChoked << _bandwidthLimited;
+    qCDebug(lcGetJob) << _bandwidthManager << _bandwidthLimited;
     if (_bandwidthManager) {
         _bandwidthManager->registerDownloadJob(this);
     }
@@ -319,14 +319,6 @@ void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
     _bandwidthManager = bwm;
 }
 
-void GETFileJob::setChoked(bool c)
-{
-    if (c != _bandwidthChoked) {
-        _bandwidthChoked = c;
-        QMetaObject::invokeMethod(this, &GETFileJob::slotReadyRead, Qt::QueuedConnection);
-    }
-}
-
 void GETFileJob::setBandwidthLimited(bool b)
 {
     if (_bandwidthLimited != b) {
@@ -338,18 +330,9 @@ void GETFileJob::setBandwidthLimited(bool b)
 void GETFileJob::giveBandwidthQuota(qint64 q)
 {
     _bandwidthQuota = q;
-    qCDebug(lcGetJob) << "Got" << q << "bytes";
     QMetaObject::invokeMethod(this, &GETFileJob::slotReadyRead, Qt::QueuedConnection);
 }
 
-qint64 GETFileJob::currentDownloadPosition()
-{
-    if (_device && _device->pos() > 0 && _device->pos() > qint64(_resumeStart)) {
-        return _device->pos();
-    }
-    return _resumeStart;
-}
-
 void GETFileJob::slotReadyRead()
 {
     Q_ASSERT(reply());
@@ -361,15 +344,11 @@ void GETFileJob::slotReadyRead()
     QByteArray buffer(bufferSize, Qt::Uninitialized);
 
     while (reply()->bytesAvailable() > 0) {
-        if (_bandwidthChoked) {
-            qCWarning(lcGetJob) << "Download choked";
-            break;
-        }
         qint64 toRead = bufferSize;
         if (_bandwidthLimited) {
             toRead = std::min<qint64>(bufferSize, _bandwidthQuota);
             if (toRead == 0) {
-                qCWarning(lcGetJob) << "Out of badnwidth quota";
+                qCDebug(lcGetJob) << "Out of bandwidth quota";
                 break;
             }
             _bandwidthQuota -= toRead;
@@ -494,6 +473,7 @@ void PropagateDownloadFile::start()
         auto computeChecksum = new ComputeChecksum(this);
         const auto checksumHeader = ChecksumHeader::parseChecksumHeader(_item->_checksumHeader);
         computeChecksum->setChecksumType(checksumHeader.type());
+        computeChecksum->setChecksumCache(propagator()->_journal);
         connect(computeChecksum, &ComputeChecksum::done,
             this, &PropagateDownloadFile::conflictChecksumComputed);
         propagator()->_activeJobList.append(this);
@@ -622,20 +602,20 @@ void PropagateDownloadFile::startFullDownload()
 {
     QMap<QByteArray, QByteArray> headers;
 
-    if (_item->_directDownloadUrl.isEmpty()) {
+    if (!_item->_directDownload) {
         // Normal job, download from oC instance
         _job = new GETFileJob(propagator()->account(), propagator()->webDavUrl(),
             propagator()->fullRemotePath(_item->_file),
             &_tmpFile, headers, _expectedEtagForResume, _resumeStart, this);
     } else {
         // We were provided a direct URL, use that one
-        qCInfo(lcPropagateDownload) << "directDownloadUrl given for " << _item->_file << _item->_directDownloadUrl;
+        qCInfo(lcPropagateDownload) << "directDownloadUrl given for " << _item->_file << _item->_directDownload->url;
 
-        if (!_item->_directDownloadCookies.isEmpty()) {
-            headers["Cookie"] = _item->_directDownloadCookies.toUtf8();
+        if (!_item->_directDownload->cookies.isEmpty()) {
+            headers["Cookie"] = _item->_directDownload->cookies.toUtf8();
         }
 
-        QUrl url = QUrl::fromUserInput(_item->_directDownloadUrl);
+        QUrl url = QUrl::fromUserInput(_item->_directDownload->url);
         _job = new GETFileJob(propagator()->account(),
             url,
             {},
@@ -643,6 +623,10 @@ void PropagateDownloadFile::startFullDownload()
     }
     _job->setBandwidthManager(propagator()->_bandwidthManager);
     _job->setExpectedContentLength(_item->_size - _resumeStart);
+    if (isLikelyFinishedQuickly()) {
+        // small downloads don't need to wait behind the big ones
+        _job->setPriority(QNetworkRequest::NormalPriority);
+    }
 
     connect(_job.data(), &GETFileJob::finishedSignal, this, &PropagateDownloadFile::slotGetFinished);
     connect(qobject_cast<GETFileJob *>(_job.data()), &GETFileJob::downloadProgress,
@@ -701,10 +685,10 @@ void PropagateDownloadFile::slotGetFinished()
             propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         }
 
-        if (!_item->_directDownloadUrl.isEmpty() && err != QNetworkReply::OperationCanceledError) {
+        if (_item->_directDownload && err != QNetworkReply::OperationCanceledError) {
             // If this was with a direct download, retry without direct download
-            qCWarning(lcPropagateDownload) << "Direct download of" << _item->_directDownloadUrl << "failed. Retrying through owncloud.";
-            _item->_directDownloadUrl.clear();
+            qCWarning(lcPropagateDownload) << "Direct download of" << _item->_directDownload->url << "failed. Retrying through owncloud.";
+            _item->_directDownload.reset();
             start();
             return;
         }
@@ -44,8 +44,6 @@ public:
         qint64 resumeStart, QObject *parent = nullptr);
     virtual ~GETFileJob();
 
-    qint64 currentDownloadPosition();
-
     void start() override;
     void finished() override;
 
@@ -60,9 +58,9 @@ public:
     qint64 expectedContentLength() const { return _expectedContentLength; }
     void setExpectedContentLength(qint64 size) { _expectedContentLength = size; }
 
-    void setChoked(bool c);
     void setBandwidthLimited(bool b);
     void giveBandwidthQuota(qint64 q);
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
     void setBandwidthManager(BandwidthManager *bwm);
 
     QString &etag() { return _etag; }
@@ -88,7 +86,6 @@ protected:
     QString _errorString;
     SyncFileItem::Status _errorStatus = SyncFileItem::NoStatus;
     bool _bandwidthLimited = false; // if _bandwidthQuota will be used
-    bool _bandwidthChoked = false; // if download is paused (won't read on readyRead())
     qint64 _bandwidthQuota = 0;
     bool _httpOk = false;
     QPointer<BandwidthManager> _bandwidthManager = nullptr;
@@ -155,6 +152,7 @@ public:
 
     // We think it might finish quickly because it is a small file.
     bool isLikelyFinishedQuickly() override { return _item->_size < propagator()->smallFileSize(); }
+    bool isBulkTransfer() override { return !isLikelyFinishedQuickly(); }
 
     /**
      * Whether an existing folder with the same name may be deleted before
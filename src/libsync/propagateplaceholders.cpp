@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagateplaceholders.h"
+
+#include "common/syncjournaldb.h"
+#include "common/vfs.h"
+#include "filesystem.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QtConcurrentRun>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPropagatePlaceholders, "sync.propagator.placeholders", QtInfoMsg)
+
+namespace {
+    /**
+     * Completes a single item of the batch, done() takes care of the
+     * blacklist and notifies the engine.
+     */
+    class PlaceholderItemJob : public PropagateItemJob
+    {
+        Q_OBJECT
+    public:
+        using PropagateItemJob::PropagateItemJob;
+
+        void start() override { }
+
+        void complete(SyncFileItem::Status status, const QString &errorString)
+        {
+            _state = Running;
+            done(status, errorString);
+        }
+    };
+}
+
+PropagatePlaceholders::PropagatePlaceholders(OwncloudPropagator *propagator, const QString &directory)
+    : PropagatorJob(propagator, directory)
+{
+    connect(&_watcher, &QFutureWatcherBase::finished, this, &PropagatePlaceholders::slotPlaceholdersCreated);
+}
+
+PropagatePlaceholders::~PropagatePlaceholders()
+{
+    // the worker writes to _placeholders
+    _canceled = true;
+    _watcher.waitForFinished();
+}
+
+bool PropagatePlaceholders::canPropagate(const OwncloudPropagator *propagator, const SyncFileItem &item)
+{
+    const auto &vfs = propagator->syncOptions()._vfs;
+    return vfs->mode() != Vfs::Off && vfs->canCreatePlaceholdersInBatches() && item._type == ItemTypeVirtualFile
+        && item._direction == SyncFileItem::Down
+        && (item._instruction == CSYNC_INSTRUCTION_NEW || item._instruction == CSYNC_INSTRUCTION_SYNC);
+}
+
+void PropagatePlaceholders::append(const SyncFileItemPtr &item)
+{
+    _placeholders.push_back({ item, {}, SyncFileItem::NoStatus, {} });
+}
+
+bool PropagatePlaceholders::scheduleSelfOrChild()
+{
+    if (_state != NotYetStarted) {
+        return false;
+    }
+    _state = Running;
+    start();
+    return true;
+}
+
+void PropagatePlaceholders::start()
+{
+    if (propagator()->_abortRequested) {
+        return;
+    }
+    qCInfo(lcPropagatePlaceholders) << "Creating" << _placeholders.size() << "placeholders in" << path();
+
+    _watcher.setFuture(QtConcurrent::run([this, vfs = propagator()->syncOptions()._vfs, localDir = propagator()->localPath()] {
+        for (auto &placeholder : _placeholders) {
+            if (_canceled) {
+                return;
+            }
+            const auto &item = *placeholder.item;
+            if (auto clash = OwncloudPropagator::localFileNameClash(localDir, item._file)) {
+                placeholder.status = SyncFileItem::NormalError;
+                placeholder.error = tr("File %1 can not be downloaded because of a local file name clash with %2!")
+                                        .arg(QDir::toNativeSeparators(item._file), QDir::toNativeSeparators(clash.get()));
+                continue;
+            }
+            const auto created = vfs->createPlaceholder(item);
+            if (!created) {
+                placeholder.status = SyncFileItem::NormalError;
+                placeholder.error = created.error();
+                continue;
+            }
+            const QString fsPath = localDir + item.destination();
+            const auto result = vfs->updateMetadata(item, fsPath, {});
+            if (!result) {
+                placeholder.status = SyncFileItem::FatalError;
+                placeholder.error = tr("Error updating metadata: %1").arg(result.error());
+                continue;
+            }
+            placeholder.record = item.toSyncJournalFileRecordWithInode(fsPath);
+            if (result.get() == Vfs::ConvertToPlaceholderResult::Locked) {
+                // like PropagateDownloadFile::updateMetadata(), a later sync updates the placeholder
+                placeholder.record._hasDirtyPlaceholder = true;
+                placeholder.status = SyncFileItem::SoftError;
+                placeholder.error = tr("The file %1 is currently in use").arg(item._file);
+                continue;
+            }
+            placeholder.status = SyncFileItem::Success;
+        }
+    }));
+}
+
+void PropagatePlaceholders::slotPlaceholdersCreated()
+{
+    if (_state != Running) {
+        return;
+    }
+    _state = Finished;
+
+    QElapsedTimer timer;
+    timer.start();
+    auto *journal = propagator()->_journal;
+    for (auto &placeholder : _placeholders) {
+        if (placeholder.record.isValid()) {
+            const auto dbResult = journal->setFileRecord(placeholder.record);
+            if (!dbResult) {
+                placeholder.status = SyncFileItem::FatalError;
+                placeholder.error = tr("Error updating metadata: %1").arg(dbResult.error());
+                continue;
+            }
+            if (placeholder.record._hasDirtyPlaceholder) {
+                Q_EMIT propagator()->seenLockedFile(propagator()->fullLocalPath(placeholder.item->_file), FileSystem::LockMode::Exclusive);
+            }
+            journal->setDownloadInfo(placeholder.item->_file, SyncJournalDb::DownloadInfo());
+        }
+    }
+    // one commit for the whole batch instead of one per file
+    journal->commit(QStringLiteral("placeholders"));
+    qCInfo(lcPropagatePlaceholders) << "Wrote the records of" << _placeholders.size() << "placeholders in" << path() << "in" << timer.elapsed() << "ms";
+
+    auto status = SyncFileItem::Success;
+    for (const auto &placeholder : _placeholders) {
+        if (placeholder.status == SyncFileItem::NoStatus) {
+            // canceled before the worker got to it
+            continue;
+        }
+        PlaceholderItemJob job(propagator(), placeholder.item);
+        job.complete(placeholder.status, placeholder.error);
+        if (placeholder.item->hasErrorStatus()) {
+            status = placeholder.item->_status;
+        }
+    }
+    Q_EMIT finished(status);
+}
+
+void PropagatePlaceholders::abort(PropagatorJob::AbortType abortType)
+{
+    // the worker stops after the current placeholder, the ones that were
+    // already created still need their journal records
+    _canceled = true;
+    if (_state != Running) {
+        if (abortType == AbortType::Asynchronous) {
+            Q_EMIT abortFinished();
+        }
+        return;
+    }
+    if (abortType == AbortType::Asynchronous) {
+        if (_watcher.isRunning()) {
+            // slotPlaceholdersCreated() is connected first and writes the records before
+            connect(&_watcher, &QFutureWatcherBase::finished, this, [this] { Q_EMIT abortFinished(); });
+        } else {
+            slotPlaceholdersCreated();
+            Q_EMIT abortFinished();
+        }
+        return;
+    }
+    // a synchronous abort has to be done when it returns
+    _watcher.waitForFinished();
+    slotPlaceholdersCreated();
+}
+
+}
+
+#include "propagateplaceholders.moc"
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "owncloudpropagator.h"
+
+#include <QFutureWatcher>
+
+#include <atomic>
+#include <vector>
+
+namespace OCC {
+
+/**
+ * @brief Creates the placeholders of several virtual files of a directory at once
+ *
+ * With a Vfs that supports it, see Vfs::canCreatePlaceholdersInBatches(), the
+ * propagator groups the new virtual files of a directory into one such job
+ * instead of a PropagateDownloadFile per file.
+ *
+ * The placeholders are created on a worker thread. Back on the main thread the
+ * journal records of the whole batch are written in one transaction and the
+ * items are completed like by their own jobs.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT PropagatePlaceholders : public PropagatorJob
+{
+    Q_OBJECT
+public:
+    /// The maximum number of items of a job, a directory with more files gets several jobs
+    static constexpr size_t MaxItems = 1000;
+
+    PropagatePlaceholders(OwncloudPropagator *propagator, const QString &directory);
+    ~PropagatePlaceholders() override;
+
+    /// Whether the item can be propagated by this job instead of a PropagateDownloadFile
+    static bool canPropagate(const OwncloudPropagator *propagator, const SyncFileItem &item);
+
+    void append(const SyncFileItemPtr &item);
+    bool isFull() const { return _placeholders.size() >= MaxItems; }
+
+    bool scheduleSelfOrChild() override;
+    void abort(PropagatorJob::AbortType abortType) override;
+
+private:
+    struct Placeholder
+    {
+        SyncFileItemPtr item;
+        SyncJournalFileRecord record;
+        SyncFileItem::Status status = SyncFileItem::NoStatus;
+        QString error;
+    };
+
+    void start();
+    void slotPlaceholdersCreated();
+
+    std::vector<Placeholder> _placeholders;
+    QFutureWatcher<void> _watcher;
+    std::atomic<bool> _canceled = false;
+};
+
+}
@@ -186,6 +186,7 @@ void PropagateUploadFileCommon::slotComputeContentChecksum()
     // Compute the content checksum.
     auto computeChecksum = new ComputeChecksum(this);
     computeChecksum->setChecksumType(checksumType);
+    computeChecksum->setChecksumCache(propagator()->_journal);
 
     connect(computeChecksum, &ComputeChecksum::done,
         this, &PropagateUploadFileCommon::slotComputeTransmissionChecksum);
@@ -274,9 +275,7 @@ UploadDevice::UploadDevice(const QString &fileName, qint64 start, qint64 size, B
     , _read(0)
     , _bandwidthManager(bwm)
     , _bandwidthQuota(0)
-    , _readWithProgress(0)
     , _bandwidthLimited(false)
-    , _choked(false)
 {
     if (_bandwidthManager) {
         _bandwidthManager->registerUploadDevice(this);
@@ -337,9 +336,6 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     if (maxlen <= 0) {
         return 0;
     }
-    if (isChoked()) {
-        return 0;
-    }
     if (isBandwidthLimited()) {
         maxlen = qMin(maxlen, _bandwidthQuota);
         if (maxlen <= 0) { // no quota
@@ -357,15 +353,6 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     return c;
 }
 
-void UploadDevice::slotJobUploadProgress(qint64 sent, qint64 t)
-{
-    if (sent == 0 || t == 0) {
-        return;
-    }
-    // used by the BandwidthManager
-    _readWithProgress = sent;
-}
-
 bool UploadDevice::atEnd() const
 {
     return _read >= _size;
@@ -416,14 +403,6 @@ void UploadDevice::setBandwidthLimited(bool b)
     }
 }
 
-void UploadDevice::setChoked(bool b)
-{
-    _choked = b;
-    if (!_choked) {
-        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
-    }
-}
-
 void PropagateUploadFileCommon::done(SyncFileItem::Status status, const QString &errorString)
 {
     _finished = true;
@@ -55,8 +55,6 @@ public:
 
     void setBandwidthLimited(bool);
     bool isBandwidthLimited() { return _bandwidthLimited; }
-    void setChoked(bool);
-    bool isChoked() { return _choked; }
     void giveBandwidthQuota(qint64 bwq);
 
 signals:
@@ -75,12 +73,8 @@ private:
     // Bandwidth manager related
     QPointer<BandwidthManager> _bandwidthManager;
     qint64 _bandwidthQuota;
-    qint64 _readWithProgress;
     bool _bandwidthLimited; // if _bandwidthQuota will be used
-    bool _choked; // if upload is paused (readData() will return 0)
     friend class BandwidthManager;
-public slots:
-    void slotJobUploadProgress(qint64 sent, qint64 t);
 };
 
 /**
@@ -191,6 +185,7 @@ public:
     void start() override;
 
     bool isLikelyFinishedQuickly() override { return _item->_size < propagator()->smallFileSize(); }
+    bool isBulkTransfer() override { return !isLikelyFinishedQuickly(); }
 
 private slots:
     void slotComputeContentChecksum();
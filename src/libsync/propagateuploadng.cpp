@@ -385,14 +385,11 @@ void PropagateUploadFileNG::startNextChunk()
     }
 
     // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
-    auto devicePtr = device.get(); // for connections later
     PUTFileJob *job = new PUTFileJob(propagator()->account(), propagator()->account()->url(), chunkPath(_currentChunkOffset), std::move(device), {}, 0, this);
     addChildJob(job);
     connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotPutFinished);
     connect(job, &PUTFileJob::uploadProgress,
         this, &PropagateUploadFileNG::slotUploadProgress);
-    connect(job, &PUTFileJob::uploadProgress,
-        devicePtr, &UploadDevice::slotJobUploadProgress);
     job->start();
     propagator()->_activeJobList.append(this);
 }
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "requestcoalescer.h"
+
+#include "account.h"
+
+#include <QBuffer>
+#include <QLoggingCategory>
+#include <QPointer>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcRequestCoalescer, "sync.networkjob.coalescer", QtInfoMsg)
+
+namespace {
+    /**
+     * A reply that copies the result of another one once it finished.
+     */
+    class CoalescedReply : public QNetworkReply
+    {
+        Q_OBJECT
+    public:
+        CoalescedReply(const QByteArray &verb, const QNetworkRequest &request)
+        {
+            setRequest(request);
+            setUrl(request.url());
+            setOperation(verb == "GET" ? QNetworkAccessManager::GetOperation : QNetworkAccessManager::CustomOperation);
+            open(QIODevice::ReadOnly);
+        }
+
+        void copyFrom(QNetworkReply *original, const QByteArray &data)
+        {
+            if (isFinished()) {
+                // aborted in the meantime
+                return;
+            }
+            for (const auto &header : original->rawHeaderPairs()) {
+                setRawHeader(header.first, header.second);
+            }
+            for (auto attribute : { QNetworkRequest::HttpStatusCodeAttribute, QNetworkRequest::HttpReasonPhraseAttribute,
+                     QNetworkRequest::RedirectionTargetAttribute, QNetworkRequest::Http2WasUsedAttribute }) {
+                setAttribute(attribute, original->attribute(attribute));
+            }
+            if (original->error() != QNetworkReply::NoError) {
+                setError(original->error(), original->errorString());
+            }
+            _data = data;
+            setFinished(true);
+
+            // the original is still being processed, don't call into its listeners recursively
+            QMetaObject::invokeMethod(
+                this, [this] {
+                    emit metaDataChanged();
+                    if (!_data.isEmpty()) {
+                        emit readyRead();
+                    }
+                    if (error() != QNetworkReply::NoError) {
+                        emit errorOccurred(error());
+                    }
+                    emit finished();
+                },
+                Qt::QueuedConnection);
+        }
+
+        void abort() override
+        {
+            if (isFinished()) {
+                return;
+            }
+            setError(QNetworkReply::OperationCanceledError, tr("Operation canceled"));
+            setFinished(true);
+            emit errorOccurred(QNetworkReply::OperationCanceledError);
+            emit finished();
+        }
+
+        bool isSequential() const override { return true; }
+
+        qint64 bytesAvailable() const override { return _data.size() - _offset + QIODevice::bytesAvailable(); }
+
+    protected:
+        qint64 readData(char *data, qint64 maxlen) override
+        {
+            const qint64 len = std::min<qint64>(maxlen, _data.size() - _offset);
+            std::memcpy(data, _data.constData() + _offset, len);
+            _offset += len;
+            return len;
+        }
+
+    private:
+        QByteArray _data;
+        qint64 _offset = 0;
+    };
+
+    QByteArray requestKey(const AccountPtr &account, const QByteArray &verb, const QNetworkRequest &request, const QByteArray &body)
+    {
+        QByteArray key = QByteArray::number(reinterpret_cast<quintptr>(account.data()), 16) + ' ' + verb + ' ' + request.url().toEncoded() + '\n';
+        auto headers = request.rawHeaderList();
+        std::sort(headers.begin(), headers.end());
+        for (const auto &header : headers) {
+            key += header + ": " + request.rawHeader(header) + '\n';
+        }
+        return key + '\n' + body;
+    }
+}
+
+struct RequestCoalescer::Group
+{
+    QByteArray key;
+    AccountPtr account;
+    QByteArray verb;
+    QNetworkRequest request;
+    QByteArray body;
+    bool hasBody = false;
+
+    QPointer<QNetworkReply> leader;
+    std::vector<QPointer<CoalescedReply>> followers;
+};
+
+RequestCoalescer *RequestCoalescer::instance()
+{
+    static RequestCoalescer *instance = new RequestCoalescer;
+    return instance;
+}
+
+RequestCoalescer::RequestCoalescer(QObject *parent)
+    : QObject(parent)
+{
+}
+
+RequestCoalescer::~RequestCoalescer()
+{
+    for (auto *group : qAsConst(_groups)) {
+        if (group->leader) {
+            group->leader->disconnect(this);
+        }
+        delete group;
+    }
+}
+
+bool RequestCoalescer::isCoalesced(const QNetworkReply *reply)
+{
+    return qobject_cast<const CoalescedReply *>(reply) != nullptr;
+}
+
+QNetworkReply *RequestCoalescer::sendRequest(const AccountPtr &account, const QByteArray &verb, const QNetworkRequest &request, QIODevice *body)
+{
+    auto *buffer = qobject_cast<QBuffer *>(body);
+    if ((verb != "GET" && verb != "PROPFIND") || (body && !buffer)) {
+        return account->sendRawRequest(verb, request.url(), request, body);
+    }
+
+    ++_stats.eligible;
+    const QByteArray bodyData = buffer ? buffer->data() : QByteArray();
+    const QByteArray key = requestKey(account, verb, request, bodyData);
+
+    if (auto *group = _groups.value(key)) {
+        ++_stats.coalesced;
+        qCDebug(lcRequestCoalescer) << "Sharing the reply of" << verb << request.url() << "hit rate" << _stats.hitRate();
+        auto *reply = new CoalescedReply(verb, request);
+        group->followers.emplace_back(reply);
+        return reply;
+    }
+
+    if (_stats.eligible % 100 == 0) {
+        qCInfo(lcRequestCoalescer) << "Shared" << _stats.coalesced << "of" << _stats.eligible << "requests, hit rate" << _stats.hitRate();
+    }
+
+    auto *group = new Group { key, account, verb, request, bodyData, buffer != nullptr, {}, {} };
+    group->leader = account->sendRawRequest(verb, request.url(), request, body);
+    _groups.insert(key, group);
+    connect(group->leader, &QNetworkReply::finished, this, [group, this] { slotLeaderDone(group); });
+    connect(group->leader, &QObject::destroyed, this, [group, this] { slotLeaderDone(group); });
+    return group->leader;
+}
+
+void RequestCoalescer::sendGroup(Group *group)
+{
+    QBuffer *buffer = nullptr;
+    if (group->hasBody) {
+        buffer = new QBuffer;
+        buffer->setData(group->body);
+        buffer->open(QIODevice::ReadOnly);
+    }
+    group->leader = group->account->sendRawRequest(group->verb, group->request.url(), group->request, buffer);
+    if (buffer) {
+        buffer->setParent(group->leader);
+    }
+    // delete the reply once we are done with it, nobody else owns it
+    connect(group->leader, &QNetworkReply::finished, group->leader, &QObject::deleteLater);
+    connect(group->leader, &QNetworkReply::finished, this, [group, this] { slotLeaderDone(group); });
+    connect(group->leader, &QObject::destroyed, this, [group, this] { slotLeaderDone(group); });
+}
+
+void RequestCoalescer::slotLeaderDone(Group *group)
+{
+    QNetworkReply *leader = group->leader;
+    if (leader) {
+        leader->disconnect(this);
+    }
+    group->followers.erase(std::remove_if(group->followers.begin(), group->followers.end(), [](const auto &f) { return f.isNull() || f->isFinished(); }),
+        group->followers.end());
+
+    const bool canceled = !leader || leader->error() == QNetworkReply::OperationCanceledError;
+    if (canceled && !group->followers.empty()) {
+        // the job that sent the request gave up, the others still want the result
+        qCDebug(lcRequestCoalescer) << "Sending" << group->verb << group->request.url() << "again for" << group->followers.size() << "waiting requests";
+        sendGroup(group);
+        return;
+    }
+
+    if (_groups.value(group->key) == group) {
+        _groups.remove(group->key);
+    }
+    if (leader && !group->followers.empty()) {
+        // the data is still unread, the job of the leader reads it after us
+        const QByteArray data = leader->peek(leader->bytesAvailable());
+        for (const auto &follower : group->followers) {
+            follower->copyFrom(leader, data);
+        }
+    }
+    delete group;
+}
+
+}
+
+#include "requestcoalescer.moc"
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) by ownCloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#pragma once
+
+#include "accountfwd.h"
+#include "owncloudlib.h"
+
+#include <QHash>
+#include <QNetworkReply>
+#include <QObject>
+
+namespace OCC {
+
+/**
+ * @brief Shares the replies of identical requests that are in flight at the same time
+ *
+ * Several parts of the client poll the same resources independently, the etag
+ * of a folder, the spaces, avatars or the PROPFINDs of the selective sync tree.
+ * If such a request is already running, a second identical one is not sent but
+ * gets a copy of the reply of the first one once it finished.
+ *
+ * Requests are identical if account, verb, url, headers and body match.
+ * Only GET and PROPFIND requests with no body or a QBuffer body are shared.
+ * Nothing is cached, once the first request finished the next one is sent again.
+ *
+ * The copies are only filled once the original finished, jobs need to opt in with
+ * AbstractNetworkJob::setCoalescingEnabled() and must read the reply in finished().
+ *
+ * If the original request is aborted while copies are waiting for it, it is sent
+ * again for them.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT RequestCoalescer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        /// The number of requests that could have been shared
+        quint64 eligible = 0;
+        /// The number of requests that were answered by another request
+        quint64 coalesced = 0;
+
+        double hitRate() const { return eligible ? static_cast<double>(coalesced) / eligible : 0; }
+    };
+
+    static RequestCoalescer *instance();
+
+    explicit RequestCoalescer(QObject *parent = nullptr);
+    ~RequestCoalescer() override;
+
+    /**
+     * Sends the request like Account::sendRawRequest() or attaches to an identical one in flight.
+     */
+    QNetworkReply *sendRequest(const AccountPtr &account, const QByteArray &verb, const QNetworkRequest &request, QIODevice *body);
+
+    /// Whether the reply is a copy of another request
+    static bool isCoalesced(const QNetworkReply *reply);
+
+    Stats stats() const { return _stats; }
+
+private:
+    struct Group;
+
+    void sendGroup(Group *group);
+    void slotLeaderDone(Group *group);
+
+    QHash<QByteArray, Group *> _groups;
+    Stats _stats;
+};
+
+}
@@ -23,11 +23,13 @@
 #include "common/syncfilestatus.h"
 #include "csync_exclude.h"
 #include "filesystem.h"
+#include "metrics.h"
 #include "propagateremotedelete.h"
 #include "propagatedownload.h"
 #include "common/asserts.h"
 #include "discovery.h"
 #include "common/vfs.h"
+#include "common/syncprofiler.h"
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -37,6 +39,7 @@
 
 #include <climits>
 #include <assert.h>
+#include <algorithm>
 #include <chrono>
 
 #include <QCoreApplication>
@@ -52,6 +55,7 @@
 #include <QSslCertificate>
 #include <QProcess>
 #include <QElapsedTimer>
+#include <QFileInfo>
 #include <qtextcodec.h>
 
 using namespace std::chrono_literals;
@@ -75,6 +79,9 @@ Q_LOGGING_CATEGORY(lcEngine, "sync.engine", QtInfoMsg)
  */
 static const std::chrono::milliseconds s_touchedFilesMaxAgeMs(3 * 1000);
 
+// a streamed sync hands the discovered items to the propagator once this many wait, or when a directory is complete
+static const size_t s_streamedBatchSize = 1000;
+
 // doc in header
 std::chrono::milliseconds SyncEngine::minimumFileAgeForUpload(2000);
 
@@ -111,6 +118,15 @@ SyncEngine::SyncEngine(AccountPtr account, const QUrl &baseUrl, const QString &l
     _clearTouchedFilesTimer.setSingleShot(true);
     _clearTouchedFilesTimer.setInterval(30s);
     connect(&_clearTouchedFilesTimer, &QTimer::timeout, this, &SyncEngine::slotClearTouchedFiles);
+
+    auto *metrics = Metrics::instance();
+    const Metrics::Labels labels = { { "folder", localPath } };
+    metrics->addGauge(this, "owncloud_journal_size_bytes", "The size of the sync journal and its write ahead log", labels,
+        [path = journal->databaseFilePath()] { return QFileInfo(path).size() + QFileInfo(path + QStringLiteral("-wal")).size(); });
+    metrics->addGauge(this, "owncloud_sync_completed_bytes", "The bytes transferred by the current sync", labels, [this] { return _progressInfo->completedSize(); });
+    metrics->addGauge(this, "owncloud_sync_total_bytes", "The bytes to transfer in the current sync", labels, [this] { return _progressInfo->totalSize(); });
+    metrics->addGauge(this, "owncloud_sync_completed_files", "The files completed by the current sync", labels, [this] { return _progressInfo->completedFiles(); });
+    metrics->addGauge(this, "owncloud_sync_total_files", "The files to complete in the current sync", labels, [this] { return _progressInfo->totalFiles(); });
 }
 
 SyncEngine::~SyncEngine()
@@ -205,6 +221,21 @@ static bool isFileTransferInstruction(SyncInstructions instruction)
         || instruction == CSYNC_INSTRUCTION_TYPE_CHANGE;
 }
 
+/// Sorts the items by destination and keeps only the first of several items for the same destination
+static void sortAndRemoveDuplicates(SyncFileItemSet &items)
+{
+    sortByDestination(items);
+    items.erase(std::unique(items.begin(), items.end(), [](const SyncFileItemPtr &item1, const SyncFileItemPtr &item2) {
+        if (*item1 < *item2) {
+            return false;
+        }
+        qCWarning(lcEngine) << "We already have an item for" << item1->destination() << ":" << item1->_instruction << item1->_direction
+                            << "| dropping" << item2->_file << item2->_instruction << item2->_direction;
+        return true;
+    }),
+        items.end());
+}
+
 void SyncEngine::deleteStaleDownloadInfos(const SyncFileItemSet &syncItems)
 {
     // Find all downloadinfo paths that we want to preserve.
@@ -340,22 +371,17 @@ void OCC::SyncEngine::slotItemDiscovered(const OCC::SyncFileItemPtr &item)
     checkErrorBlacklisting(*item);
     _needsUpdate = true;
 
-    Q_ASSERT([&] {
-        const auto it = _syncItems.find(item);
-        if (it != _syncItems.cend()) {
-            const auto &item2 = it->get();
-            qCWarning(lcEngine) << "We already have an item for " << item2->_file << ":" << item2->_instruction << item2->_direction << "|" << item->_instruction << item->_direction;
-            return false;
-        }
-        return true;
-    }());
-    _syncItems.insert(item);
+    _syncItems.push_back(item);
 
     slotNewItem(item);
 
     if (item->isDirectory()) {
         slotFolderDiscovered(item->_etag.isEmpty(), item->_file);
     }
+
+    if (_streaming && _syncItems.size() >= s_streamedBatchSize) {
+        streamItems();
+    }
 }
 
 void SyncEngine::startSync()
@@ -372,6 +398,7 @@ void SyncEngine::startSync()
     _hasNoneFiles = false;
     _hasRemoveFile = false;
     _seenConflictFiles.clear();
+    _streamedItemsPending = 0;
 
     _progressInfo->reset();
 
@@ -452,7 +479,17 @@ void SyncEngine::startSync()
         return;
     }
 
+    _streaming = canStreamPropagation();
+    if (_streaming) {
+        qCInfo(lcEngine) << "Propagating while discovering, with up to" << syncOptions()._maxStreamedItems << "waiting items";
+    }
+
     _stopWatch.start();
+    if (SyncProfiler::isEnabled()) {
+        SyncProfiler::reset();
+        _syncProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("sync"));
+        _phaseProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("discovery"));
+    }
 
     qCInfo(lcEngine) << "#### Discovery start ####################################################";
     qCInfo(lcEngine) << "Server" << account()->capabilities().status().versionString()
@@ -472,6 +509,10 @@ void SyncEngine::startSync()
     if (!_discoveryPhase->_remoteFolder.endsWith(QLatin1Char('/')))
         _discoveryPhase->_remoteFolder+=QLatin1Char('/');
     _discoveryPhase->_shouldDiscoverLocaly = [this](const QString &s) { return shouldDiscoverLocally(s); };
+    _discoveryPhase->_localRenameHints = std::move(_localRenameHints);
+    _discoveryPhase->_localRenameHintsComplete = _localRenameHintsComplete && _localDiscoveryStyle == LocalDiscoveryStyle::DatabaseAndFilesystem;
+    _localRenameHints.clear();
+    _localRenameHintsComplete = false;
     _discoveryPhase->setSelectiveSyncBlackList(selectiveSyncBlackList);
     _discoveryPhase->setSelectiveSyncWhiteList(_journal->getSelectiveSyncList(SyncJournalDb::SelectiveSyncWhiteList, &ok));
     if (!ok) {
@@ -487,12 +528,19 @@ void SyncEngine::startSync()
     }
     _discoveryPhase->_serverBlacklistedFiles = _account->capabilities().blacklistedFiles();
     _discoveryPhase->_ignoreHiddenFiles = ignoreHiddenFiles();
+    _discoveryPhase->_emitDirectoriesFirst = _streaming;
 
     connect(_discoveryPhase.data(), &DiscoveryPhase::itemDiscovered, this, &SyncEngine::slotItemDiscovered);
+    connect(_discoveryPhase.data(), &DiscoveryPhase::directoryFinished, this, &SyncEngine::slotDirectoryDiscovered);
     connect(_discoveryPhase.data(), &DiscoveryPhase::newBigFolder, this, &SyncEngine::newBigFolder);
     connect(_discoveryPhase.data(), &DiscoveryPhase::fatalError, this, [this](const QString &errorString) {
         Q_EMIT syncError(errorString);
-        finalize(false);
+        if (_propagator) {
+            // a streamed sync, the propagation finalizes it
+            abort();
+        } else {
+            finalize(false);
+        }
     });
     connect(_discoveryPhase.data(), &DiscoveryPhase::finished, this, &SyncEngine::slotDiscoveryFinished);
     connect(_discoveryPhase.data(), &DiscoveryPhase::silentlyExcluded,
@@ -550,7 +598,27 @@ void SyncEngine::slotDiscoveryFinished()
         return;
     }
 
-    qCInfo(lcEngine) << "#### Discovery end #################################################### " << _stopWatch.addLapTime(QStringLiteral("Discovery Finished")) << "ms";
+    const auto discoveryDuration = _stopWatch.addLapTime(QStringLiteral("Discovery Finished"));
+    qCInfo(lcEngine) << "#### Discovery end #################################################### " << discoveryDuration << "ms";
+    if (Metrics::isEnabled()) {
+        Metrics::instance()
+            ->histogram("owncloud_discovery_duration_seconds", "The duration of the discovery", Metrics::durationBuckets(), { { "folder", _localPath } })
+            ->observe(discoveryDuration / 1000.0);
+    }
+
+    if (_propagator) {
+        // A streamed sync, hand over the remaining items
+        if (_discoveryPhase->_anotherSyncNeeded && _anotherSyncNeeded == NoFollowUpSync) {
+            _anotherSyncNeeded = ImmediateFollowUp;
+        }
+        _localDiscoveryPaths.clear();
+        streamItems();
+        _propagator->finishAppending();
+        _phaseProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("propagation"));
+        return;
+    }
+
+    _phaseProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("reconcile"));
 
     // Sanity check
     if (!_journal->open()) {
@@ -585,7 +653,10 @@ void SyncEngine::slotDiscoveryFinished()
             _anotherSyncNeeded = ImmediateFollowUp;
         }
 
-        Q_ASSERT(std::is_sorted(_syncItems.begin(), _syncItems.end()));
+        {
+            OC_PROFILE_SCOPE("sync", "sort");
+            sortAndRemoveDuplicates(_syncItems);
+        }
 
         const auto regex = syncOptions().fileRegex();
         if (regex.isValid()) {
@@ -601,22 +672,11 @@ void SyncEngine::slotDiscoveryFinished()
                     } while (index > 0);
                 }
             }
-            //std::erase_if c++20
-            // https://en.cppreference.com/w/cpp/container/set/erase_if
-            const auto erase_if = [](auto &c, const auto &pred) {
-                auto old_size = c.size();
-                for (auto i = c.begin(), last = c.end(); i != last;) {
-                    if (pred(*i)) {
-                        i = c.erase(i);
-                    } else {
-                        ++i;
-                    }
-                }
-                return old_size - c.size();
-            };
-            erase_if(_syncItems, [&names](const SyncFileItemPtr &i) {
-                return !names.contains(QStringRef { &i->_file });
-            });
+            _syncItems.erase(std::remove_if(_syncItems.begin(), _syncItems.end(),
+                                 [&names](const SyncFileItemPtr &i) {
+                                     return !names.contains(QStringRef { &i->_file });
+                                 }),
+                _syncItems.end());
         }
 
         qCInfo(lcEngine) << "#### Reconcile (aboutToPropagate) #################################################### " << _stopWatch.addLapTime(QStringLiteral("Reconcile (aboutToPropagate)")) << "ms";
@@ -624,7 +684,10 @@ void SyncEngine::slotDiscoveryFinished()
         _localDiscoveryPaths.clear();
 
         // To announce the beginning of the sync
-        emit aboutToPropagate(_syncItems);
+        {
+            OC_PROFILE_SCOPE("sync", "aboutToPropagate");
+            emit aboutToPropagate(_syncItems);
+        }
 
         qCInfo(lcEngine) << "#### Reconcile (aboutToPropagate OK) #################################################### "<< _stopWatch.addLapTime(QStringLiteral("Reconcile (aboutToPropagate OK)")) << "ms";
 
@@ -648,22 +711,7 @@ void SyncEngine::slotDiscoveryFinished()
         // do a database commit
         _journal->commit(QStringLiteral("post treewalk"));
 
-        _propagator = QSharedPointer<OwncloudPropagator>::create(_account, syncOptions(), _baseUrl, _localPath, _remotePath, _journal);
-        connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
-            this, &SyncEngine::slotItemCompleted);
-        connect(_propagator.data(), &OwncloudPropagator::progress,
-            this, &SyncEngine::slotProgress);
-        connect(_propagator.data(), &OwncloudPropagator::updateFileTotal,
-            this, &SyncEngine::updateFileTotal);
-        connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
-        connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
-        connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
-        connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
-        connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
-
-        // apply the network limits to the propagator
-        setNetworkLimits(_uploadLimit, _downloadLimit);
+        createPropagator();
 
         deleteStaleDownloadInfos(_syncItems);
         deleteStaleUploadInfos(_syncItems);
@@ -674,6 +722,7 @@ void SyncEngine::slotDiscoveryFinished()
         if (_needsUpdate)
             Q_EMIT started();
 
+        _phaseProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("propagation"));
         _propagator->start(std::move(_syncItems));
 
         qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QStringLiteral("Post-Reconcile Finished")) << "ms";
@@ -711,23 +760,126 @@ void SyncEngine::slotDiscoveryFinished()
     finish();
 }
 
+void SyncEngine::createPropagator()
+{
+    _propagator = QSharedPointer<OwncloudPropagator>::create(_account, syncOptions(), _baseUrl, _localPath, _remotePath, _journal);
+    connect(_propagator.data(), &OwncloudPropagator::itemCompleted,
+        this, &SyncEngine::slotItemCompleted);
+    connect(_propagator.data(), &OwncloudPropagator::progress,
+        this, &SyncEngine::slotProgress);
+    connect(_propagator.data(), &OwncloudPropagator::updateFileTotal,
+        this, &SyncEngine::updateFileTotal);
+    connect(_propagator.data(), &OwncloudPropagator::finished, this, &SyncEngine::slotPropagationFinished, Qt::QueuedConnection);
+    connect(_propagator.data(), &OwncloudPropagator::seenLockedFile, this, &SyncEngine::seenLockedFile);
+    connect(_propagator.data(), &OwncloudPropagator::touchedFile, this, &SyncEngine::slotAddTouchedFile);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientLocalStorage, this, &SyncEngine::slotInsufficientLocalStorage);
+    connect(_propagator.data(), &OwncloudPropagator::insufficientRemoteStorage, this, &SyncEngine::slotInsufficientRemoteStorage);
+    connect(_propagator.data(), &OwncloudPropagator::newItem, this, &SyncEngine::slotNewItem);
+    connect(_propagator.data(), &OwncloudPropagator::hydrationProgress, this, &SyncEngine::hydrationProgress);
+    for (const auto &[path, priority] : Utility::asKeyValueRange(_hydrationRequests)) {
+        _propagator->addHydrationRequest(path, priority);
+    }
+    _hydrationRequests.clear();
+
+    // apply the network limits to the propagator
+    setNetworkLimits(_uploadLimit, _downloadLimit);
+}
+
+bool SyncEngine::canStreamPropagation()
+{
+    return syncOptions()._maxStreamedItems > 0 && _journal->isMetadataTableEmpty()
+        // nothing to restore, see restoreOldFiles()
+        && _journal->dataFingerprint().isEmpty()
+        // the filter needs all the items
+        && !syncOptions().fileRegex().isValid() && qEnvironmentVariableIsEmpty("OWNCLOUD_POST_UPDATE_SCRIPT");
+}
+
+void SyncEngine::startStreamedPropagation()
+{
+    qCInfo(lcEngine) << "#### Propagation start while discovering ####################################################"
+                     << _stopWatch.addLapTime(QStringLiteral("Streamed propagation start")) << "ms";
+
+    // the items follow with aboutToPropagateMore()
+    emit aboutToPropagate(SyncFileItemSet());
+
+    _progressInfo->_status = ProgressInfo::Propagation;
+    emit transmissionProgress(*_progressInfo);
+    _progressInfo->startEstimateUpdates();
+
+    _journal->commitIfNeededAndStartNewTransaction(QStringLiteral("Streamed propagation"));
+
+    // The stale download and upload infos and blacklist entries are kept,
+    // the next sync with all items removes them.
+    createPropagator();
+    connect(_propagator.data(), &OwncloudPropagator::waitingForItems, this, &SyncEngine::slotPropagatorWaitingForItems);
+
+    if (_needsUpdate)
+        Q_EMIT started();
+
+    _propagator->startAppending();
+}
+
+void SyncEngine::streamItems()
+{
+    if (_syncItems.empty()) {
+        return;
+    }
+    if (!_propagator) {
+        startStreamedPropagation();
+    }
+    sortAndRemoveDuplicates(_syncItems);
+    _streamedItemsPending += _syncItems.size();
+    emit aboutToPropagateMore(_syncItems);
+    _propagator->append(std::move(_syncItems));
+    _syncItems.clear();
+
+    if (_streamedItemsPending >= syncOptions()._maxStreamedItems && _discoveryPhase) {
+        _discoveryPhase->setPaused(true);
+    }
+}
+
+void SyncEngine::stopStreamedDiscovery()
+{
+    if (!_discoveryPhase || !_propagator || !_propagator->isAppending()) {
+        return;
+    }
+    disconnect(_discoveryPhase.data(), nullptr, this, nullptr);
+    _discoveryPhase.take()->deleteLater();
+}
+
+void SyncEngine::slotDirectoryDiscovered(const QString &path)
+{
+    // a directory that was not handed over has nothing to close
+    if (!_propagator && _syncItems.empty()) {
+        return;
+    }
+    // its last items go first
+    streamItems();
+    _propagator->closeDirectory(path);
+}
+
+void SyncEngine::slotPropagatorWaitingForItems()
+{
+    // the items that never completed were skipped
+    _streamedItemsPending = 0;
+    if (_discoveryPhase) {
+        _discoveryPhase->setPaused(false);
+    }
+}
+
 void SyncEngine::setNetworkLimits(int upload, int download)
 {
     _uploadLimit = upload;
     _downloadLimit = download;
 
     if (_propagator) {
-        if (upload != 0 || download != 0) {
-            qCInfo(lcEngine) << "Network Limits (down/up) " << upload << download;
-            if (!_propagator->_bandwidthManager) {
-                _propagator->_bandwidthManager = new BandwidthManager(_propagator.data());
-            }
-        }
-        // this might set the limit to 0 but only the next sync will have no bandwithd manager set
-        if (_propagator->_bandwidthManager) {
-            _propagator->_bandwidthManager->setCurrentDownloadLimit(download);
-            _propagator->_bandwidthManager->setCurrentUploadLimit(upload);
+        qCInfo(lcEngine) << "Network Limits (down/up) " << upload << download;
+        // The bandwidth manager is always needed, limits might also be set globally or for the account
+        if (!_propagator->_bandwidthManager) {
+            _propagator->_bandwidthManager = new BandwidthManager(_propagator.data());
         }
+        _propagator->_bandwidthManager->setCurrentDownloadLimit(download);
+        _propagator->_bandwidthManager->setCurrentUploadLimit(upload);
     }
 }
 
@@ -744,10 +896,18 @@ void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
 
     emit transmissionProgress(*_progressInfo);
     emit itemCompleted(item);
+
+    if (_streaming && _streamedItemsPending > 0 && --_streamedItemsPending < syncOptions()._maxStreamedItems / 2 && _discoveryPhase) {
+        _discoveryPhase->setPaused(false);
+    }
 }
 
 void SyncEngine::slotPropagationFinished(bool success)
 {
+    // the propagation of a streamed sync was aborted
+    stopStreamedDiscovery();
+
+    _phaseProfileTimer = SyncProfiler::Timer("sync", QByteArrayLiteral("finalize"));
     if (_propagator->_anotherSyncNeeded && _anotherSyncNeeded == NoFollowUpSync) {
         _anotherSyncNeeded = ImmediateFollowUp;
     }
@@ -765,6 +925,7 @@ void SyncEngine::slotPropagationFinished(bool success)
     }
 
     _journal->deleteStaleFlagsEntries();
+    _journal->deleteStaleChecksumCacheEntries();
     _journal->commit(QStringLiteral("All Finished."), false);
 
     // Send final progress information even if no
@@ -779,8 +940,29 @@ void SyncEngine::slotPropagationFinished(bool success)
 
 void SyncEngine::finalize(bool success)
 {
-    qCInfo(lcEngine) << "Sync run took " << _stopWatch.addLapTime(QStringLiteral("Sync Finished")) << "ms";
+    const auto syncDuration = _stopWatch.addLapTime(QStringLiteral("Sync Finished"));
+    qCInfo(lcEngine) << "Sync run took " << syncDuration << "ms";
     _stopWatch.stop();
+    if (Metrics::isEnabled()) {
+        auto *metrics = Metrics::instance();
+        metrics->counter("owncloud_syncs_total", "The finished syncs", { { "folder", _localPath }, { "result", success ? QStringLiteral("success") : QStringLiteral("failure") } })
+            ->increment();
+        metrics->histogram("owncloud_sync_duration_seconds", "The duration of the syncs", Metrics::durationBuckets(), { { "folder", _localPath } })
+            ->observe(syncDuration / 1000.0);
+    }
+
+    _phaseProfileTimer.finish();
+    _syncProfileTimer.finish();
+    if (SyncProfiler::isEnabled()) {
+        qCInfo(lcEngine).noquote() << SyncProfiler::report();
+        const QString traceDir = SyncProfiler::traceDirectory();
+        if (!traceDir.isEmpty() && QDir().mkpath(traceDir)) {
+            const QString traceFile = QDir(traceDir).filePath(QStringLiteral("sync-%1.json").arg(QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-hhmmss-zzz"))));
+            if (!SyncProfiler::writeChromeTrace(traceFile)) {
+                qCWarning(lcEngine) << "Failed to write the sync profile to" << traceFile;
+            }
+        }
+    }
 
     if (_discoveryPhase) {
         _discoveryPhase.take()->deleteLater();
@@ -919,6 +1101,45 @@ void SyncEngine::setLocalDiscoveryOptions(LocalDiscoveryStyle style, std::set<QS
     }
 }
 
+void SyncEngine::setLocalRenameHints(const QHash<QString, QString> &hints, bool complete)
+{
+    _localRenameHints = hints;
+    _localRenameHintsComplete = complete;
+}
+
+void SyncEngine::requestHydration(const QString &path, HydrationQueue::Priority priority)
+{
+    const QString file = syncOptions()._vfs->underlyingFileName(path);
+    _hydrationRequests.insert(file, priority);
+    if (!_propagator) {
+        return;
+    }
+    _propagator->addHydrationRequest(file, priority);
+
+    // a virtual file doesn't need to wait for the next sync
+    SyncJournalFileRecord record;
+    if (_journal->getFileRecord(path, &record) && record.isValid() && record.isVirtualFile()) {
+        auto item = SyncFileItem::fromSyncJournalFileRecord(record);
+        item->_file = file;
+        item->_originalFile = file;
+        item->_type = ItemTypeVirtualFileDownload;
+        item->_instruction = CSYNC_INSTRUCTION_SYNC;
+        item->_direction = SyncFileItem::Down;
+        if (!_propagator->hydrate(item)) {
+            qCInfo(lcEngine) << "The hydration of" << path << "has to wait for the next sync";
+        }
+    }
+}
+
+void SyncEngine::cancelHydration(const QString &path)
+{
+    const QString file = syncOptions()._vfs->underlyingFileName(path);
+    _hydrationRequests.remove(file);
+    if (_propagator) {
+        _propagator->cancelHydrationRequest(file);
+    }
+}
+
 bool SyncEngine::shouldDiscoverLocally(const QString &path) const
 {
     if (_localDiscoveryStyle == LocalDiscoveryStyle::FilesystemOnly) {
@@ -989,7 +1210,9 @@ void SyncEngine::abort()
         qCInfo(lcEngine) << "Aborting sync";
 
     if (_propagator) {
-        // If we're already in the propagation phase, aborting that is sufficient
+        // If we're already in the propagation phase, aborting that is sufficient,
+        // unless a streamed sync still discovers
+        stopStreamedDiscovery();
         _propagator->abort();
     } else if (_discoveryPhase) {
         // Delete the discovery and all child jobs after ensuring
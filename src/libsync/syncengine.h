@@ -33,6 +33,7 @@
 #include "syncfilestatustracker.h"
 #include "accountfwd.h"
 #include "discoveryphase.h"
+#include "owncloudpropagator.h"
 #include "common/checksums.h"
 
 #include <optional>
@@ -81,13 +82,20 @@ public:
     void setSyncOptions(const SyncOptions &options)
     {
         _syncOptions = options;
+        _syncFileStatusTracker->setExcludeOptions(options._vfs, _ignore_hidden_files);
     }
     bool ignoreHiddenFiles() const { return _ignore_hidden_files; }
-    void setIgnoreHiddenFiles(bool ignore) { _ignore_hidden_files = ignore; }
+    void setIgnoreHiddenFiles(bool ignore)
+    {
+        _ignore_hidden_files = ignore;
+        _syncFileStatusTracker->setExcludeOptions(_syncOptions ? _syncOptions->_vfs : QSharedPointer<Vfs>(), ignore);
+    }
 
     ExcludedFiles &excludedFiles() { return *_excludedFiles; }
     Utility::StopWatch &stopWatch() { return _stopWatch; }
     SyncFileStatusTracker &syncFileStatusTracker() { return *_syncFileStatusTracker; }
+    /// The progress of the current or last sync, as in transmissionProgress()
+    const ProgressInfo &progressInfo() const { return *_progressInfo; }
 
     /* Returns whether another sync is needed to complete the sync */
     AnotherSyncNeeded isAnotherSyncNeeded() { return _anotherSyncNeeded; }
@@ -132,6 +140,28 @@ public:
      */
     bool shouldDiscoverLocally(const QString &path) const;
 
+    /**
+     * Renames reported by the folder watcher for the next sync, mapping the new
+     * to the old path relative to the synced folder.
+     *
+     * If complete is set, these are all local renames since the last sync. That
+     * is only used with LocalDiscoveryStyle::DatabaseAndFilesystem.
+     */
+    void setLocalRenameHints(const QHash<QString, QString> &hints, bool complete);
+
+    /**
+     * Requests the hydration of a virtual file or of everything below a folder,
+     * see HydrationQueue.
+     *
+     * The path is relative to the synced folder, with the suffix for suffix
+     * virtual files. While the propagation runs, a virtual file is hydrated
+     * right away if possible. The request also applies to the next sync.
+     */
+    void requestHydration(const QString &path, HydrationQueue::Priority priority);
+
+    /** Cancels a request of requestHydration(), see HydrationQueue::cancelRequest() */
+    void cancelHydration(const QString &path);
+
     /** Access the last sync run's local discovery style */
     LocalDiscoveryStyle lastLocalDiscoveryStyle() const { return _lastLocalDiscoveryStyle; }
 
@@ -154,6 +184,9 @@ signals:
     // after the above signals. with the items that actually need propagating
     void aboutToPropagate(const SyncFileItemSet &items);
 
+    // in a streamed sync, after aboutToPropagate() with the items that are handed to the running propagation
+    void aboutToPropagateMore(const SyncFileItemSet &items);
+
     // after each item completed by a job (successful or not)
     void itemCompleted(const SyncFileItemPtr &);
 
@@ -182,6 +215,9 @@ signals:
      */
     void seenLockedFile(const QString &fileName, FileSystem::LockMode mode);
 
+    /** The progress of a request of requestHydration() */
+    void hydrationProgress(const QString &path, const HydrationQueue::Progress &progress);
+
 private slots:
     void slotFolderDiscovered(bool local, const QString &folder);
     void slotRootEtagReceived(const QString &, const QDateTime &time);
@@ -198,7 +234,9 @@ private slots:
     void slotNewItem(const SyncFileItemPtr &item);
 
     void slotItemCompleted(const SyncFileItemPtr &item);
+    void slotDirectoryDiscovered(const QString &path);
     void slotDiscoveryFinished();
+    void slotPropagatorWaitingForItems();
     void slotPropagationFinished(bool success);
     void slotProgress(const SyncFileItem &item, qint64 curent);
     void updateFileTotal(const SyncFileItem &item, qint64 newSize);
@@ -234,9 +272,32 @@ private:
     // cleanup and emit the finished signal
     void finalize(bool success);
 
+    void createPropagator();
+
+    /** Whether the propagation can start while the discovery runs.
+     *
+     * Only in the first sync of a folder: without file records the discovery
+     * finds no renames or removals and a directory's instruction is final once
+     * it was listed. The discovery pauses while _maxStreamedItems wait for the
+     * propagation, so the memory depends on the directories in progress
+     * instead of the whole tree.
+     */
+    bool canStreamPropagation();
+    void startStreamedPropagation();
+    // hands the discovered items to the propagator, in a streamed sync
+    void streamItems();
+    // stops the discovery when the propagation of a streamed sync ends early
+    void stopStreamedDiscovery();
+
     // Must only be acessed during update and reconcile
+    // In a streamed sync, the items that were not handed to the propagator yet
     SyncFileItemSet _syncItems;
 
+    // see canStreamPropagation()
+    bool _streaming = false;
+    // the items handed to the propagator that didn't complete yet
+    qint64 _streamedItemsPending = 0;
+
     AccountPtr _account;
     const QUrl _baseUrl;
     bool _needsUpdate;
@@ -248,6 +309,9 @@ private:
     QScopedPointer<DiscoveryPhase> _discoveryPhase;
     QSharedPointer<OwncloudPropagator> _propagator;
 
+    // the hydration requests for the next propagation
+    QMap<QString, HydrationQueue::Priority> _hydrationRequests;
+
     // List of all files with conflicts
     QSet<QString> _seenConflictFiles;
 
@@ -256,6 +320,9 @@ private:
     QScopedPointer<ExcludedFiles> _excludedFiles;
     QScopedPointer<SyncFileStatusTracker> _syncFileStatusTracker;
     Utility::StopWatch _stopWatch;
+    // the whole sync and its current phase, see SyncProfiler
+    SyncProfiler::Timer _syncProfileTimer;
+    SyncProfiler::Timer _phaseProfileTimer;
 
     /**
      * check if we are allowed to propagate everything, and if we are not, adjust the instructions
@@ -304,6 +371,9 @@ private:
     // must be ordered
     std::set<QString> _localDiscoveryPaths;
 
+    QHash<QString, QString> _localRenameHints;
+    bool _localRenameHintsComplete = false;
+
     // destructor called
     bool _goingDown = false;
 };
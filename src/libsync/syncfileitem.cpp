@@ -21,8 +21,61 @@
 
 #include <QCoreApplication>
 
+#include <algorithm>
+#include <array>
+
+namespace {
+struct SortEntry
+{
+    const QChar *path;
+    int size;
+    OCC::SyncFileItemPtr item;
+};
+
+// ranges this small are left to std::stable_sort()
+constexpr size_t smallRangeC = 32;
+
+// The bucket of the byte of the path at depth, two per character. The end of the path
+// comes first and '/' right after it, so "foo" < "foo/bar" < "foo-bar" like in operator<().
+int bucket(const SortEntry &entry, int depth)
+{
+    const int index = depth / 2;
+    if (index >= entry.size) {
+        return 0;
+    }
+    const ushort c = entry.path[index] == QLatin1Char('/') ? 0 : entry.path[index].unicode();
+    return (depth % 2 == 0 ? c >> 8 : c & 0xff) + 1;
+}
+
+bool lessPath(const SortEntry &a, const SortEntry &b)
+{
+    const int minSize = std::min(a.size, b.size);
+    int prefix = 0;
+    while (prefix < minSize && a.path[prefix] == b.path[prefix]) {
+        prefix++;
+    }
+    if (prefix == b.size) {
+        return false;
+    }
+    if (prefix == a.size) {
+        return true;
+    }
+    if (a.path[prefix] == QLatin1Char('/')) {
+        return true;
+    }
+    if (b.path[prefix] == QLatin1Char('/')) {
+        return false;
+    }
+    return a.path[prefix] < b.path[prefix];
+}
+}
+
 namespace OCC {
 
+// A sync keeps an item for every changed file, don't let padding creep back in.
+// The nine strings and byte arrays take a pointer each with Qt 5 and three with Qt 6.
+static_assert(sizeof(void *) != 8 || sizeof(SyncFileItem) <= 144 + 9 * (sizeof(QString) - sizeof(void *)), "SyncFileItem grew");
+
 Q_LOGGING_CATEGORY(lcFileItem, "sync.fileitem", QtInfoMsg)
 
 SyncJournalFileRecord SyncFileItem::toSyncJournalFileRecordWithInode(const QString &localFileName) const
@@ -75,6 +128,68 @@ SyncFileItemPtr SyncFileItem::fromSyncJournalFileRecord(const SyncJournalFileRec
     return item;
 }
 
+void sortByDestination(SyncFileItemSet &items)
+{
+    // The paths are looked up once, the items are not touched while sorting
+    std::vector<SortEntry> entries;
+    entries.reserve(items.size());
+    for (auto &item : items) {
+        const QString &destination = item->_renameTarget.isEmpty() ? item->_file : item->_renameTarget;
+        entries.push_back({ destination.constData(), destination.size(), std::move(item) });
+    }
+
+    // Most significant byte first, each bucket is sorted by the following bytes
+    struct Range
+    {
+        size_t begin;
+        size_t end;
+        int depth;
+    };
+    std::vector<SortEntry> scratch(entries.size());
+    std::vector<Range> ranges = { { 0, entries.size(), 0 } };
+    while (!ranges.empty()) {
+        const Range range = ranges.back();
+        ranges.pop_back();
+        if (range.end - range.begin <= smallRangeC) {
+            // stable like the scatter below, of duplicates the first discovered stays first
+            std::stable_sort(entries.begin() + range.begin, entries.begin() + range.end, lessPath);
+            continue;
+        }
+
+        std::array<size_t, 258> starts = {};
+        for (size_t i = range.begin; i < range.end; ++i) {
+            ++starts[bucket(entries[i], range.depth) + 1];
+        }
+        // a shared prefix, like the parent directories, doesn't move anything
+        if (std::find(starts.cbegin(), starts.cend(), range.end - range.begin) != starts.cend()) {
+            if (starts[1] == 0) {
+                ranges.push_back({ range.begin, range.end, range.depth + 1 });
+            }
+            continue;
+        }
+        for (size_t b = 1; b < starts.size(); ++b) {
+            starts[b] += starts[b - 1];
+        }
+        auto next = starts;
+        for (size_t i = range.begin; i < range.end; ++i) {
+            const int b = bucket(entries[i], range.depth);
+            scratch[range.begin + next[b]++] = std::move(entries[i]);
+        }
+        std::move(scratch.begin() + range.begin, scratch.begin() + range.end, entries.begin() + range.begin);
+
+        // the paths that ended are equal
+        for (size_t b = 1; b + 1 < starts.size(); ++b) {
+            if (starts[b + 1] - starts[b] > 1) {
+                ranges.push_back({ range.begin + starts[b], range.begin + starts[b + 1], range.depth + 1 });
+            }
+        }
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        items[i] = std::move(entries[i].item);
+    }
+}
+
 template <>
 QString Utility::enumToDisplayName(SyncFileItem::Status s)
 {
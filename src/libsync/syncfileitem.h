@@ -19,9 +19,10 @@
 #include <QString>
 #include <QDateTime>
 #include <QMetaType>
+#include <QSharedData>
 #include <QSharedPointer>
 
-#include <set>
+#include <vector>
 
 #include "common/syncjournaldb.h"
 #include "common/utility.h"
@@ -123,6 +124,7 @@ public:
         , _status(NoStatus)
         , _isRestoration(false)
         , _isSelectiveSync(false)
+        , _relevantDirectoyInstruction(false)
         , _httpErrorCode(0)
         , _affectedItems(1)
         , _instruction(CSYNC_INSTRUCTION_NONE)
@@ -131,7 +133,6 @@ public:
         , _inode(0)
         , _previousSize(0)
         , _previousModtime(0)
-        , _relevantDirectoyInstruction(false)
     {
     }
 
@@ -254,10 +255,12 @@ public:
     Status _status;
     bool _isRestoration; // The original operation was forbidden, and this is a restoration
     bool _isSelectiveSync; // The file is removed or ignored because it is in the selective sync list
+    // the flags are kept next to each other, a sync holds an item for every changed file
+    bool _relevantDirectoyInstruction;
     quint16 _httpErrorCode;
     RemotePermissions _remotePerm;
+    bool _finished = false;
     QString _errorString; // Contains a string only in case of error
-    QString _messageString; // Contains a string only in case of hand crafted events
     QByteArray _responseTimeStamp;
     QByteArray _requestId; // X-Request-Id of the failed request
     quint32 _affectedItems; // the number of affected items by the operation on this item.
@@ -283,11 +286,14 @@ public:
     qint64 _previousSize;
     time_t _previousModtime;
 
-    QString _directDownloadUrl;
-    QString _directDownloadCookies;
-
-    bool _relevantDirectoyInstruction = false;
-    bool _finished = false;
+    /// Only few servers offer a direct download, the items without one keep just a null pointer
+    struct DirectDownload : public QSharedData
+    {
+        QString url;
+        QString cookies;
+    };
+    using DirectDownloadPtr = QExplicitlySharedDataPointer<DirectDownload>;
+    DirectDownloadPtr _directDownload;
 
     auto toUploadInfo() const
     {
@@ -310,7 +316,22 @@ inline bool operator<(const SyncFileItemPtr &item1, const SyncFileItemPtr &item2
     return *item1 < *item2;
 }
 
-using SyncFileItemSet = std::set<SyncFileItemPtr>;
+/**
+ * The items of a sync.
+ *
+ * The discovery appends them in any order, sortByDestination() brings them into
+ * the order of operator<() once, before the propagation.
+ */
+using SyncFileItemSet = std::vector<SyncFileItemPtr>;
+
+/**
+ * Sorts the items like operator<(), a directory comes right before its contents.
+ *
+ * A radix sort on the destinations, it doesn't compare each path against
+ * log(n) others like std::sort(). The sort is stable, items with the same
+ * destination keep their order.
+ */
+OWNCLOUDSYNC_EXPORT void sortByDestination(SyncFileItemSet &items);
 }
 
 Q_DECLARE_METATYPE(OCC::SyncFileItemSet)
@@ -19,14 +19,23 @@
 #include "common/syncjournalfilerecord.h"
 #include "common/asserts.h"
 #include "csync_exclude.h"
+#include "common/vfs.h"
 
 #include <QFileInfo>
 #include <QLoggingCategory>
 
+#include <algorithm>
+#include <functional>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcStatusTracker, "sync.statustracker", QtInfoMsg)
 
+namespace {
+    // A huge folder shouldn't keep megabytes of statuses around
+    constexpr int MaxCachedStatuses = 100000;
+}
+
 bool SyncFileStatusTracker::PathComparator::operator()( const QString& lhs, const QString& rhs ) const
 {
     // This will make sure that the std::map is ordered and queried case-insensitively on macOS and Windows.
@@ -90,16 +99,66 @@ static inline bool hasExcludedStatus(const SyncFileItem &item)
 }
 
 SyncFileStatusTracker::SyncFileStatusTracker(SyncEngine *syncEngine)
-    : _syncEngine(syncEngine)
+    : _localPath(syncEngine->localPath())
+    , _excludes(&syncEngine->excludedFiles())
+    , _journal(syncEngine->journal())
     , _caseSensitivity(Utility::fsCaseSensitivity())
 {
     connect(syncEngine, &SyncEngine::aboutToPropagate,
         this, &SyncFileStatusTracker::slotAboutToPropagate);
+    connect(syncEngine, &SyncEngine::aboutToPropagateMore,
+        this, &SyncFileStatusTracker::slotAboutToPropagateMore);
     connect(syncEngine, &SyncEngine::itemCompleted,
         this, &SyncFileStatusTracker::slotItemCompleted);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncFinished);
     connect(syncEngine, &SyncEngine::started, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
     connect(syncEngine, &SyncEngine::finished, this, &SyncFileStatusTracker::slotSyncEngineRunningChanged);
+
+    connect(this, &SyncFileStatusTracker::fileStatusChanged, this, [this](const QString &systemFileName) {
+        QMutexLocker locker(&_mutex);
+        ++_statusCacheGeneration;
+        if (!_statusCache.isEmpty()) {
+            _statusCache.remove(statusCacheKey(systemFileName.mid(_localPath.size())));
+        }
+    });
+}
+
+QString SyncFileStatusTracker::statusCacheKey(const QString &relativePath) const
+{
+    return _caseSensitivity == Qt::CaseSensitive ? relativePath : relativePath.toCaseFolded();
+}
+
+SyncFileStatus SyncFileStatusTracker::cachedFileStatus(const QString &relativePath)
+{
+    const QString key = statusCacheKey(relativePath);
+    quint64 generation;
+    {
+        QMutexLocker locker(&_mutex);
+        auto it = _statusCache.constFind(key);
+        if (it != _statusCache.constEnd()) {
+            return it.value();
+        }
+        generation = _statusCacheGeneration;
+    }
+
+    const auto status = fileStatus(relativePath);
+
+    QMutexLocker locker(&_mutex);
+    // don't remember a result that was outdated while we computed it on another thread
+    if (generation == _statusCacheGeneration) {
+        if (_statusCache.size() >= MaxCachedStatuses) {
+            _statusCache.clear();
+        }
+        _statusCache.insert(key, status);
+    }
+    return status;
+}
+
+void SyncFileStatusTracker::setExcludeOptions(const QSharedPointer<Vfs> &vfs, bool ignoreHiddenFiles)
+{
+    QMutexLocker locker(&_mutex);
+    _vfs = vfs;
+    _ignoreHiddenFiles = ignoreHiddenFiles;
 }
 
 SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
@@ -108,10 +167,11 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
 
     if (relativePath.isEmpty()) {
         // This is the root sync folder, it doesn't have an entry in the database and won't be walked by csync, so resolve manually.
+        QMutexLocker locker(&_mutex);
         return resolveSyncAndErrorStatus(QString(), NotShared);
     }
 
-    const QString absolutePath = _syncEngine->localPath() + relativePath;
+    const QString absolutePath = _localPath + relativePath;
 
     if (!QFileInfo::exists(absolutePath)) {
         return SyncFileStatus(SyncFileStatus::StatusNone);
@@ -125,121 +185,190 @@ SyncFileStatus SyncFileStatusTracker::fileStatus(const QString &relativePath)
     // it's an acceptable compromize to treat all exclude types the same.
     // Update: This extra check shouldn't hurt even though silently excluded files
     // are now available via slotAddSilentlyExcluded().
-    if (_syncEngine->excludedFiles().isExcluded(_syncEngine->syncOptions()._vfs->underlyingFileName(absolutePath),
-            _syncEngine->localPath(),
-            _syncEngine->ignoreHiddenFiles())) {
+    QSharedPointer<Vfs> vfs;
+    bool ignoreHiddenFiles;
+    {
+        QMutexLocker locker(&_mutex);
+        vfs = _vfs;
+        ignoreHiddenFiles = _ignoreHiddenFiles;
+    }
+    if (_excludes->isExcluded(vfs ? vfs->underlyingFileName(absolutePath) : absolutePath, _localPath, ignoreHiddenFiles)) {
         return SyncFileStatus(SyncFileStatus::StatusExcluded);
     }
 
-    if (_dirtyPaths.contains(relativePath))
-        return SyncFileStatus::StatusSync;
+    {
+        QMutexLocker locker(&_mutex);
+        if (_dirtyPaths.contains(relativePath))
+            return SyncFileStatus::StatusSync;
+    }
 
     // First look it up in the database to know if it's shared
     SyncJournalFileRecord rec;
-    if (_syncEngine->journal()->getFileRecord(relativePath, &rec) && rec.isValid()) {
+    if (_journal->getFileRecord(relativePath, &rec) && rec.isValid()) {
+        QMutexLocker locker(&_mutex);
         return resolveSyncAndErrorStatus(relativePath, rec._remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared);
     }
 
     // Must be a new file not yet in the database, check if it's syncing or has an error.
+    QMutexLocker locker(&_mutex);
     return resolveSyncAndErrorStatus(relativePath, NotShared, PathUnknown);
 }
 
 void SyncFileStatusTracker::slotPathTouched(const QString &fileName)
 {
-    QString folderPath = _syncEngine->localPath();
+    QString folderPath = _localPath;
 
     OC_ASSERT(fileName.startsWith(folderPath));
     QString localPath = fileName.mid(folderPath.size());
-    _dirtyPaths.insert(localPath);
+    {
+        QMutexLocker locker(&_mutex);
+        _dirtyPaths.insert(localPath);
+    }
 
     emit fileStatusChanged(fileName, SyncFileStatus::StatusSync);
 }
 
 void SyncFileStatusTracker::slotAddSilentlyExcluded(const QString &folderPath)
 {
-    _syncProblems[folderPath] = SyncFileStatus::StatusExcluded;
+    {
+        QMutexLocker locker(&_mutex);
+        _syncProblems[folderPath] = SyncFileStatus::StatusExcluded;
+    }
     emit fileStatusChanged(getSystemDestination(folderPath), resolveSyncAndErrorStatus(folderPath, NotShared));
 }
 
-void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
+SyncFileStatusTracker::SyncCountNode *SyncFileStatusTracker::syncCountNode(const QString &relativePath, bool create)
 {
-    // Will return 0 (and increase to 1) if the path wasn't in the map yet
-    int count = _syncCount[relativePath]++;
-    if (!count) {
-        SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
-            : resolveSyncAndErrorStatus(relativePath, sharedFlag);
-        emit fileStatusChanged(getSystemDestination(relativePath), status);
-
-        // We passed from OK to SYNC, increment the parent to keep it marked as
-        // SYNC while we propagate ourselves and our own children.
-        OC_ASSERT(!relativePath.endsWith(QLatin1Char('/')));
-        int lastSlashIndex = relativePath.lastIndexOf(QLatin1Char('/'));
-        if (lastSlashIndex != -1)
-            incSyncCountAndEmitStatusChanged(relativePath.left(lastSlashIndex), UnknownShared);
-        else if (!relativePath.isEmpty())
-            incSyncCountAndEmitStatusChanged(QString(), UnknownShared);
+    SyncCountNode *node = &_syncCountRoot;
+    int start = 0;
+    while (node && start < relativePath.size()) {
+        int end = relativePath.indexOf(QLatin1Char('/'), start);
+        if (end == -1) {
+            end = relativePath.size();
+        }
+        // only look up the path component, without copying it
+        const QString name = QString::fromRawData(relativePath.constData() + start, end - start);
+        auto it = node->children.find(name);
+        if (it == node->children.end()) {
+            if (!create) {
+                return nullptr;
+            }
+            const QString key(name.constData(), name.size());
+            auto child = std::make_unique<SyncCountNode>();
+            child->parent = node;
+            child->name = key;
+            it = node->children.emplace(key, std::move(child)).first;
+        }
+        node = it->second.get();
+        start = end + 1;
     }
+    return node;
 }
 
-void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
+SyncFileStatusTracker::SyncCountNode *SyncFileStatusTracker::pruneSyncCountNode(SyncCountNode *node)
 {
-    int count = --_syncCount[relativePath];
-    if (!count) {
-        // Remove from the map, same as 0
-        _syncCount.remove(relativePath);
-
-        SyncFileStatus status = sharedFlag == UnknownShared
-            ? fileStatus(relativePath)
-            : resolveSyncAndErrorStatus(relativePath, sharedFlag);
-        emit fileStatusChanged(getSystemDestination(relativePath), status);
-
-        // We passed from SYNC to OK, decrement our parent.
-        OC_ASSERT(!relativePath.endsWith(QLatin1Char('/')));
-        int lastSlashIndex = relativePath.lastIndexOf(QLatin1Char('/'));
-        if (lastSlashIndex != -1)
-            decSyncCountAndEmitStatusChanged(relativePath.left(lastSlashIndex), UnknownShared);
-        else if (!relativePath.isEmpty())
-            decSyncCountAndEmitStatusChanged(QString(), UnknownShared);
+    SyncCountNode *parent = node->parent;
+    if (parent && node->count == 0 && node->children.empty()) {
+        // the key is destroyed with the node
+        const QString name = node->name;
+        parent->children.erase(name);
     }
+    return parent;
 }
 
-void SyncFileStatusTracker::slotAboutToPropagate(const SyncFileItemSet &items)
+void SyncFileStatusTracker::incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
 {
-    OC_ASSERT(_syncCount.isEmpty());
-
-    ProblemsMap oldProblems;
-    std::swap(_syncProblems, oldProblems);
+    SyncCountNode *node;
+    {
+        QMutexLocker locker(&_mutex);
+        node = syncCountNode(relativePath, true);
+        // Was 0 (and is increased to 1) if the path wasn't syncing yet
+        if (node->count++) {
+            return;
+        }
+    }
+    SyncFileStatus status = sharedFlag == UnknownShared
+        ? fileStatus(relativePath)
+        : resolveSyncAndErrorStatus(relativePath, sharedFlag);
+    emit fileStatusChanged(getSystemDestination(relativePath), status);
 
-    for (const auto &item : qAsConst(items)) {
-        qCDebug(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction;
-        _dirtyPaths.remove(item->destination());
-        _dirtyPaths.remove(item->_originalFile);
+    // We passed from OK to SYNC, increment the parents to keep them marked as
+    // SYNC while we propagate ourselves and our own children.
+    OC_ASSERT(!relativePath.endsWith(QLatin1Char('/')));
+    QString path = relativePath;
+    while (!path.isEmpty()) {
+        path.truncate(std::max(path.lastIndexOf(QLatin1Char('/')), 0));
+        node = node->parent;
+        {
+            QMutexLocker locker(&_mutex);
+            if (node->count++) {
+                return;
+            }
+        }
+        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
+    }
+}
 
-        if (hasErrorStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-            invalidateParentPaths(item->destination());
-        } else if (hasExcludedStatus(*item)) {
-            _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+void SyncFileStatusTracker::decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedFlag)
+{
+    SyncCountNode *node;
+    {
+        QMutexLocker locker(&_mutex);
+        node = syncCountNode(relativePath, false);
+        if (!node || node->count == 0) {
+            qCWarning(lcStatusTracker) << "Sync count of" << relativePath << "is already 0";
+            return;
+        }
+        if (--node->count) {
+            return;
         }
+        // Remove from the tree, same as 0
+        node = pruneSyncCountNode(node);
+    }
+    SyncFileStatus status = sharedFlag == UnknownShared
+        ? fileStatus(relativePath)
+        : resolveSyncAndErrorStatus(relativePath, sharedFlag);
+    emit fileStatusChanged(getSystemDestination(relativePath), status);
 
-        SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
-        if (item->_instruction != CSYNC_INSTRUCTION_NONE
-            && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA
-            && item->_instruction != CSYNC_INSTRUCTION_IGNORE
-            && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
-            // Mark this path as syncing for instructions that will result in propagation.
-            incSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
-        } else {
-            emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
+    // We passed from SYNC to OK, decrement our parents.
+    OC_ASSERT(!relativePath.endsWith(QLatin1Char('/')));
+    QString path = relativePath;
+    while (!path.isEmpty() && node) {
+        path.truncate(std::max(path.lastIndexOf(QLatin1Char('/')), 0));
+        {
+            QMutexLocker locker(&_mutex);
+            if (node->count == 0 || --node->count) {
+                return;
+            }
+            node = pruneSyncCountNode(node);
         }
+        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
     }
+}
+
+void SyncFileStatusTracker::slotAboutToPropagate(const SyncFileItemSet &items)
+{
+    OC_ASSERT(_syncCountRoot.count == 0 && _syncCountRoot.children.empty());
+
+    // Many errors share their parents, emit each of them only once at the end
+    std::set<QString> invalidatedParents;
+
+    ProblemsMap oldProblems;
+    {
+        QMutexLocker locker(&_mutex);
+        std::swap(_syncProblems, oldProblems);
+    }
+
+    markAboutToPropagate(items, invalidatedParents);
 
     // Some metadata status won't trigger files to be synced, make sure that we
     // push the OK status for dirty files that don't need to be propagated.
     // Swap into a copy since fileStatus() reads _dirtyPaths to determine the status
     QSet<QString> oldDirtyPaths;
-    std::swap(_dirtyPaths, oldDirtyPaths);
+    {
+        QMutexLocker locker(&_mutex);
+        std::swap(_dirtyPaths, oldDirtyPaths);
+    }
     for (auto it = oldDirtyPaths.constBegin(); it != oldDirtyPaths.constEnd(); ++it)
         emit fileStatusChanged(getSystemDestination(*it), fileStatus(*it));
 
@@ -251,22 +380,69 @@ void SyncFileStatusTracker::slotAboutToPropagate(const SyncFileItemSet &items)
         const QString &path = it->first;
         SyncFileStatus::SyncFileStatusTag severity = it->second;
         if (severity == SyncFileStatus::StatusError)
-            invalidateParentPaths(path);
+            collectParentPaths(path, invalidatedParents);
         emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
     }
+
+    invalidateParentPaths(invalidatedParents);
+}
+
+void SyncFileStatusTracker::slotAboutToPropagateMore(const SyncFileItemSet &items)
+{
+    std::set<QString> invalidatedParents;
+    markAboutToPropagate(items, invalidatedParents);
+    invalidateParentPaths(invalidatedParents);
+}
+
+void SyncFileStatusTracker::markAboutToPropagate(const SyncFileItemSet &items, std::set<QString> &invalidatedParents)
+{
+    for (const auto &item : qAsConst(items)) {
+        qCDebug(lcStatusTracker) << "Investigating" << item->destination() << item->_status << item->_instruction;
+        {
+            QMutexLocker locker(&_mutex);
+            _dirtyPaths.remove(item->destination());
+            _dirtyPaths.remove(item->_originalFile);
+            if (hasErrorStatus(*item)) {
+                _syncProblems[item->destination()] = SyncFileStatus::StatusError;
+            } else if (hasExcludedStatus(*item)) {
+                _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+            }
+        }
+        if (hasErrorStatus(*item)) {
+            collectParentPaths(item->destination(), invalidatedParents);
+        }
+
+        SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
+        if (item->_instruction != CSYNC_INSTRUCTION_NONE
+            && item->_instruction != CSYNC_INSTRUCTION_UPDATE_METADATA
+            && item->_instruction != CSYNC_INSTRUCTION_IGNORE
+            && item->_instruction != CSYNC_INSTRUCTION_ERROR) {
+            // Mark this path as syncing for instructions that will result in propagation.
+            incSyncCountAndEmitStatusChanged(item->destination(), sharedFlag);
+        } else {
+            emit fileStatusChanged(getSystemDestination(item->destination()), resolveSyncAndErrorStatus(item->destination(), sharedFlag));
+        }
+    }
 }
 
 void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
 {
     qCDebug(lcStatusTracker) << "Item completed" << item->destination() << item->_status << item->_instruction;
 
+    {
+        QMutexLocker locker(&_mutex);
+        if (hasErrorStatus(*item)) {
+            _syncProblems[item->destination()] = SyncFileStatus::StatusError;
+        } else if (hasExcludedStatus(*item)) {
+            _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
+        } else {
+            _syncProblems.erase(item->destination());
+        }
+    }
     if (hasErrorStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusError;
-        invalidateParentPaths(item->destination());
-    } else if (hasExcludedStatus(*item)) {
-        _syncProblems[item->destination()] = SyncFileStatus::StatusExcluded;
-    } else {
-        _syncProblems.erase(item->destination());
+        std::set<QString> parents;
+        collectParentPaths(item->destination(), parents);
+        invalidateParentPaths(parents);
     }
 
     SharedFlag sharedFlag = item->_remotePerm.hasPermission(RemotePermissions::IsShared) ? Shared : NotShared;
@@ -284,14 +460,33 @@ void SyncFileStatusTracker::slotItemCompleted(const SyncFileItemPtr &item)
 void SyncFileStatusTracker::slotSyncFinished()
 {
     // Clear the sync counts to reduce the impact of unsymetrical inc/dec calls (e.g. when directory job abort)
-    QHash<QString, int> oldSyncCount;
-    std::swap(_syncCount, oldSyncCount);
-    for (auto it = oldSyncCount.begin(); it != oldSyncCount.end(); ++it)
-        emit fileStatusChanged(getSystemDestination(it.key()), fileStatus(it.key()));
+    QStringList oldSyncPaths;
+    const std::function<void(const SyncCountNode &, const QString &)> collect = [&](const SyncCountNode &node, const QString &path) {
+        for (const auto &child : node.children) {
+            collect(*child.second, path.isEmpty() ? child.first : path + QLatin1Char('/') + child.first);
+        }
+        if (node.count) {
+            oldSyncPaths.append(path);
+        }
+    };
+    collect(_syncCountRoot, QString());
+    {
+        QMutexLocker locker(&_mutex);
+        _syncCountRoot.children.clear();
+        _syncCountRoot.count = 0;
+    }
+    for (const auto &path : qAsConst(oldSyncPaths))
+        emit fileStatusChanged(getSystemDestination(path), fileStatus(path));
 }
 
 void SyncFileStatusTracker::slotSyncEngineRunningChanged()
 {
+    // the sync might have changed the db and the excludes without telling us about every file
+    {
+        QMutexLocker locker(&_mutex);
+        ++_statusCacheGeneration;
+        _statusCache.clear();
+    }
     emit fileStatusChanged(getSystemDestination(QString()), resolveSyncAndErrorStatus(QString(), NotShared));
 }
 
@@ -300,7 +495,8 @@ SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &r
     // If it's a new file and that we're not syncing it yet,
     // don't show any icon and wait for the filesystem watcher to trigger a sync.
     SyncFileStatus status(isPathKnown ? SyncFileStatus::StatusUpToDate : SyncFileStatus::StatusNone);
-    if (_syncCount.value(relativePath)) {
+    const auto *syncCount = syncCountNode(relativePath, false);
+    if (syncCount && syncCount->count) {
         status.set(SyncFileStatus::StatusSync);
     } else {
         // After a sync finished, we need to show the users issues from that last sync like the activity list does.
@@ -318,18 +514,28 @@ SyncFileStatus SyncFileStatusTracker::resolveSyncAndErrorStatus(const QString &r
     return status;
 }
 
-void SyncFileStatusTracker::invalidateParentPaths(const QString &path)
+void SyncFileStatusTracker::collectParentPaths(const QString &path, std::set<QString> &parents)
+{
+    QString parentPath = path;
+    while (!parentPath.isEmpty()) {
+        parentPath.truncate(std::max(parentPath.lastIndexOf(QLatin1Char('/')), 0));
+        if (!parents.insert(parentPath).second) {
+            // its parents were collected already
+            break;
+        }
+    }
+}
+
+void SyncFileStatusTracker::invalidateParentPaths(const std::set<QString> &parents)
 {
-    QStringList splitPath = path.split(QLatin1Char('/'), Qt::SkipEmptyParts);
-    for (int i = 0; i < splitPath.size(); ++i) {
-        QString parentPath = QStringList(splitPath.mid(0, i)).join(QLatin1Char('/'));
+    for (const auto &parentPath : parents) {
         emit fileStatusChanged(getSystemDestination(parentPath), fileStatus(parentPath));
     }
 }
 
 QString SyncFileStatusTracker::getSystemDestination(const QString &relativePath)
 {
-    QString systemPath = _syncEngine->localPath() + relativePath;
+    QString systemPath = _localPath + relativePath;
     // SyncEngine::localPath() has a trailing slash, make sure to remove it if the
     // destination is empty.
     if (systemPath.endsWith(QLatin1Char('/'))) {
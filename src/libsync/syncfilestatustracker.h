@@ -20,11 +20,18 @@
 #include "syncfileitem.h"
 #include "common/syncfilestatus.h"
 #include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <QMutex>
 #include <QSet>
 
 namespace OCC {
 
+class ExcludedFiles;
 class SyncEngine;
+class SyncJournalDb;
+class Vfs;
 
 /**
  * @brief Takes care of tracking the status of individual files as they
@@ -36,8 +43,30 @@ class OWNCLOUDSYNC_EXPORT SyncFileStatusTracker : public QObject
     Q_OBJECT
 public:
     explicit SyncFileStatusTracker(SyncEngine *syncEngine);
+
+    /**
+     * The status of a file, may be called from any thread.
+     *
+     * The sync state is only changed on the thread of the tracker, the journal
+     * and the exclude matching are safe to use from other threads. The engine
+     * isn't used, see setExcludeOptions().
+     */
     SyncFileStatus fileStatus(const QString &relativePath);
 
+    /**
+     * Takes over the options of the engine that fileStatus() needs for the
+     * exclude matching. The engine calls it whenever they change.
+     */
+    void setExcludeOptions(const QSharedPointer<Vfs> &vfs, bool ignoreHiddenFiles);
+
+    /**
+     * Like fileStatus() but remembers the result until fileStatusChanged() is
+     * emitted for the path or a sync starts or finishes.
+     *
+     * Meant for the shell integration that asks for the same files over and over.
+     */
+    SyncFileStatus cachedFileStatus(const QString &relativePath);
+
 public slots:
     void slotPathTouched(const QString &fileName);
     // path relative to folder
@@ -48,6 +77,7 @@ signals:
 
 private slots:
     void slotAboutToPropagate(const SyncFileItemSet &items);
+    void slotAboutToPropagateMore(const SyncFileItemSet &items);
     void slotItemCompleted(const SyncFileItemPtr &item);
     void slotSyncFinished();
     void slotSyncEngineRunningChanged();
@@ -66,19 +96,52 @@ private:
         PathKnown };
     SyncFileStatus resolveSyncAndErrorStatus(const QString &relativePath, SharedFlag sharedState, PathKnownFlag isPathKnown = PathKnown);
 
-    void invalidateParentPaths(const QString &path);
+    // marks the items that will be propagated as syncing and records their problems
+    void markAboutToPropagate(const SyncFileItemSet &items, std::set<QString> &invalidatedParents);
+    static void collectParentPaths(const QString &path, std::set<QString> &parents);
+    void invalidateParentPaths(const std::set<QString> &parents);
+    QString statusCacheKey(const QString &relativePath) const;
     QString getSystemDestination(const QString &relativePath);
     void incSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
     void decSyncCountAndEmitStatusChanged(const QString &relativePath, SharedFlag sharedState);
 
-    SyncEngine *_syncEngine;
+    // fixed for the lifetime of the engine
+    const QString _localPath;
+    ExcludedFiles *const _excludes;
+    SyncJournalDb *const _journal;
+
+    // guarded by _mutex, see setExcludeOptions()
+    QSharedPointer<Vfs> _vfs;
+    bool _ignoreHiddenFiles = false;
 
     ProblemsMap _syncProblems;
     QSet<QString> _dirtyPaths;
     // Counts the number direct children currently being synced (has unfinished propagation jobs).
     // We'll show a file/directory as SYNC as long as its sync count is > 0.
     // A directory that starts/ends propagation will in turn increase/decrease its own parent by 1.
-    QHash<QString, int> _syncCount;
+    // The nodes form a tree along the path components, the parents are reached without
+    // hashing their paths again. Only paths that are syncing have a node.
+    struct SyncCountNode
+    {
+        SyncCountNode *parent = nullptr;
+        QString name;
+        int count = 0;
+        std::unordered_map<QString, std::unique_ptr<SyncCountNode>> children;
+    };
+    SyncCountNode _syncCountRoot;
+
+    // nullptr if the path is not syncing and create is false
+    SyncCountNode *syncCountNode(const QString &relativePath, bool create);
+    // removes the node if it is done, returns the parent
+    SyncCountNode *pruneSyncCountNode(SyncCountNode *node);
+
+    // The results of cachedFileStatus(), entries are dropped when the status changes
+    QHash<QString, SyncFileStatus> _statusCache;
+    // Counts the invalidations of _statusCache
+    quint64 _statusCacheGeneration = 0;
+
+    // Guards the modification of the members above, the status is read from other threads
+    QMutex _mutex;
 
     // case sensitivity used for path comparisons
     Qt::CaseSensitivity _caseSensitivity;
@@ -49,6 +49,27 @@ void SyncOptions::fillFromEnvironmentVariables()
     int maxParallel = qEnvironmentVariableIntValue("OWNCLOUD_MAX_PARALLEL");
     if (maxParallel > 0)
         _parallelNetworkJobs = maxParallel;
+
+    int maxParallelTransfers = qEnvironmentVariableIntValue("OWNCLOUD_MAX_PARALLEL_TRANSFERS");
+    if (maxParallelTransfers > 0)
+        _parallelTransferJobs = maxParallelTransfers;
+
+    bool ok;
+    const qint64 maxStreamedItems = qEnvironmentVariable("OWNCLOUD_MAX_STREAMED_ITEMS").toLongLong(&ok);
+    if (ok && maxStreamedItems >= 0)
+        _maxStreamedItems = maxStreamedItems;
+}
+
+void SyncOptions::setupParallelism(bool http2)
+{
+    _http2 = http2;
+    if (http2) {
+        _parallelNetworkJobs = 32;
+        _parallelTransferJobs = 2;
+    } else {
+        _parallelNetworkJobs = 6;
+        _parallelTransferJobs = 3;
+    }
 }
 
 void SyncOptions::verifyChunkSizes()
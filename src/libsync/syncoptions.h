@@ -73,10 +73,34 @@ public:
     /** The maximum number of active jobs in parallel  */
     int _parallelNetworkJobs = 6;
 
+    /** The maximum number of jobs using bandwidth in parallel (uploads or downloads of big files) */
+    int _parallelTransferJobs = 3;
+
+    /** Whether the requests are multiplexed on a single HTTP/2 connection */
+    bool _http2 = false;
+
+    /** The maximum number of discovered items that wait for their propagation in a streamed sync.
+     *
+     * The first sync of a folder can start the propagation while the discovery
+     * still runs, the discovery pauses while more items wait. 0 disables the
+     * streaming, see SyncEngine::canStreamPropagation().
+     */
+    qint64 _maxStreamedItems = 0;
+
+    /** Sets up the parallelism for the connection to the server.
+     *
+     * With HTTP/1.1 Qt uses up to 6 connections per host. With HTTP/2 all
+     * requests are multiplexed on one connection: small requests are cheap and
+     * many of them can run in parallel, but bulk transfers share the same TCP
+     * window and delay everything queued behind them.
+     */
+    void setupParallelism(bool http2);
+
     /** Reads settings from env vars where available.
      *
      * Currently reads _initialChunkSize, _minChunkSize, _maxChunkSize,
-     * _targetChunkUploadDuration, _parallelNetworkJobs.
+     * _targetChunkUploadDuration, _parallelNetworkJobs, _parallelTransferJobs,
+     * _maxStreamedItems.
      */
     void fillFromEnvironmentVariables();
 
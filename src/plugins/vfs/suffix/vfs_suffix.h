@@ -41,6 +41,7 @@ public:
 
 
     Result<void, QString> createPlaceholder(const SyncFileItem &item) override;
+    bool canCreatePlaceholdersInBatches() const override { return true; }
 
     bool needsMetadataUpdate(const SyncFileItem &) override { return false; }
     bool isDehydratedPlaceholder(const QString &filePath) override;
@@ -0,0 +1,263 @@
+/*
+   This software is in the public domain, furnished "as is", without technical
+   support, and with no warranty, express or implied, as to its usefulness for
+   any purpose.
+*/
+
+#include <QtTest>
+
+#include "adaptivebandwidthlimiter.h"
+#include "bandwidthmanager.h"
+#include "bandwidthschedule.h"
+#include "bandwidthshaper.h"
+
+using namespace OCC;
+using namespace std::chrono_literals;
+
+namespace {
+
+/// A job that transfers as much as it is allowed to
+struct FakeTransfer
+{
+    bool limited = false;
+    bool idle = false;
+    qint64 quota = 0;
+    qint64 transferred = 0;
+
+    BandwidthShaper::Job job()
+    {
+        return { [this](bool l) { limited = l; },
+            [this](qint64 q) { quota = q; },
+            [this] { return quota; } };
+    }
+
+    void transfer()
+    {
+        if (idle) {
+            return;
+        }
+        const qint64 amount = limited ? quota : 1024 * 1024;
+        transferred += amount;
+        if (limited) {
+            quota = 0;
+        }
+    }
+};
+
+void run(BandwidthShaper &shaper, std::vector<FakeTransfer *> transfers, std::chrono::milliseconds duration)
+{
+    for (auto elapsed = 0ms; elapsed < duration; elapsed += BandwidthShaper::RefillInterval) {
+        shaper.tick(BandwidthShaper::RefillInterval);
+        for (auto *t : transfers) {
+            t->transfer();
+        }
+    }
+}
+
+bool isAround(qint64 value, qint64 expected)
+{
+    return value >= expected * 9 / 10 && value <= expected * 11 / 10;
+}
+}
+
+class TestBandwidthShaper : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testUnlimited()
+    {
+        BandwidthShaper shaper;
+        FakeTransfer t;
+        auto *folder = shaper.addNode(shaper.root(BandwidthShaper::Direction::Upload), QStringLiteral("folder"));
+        shaper.addJob(folder, t.job());
+        QVERIFY(!t.limited);
+
+        shaper.setLimit(folder, 100 * 1000);
+        QVERIFY(t.limited);
+        QCOMPARE(t.quota, qint64(0));
+
+        shaper.setLimit(folder, 0);
+        QVERIFY(!t.limited);
+    }
+
+    void testAbsoluteLimit()
+    {
+        BandwidthShaper shaper;
+        FakeTransfer t;
+        auto *folder = shaper.addNode(shaper.root(BandwidthShaper::Direction::Download), QStringLiteral("folder"));
+        shaper.setLimit(folder, 100 * 1000);
+        shaper.addJob(folder, t.job());
+        QVERIFY(t.limited);
+
+        run(shaper, { &t }, 10s);
+        QVERIFY2(isAround(t.transferred, 10 * 100 * 1000), QByteArray::number(t.transferred));
+    }
+
+    void testFairShare()
+    {
+        // two folders of the same account share the global limit
+        BandwidthShaper shaper;
+        auto *root = shaper.root(BandwidthShaper::Direction::Upload);
+        shaper.setLimit(root, 200 * 1000);
+        auto *account = shaper.groupNode(root, QStringLiteral("account"));
+        QCOMPARE(shaper.groupNode(root, QStringLiteral("account")), account);
+
+        FakeTransfer t1, t2, t3;
+        shaper.addJob(shaper.addNode(account, QStringLiteral("folder1")), t1.job());
+        auto *folder2 = shaper.addNode(account, QStringLiteral("folder2"));
+        shaper.addJob(folder2, t2.job());
+        shaper.addJob(folder2, t3.job());
+
+        run(shaper, { &t1, &t2, &t3 }, 10s);
+        // the folders get the same share, no matter how many jobs they run
+        QVERIFY2(isAround(t1.transferred, 10 * 100 * 1000), QByteArray::number(t1.transferred));
+        QVERIFY2(isAround(t2.transferred + t3.transferred, 10 * 100 * 1000), QByteArray::number(t2.transferred + t3.transferred));
+        QVERIFY(isAround(t2.transferred, t3.transferred));
+    }
+
+    void testIdleJobsDontWasteQuota()
+    {
+        BandwidthShaper shaper;
+        auto *folder = shaper.addNode(shaper.root(BandwidthShaper::Direction::Upload), QStringLiteral("folder"));
+        shaper.setLimit(folder, 100 * 1000);
+
+        FakeTransfer busy, idle;
+        idle.idle = true;
+        shaper.addJob(folder, busy.job());
+        shaper.addJob(folder, idle.job());
+
+        run(shaper, { &busy, &idle }, 10s);
+        QCOMPARE(idle.transferred, qint64(0));
+        QVERIFY2(isAround(busy.transferred, 10 * 100 * 1000), QByteArray::number(busy.transferred));
+    }
+
+    void testBurst()
+    {
+        BandwidthShaper shaper;
+        auto *folder = shaper.addNode(shaper.root(BandwidthShaper::Direction::Upload), QStringLiteral("folder"));
+        shaper.setLimit(folder, 100 * 1000);
+        FakeTransfer t;
+        t.idle = true;
+        shaper.addJob(folder, t.job());
+
+        // a long idle period must not accumulate more than the burst
+        run(shaper, { &t }, 10s);
+        t.idle = false;
+        run(shaper, { &t }, 1s);
+        const qint64 burst = 100 * 1000 * BandwidthShaper::BurstDuration.count() / 1000;
+        QVERIFY2(t.transferred <= 100 * 1000 + burst + BandwidthShaper::MinimumJobQuota, QByteArray::number(t.transferred));
+    }
+
+    void testRemoveNode()
+    {
+        BandwidthShaper shaper;
+        auto *root = shaper.root(BandwidthShaper::Direction::Upload);
+        auto *account = shaper.groupNode(root, QStringLiteral("account"));
+        auto *folder = shaper.addNode(account, QStringLiteral("folder"));
+        FakeTransfer t;
+        shaper.addJob(folder, t.job());
+
+        // removes the job with it, and the group node once it is empty
+        shaper.removeNode(folder);
+        shaper.tick(BandwidthShaper::RefillInterval);
+    }
+
+    void testScheduleParse()
+    {
+        QVERIFY(BandwidthSchedule::parse(QString())->isEmpty());
+        QVERIFY(!BandwidthSchedule::parse(QStringLiteral("Mon-Fri up=100")));
+        QVERIFY(!BandwidthSchedule::parse(QStringLiteral("Foo 08:00-18:00 up=100")));
+        QVERIFY(!BandwidthSchedule::parse(QStringLiteral("Mon 08:00-25:00 up=100")));
+        QVERIFY(!BandwidthSchedule::parse(QStringLiteral("Mon 08:00-18:00 sideways=100")));
+        QVERIFY(!BandwidthSchedule::parse(QStringLiteral("Mon 08:00-18:00 up=150%")));
+
+        auto schedule = BandwidthSchedule::parse(QStringLiteral("Mon-Wed,Fri 08:00-18:00 up=100 down=50%;\n* 22:00-06:00 down=adaptive up=none"));
+        QVERIFY(schedule);
+        QCOMPARE(schedule->rules().size(), size_t(2));
+        const auto &work = schedule->rules()[0];
+        QCOMPARE(work.days.to_string(), std::string("0010111"));
+        QCOMPARE(work.start, 8 * 60);
+        QCOMPARE(work.end, 18 * 60);
+        QCOMPARE(*work.upload, qint64(100 * 1000));
+        QCOMPARE(*work.download, qint64(-50));
+        const auto &night = schedule->rules()[1];
+        QVERIFY(night.days.all());
+        QCOMPARE(*night.upload, qint64(0));
+        QCOMPARE(*night.download, BandwidthManager::AdaptiveLimit);
+
+        // ranges wrap around the week
+        QCOMPARE(BandwidthSchedule::parse(QStringLiteral("Sat-Mon 00:00-24:00 up=1"))->rules()[0].days.to_string(), std::string("1100001"));
+    }
+
+    void testScheduleLimits()
+    {
+        const auto schedule = *BandwidthSchedule::parse(QStringLiteral("Mon-Fri 08:00-18:00 up=100; * 22:00-06:00 down=200"));
+        const BandwidthSchedule::Limits defaults { 1000, 2000 };
+        // 2024-01-01 was a Monday
+        const auto at = [](int day, int hour, int minute) { return QDateTime(QDate(2024, 1, day), QTime(hour, minute)); };
+
+        QCOMPARE(schedule.limitsAt(at(1, 7, 59), defaults), defaults);
+        QCOMPARE(schedule.limitsAt(at(1, 8, 0), defaults), (BandwidthSchedule::Limits { 100 * 1000, 2000 }));
+        QCOMPARE(schedule.limitsAt(at(1, 18, 0), defaults), defaults);
+        // saturday
+        QCOMPARE(schedule.limitsAt(at(6, 12, 0), defaults), defaults);
+        QCOMPARE(schedule.limitsAt(at(6, 23, 0), defaults), (BandwidthSchedule::Limits { 1000, 200 * 1000 }));
+        QCOMPARE(schedule.limitsAt(at(7, 5, 59), defaults), (BandwidthSchedule::Limits { 1000, 200 * 1000 }));
+
+        QCOMPARE(schedule.nextChange(at(1, 7, 0)), at(1, 8, 0));
+        QCOMPARE(schedule.nextChange(at(1, 8, 0)), at(1, 18, 0));
+        QCOMPARE(schedule.nextChange(at(1, 23, 0)), at(2, 6, 0));
+        QVERIFY(!BandwidthSchedule().nextChange(at(1, 7, 0)).isValid());
+    }
+
+    void testAdaptiveLimit()
+    {
+        BandwidthShaper shaper;
+        AdaptiveBandwidthLimiter limiter(&shaper);
+        auto *root = shaper.root(BandwidthShaper::Direction::Upload);
+        FakeTransfer t;
+        shaper.addJob(root, t.job());
+
+        limiter.setEnabled(BandwidthShaper::Direction::Upload, true);
+        QVERIFY(t.limited);
+        QCOMPARE(shaper.limit(root), AdaptiveBandwidthLimiter::MaximumRate);
+
+        const auto host = QStringLiteral("example.com");
+        auto now = AdaptiveBandwidthLimiter::Clock::now();
+        limiter.addRttSample(host, 20ms, now);
+        QCOMPARE(limiter.queueingDelay(now), 0ms);
+
+        // the transfer is fast but the latency grows, we need to back off
+        run(shaper, { &t }, 2s);
+        for (int i = 0; i < 20; ++i) {
+            limiter.addRttSample(host, 500ms, now);
+        }
+        QVERIFY(limiter.queueingDelay(now) > AdaptiveBandwidthLimiter::TargetDelay);
+        limiter.update(now);
+        const auto reduced = limiter.currentRate(BandwidthShaper::Direction::Upload);
+        QVERIFY(reduced < AdaptiveBandwidthLimiter::MaximumRate);
+        QCOMPARE(shaper.limit(root), reduced);
+
+        // don't back off again right away
+        now += 1s;
+        limiter.update(now);
+        QCOMPARE(limiter.currentRate(BandwidthShaper::Direction::Upload), reduced);
+
+        // once the latency is back to normal, the limit grows again
+        for (int i = 0; i < 40; ++i) {
+            limiter.addRttSample(host, 20ms, now);
+        }
+        limiter.update(now);
+        QVERIFY(limiter.currentRate(BandwidthShaper::Direction::Upload) > reduced);
+
+        // old samples are ignored
+        QCOMPARE(limiter.queueingDelay(now + AdaptiveBandwidthLimiter::SampleTimeout + 1s), 0ms);
+
+        limiter.setEnabled(BandwidthShaper::Direction::Upload, false);
+        QVERIFY(!t.limited);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBandwidthShaper)
+#include "testbandwidthshaper.moc"
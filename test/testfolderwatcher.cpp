@@ -11,6 +11,10 @@
 #include "folderwatcher.h"
 #include "testutils/testutils.h"
 
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#endif
+
 void touch(const QString &file)
 {
 #ifdef Q_OS_WIN
@@ -98,7 +102,8 @@ class TestFolderWatcher : public QObject
     }
 
 #ifdef Q_OS_LINUX
-#define CHECK_WATCH_COUNT(n) QCOMPARE(_watcher->testLinuxWatchCount(), (n))
+// the watches are registered asynchronously
+#define CHECK_WATCH_COUNT(n) QTRY_COMPARE(_watcher->testLinuxWatchCount(), (n))
 #else
 #define CHECK_WATCH_COUNT(n) do {} while (false)
 #endif
@@ -119,8 +124,15 @@ public:
         TestUtils::writeRandomFile(_rootPath + "/a2/renamefile");
         TestUtils::writeRandomFile(_rootPath + "/a1/movefile");
 
+#ifdef Q_OS_LINUX
+        // the watch counts are checked for inotify, fanotify is tested separately
+        qputenv("OWNCLOUD_NO_FANOTIFY", "1");
+#endif
         _watcher.reset(new FolderWatcher);
         _watcher->init(_rootPath);
+#ifdef Q_OS_LINUX
+        qunsetenv("OWNCLOUD_NO_FANOTIFY");
+#endif
         _pathChangedSpy.reset(new QSignalSpy(_watcher.data(), &FolderWatcher::pathChanged));
     }
 
@@ -250,6 +262,133 @@ private slots:
         mkdir(dir);
         QVERIFY(waitForPathChanged(dir));
     }
+
+#ifndef Q_OS_MAC
+    void testRenameHint()
+    {
+        const QString file(_rootPath + "/a2/hint");
+        const QString renamed(_rootPath + "/a2/hint.renamed");
+        touch(file);
+        QVERIFY(waitForPathChanged(file));
+
+        QSignalSpy spy(_watcher.data(), &FolderWatcher::pathsRenamed);
+        mv(file, renamed);
+        QVERIFY(waitForPathChanged(renamed));
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.first().first().value<QHash<QString, QString>>().value(file), renamed);
+    }
+#endif
+
+    void testCoalesceChanges()
+    {
+        const QString root = QStringLiteral("/sync");
+        QSet<QString> paths;
+        for (int i = 0; i < 5; ++i) {
+            paths.insert(root + "/a/few" + QString::number(i));
+        }
+        for (int i = 0; i < 20; ++i) {
+            paths.insert(root + "/b/many/" + QString::number(i));
+            // the root is never reported
+            paths.insert(root + "/" + QString::number(i));
+        }
+        paths.insert(root + "/b/many/sub/deep");
+        // directories that are coalesced count for their parent
+        for (int i = 0; i < 11; ++i) {
+            for (int j = 0; j < 11; ++j) {
+                paths.insert(root + "/c/d" + QString::number(i) + "/" + QString::number(j));
+            }
+        }
+
+        const auto result = FolderWatcher::coalesceChanges(paths, root, 10);
+        QCOMPARE(result.size(), 5 + 20 + 2);
+        QVERIFY(result.contains(root + "/a/few0"));
+        QVERIFY(result.contains(root + "/0"));
+        QVERIFY(result.contains(root + "/b/many"));
+        QVERIFY(!result.contains(root + "/b/many/0"));
+        QVERIFY(!result.contains(root + "/b/many/sub/deep"));
+        QVERIFY(result.contains(root + "/c"));
+        QVERIFY(!result.contains(root + "/c/d0"));
+
+        // below the threshold nothing changes
+        QCOMPARE(FolderWatcher::coalesceChanges(paths, root, 1000), paths);
+    }
+
+#ifdef Q_OS_LINUX
+    void benchmarkInotifyRegistration()
+    {
+        QTemporaryDir tree;
+        for (int i = 0; i < 20; ++i) {
+            for (int j = 0; j < 20; ++j) {
+                for (int k = 0; k < 5; ++k) {
+                    QDir(tree.path()).mkpath(QStringLiteral("%1/%2/%3").arg(i).arg(j).arg(k));
+                }
+            }
+        }
+        const int folders = countFolders(tree.path()) + 1;
+
+        qputenv("OWNCLOUD_NO_FANOTIFY", "1");
+        QBENCHMARK {
+            FolderWatcher watcher;
+            QElapsedTimer duration;
+            duration.start();
+            watcher.init(tree.path());
+            // the gui thread must not walk the tree
+            QVERIFY(duration.elapsed() < 1000);
+            while (watcher.testLinuxWatchCount() < folders && duration.elapsed() < 30000) {
+                QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+            }
+            QCOMPARE(watcher.testLinuxWatchCount(), folders);
+        }
+        qunsetenv("OWNCLOUD_NO_FANOTIFY");
+    }
+
+    void testInotifyOverflow()
+    {
+        QSignalSpy renamesMissedSpy(_watcher.data(), &FolderWatcher::renamesMissed);
+        QSignalSpy lostChangesSpy(_watcher.data(), &FolderWatcher::lostChanges);
+
+        // the kernel reports a dropped event queue without a watch and a name
+        inotify_event event = {};
+        event.wd = -1;
+        event.mask = IN_Q_OVERFLOW;
+        _watcher->testLinuxHandleEvents(QByteArray(reinterpret_cast<const char *>(&event), sizeof(event)));
+        QCOMPARE(renamesMissedSpy.count(), 1);
+        QCOMPARE(lostChangesSpy.count(), 1);
+    }
+
+    void testFanotify()
+    {
+        FolderWatcher watcher;
+        watcher.init(_rootPath);
+        if (watcher.testLinuxWatchCount() != 0) {
+            QSKIP("fanotify is not permitted, inotify is used");
+        }
+        QSignalSpy spy(&watcher, &FolderWatcher::pathChanged);
+        auto changed = [&spy](const QString &path) {
+            return std::any_of(spy.cbegin(), spy.cend(), [&path](const QList<QVariant> &args) { return args.first().value<QSet<QString>>().contains(path); });
+        };
+
+        // no watches are needed for new directories
+        const QString dir(_rootPath + "/a2/fanotify");
+        mkdir(dir);
+        QTRY_VERIFY(changed(dir));
+        const QString file(dir + "/file");
+        touch(file);
+        QTRY_VERIFY(changed(file));
+
+        const QString renamed(_rootPath + "/a2/fanotify.renamed");
+        mv(dir, renamed);
+        QTRY_VERIFY(changed(dir));
+        QTRY_VERIFY(changed(renamed));
+
+        // changes outside of the folder are not reported
+        QTemporaryDir outside;
+        touch(outside.path() + "/file");
+        touch(_rootPath + "/a2/fanotify.renamed/file");
+        QTRY_VERIFY(changed(_rootPath + "/a2/fanotify.renamed/file"));
+        QVERIFY(!changed(outside.path() + "/file"));
+    }
+#endif
 };
 
 #ifdef Q_OS_MAC
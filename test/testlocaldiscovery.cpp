@@ -192,6 +192,81 @@ private slots:
         QVERIFY(tracker.localDiscoveryPaths().empty());
     }
 
+    // Renames reported by the folder watcher are used instead of the inode lookup
+    void testRenameHints()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+        if (filesAreDehydrated) {
+            QSKIP("The placeholders are renamed with their suffix");
+        }
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        int moves = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "MOVE") {
+                ++moves;
+            }
+            return nullptr;
+        });
+
+        LocalDiscoveryTracker tracker;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, &tracker, &LocalDiscoveryTracker::slotItemCompleted);
+        connect(&fakeFolder.syncEngine(), &SyncEngine::finished, &tracker, &LocalDiscoveryTracker::slotSyncFinished);
+
+        // a chain of renames collapses to a single hint
+        fakeFolder.localModifier().rename(QStringLiteral("A/a1"), QStringLiteral("A/a1renamed"));
+        fakeFolder.localModifier().rename(QStringLiteral("A/a1renamed"), QStringLiteral("B/a1moved"));
+        tracker.addRenameHint(QStringLiteral("A/a1"), QStringLiteral("A/a1renamed"));
+        tracker.addRenameHint(QStringLiteral("A/a1renamed"), QStringLiteral("B/a1moved"));
+        tracker.addTouchedPath(QStringLiteral("A/a1"));
+        tracker.addTouchedPath(QStringLiteral("B/a1moved"));
+        QCOMPARE(tracker.renameHints(), (QHash<QString, QString> { { QStringLiteral("B/a1moved"), QStringLiteral("A/a1") } }));
+
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, tracker.localDiscoveryPaths());
+        fakeFolder.syncEngine().setLocalRenameHints(tracker.renameHints(), true);
+        tracker.startSyncPartialDiscovery();
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(moves, 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(tracker.renameHints().isEmpty());
+
+        // a hint that doesn't match the file falls back to the inode lookup
+        fakeFolder.localModifier().rename(QStringLiteral("A/a2"), QStringLiteral("A/a2renamed"));
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, { QStringLiteral("A") });
+        fakeFolder.syncEngine().setLocalRenameHints({ { QStringLiteral("A/a2renamed"), QStringLiteral("C/c1") } }, true);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(moves, 2);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // without a hint a complete watcher says it is a new file
+        fakeFolder.localModifier().rename(QStringLiteral("C/c1"), QStringLiteral("C/c1renamed"));
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, { QStringLiteral("C") });
+        fakeFolder.syncEngine().setLocalRenameHints({}, true);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(moves, 2);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Missed renames make the hints incomplete until a sync succeeded
+    void testRenameHintsIncomplete()
+    {
+        LocalDiscoveryTracker tracker;
+        QVERIFY(tracker.renameHintsComplete());
+
+        tracker.setRenameHintsIncomplete();
+        QVERIFY(!tracker.renameHintsComplete());
+        tracker.startSyncPartialDiscovery();
+        QVERIFY(tracker.renameHintsComplete());
+        // the renames of the failed sync are retried, they are still incomplete
+        tracker.slotSyncFinished(false);
+        QVERIFY(!tracker.renameHintsComplete());
+
+        tracker.startSyncPartialDiscovery();
+        tracker.slotSyncFinished(true);
+        QVERIFY(tracker.renameHintsComplete());
+    }
+
     void testDirectoryAndSubDirectory()
     {
         QFETCH_GLOBAL(Vfs::Mode, vfsMode);
@@ -0,0 +1,122 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "logger.h"
+
+#include "testutils/syncenginetestutils.h"
+#include "testutils/testutils.h"
+
+#include <QLoggingCategory>
+#include <QScopeGuard>
+#include <QTest>
+
+#include <thread>
+#include <vector>
+
+using namespace OCC;
+
+Q_LOGGING_CATEGORY(lcTestLogger, "sync.testlogger", QtInfoMsg)
+
+class TestLogger : public QObject
+{
+    Q_OBJECT
+
+    const QTemporaryDir _dir = TestUtils::createTempDir();
+
+    QString logToFile(const QString &name)
+    {
+        const QString path = _dir.filePath(name);
+        Logger::instance()->setLogFile(path);
+        return path;
+    }
+
+private Q_SLOTS:
+    void cleanup()
+    {
+        Logger::instance()->setLogFile(QStringLiteral("-"));
+    }
+
+    void testConcurrentLogging()
+    {
+        const QString path = logToFile(QStringLiteral("concurrent.log"));
+        const int threadCount = 4;
+        const int messageCount = 1000;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t) {
+            threads.emplace_back([t] {
+                for (int i = 0; i < messageCount; ++i) {
+                    qCInfo(lcTestLogger) << "thread" << t << "message" << i;
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        Logger::instance()->flush();
+
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVector<int> next(threadCount, 0);
+        while (!file.atEnd()) {
+            const QString line = QString::fromUtf8(file.readLine());
+            if (!line.contains(QLatin1String("sync.testlogger"))) {
+                continue;
+            }
+            // the time of the call is kept, not the one of the writer
+            QVERIFY(QDateTime::fromString(line.left(21), QStringLiteral("yy-MM-dd hh:mm:ss:zzz")).isValid());
+            const auto parts = line.section(QLatin1String(":\t"), 1).split(QLatin1Char(' '));
+            QCOMPARE(parts.size(), 4);
+            const int t = parts[1].toInt();
+            // the messages of a thread stay in order
+            QCOMPARE(parts[3].trimmed().toInt(), next[t]);
+            ++next[t];
+        }
+        QCOMPARE(next, QVector<int>(threadCount, messageCount));
+    }
+
+    void testFlushAfterSetLogFile()
+    {
+        const QString path = logToFile(QStringLiteral("flush.log"));
+        qCInfo(lcTestLogger) << "a single message";
+        Logger::instance()->flush();
+
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVERIFY(file.readAll().contains("a single message"));
+    }
+
+    // A sync with the debug log, as used for the analysis of issues
+    void benchmarkLogHeavySync()
+    {
+        logToFile(QStringLiteral("sync.log"));
+        // the sync's qCDebug messages are filtered out by default
+        const bool logDebug = Logger::instance()->logDebug();
+        Logger::instance()->setLogDebug(true);
+        const auto restoreLogDebug = qScopeGuard([logDebug] { Logger::instance()->setLogDebug(logDebug); });
+        FakeFolder fakeFolder { FileInfo::A12_B12_C12_S12() };
+        for (int i = 0; i < 100; ++i) {
+            fakeFolder.remoteModifier().insert(QStringLiteral("A/file%1").arg(i));
+        }
+        const auto dropped = Logger::instance()->droppedMessages();
+
+        int round = 0;
+        QBENCHMARK {
+            for (int i = 0; i < 100; ++i) {
+                fakeFolder.remoteModifier().appendByte(QStringLiteral("A/file%1").arg(i));
+            }
+            fakeFolder.remoteModifier().insert(QStringLiteral("B/round%1").arg(round++));
+            QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        }
+        Logger::instance()->flush();
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        qCInfo(lcTestLogger) << "Dropped" << Logger::instance()->droppedMessages() - dropped << "messages";
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLogger)
+#include "testlogger.moc"
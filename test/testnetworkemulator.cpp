@@ -0,0 +1,155 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "testutils/syncenginetestutils.h"
+#include "testutils/testutils.h"
+
+#include <QTest>
+
+using namespace std::chrono_literals;
+using namespace OCC::FileSystem::SizeLiterals;
+using namespace OCC;
+
+class TestNetworkEmulator : public QObject
+{
+    Q_OBJECT
+
+    static QNetworkReply *get(FakeAM &am, const QString &path)
+    {
+        return am.get(QNetworkRequest(QUrl(sRootUrl.toString() + path)));
+    }
+
+    static qint64 waitForFinished(const std::vector<QNetworkReply *> &replies)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (auto *reply : replies) {
+            if (!reply->isFinished()) {
+                QSignalSpy spy(reply, &QNetworkReply::finished);
+                if (!spy.wait(10000)) {
+                    return -1;
+                }
+            }
+        }
+        return timer.elapsed();
+    }
+
+private Q_SLOTS:
+    void testConditionsFromString()
+    {
+        const auto conditions = NetworkEmulator::Conditions::fromString(QStringLiteral("rtt=200, jitter=20,down=2500000,up=1000,connections=6,429=0.1,503=0.2,retry-after=3,seed=7"));
+        QCOMPARE(conditions.rtt, 200ms);
+        QCOMPARE(conditions.jitter, 20ms);
+        QCOMPARE(conditions.downloadBandwidth, qint64(2500000));
+        QCOMPARE(conditions.uploadBandwidth, qint64(1000));
+        QCOMPARE(conditions.maxConnections, 6);
+        QCOMPARE(conditions.tooManyRequestsRate, 0.1);
+        QCOMPARE(conditions.unavailableRate, 0.2);
+        QCOMPARE(conditions.retryAfter, 3s);
+        QCOMPARE(conditions.seed, 7u);
+        QVERIFY(!conditions.isIdeal());
+        QVERIFY(NetworkEmulator::Conditions::fromString(QString()).isIdeal());
+    }
+
+    void testRoundTrip()
+    {
+        FakeAM am(FileInfo::A12_B12_C12_S12());
+        NetworkEmulator::Conditions conditions;
+        conditions.rtt = 200ms;
+        am.networkEmulator().setConditions(conditions);
+
+        auto *reply = get(am, QStringLiteral("A/a1"));
+        const qint64 elapsed = waitForFinished({ reply });
+        QVERIFY(elapsed >= 200);
+        QCOMPARE(reply->error(), QNetworkReply::NoError);
+        QCOMPARE(static_cast<quint64>(reply->readAll().size()), static_cast<quint64>(FileModifier::DefaultFileSize));
+    }
+
+    void testBandwidth()
+    {
+        FakeAM am(FileInfo::A12_B12_C12_S12());
+        am.currentRemoteState().insert(QStringLiteral("A/big1"), 50_kb);
+        am.currentRemoteState().insert(QStringLiteral("A/big2"), 50_kb);
+        NetworkEmulator::Conditions conditions;
+        conditions.downloadBandwidth = 200 * 1000;
+        am.networkEmulator().setConditions(conditions);
+
+        // both share the link, each takes 250 ms alone (50 kB at 200 kB/s), 500 ms together
+        auto *big1 = get(am, QStringLiteral("A/big1"));
+        auto *big2 = get(am, QStringLiteral("A/big2"));
+        const qint64 elapsed = waitForFinished({ big1, big2 });
+        // the transfers start before the timer, allow for the timer granularity
+        QVERIFY2(elapsed >= 450, qPrintable(QString::number(elapsed)));
+    }
+
+    void testConnectionLimit()
+    {
+        FakeAM am(FileInfo::A12_B12_C12_S12());
+        NetworkEmulator::Conditions conditions;
+        conditions.rtt = 50ms;
+        conditions.maxConnections = 2;
+        am.networkEmulator().setConditions(conditions);
+
+        std::vector<QNetworkReply *> replies;
+        for (int i = 1; i <= 6; ++i) {
+            replies.push_back(get(am, QStringLiteral("A/a%1").arg(i % 2 + 1)));
+        }
+        // three rounds of two requests
+        const qint64 elapsed = waitForFinished(replies);
+        QVERIFY(elapsed >= 150);
+        QCOMPARE(am.networkEmulator().peakConnections(), 2);
+        QCOMPARE(am.networkEmulator().activeConnections(), 0);
+    }
+
+    void testInjectedErrors()
+    {
+        FakeAM am(FileInfo::A12_B12_C12_S12());
+        NetworkEmulator::Conditions conditions;
+        conditions.tooManyRequestsRate = 1;
+        conditions.retryAfter = 2s;
+        am.networkEmulator().setConditions(conditions);
+
+        auto *reply = get(am, QStringLiteral("A/a1"));
+        QVERIFY(waitForFinished({ reply }) >= 0);
+        QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 429);
+        QCOMPARE(reply->rawHeader("Retry-After"), QByteArrayLiteral("2"));
+
+        conditions.tooManyRequestsRate = 0;
+        conditions.unavailableRate = 1;
+        am.networkEmulator().setConditions(conditions);
+        reply = get(am, QStringLiteral("A/a1"));
+        QVERIFY(waitForFinished({ reply }) >= 0);
+        QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 503);
+        QCOMPARE(am.networkEmulator().injectedErrors(), 2);
+    }
+
+    void testSync()
+    {
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12());
+        NetworkEmulator::Conditions conditions;
+        conditions.rtt = 20ms;
+        conditions.jitter = 10ms;
+        conditions.uploadBandwidth = 1000 * 1000;
+        conditions.downloadBandwidth = 1000 * 1000;
+        conditions.maxConnections = 3;
+        fakeFolder.networkEmulator().setConditions(conditions);
+
+        fakeFolder.localModifier().insert(QStringLiteral("A/new"), 100_kb);
+        fakeFolder.remoteModifier().insert(QStringLiteral("B/new"), 100_kb);
+        fakeFolder.remoteModifier().mkdir(QStringLiteral("D"));
+        for (int i = 0; i < 10; ++i) {
+            fakeFolder.remoteModifier().insert(QStringLiteral("D/d%1").arg(i));
+        }
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(fakeFolder.networkEmulator().peakConnections() <= 3);
+        QCOMPARE(fakeFolder.networkEmulator().activeConnections(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestNetworkEmulator)
+#include "testnetworkemulator.moc"
@@ -0,0 +1,120 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "requestcoalescer.h"
+
+#include "account.h"
+#include "networkjobs.h"
+
+#include "testutils/syncenginetestutils.h"
+
+#include <QTest>
+
+using namespace OCC;
+
+class TestRequestCoalescer : public QObject
+{
+    Q_OBJECT
+
+    static FakeAM::Override countPropfinds(int *count, const QString &path)
+    {
+        return [count, path](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "PROPFIND" && request.url().path().endsWith(path)) {
+                ++*count;
+            }
+            return nullptr;
+        };
+    }
+
+    static RequestEtagJob *startEtagJob(FakeFolder &fakeFolder, const QString &path, QString *etag)
+    {
+        auto *job = new RequestEtagJob(fakeFolder.account(), fakeFolder.account()->davUrl(), path);
+        QObject::connect(job, &RequestEtagJob::finishedSignal, job, [job, etag] { *etag = job->etag(); });
+        job->start();
+        return job;
+    }
+
+private Q_SLOTS:
+    void testSharedReply()
+    {
+        FakeFolder fakeFolder { FileInfo::A12_B12_C12_S12() };
+        int requests = 0;
+        fakeFolder.setServerOverride(countPropfinds(&requests, QStringLiteral("/A")));
+        const auto before = RequestCoalescer::instance()->stats();
+
+        QString etag1, etag2;
+        startEtagJob(fakeFolder, QStringLiteral("/A"), &etag1);
+        startEtagJob(fakeFolder, QStringLiteral("/A"), &etag2);
+
+        QTRY_VERIFY(!etag1.isEmpty() && !etag2.isEmpty());
+        QCOMPARE(etag1, etag2);
+        QCOMPARE(requests, 1);
+
+        const auto after = RequestCoalescer::instance()->stats();
+        QCOMPARE(after.eligible - before.eligible, quint64(2));
+        QCOMPARE(after.coalesced - before.coalesced, quint64(1));
+
+        // nothing is cached, the next request goes to the server
+        QString etag3;
+        startEtagJob(fakeFolder, QStringLiteral("/A"), &etag3);
+        QTRY_VERIFY(!etag3.isEmpty());
+        QCOMPARE(requests, 2);
+    }
+
+    void testDifferentRequests()
+    {
+        FakeFolder fakeFolder { FileInfo::A12_B12_C12_S12() };
+        int requestsA = 0;
+        int requestsB = 0;
+        const auto countA = countPropfinds(&requestsA, QStringLiteral("/A"));
+        const auto countB = countPropfinds(&requestsB, QStringLiteral("/B"));
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *data) {
+            countA(op, request, data);
+            return countB(op, request, data);
+        });
+        const auto before = RequestCoalescer::instance()->stats();
+
+        QString etagA, etagB;
+        startEtagJob(fakeFolder, QStringLiteral("/A"), &etagA);
+        startEtagJob(fakeFolder, QStringLiteral("/B"), &etagB);
+
+        QTRY_VERIFY(!etagA.isEmpty() && !etagB.isEmpty());
+        QVERIFY(etagA != etagB);
+        QCOMPARE(requestsA, 1);
+        QCOMPARE(requestsB, 1);
+        QCOMPARE(RequestCoalescer::instance()->stats().coalesced, before.coalesced);
+    }
+
+    void testAbortedLeader()
+    {
+        FakeFolder fakeFolder { FileInfo::A12_B12_C12_S12() };
+        int requests = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "PROPFIND" && request.url().path().endsWith(QLatin1String("/A"))) {
+                // the first request never gets an answer
+                if (requests++ == 0) {
+                    return new FakeHangingReply(op, request, this);
+                }
+            }
+            return nullptr;
+        });
+
+        QString etag1, etag2;
+        auto *leader = startEtagJob(fakeFolder, QStringLiteral("/A"), &etag1);
+        startEtagJob(fakeFolder, QStringLiteral("/A"), &etag2);
+        QCOMPARE(requests, 1);
+
+        // the follower must not be affected by the abort
+        leader->abort();
+        QTRY_VERIFY(!etag2.isEmpty());
+        QVERIFY(etag1.isEmpty());
+        QCOMPARE(requests, 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestRequestCoalescer)
+#include "testrequestcoalescer.moc"
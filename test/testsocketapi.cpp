@@ -0,0 +1,87 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "socketapi/socketapi_p.h"
+
+using namespace OCC;
+
+class TestSocketApi : public QObject
+{
+    Q_OBJECT
+
+    static QStringList sentMessages(const QBuffer &buffer)
+    {
+        return QString::fromUtf8(buffer.data()).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+    }
+
+private slots:
+    void testReservedReplies()
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        auto listener = QSharedPointer<SocketListener>::create(&buffer);
+        const QString directory = QStringLiteral("/folder/dir");
+        listener->registerMonitoredDirectory(qHash(directory));
+
+        const auto first = listener->reserveReply();
+        const auto second = listener->reserveReply();
+        listener->sendMessage(QStringLiteral("VERSION:1.0"));
+        QCOMPARE(listener->queueStatusPushIfDirectoryMonitored(directory + QStringLiteral("/a"), QStringLiteral("STATUS:SYNC:/folder/dir/a"), qHash(directory)),
+            SocketListener::PushResult::Queued);
+        // the pushes wait for the replies, they might be newer
+        QCOMPARE(listener->flushStatusPushes(10), 0);
+
+        listener->sendReservedReply(second, QStringLiteral("STATUS:OK:/folder/dir/b"));
+        QVERIFY(buffer.data().isEmpty());
+        listener->sendReservedReply(first, QStringLiteral("STATUS:OK:/folder/dir/a"));
+        QCOMPARE(sentMessages(buffer),
+            QStringList({ QStringLiteral("STATUS:OK:/folder/dir/a"), QStringLiteral("STATUS:OK:/folder/dir/b"), QStringLiteral("VERSION:1.0") }));
+        QVERIFY(!listener->hasReservedReplies());
+
+        QCOMPARE(listener->flushStatusPushes(10), 1);
+        QCOMPARE(sentMessages(buffer).last(), QStringLiteral("STATUS:SYNC:/folder/dir/a"));
+    }
+
+    void testDroppedPushes()
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        auto listener = QSharedPointer<SocketListener>::create(&buffer);
+        const QString full = QStringLiteral("/folder/full");
+        const QString other = QStringLiteral("/folder/other");
+        listener->registerMonitoredDirectory(qHash(full));
+        listener->registerMonitoredDirectory(qHash(other));
+
+        auto push = [&](const QString &path) {
+            const QString directory = path.left(path.lastIndexOf(QLatin1Char('/')));
+            return listener->queueStatusPushIfDirectoryMonitored(path, QStringLiteral("STATUS:SYNC:") + path, qHash(directory));
+        };
+        for (size_t i = 0; i < SocketListener::MaxQueuedPushes; ++i) {
+            QCOMPARE(push(full + QStringLiteral("/%1").arg(i)), SocketListener::PushResult::Queued);
+        }
+        QCOMPARE(push(full + QStringLiteral("/new")), SocketListener::PushResult::Dropped);
+        QCOMPARE(push(other + QStringLiteral("/new")), SocketListener::PushResult::Dropped);
+        // queued paths are still updated
+        QCOMPARE(push(full + QStringLiteral("/0")), SocketListener::PushResult::Merged);
+        QCOMPARE(listener->queuedStatusPushes(), SocketListener::MaxQueuedPushes);
+
+        // the directories of the dropped pushes are remembered to push their entries again
+        QCOMPARE(listener->takeDroppedDirectories(), QSet<QString>({ full, other }));
+        QVERIFY(listener->takeDroppedDirectories().isEmpty());
+
+        while (listener->hasQueuedStatusPushes()) {
+            QVERIFY(listener->flushStatusPushes(1000) > 0);
+        }
+        QCOMPARE(push(full + QStringLiteral("/new")), SocketListener::PushResult::Queued);
+        QVERIFY(listener->takeDroppedDirectories().isEmpty());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSocketApi)
+#include "testsocketapi.moc"
@@ -0,0 +1,384 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+/*
+ * Benchmarks of whole syncs of generated trees against the fake server.
+ *
+ * Each benchmark reports the wall time of the measured sync as its QtTest result,
+ * the allocations, the peak RSS, the memory held by the sync items and the number
+ * of requests are logged and appended as a JSON line to the file in
+ * OWNCLOUD_BENCHMARK_REPORT. The peak RSS includes the trees of the fake server,
+ * the item memory is what the client itself keeps per changed file.
+ *
+ * The default trees are small enough for ctest, larger trees are given with
+ * OWNCLOUD_BENCHMARK_TREES as a comma separated list of
+ * files:depth:fan-out:file size, e.g. "2000000:4:12:0". OWNCLOUD_BENCHMARK_NETWORK
+ * emulates a network between the client and the fake server, e.g.
+ * "rtt=200,down=2500000,up=2500000,connections=6", see NetworkEmulator::Conditions.
+ * With injected errors a phase syncs until the sync succeeds.
+ */
+
+#include "testutils/syncenginetestutils.h"
+#include "testutils/testutils.h"
+
+#include <QDirIterator>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QSet>
+#include <QTest>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+using namespace OCC;
+
+Q_LOGGING_CATEGORY(lcSyncBenchmark, "sync.testsyncbenchmark", QtInfoMsg)
+
+// Count the allocations of the whole process, the sanitizers bring their own operator new
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define OC_SANITIZED_BUILD
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define OC_SANITIZED_BUILD
+#endif
+
+namespace {
+std::atomic<quint64> allocations = 0;
+
+// the syncs of a phase with injected errors
+constexpr int maxAttemptsC = 10;
+}
+
+#ifndef OC_SANITIZED_BUILD
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+namespace {
+
+struct Tree
+{
+    qint64 files;
+    int depth;
+    int fanOut;
+    quint64 fileSize;
+};
+}
+
+Q_DECLARE_METATYPE(Tree)
+
+namespace {
+/// The fan-out directories per level down to the depth, the files are spread over all directories
+void generate(FileInfo &root, const Tree &tree)
+{
+    QStringList dirs = { QString() };
+    QStringList level = { QString() };
+    for (int depth = 0; depth < tree.depth; ++depth) {
+        QStringList next;
+        for (const auto &parent : qAsConst(level)) {
+            for (int i = 0; i < tree.fanOut; ++i) {
+                const QString dir = QStringLiteral("%1d%2").arg(parent).arg(i);
+                root.mkdir(dir);
+                next.append(dir + QLatin1Char('/'));
+            }
+        }
+        dirs.append(next);
+        level = std::move(next);
+    }
+    for (qint64 i = 0; i < tree.files; ++i) {
+        root.insert(QStringLiteral("%1f%2.dat").arg(dirs[i % dirs.size()]).arg(i), tree.fileSize);
+    }
+}
+
+/// The files of the tree in the sync folder
+QStringList generatedFiles(const QString &localPath)
+{
+    QStringList out;
+    QDirIterator it(localPath, { QStringLiteral("f*.dat") }, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        out.append(it.next());
+    }
+    return out;
+}
+
+#if defined(Q_OS_LINUX)
+void resetPeakRss()
+{
+    // resets VmHWM, since Linux 4.0
+    QFile file(QStringLiteral("/proc/self/clear_refs"));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write("5");
+    }
+}
+
+qint64 peakRss()
+{
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    for (const auto &line : file.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+#elif defined(Q_OS_WIN)
+void resetPeakRss() { }
+
+qint64 peakRss()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return -1;
+    }
+    return counters.PeakWorkingSetSize;
+}
+#else
+// the peak of the whole process
+void resetPeakRss() { }
+
+qint64 peakRss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+#endif
+
+/// The bytes of the items and of their strings, the buffers that are shared are counted once
+qint64 itemBytes(const SyncFileItemSet &items)
+{
+    QSet<const void *> seen;
+    qint64 bytes = 0;
+    auto addBuffer = [&](const void *data, qint64 capacity) {
+        if (capacity > 0 && !seen.contains(data)) {
+            seen.insert(data);
+            bytes += sizeof(QArrayData) + capacity;
+        }
+    };
+    auto addString = [&](const QString &string) { addBuffer(string.constData(), string.capacity() * static_cast<qint64>(sizeof(QChar))); };
+    auto addBytes = [&](const QByteArray &data) { addBuffer(data.constData(), data.capacity()); };
+    for (const auto &item : items) {
+        bytes += sizeof(SyncFileItem);
+        addString(item->_file);
+        addString(item->_renameTarget);
+        addString(item->_originalFile);
+        addString(item->_errorString);
+        addString(item->_etag);
+        addBytes(item->_responseTimeStamp);
+        addBytes(item->_requestId);
+        addBytes(item->_fileId);
+        addBytes(item->_checksumHeader);
+        if (item->_directDownload && !seen.contains(item->_directDownload.data())) {
+            seen.insert(item->_directDownload.data());
+            bytes += sizeof(SyncFileItem::DirectDownload);
+            addString(item->_directDownload->url);
+            addString(item->_directDownload->cookies);
+        }
+    }
+    return bytes;
+}
+
+/**
+ * Measures a sync of the fake folder
+ */
+class Phase
+{
+public:
+    Phase(FakeFolder &fakeFolder, const QString &name)
+        : _fakeFolder(fakeFolder)
+        , _name(name)
+    {
+        fakeFolder.setServerOverride([this](QNetworkAccessManager::Operation, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            ++_requests;
+            return nullptr;
+        });
+        // the propagation holds the items until the sync is done, they are measured with their results
+        auto keepItems = [this](const SyncFileItemSet &items) { _items.insert(_items.end(), items.cbegin(), items.cend()); };
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate, &_context, keepItems);
+        QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagateMore, &_context, keepItems);
+    }
+
+    ~Phase() { _fakeFolder.setServerOverride({}); }
+
+    bool sync()
+    {
+        resetPeakRss();
+        const quint64 allocationsBefore = allocations.load();
+        QElapsedTimer timer;
+        timer.start();
+        bool ok = _fakeFolder.syncOnce();
+        const auto &conditions = _fakeFolder.networkEmulator().conditions();
+        for (int attempt = 1; !ok && attempt < maxAttemptsC && (conditions.tooManyRequestsRate > 0 || conditions.unavailableRate > 0); ++attempt) {
+            ok = _fakeFolder.syncOnce();
+        }
+        const qint64 elapsed = timer.elapsed();
+        const quint64 allocated = allocations.load() - allocationsBefore;
+        const qint64 rss = peakRss();
+        const qint64 items = static_cast<qint64>(_items.size());
+        const qint64 itemMemory = itemBytes(_items);
+        _items.clear();
+
+        QTest::setBenchmarkResult(elapsed, QTest::WalltimeMilliseconds);
+        const QString row = QString::fromUtf8(QTest::currentDataTag());
+        qCInfo(lcSyncBenchmark).noquote() << QStringLiteral("%1 %2: %3 ms, %4 allocations, %5 MiB peak RSS, %6 items in %7 KiB, %8 requests, %9 concurrent")
+                                                 .arg(_name, row)
+                                                 .arg(elapsed)
+                                                 .arg(allocated)
+                                                 .arg(rss / (1024.0 * 1024.0), 0, 'f', 1)
+                                                 .arg(items)
+                                                 .arg(itemMemory / 1024.0, 0, 'f', 1)
+                                                 .arg(_requests)
+                                                 .arg(_fakeFolder.networkEmulator().peakConnections());
+
+        const QString report = qEnvironmentVariable("OWNCLOUD_BENCHMARK_REPORT");
+        if (!report.isEmpty()) {
+            QFile file(report);
+            if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                const QJsonObject result{ { QStringLiteral("phase"), _name }, { QStringLiteral("tree"), row }, { QStringLiteral("ms"), elapsed },
+                    { QStringLiteral("allocations"), static_cast<qint64>(allocated) }, { QStringLiteral("peakRss"), rss },
+                    { QStringLiteral("items"), items }, { QStringLiteral("itemBytes"), itemMemory },
+                    { QStringLiteral("requests"), _requests }, { QStringLiteral("success"), ok } };
+                file.write(QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n');
+            }
+        }
+        return ok;
+    }
+
+private:
+    FakeFolder &_fakeFolder;
+    QString _name;
+    int _requests = 0;
+    QObject _context;
+    SyncFileItemSet _items;
+};
+}
+
+class TestSyncBenchmark : public QObject
+{
+    Q_OBJECT
+
+    std::unique_ptr<FakeFolder> generatedFolder(const Tree &tree)
+    {
+        auto fakeFolder = std::make_unique<FakeFolder>(FileInfo());
+        generate(fakeFolder->remoteModifier(), tree);
+        fakeFolder->networkEmulator().setConditions(NetworkEmulator::Conditions::fromString(qEnvironmentVariable("OWNCLOUD_BENCHMARK_NETWORK")));
+        // the mass deletes remove everything
+        connect(&fakeFolder->syncEngine(), &SyncEngine::aboutToRemoveAllFiles, this,
+            [](SyncFileItem::Direction, const std::function<void(bool)> &callback) { callback(false); });
+        return fakeFolder;
+    }
+
+private Q_SLOTS:
+    void initTestCase_data()
+    {
+        QTest::addColumn<Tree>("tree");
+
+        QTest::newRow("1k files, depth 2, fan-out 8, 1 KiB") << Tree{ 1000, 2, 8, 1024 };
+        QTest::newRow("1k files, flat, empty") << Tree{ 1000, 0, 0, 0 };
+
+        const auto trees = qEnvironmentVariable("OWNCLOUD_BENCHMARK_TREES").split(QLatin1Char(','), Qt::SkipEmptyParts);
+        for (const auto &spec : trees) {
+            const auto values = spec.split(QLatin1Char(':'));
+            if (values.size() != 4) {
+                qFatal("Invalid tree %s in OWNCLOUD_BENCHMARK_TREES, expected files:depth:fan-out:file size", qPrintable(spec));
+            }
+            const Tree tree{ values[0].toLongLong(), values[1].toInt(), values[2].toInt(), values[3].toULongLong() };
+            QTest::newRow(qPrintable(QStringLiteral("%1 files, depth %2, fan-out %3, %4 bytes").arg(tree.files).arg(tree.depth).arg(tree.fanOut).arg(tree.fileSize)))
+                << tree;
+        }
+    }
+
+    void benchmarkInitialSync()
+    {
+        QFETCH_GLOBAL(Tree, tree);
+        auto fakeFolder = generatedFolder(tree);
+
+        Phase phase(*fakeFolder, QStringLiteral("initial sync"));
+        QVERIFY(phase.sync());
+        QCOMPARE(static_cast<qint64>(generatedFiles(fakeFolder->localPath()).size()), tree.files);
+    }
+
+    void benchmarkNoChangeSync()
+    {
+        QFETCH_GLOBAL(Tree, tree);
+        auto fakeFolder = generatedFolder(tree);
+        QVERIFY(fakeFolder->syncOnce());
+
+        Phase phase(*fakeFolder, QStringLiteral("no change sync"));
+        ItemCompletedSpy completeSpy(*fakeFolder);
+        QVERIFY(phase.sync());
+        QVERIFY(completeSpy.isEmpty());
+    }
+
+    void benchmarkMassRename()
+    {
+        QFETCH_GLOBAL(Tree, tree);
+        auto fakeFolder = generatedFolder(tree);
+        QVERIFY(fakeFolder->syncOnce());
+
+        for (const auto &file : generatedFiles(fakeFolder->localPath())) {
+            const QFileInfo info(file);
+            QVERIFY(QFile::rename(file, info.dir().filePath(QLatin1Char('r') + info.fileName().mid(1))));
+        }
+        Phase phase(*fakeFolder, QStringLiteral("mass rename"));
+        QVERIFY(phase.sync());
+        QCOMPARE(fakeFolder->currentLocalState(), fakeFolder->currentRemoteState());
+    }
+
+    void benchmarkMassDelete()
+    {
+        QFETCH_GLOBAL(Tree, tree);
+        auto fakeFolder = generatedFolder(tree);
+        QVERIFY(fakeFolder->syncOnce());
+
+        for (const auto &file : generatedFiles(fakeFolder->localPath())) {
+            QVERIFY(QFile::remove(file));
+        }
+        Phase phase(*fakeFolder, QStringLiteral("mass delete"));
+        QVERIFY(phase.sync());
+        QCOMPARE(fakeFolder->currentLocalState(), fakeFolder->currentRemoteState());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncBenchmark)
+#include "testsyncbenchmark.moc"
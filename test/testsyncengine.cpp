@@ -5,11 +5,15 @@
  *
  */
 
+#include <common/syncprofiler.h>
+#include <httplogger.h>
+#include <metrics.h>
 #include <syncengine.h>
 
 #include "testutils/syncenginetestutils.h"
 #include "testutils/testutils.h"
 
+#include <QLocalSocket>
 #include <QtTest>
 
 using namespace std::chrono_literals;
@@ -86,6 +90,125 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void testHttpTrace()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        const auto dir = TestUtils::createTempDir();
+        const QString traceFile = dir.filePath(QStringLiteral("trace.jsonl"));
+        HttpLogger::setTraceFile(traceFile);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        fakeFolder.localModifier().insert(QStringLiteral("A/a0"), 100);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        HttpLogger::setTraceFile(QString());
+
+        QFile file(traceFile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        int puts = 0;
+        int propfinds = 0;
+        while (!file.atEnd()) {
+            const auto event = QJsonDocument::fromJson(file.readLine()).object();
+            QVERIFY(!event.isEmpty());
+            QVERIFY(event.value(QStringLiteral("total")).toDouble() >= 0);
+            const QString verb = event.value(QStringLiteral("verb")).toString();
+            if (verb == QLatin1String("PUT") && event.value(QStringLiteral("path")).toString().endsWith(QLatin1String("A/a0"))) {
+                QCOMPARE(event.value(QStringLiteral("sent")).toInt(), 100);
+                QCOMPARE(event.value(QStringLiteral("status")).toInt() / 100, 2);
+                ++puts;
+            } else if (verb == QLatin1String("PROPFIND")) {
+                ++propfinds;
+            }
+        }
+        QCOMPARE(puts, 1);
+        QVERIFY(propfinds > 0);
+    }
+
+    void testSyncProfile()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        SyncProfiler::setEnabled(true);
+        fakeFolder.remoteModifier().insert(QStringLiteral("A/a0"));
+        fakeFolder.localModifier().insert(QStringLiteral("B/b0"));
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        SyncProfiler::setEnabled(false);
+
+        const QString report = SyncProfiler::report();
+        for (const auto &name : { "sync sync", "sync discovery", "sync propagation", "discovery directory", "propagator " }) {
+            QVERIFY2(report.contains(QLatin1String(name)), name);
+        }
+
+        const auto dir = TestUtils::createTempDir();
+        const QString traceFile = dir.filePath(QStringLiteral("profile.json"));
+        QVERIFY(SyncProfiler::writeChromeTrace(traceFile));
+        QFile file(traceFile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QJsonParseError error;
+        const auto trace = QJsonDocument::fromJson(file.readAll(), &error).object();
+        QCOMPARE(error.error, QJsonParseError::NoError);
+        const auto events = trace.value(QStringLiteral("traceEvents")).toArray();
+        QVERIFY(!events.isEmpty());
+        QVERIFY(std::any_of(events.begin(), events.end(), [](const QJsonValue &event) {
+            return event.toObject().value(QStringLiteral("cat")).toString() == QLatin1String("db");
+        }));
+
+        // nothing is recorded while disabled
+        SyncProfiler::reset();
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QVERIFY(!SyncProfiler::report().contains(QLatin1String("sync sync")));
+    }
+
+    void testMetrics()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        const auto dir = TestUtils::createTempDir();
+        const QString socketName = dir.filePath(QStringLiteral("metrics"));
+        QVERIFY(Metrics::instance()->listen(socketName));
+        QVERIFY(Metrics::isEnabled());
+#ifndef Q_OS_WIN
+        // only the user may read the metrics
+        QCOMPARE(QFileInfo(socketName).permissions() & (QFileDevice::ReadGroup | QFileDevice::WriteGroup | QFileDevice::ReadOther | QFileDevice::WriteOther), QFileDevice::Permissions());
+#endif
+
+        fakeFolder.localModifier().insert(QStringLiteral("A/a0"), 1_kb);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        Metrics::setEnabled(false);
+
+        const QByteArray folder = "folder=\"" + fakeFolder.localPath().toUtf8() + '"';
+        const QByteArray exposition = Metrics::instance()->exposition();
+        QVERIFY(exposition.contains("# TYPE owncloud_syncs_total counter\n"));
+        QVERIFY(exposition.contains("owncloud_syncs_total{" + folder + ",result=\"success\"} "));
+        QVERIFY(exposition.contains("owncloud_sync_duration_seconds_bucket{" + folder + ",le=\"+Inf\"} "));
+        QVERIFY(exposition.contains("owncloud_discovery_duration_seconds_count{" + folder + "} "));
+        QVERIFY(exposition.contains("owncloud_journal_size_bytes{" + folder + "} "));
+        QVERIFY(exposition.contains("owncloud_propagated_items_total{job=\"OCC::PropagateUploadFile"));
+        QVERIFY(exposition.contains("owncloud_propagated_bytes_total{direction=\"Up\"} "));
+        QVERIFY(exposition.contains("# TYPE owncloud_job_queue_size gauge\n"));
+
+        // scrape it like Prometheus would
+        QLocalSocket socket;
+        QByteArray response;
+        connect(&socket, &QLocalSocket::readyRead, &socket, [&] { response += socket.readAll(); });
+        socket.connectToServer(socketName);
+        socket.write("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        QTRY_COMPARE(socket.state(), QLocalSocket::UnconnectedState);
+        QVERIFY(response.startsWith("HTTP/1.1 200 OK\r\n"));
+        QVERIFY(response.contains("owncloud_syncs_total{" + folder + ",result=\"success\"} "));
+
+        // only served on loopback addresses
+        QVERIFY(!Metrics::instance()->listen(QStringLiteral("0.0.0.0:0")));
+        QVERIFY(!Metrics::instance()->listen(QStringLiteral("192.0.2.1:0")));
+        QVERIFY(Metrics::instance()->listen(QStringLiteral("127.0.0.1:0")));
+        Metrics::setEnabled(false);
+    }
+
     void testDirDownload() {
         QFETCH_GLOBAL(Vfs::Mode, vfsMode);
         QFETCH_GLOBAL(bool, filesAreDehydrated);
@@ -848,6 +971,59 @@ private slots:
         QCOMPARE(nPUT, 3);
     }
 
+    // With HTTP/2 many small requests run in parallel, while the bulk transfers are limited
+    void testHttp2Scheduling()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo {}, vfsMode, filesAreDehydrated);
+        SyncOptions options = fakeFolder.syncEngine().syncOptions();
+        options.setupParallelism(true);
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        QObject parent;
+        int runningBulk = 0;
+        int runningSmall = 0;
+        int maxBulk = 0;
+        int maxTotal = 0;
+        int smallWhileBulkLimited = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                const auto payload = outgoingData->readAll();
+                const bool bulk = payload.size() >= qint64(100_kb);
+                ++(bulk ? runningBulk : runningSmall);
+                maxBulk = std::max(maxBulk, runningBulk);
+                maxTotal = std::max(maxTotal, runningBulk + runningSmall);
+                // the big transfers are slow, the small ones must not wait for them
+                auto reply = new DelayedReply<FakePutReply>(bulk ? 500ms : 50ms, fakeFolder.remoteModifier(), op, request, payload, &parent);
+                connect(reply, &QNetworkReply::finished, &parent, [&, bulk] {
+                    --(bulk ? runningBulk : runningSmall);
+                    if (!bulk && runningBulk == options._parallelTransferJobs) {
+                        ++smallWhileBulkLimited;
+                    }
+                });
+                return reply;
+            }
+            return nullptr;
+        });
+
+        for (int i = 0; i < 4; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("big%1").arg(i), 1_mb);
+        }
+        for (int i = 0; i < 30; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("small%1").arg(i), 1_kb);
+        }
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        QCOMPARE(maxBulk, options._parallelTransferJobs);
+        // more than the 6 connections of HTTP/1.1
+        QVERIFY(maxTotal > 6);
+        // the small uploads were done while the big ones used all their slots
+        QVERIFY(smallWhileBulkLimited >= 10);
+    }
+
 #ifndef Q_OS_WIN
     void testPropagatePermissions()
     {
@@ -942,6 +1118,147 @@ private slots:
         QVERIFY(!fakeFolder.currentLocalState().find(QStringLiteral("A")));
         QVERIFY(!fakeFolder.currentLocalState().find(QStringLiteral("S")));
     }
+
+    void testStreamedInitialSync()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo {}, vfsMode, filesAreDehydrated);
+        SyncOptions options = fakeFolder.syncEngine().syncOptions();
+        options._maxStreamedItems = 4;
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        for (const auto &dir : { QStringLiteral("A"), QStringLiteral("B"), QStringLiteral("B/sub"), QStringLiteral("C") }) {
+            fakeFolder.remoteModifier().mkdir(dir);
+            for (int i = 0; i < 5; ++i) {
+                fakeFolder.remoteModifier().insert(QStringLiteral("%1/f%2").arg(dir).arg(i));
+            }
+        }
+        fakeFolder.localModifier().mkdir(QStringLiteral("D"));
+        fakeFolder.localModifier().insert(QStringLiteral("D/local"));
+
+        QSignalSpy startedSpy(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate);
+        QSignalSpy batchSpy(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagateMore);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(startedSpy.count(), 1);
+        // the directories were handed over while the discovery went on
+        QVERIFY(batchSpy.count() > 1);
+
+        // the next sync has the file records and propagates at once
+        batchSpy.clear();
+        fakeFolder.remoteModifier().insert(QStringLiteral("A/new"));
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(batchSpy.isEmpty());
+    }
+
+    void testProgressTotals()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        for (int i = 0; i < 20; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("A/up%1").arg(i), (10 + i) * 1_kb);
+            fakeFolder.remoteModifier().insert(QStringLiteral("B/down%1").arg(i), (10 + i) * 1_kb);
+        }
+
+        qint64 maxCompletedSize = 0;
+        bool done = false;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, this, [&](const ProgressInfo &progress) {
+            if (progress.status() == ProgressInfo::Propagation) {
+                // the running totals never go back or beyond the total
+                QVERIFY(progress.completedSize() >= maxCompletedSize);
+                QVERIFY(progress.completedSize() <= progress.totalSize());
+                maxCompletedSize = progress.completedSize();
+
+                // the biggest of the running items come first
+                qint64 biggestSize = -1;
+                for (const auto &item : progress._currentItems) {
+                    if (ProgressInfo::isSizeDependent(item._item)) {
+                        biggestSize = std::max(biggestSize, item._item._size);
+                    }
+                }
+                const auto biggest = progress.biggestCurrentItems(3);
+                QCOMPARE(biggest.size(), std::min<size_t>(3, progress._currentItems.size()));
+                if (biggestSize >= 0) {
+                    QCOMPARE(biggest.front()->_item._size, biggestSize);
+                }
+                for (size_t i = 1; i < biggest.size(); ++i) {
+                    QVERIFY(!ProgressInfo::isSizeDependent(biggest[i]->_item) || biggest[i - 1]->_item._size >= biggest[i]->_item._size);
+                }
+            } else if (progress.status() == ProgressInfo::Done) {
+                QCOMPARE(progress.completedSize(), progress.totalSize());
+                QCOMPARE(progress.completedFiles(), progress.totalFiles());
+                QVERIFY(progress._currentItems.isEmpty());
+                done = true;
+            }
+        });
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QVERIFY(done);
+    }
+
+    void testProgressCompletedItems()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        for (int i = 0; i < 10; ++i) {
+            fakeFolder.localModifier().insert(QStringLiteral("A/up%1").arg(i), 100_kb);
+            fakeFolder.remoteModifier().insert(QStringLiteral("B/down%1").arg(i), 100_kb);
+        }
+
+        // the report of a completed item must not be throttled, the recent changes are taken from it
+        QString lastCompletedFile;
+        bool lastIsProgressOnly = true;
+        int progressOnly = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, this, [&](const ProgressInfo &progress) {
+            lastCompletedFile = progress._lastCompletedItem._file;
+            lastIsProgressOnly = progress.isTransferProgressOnly();
+            if (lastIsProgressOnly) {
+                ++progressOnly;
+            }
+        });
+        int completed = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, this, [&](const SyncFileItemPtr &item) {
+            if (item->_instruction == CSYNC_INSTRUCTION_NEW && item->_type == ItemTypeFile) {
+                QCOMPARE(lastCompletedFile, item->_file);
+                QVERIFY(!lastIsProgressOnly);
+                ++completed;
+            }
+        });
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        // the downloads are virtual files with vfs
+        QVERIFY(completed >= 10);
+        QVERIFY(progressOnly > 0);
+    }
+
+    void testIgnoredItemsShareMessage()
+    {
+        QFETCH_GLOBAL(Vfs::Mode, vfsMode);
+        QFETCH_GLOBAL(bool, filesAreDehydrated);
+
+        FakeFolder fakeFolder(FileInfo::A12_B12_C12_S12(), vfsMode, filesAreDehydrated);
+        fakeFolder.syncEngine().excludedFiles().addManualExclude(QStringLiteral("*.ignored"));
+        fakeFolder.localModifier().insert(QStringLiteral("A/a.ignored"));
+        fakeFolder.localModifier().insert(QStringLiteral("B/b.ignored"));
+
+        SyncFileItemSet discovery;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::aboutToPropagate, this, [&discovery](auto v) { discovery = v; });
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+
+        std::vector<SyncFileItemPtr> ignored;
+        std::copy_if(discovery.cbegin(), discovery.cend(), std::back_inserter(ignored), [](const SyncFileItemPtr &item) {
+            return item->_instruction == CSYNC_INSTRUCTION_IGNORE;
+        });
+        QCOMPARE(ignored.size(), size_t(2));
+        // the items keep one copy of the message between them
+        QVERIFY(!ignored[0]->_errorString.isEmpty());
+        QCOMPARE(ignored[0]->_errorString.constData(), ignored[1]->_errorString.constData());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
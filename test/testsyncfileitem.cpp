@@ -6,6 +6,8 @@
 
 #include <QtTest>
 
+#include <algorithm>
+
 #include "syncfileitem.h"
 
 using namespace OCC;
@@ -63,6 +65,90 @@ private slots:
         QVERIFY(!(b < b));
         QVERIFY(!(c < c));
     }
+
+    void testSortByDestination()
+    {
+        auto items = generateItems(5000, 6);
+        items.push_back(createItemPtr(QStringLiteral("client")));
+        items.push_back(createItemPtr(QStringLiteral("client-build")));
+        items.push_back(createItemPtr(QStringLiteral("client/build")));
+        auto expected = items;
+        std::sort(expected.begin(), expected.end());
+
+        sortByDestination(items);
+        QVERIFY(std::is_sorted(items.cbegin(), items.cend()));
+        QVERIFY(items == expected);
+    }
+
+    void testSortByDestinationIsStable()
+    {
+        // duplicates in a small range and in one that is scattered by the radix sort
+        auto items = generateItems(100, 1);
+        for (int i = 0; i < 20; ++i) {
+            items.push_back(createItemPtr(QStringLiteral("dup")));
+        }
+        for (int i = 0; i < 50; ++i) {
+            items.push_back(createItemPtr(QStringLiteral("a/f1")));
+        }
+        auto expected = items;
+        std::stable_sort(expected.begin(), expected.end());
+
+        sortByDestination(items);
+        QVERIFY(items == expected);
+    }
+
+    void benchmarkSort_data()
+    {
+        QTest::addColumn<bool>("radix");
+        QTest::newRow("sortByDestination") << true;
+        QTest::newRow("std::sort") << false;
+    }
+
+    void benchmarkSort()
+    {
+        QFETCH(bool, radix);
+        const auto items = generateItems(200000, 8);
+        QBENCHMARK {
+            auto sorted = items;
+            if (radix) {
+                sortByDestination(sorted);
+            } else {
+                std::sort(sorted.begin(), sorted.end());
+            }
+        }
+    }
+
+private:
+    /// Paths in a tree of the given depth, with the characters that sort around '/'
+    static SyncFileItemSet generateItems(int count, int depth)
+    {
+        const QStringList names = { QStringLiteral("a"), QStringLiteral("a-b"), QStringLiteral("a.b"), QStringLiteral("A"), QStringLiteral("\u00e9"),
+            QStringLiteral("\u4e2d"), QStringLiteral("z") };
+        QRandomGenerator random(42);
+        SyncFileItemSet items;
+        for (int i = 0; i < count; ++i) {
+            QString path = QStringLiteral("f%1").arg(i);
+            for (int level = random.bounded(depth + 1); level > 0; --level) {
+                path.prepend(names[random.bounded(names.size())] + QLatin1Char('/'));
+            }
+            auto item = SyncFileItemPtr::create();
+            if (i % 10 == 0) {
+                item->_file = QStringLiteral("source/") + path;
+                item->_renameTarget = path;
+            } else {
+                item->_file = path;
+            }
+            items.push_back(item);
+        }
+        return items;
+    }
+
+    static SyncFileItemPtr createItemPtr(const QString &file)
+    {
+        auto item = SyncFileItemPtr::create();
+        item->_file = file;
+        return item;
+    }
 };
 
 QTEST_APPLESS_MAIN(TestSyncFileItem)
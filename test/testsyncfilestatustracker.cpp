@@ -9,6 +9,11 @@
 #include "testutils/syncenginetestutils.h"
 #include "csync_exclude.h"
 
+#include <QScopeGuard>
+
+#include <atomic>
+#include <memory>
+
 using namespace OCC;
 
 class StatusPushSpy : public QSignalSpy
@@ -401,6 +406,33 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void parentsOfErrorsEmittedOnce() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.localModifier().mkdir(QStringLiteral("A/sub"));
+        for (int i = 0; i < 20; ++i) {
+            const QString path = QStringLiteral("A/sub/e%1").arg(i);
+            fakeFolder.localModifier().insert(path);
+            fakeFolder.serverErrorPaths().append(path);
+        }
+        QVERIFY(!fakeFolder.applyLocalModificationsAndSync());
+
+        // the errors are blacklisted now, they mark their parents already before the propagation
+        StatusPushSpy statusSpy(fakeFolder.syncEngine());
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        verifyThatPushMatchesPull(fakeFolder, statusSpy);
+        QCOMPARE(statusSpy.statusOf("A/sub"), SyncFileStatus(SyncFileStatus::StatusWarning));
+        QCOMPARE(statusSpy.statusOf("A"), SyncFileStatus(SyncFileStatus::StatusWarning));
+        const auto pushesOf = [&](const QString &relativePath) {
+            const QFileInfo file(fakeFolder.localPath(), relativePath);
+            return std::count_if(statusSpy.cbegin(), statusSpy.cend(), [&](const QList<QVariant> &args) { return QFileInfo(args[0].toString()) == file; });
+        };
+        // once for the item of the directory and once for the errors below it
+        QVERIFY(pushesOf(QStringLiteral("A/sub")) <= 2);
+        QVERIFY(pushesOf(QStringLiteral("A")) <= 2);
+        fakeFolder.execUntilFinished();
+    }
+
     void parentsGetWarningStatusForError_SibblingStartsWithPath() {
         // A is a parent of A/a1, but A/a is not even if it's a substring of A/a1
         FakeFolder fakeFolder{{QString{},{
@@ -489,6 +521,91 @@ private slots:
         QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
     }
 
+    void cachedStatus() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+        auto verifyThatCacheMatches = [&] {
+            QDirIterator it(fakeFolder.localPath(), QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                const QString filePath = it.next().mid(fakeFolder.localPath().size());
+                QCOMPARE(tracker.cachedFileStatus(filePath), tracker.fileStatus(filePath));
+            }
+        };
+        verifyThatCacheMatches();
+        QCOMPARE(tracker.cachedFileStatus(QStringLiteral("B/b1")), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+
+        // the file watcher saw a change
+        fakeFolder.localModifier().appendByte(QStringLiteral("B/b1"));
+        fakeFolder.applyLocalModificationsWithoutSync();
+        tracker.slotPathTouched(fakeFolder.localPath() + QStringLiteral("B/b1"));
+        QCOMPARE(tracker.cachedFileStatus(QStringLiteral("B/b1")), SyncFileStatus(SyncFileStatus::StatusSync));
+
+        fakeFolder.scheduleSync();
+        fakeFolder.execUntilBeforePropagation();
+        verifyThatCacheMatches();
+        QCOMPARE(tracker.cachedFileStatus(QStringLiteral("B")), SyncFileStatus(SyncFileStatus::StatusSync));
+
+        fakeFolder.execUntilFinished();
+        verifyThatCacheMatches();
+        QCOMPARE(tracker.cachedFileStatus(QStringLiteral("B/b1")), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        QCOMPARE(tracker.cachedFileStatus(QString()), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+    }
+
+    void concurrentStatus() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+        fakeFolder.localModifier().appendByte(QStringLiteral("A/a1"));
+        fakeFolder.remoteModifier().appendByte(QStringLiteral("B/b1"));
+        fakeFolder.remoteModifier().insert(QStringLiteral("C/c3"));
+
+        // the shell integration asks from another thread while the sync changes the status
+        std::atomic<bool> done(false);
+        std::atomic<int> lookups(0);
+        std::unique_ptr<QThread> reader(QThread::create([&] {
+            const QStringList paths = { QString(), QStringLiteral("A"), QStringLiteral("A/a1"), QStringLiteral("B/b1"), QStringLiteral("C/c3") };
+            while (!done) {
+                for (const auto &path : paths) {
+                    tracker.cachedFileStatus(path);
+                    tracker.fileStatus(path);
+                }
+                ++lookups;
+            }
+        }));
+        reader->start();
+        {
+            auto stopReader = qScopeGuard([&] {
+                done = true;
+                reader->wait();
+            });
+            // the folder replaces the options while the shell integration asks
+            for (int i = 0; i < 100; ++i) {
+                fakeFolder.syncEngine().setSyncOptions(fakeFolder.syncEngine().syncOptions());
+                fakeFolder.syncEngine().setIgnoreHiddenFiles(i % 2 == 0);
+            }
+            fakeFolder.syncEngine().setIgnoreHiddenFiles(false);
+            QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+            QTRY_VERIFY(lookups > 0);
+        }
+
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        for (const auto &path : { QString(), QStringLiteral("A/a1"), QStringLiteral("B/b1"), QStringLiteral("C/c3") }) {
+            QCOMPARE(tracker.cachedFileStatus(path), SyncFileStatus(SyncFileStatus::StatusUpToDate));
+        }
+    }
+
+    void hiddenFilesOption() {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        auto &tracker = fakeFolder.syncEngine().syncFileStatusTracker();
+        fakeFolder.localModifier().insert(QStringLiteral("A/.hidden"));
+        fakeFolder.applyLocalModificationsWithoutSync();
+
+        // the tracker follows the option without asking the engine
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        QCOMPARE(tracker.fileStatus(QStringLiteral("A/.hidden")), SyncFileStatus(SyncFileStatus::StatusExcluded));
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(false);
+        QVERIFY(tracker.fileStatus(QStringLiteral("A/.hidden")) != SyncFileStatus(SyncFileStatus::StatusExcluded));
+    }
+
     void renameError() {
         FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
         fakeFolder.serverErrorPaths().append(QStringLiteral("A/a1"));
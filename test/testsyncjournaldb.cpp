@@ -170,6 +170,52 @@ private slots:
         QVERIFY(!wipedRecord._valid);
     }
 
+    void testChecksumCache()
+    {
+        SyncJournalDb::ChecksumCacheKey key;
+        key.inode = std::numeric_limits<quint32>::max() + 42ull;
+        key.size = 12894789147;
+        key.modtime = 1234567;
+        key.changeTime = 1234568;
+        QVERIFY(_db.getCachedChecksum(key, CheckSums::Algorithm::SHA1).isEmpty());
+
+        _db.setCachedChecksum(key, CheckSums::Algorithm::SHA1, "abcdef");
+        QCOMPARE(_db.getCachedChecksum(key, CheckSums::Algorithm::SHA1), QByteArrayLiteral("abcdef"));
+        QVERIFY(_db.getCachedChecksum(key, CheckSums::Algorithm::MD5).isEmpty());
+
+        // Any change of the file's metadata invalidates the entry
+        auto changed = key;
+        changed.size += 1;
+        QVERIFY(_db.getCachedChecksum(changed, CheckSums::Algorithm::SHA1).isEmpty());
+        changed = key;
+        changed.modtime += 1;
+        QVERIFY(_db.getCachedChecksum(changed, CheckSums::Algorithm::SHA1).isEmpty());
+        changed = key;
+        changed.changeTime += 1;
+        QVERIFY(_db.getCachedChecksum(changed, CheckSums::Algorithm::SHA1).isEmpty());
+
+        // A new entry for the same inode replaces the old one
+        _db.setCachedChecksum(changed, CheckSums::Algorithm::SHA1, "123456");
+        QCOMPARE(_db.getCachedChecksum(changed, CheckSums::Algorithm::SHA1), QByteArrayLiteral("123456"));
+        QVERIFY(_db.getCachedChecksum(key, CheckSums::Algorithm::SHA1).isEmpty());
+
+        // Entries of inodes without a file record are pruned
+        SyncJournalFileRecord record;
+        record._path = "checksumcached";
+        record._inode = changed.inode;
+        record._type = ItemTypeFile;
+        record._etag = "etag";
+        record._remotePerm = RemotePermissions::fromDbValue("RW");
+        QVERIFY(_db.setFileRecord(record));
+        auto other = key;
+        other.inode += 1;
+        _db.setCachedChecksum(other, CheckSums::Algorithm::SHA1, "fedcba");
+        _db.deleteStaleChecksumCacheEntries();
+        QCOMPARE(_db.getCachedChecksum(changed, CheckSums::Algorithm::SHA1), QByteArrayLiteral("123456"));
+        QVERIFY(_db.getCachedChecksum(other, CheckSums::Algorithm::SHA1).isEmpty());
+        QVERIFY(_db.deleteFileRecord(QStringLiteral("checksumcached")));
+    }
+
     void testConflictRecord()
     {
         ConflictRecord record;
@@ -12,6 +12,7 @@
 #include <syncengine.h>
 
 using namespace OCC;
+using namespace std::chrono_literals;
 
 #define DVSUFFIX APPLICATION_DOTVIRTUALFILE_SUFFIX
 
@@ -977,6 +978,151 @@ private slots:
         QVERIFY(fakeFolder.currentLocalState().find("unspec/file1" DVSUFFIX));
     }
 
+    // The placeholders of a directory are created in batches
+    void testManyNewVirtuals()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        setupVfs(fakeFolder);
+        ItemCompletedSpy completeSpy(fakeFolder);
+
+        // more than fit in one batch
+        const int count = 1200;
+        fakeFolder.remoteModifier().mkdir(QStringLiteral("A"));
+        for (int i = 0; i < count; ++i) {
+            fakeFolder.remoteModifier().insert(QStringLiteral("A/file%1").arg(i));
+        }
+        fakeFolder.remoteModifier().insert(QStringLiteral("a1"));
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+
+        for (const auto &path : { QStringLiteral("a1"), QStringLiteral("A/file0"), QStringLiteral("A/file%1").arg(count - 1) }) {
+            QVERIFY(!fakeFolder.currentLocalState().find(path));
+            QVERIFY(fakeFolder.currentLocalState().find(path + QStringLiteral(DVSUFFIX)));
+            QCOMPARE(dbRecord(fakeFolder, path + QStringLiteral(DVSUFFIX))._type, ItemTypeVirtualFile);
+        }
+        QCOMPARE(fakeFolder.currentLocalState().find("A")->children.size(), count);
+        int completed = 0;
+        for (const auto &args : completeSpy) {
+            auto item = args[0].value<SyncFileItemPtr>();
+            if (item->_file.startsWith(QLatin1String("A/file"))) {
+                QCOMPARE(item->_instruction, CSYNC_INSTRUCTION_NEW);
+                QCOMPARE(item->_status, SyncFileItem::Success);
+                ++completed;
+            }
+        }
+        QCOMPARE(completed, count);
+
+        // nothing left to do
+        completeSpy.clear();
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QVERIFY(completeSpy.isEmpty());
+    }
+
+    // An aborted batch writes the records of the placeholders it created
+    void testManyNewVirtualsAbort()
+    {
+        FakeFolder fakeFolder{ FileInfo() };
+        setupVfs(fakeFolder);
+
+        const int count = 1200;
+        fakeFolder.remoteModifier().mkdir(QStringLiteral("A"));
+        for (int i = 0; i < count; ++i) {
+            fakeFolder.remoteModifier().insert(QStringLiteral("A/file%1").arg(i));
+        }
+        auto con = QObject::connect(&fakeFolder.syncEngine(), &SyncEngine::itemCompleted, &fakeFolder.syncEngine(), &SyncEngine::abort);
+        QVERIFY(!fakeFolder.applyLocalModificationsAndSync());
+        QObject::disconnect(con);
+
+        if (const auto *dir = fakeFolder.currentLocalState().find("A")) {
+            for (const auto &child : dir->children) {
+                QVERIFY(dbRecord(fakeFolder, QStringLiteral("A/") + child.name).isValid());
+            }
+        }
+
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QCOMPARE(fakeFolder.currentLocalState().find("A")->children.size(), count);
+    }
+
+    void testHydrationPriority_data()
+    {
+        QTest::addColumn<bool>("http2");
+
+        QTest::newRow("http/1.1") << false;
+        QTest::newRow("http/2") << true;
+    }
+
+    void testHydrationPriority()
+    {
+        QFETCH(bool, http2);
+
+        FakeFolder fakeFolder{ FileInfo() };
+        setupVfs(fakeFolder);
+        SyncOptions options = fakeFolder.syncEngine().syncOptions();
+        options.setupParallelism(http2);
+        fakeFolder.syncEngine().setSyncOptions(options);
+
+        // with HTTP/2 the hydrations are bulk transfers
+        const auto size = http2 ? 200_kb : FileModifier::DefaultFileSize;
+        fakeFolder.remoteModifier().mkdir(QStringLiteral("A"));
+        fakeFolder.remoteModifier().mkdir(QStringLiteral("B"));
+        for (int i = 1; i <= 4; ++i) {
+            fakeFolder.remoteModifier().insert(QStringLiteral("A/a%1").arg(i), size);
+            fakeFolder.remoteModifier().insert(QStringLiteral("B/b%1").arg(i), size);
+        }
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+        QVERIFY(fakeFolder.currentLocalState().find("B/b4" DVSUFFIX));
+
+        QObject parent;
+        QStringList downloads;
+        int running = 0;
+        int maxRunning = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation) {
+                downloads.append(request.url().path().section(QLatin1Char('/'), -2));
+                maxRunning = std::max(maxRunning, ++running);
+                auto reply = new DelayedReply<FakeGetReply>(50ms, fakeFolder.remoteModifier(), op, request, &parent);
+                connect(reply, &QNetworkReply::finished, &parent, [&] { --running; });
+                return reply;
+            }
+            return nullptr;
+        });
+        QMap<QString, HydrationQueue::Progress> progress;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::hydrationProgress, this,
+            [&](const QString &path, const HydrationQueue::Progress &p) { progress[path] = p; });
+
+        for (int i = 1; i <= 4; ++i) {
+            triggerDownload(fakeFolder, QByteArrayLiteral("A/a") + QByteArray::number(i));
+            triggerDownload(fakeFolder, QByteArrayLiteral("B/b") + QByteArray::number(i));
+        }
+        fakeFolder.syncEngine().requestHydration(QStringLiteral("B/b3" DVSUFFIX), HydrationQueue::Priority::Opened);
+        fakeFolder.syncEngine().requestHydration(QStringLiteral("A"), HydrationQueue::Priority::Prefetch);
+        QVERIFY(fakeFolder.applyLocalModificationsAndSync());
+
+        // the opened file first, the prefetched folder last
+        QCOMPARE(downloads.size(), 8);
+        QCOMPARE(downloads.first(), QStringLiteral("B/b3"));
+        for (int i = 1; i < 4; ++i) {
+            QVERIFY(downloads[i].startsWith(QLatin1String("B/")));
+        }
+        for (int i = 4; i < 8; ++i) {
+            QVERIFY(downloads[i].startsWith(QLatin1String("A/")));
+        }
+
+        if (http2) {
+            // the queued hydrations keep to the limit of the bulk transfers, the opened file may exceed it
+            QVERIFY(maxRunning <= options._parallelTransferJobs + 1);
+        }
+
+        QCOMPARE(progress[QStringLiteral("B/b3")].files, 1);
+        QVERIFY(progress[QStringLiteral("B/b3")].isFinished());
+        QCOMPARE(progress[QStringLiteral("A")].files, 4);
+        QVERIFY(progress[QStringLiteral("A")].isFinished());
+        QCOMPARE(progress[QStringLiteral("A")].completedSize, progress[QStringLiteral("A")].size);
+        for (int i = 1; i <= 4; ++i) {
+            QVERIFY(fakeFolder.currentLocalState().find(QStringLiteral("A/a%1").arg(i)));
+            QVERIFY(fakeFolder.currentLocalState().find(QStringLiteral("B/b%1").arg(i)));
+        }
+    }
+
     // Check what happens if vfs-suffixed files exist on the server or in the db
     void testExtraFilesLocalDehydrated()
     {
@@ -0,0 +1,142 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "networkemulator.h"
+
+#include <QTimer>
+
+#include <algorithm>
+#include <memory>
+
+using namespace std::chrono;
+
+NetworkEmulator::Conditions NetworkEmulator::Conditions::fromString(const QString &spec)
+{
+    Conditions out;
+    for (const auto &entry : spec.split(QLatin1Char(','), Qt::SkipEmptyParts)) {
+        const auto keyValue = entry.split(QLatin1Char('='));
+        const QString key = keyValue.value(0).trimmed();
+        const QString value = keyValue.value(1).trimmed();
+        if (key == QLatin1String("rtt")) {
+            out.rtt = milliseconds(value.toLongLong());
+        } else if (key == QLatin1String("jitter")) {
+            out.jitter = milliseconds(value.toLongLong());
+        } else if (key == QLatin1String("down")) {
+            out.downloadBandwidth = value.toLongLong();
+        } else if (key == QLatin1String("up")) {
+            out.uploadBandwidth = value.toLongLong();
+        } else if (key == QLatin1String("connections")) {
+            out.maxConnections = value.toInt();
+        } else if (key == QLatin1String("429")) {
+            out.tooManyRequestsRate = value.toDouble();
+        } else if (key == QLatin1String("503")) {
+            out.unavailableRate = value.toDouble();
+        } else if (key == QLatin1String("retry-after")) {
+            out.retryAfter = seconds(value.toLongLong());
+        } else if (key == QLatin1String("seed")) {
+            out.seed = value.toUInt();
+        } else {
+            qFatal("Unknown network condition %s", qPrintable(key));
+        }
+    }
+    return out;
+}
+
+bool NetworkEmulator::Conditions::isIdeal() const
+{
+    return rtt.count() == 0 && jitter.count() == 0 && downloadBandwidth == 0 && uploadBandwidth == 0 && maxConnections == 0 && tooManyRequestsRate == 0
+        && unavailableRate == 0;
+}
+
+NetworkEmulator::NetworkEmulator(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void NetworkEmulator::setConditions(const Conditions &conditions)
+{
+    _conditions = conditions;
+    _random.seed(conditions.seed);
+}
+
+int NetworkEmulator::injectedError()
+{
+    if (_conditions.tooManyRequestsRate == 0 && _conditions.unavailableRate == 0) {
+        return 0;
+    }
+    const double draw = std::uniform_real_distribution<double>(0, 1)(_random);
+    int code = 0;
+    if (draw < _conditions.tooManyRequestsRate) {
+        code = 429;
+    } else if (draw < _conditions.tooManyRequestsRate + _conditions.unavailableRate) {
+        code = 503;
+    }
+    if (code) {
+        ++_injectedErrors;
+    }
+    return code;
+}
+
+void NetworkEmulator::schedule(QNetworkReply *reply, qint64 uploadBytes, qint64 downloadBytes, std::function<void()> &&respond)
+{
+    Pending pending{ reply, uploadBytes, downloadBytes, std::move(respond) };
+    if (_conditions.maxConnections > 0 && _activeConnections >= _conditions.maxConnections) {
+        _pending.push_back(std::move(pending));
+        return;
+    }
+    start(std::move(pending));
+}
+
+void NetworkEmulator::start(Pending &&pending)
+{
+    ++_activeConnections;
+    _peakConnections = std::max(_peakConnections, _activeConnections);
+
+    // the connection is released once, by whatever comes first
+    auto released = std::make_shared<bool>(false);
+    const auto release = [this, released] {
+        if (!*released) {
+            *released = true;
+            this->release();
+        }
+    };
+    connect(pending.reply.data(), &QNetworkReply::finished, this, release);
+    connect(pending.reply.data(), &QObject::destroyed, this, release);
+
+    milliseconds rtt = _conditions.rtt;
+    if (_conditions.jitter.count() > 0) {
+        rtt += milliseconds(std::uniform_int_distribution<qint64>(-_conditions.jitter.count(), _conditions.jitter.count())(_random));
+        rtt = std::max(rtt, milliseconds(0));
+    }
+    const auto now = steady_clock::now();
+    const auto sent = transfer(now, pending.uploadBytes, _conditions.uploadBandwidth, _uplinkBusyUntil);
+    const auto received = transfer(sent + rtt, pending.downloadBytes, _conditions.downloadBandwidth, _downlinkBusyUntil);
+    QTimer::singleShot(ceil<milliseconds>(received - now), pending.reply.data(), std::move(pending.respond));
+}
+
+void NetworkEmulator::release()
+{
+    --_activeConnections;
+    while (!_pending.empty()) {
+        auto next = std::move(_pending.front());
+        _pending.pop_front();
+        if (next.reply) {
+            start(std::move(next));
+            return;
+        }
+    }
+}
+
+steady_clock::time_point NetworkEmulator::transfer(steady_clock::time_point from, qint64 bytes, qint64 bandwidth, steady_clock::time_point &busyUntil)
+{
+    if (bandwidth <= 0 || bytes <= 0) {
+        return from;
+    }
+    const auto start = std::max(from, busyUntil);
+    busyUntil = start + duration_cast<steady_clock::duration>(duration<double>(static_cast<double>(bytes) / bandwidth));
+    return busyUntil;
+}
@@ -0,0 +1,100 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#pragma once
+
+#include <QNetworkReply>
+#include <QObject>
+#include <QPointer>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <random>
+
+/**
+ * Emulates the network between the client and the fake server.
+ *
+ * A reply waits for a free connection, its request is sent over the shared
+ * uplink and its response over the shared downlink, one round trip apart.
+ * The links transfer one request at a time at their bandwidth, which gives
+ * the same total time as sharing them.
+ *
+ * Requests can be answered with 429 or 503 and a Retry-After header instead.
+ */
+class NetworkEmulator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Conditions
+    {
+        std::chrono::milliseconds rtt = std::chrono::milliseconds(0);
+        /// The round trip time varies uniformly by up to this
+        std::chrono::milliseconds jitter = std::chrono::milliseconds(0);
+        /// In bytes per second, 0 means unlimited
+        qint64 downloadBandwidth = 0;
+        qint64 uploadBandwidth = 0;
+        /// The maximum of concurrent requests, 0 means unlimited
+        int maxConnections = 0;
+        /// The share of the requests answered with 429 Too Many Requests
+        double tooManyRequestsRate = 0;
+        /// The share of the requests answered with 503 Service Unavailable
+        double unavailableRate = 0;
+        std::chrono::seconds retryAfter = std::chrono::seconds(1);
+        quint32 seed = 0;
+
+        /**
+         * Parses a comma separated list of key=value, e.g.
+         * "rtt=200,jitter=20,down=2500000,up=2500000,connections=6,429=0.01,503=0.01,retry-after=2,seed=1"
+         * The times are in milliseconds, except retry-after in seconds, the bandwidths in bytes per second.
+         */
+        static Conditions fromString(const QString &spec);
+
+        bool isIdeal() const;
+    };
+
+    explicit NetworkEmulator(QObject *parent = nullptr);
+
+    const Conditions &conditions() const { return _conditions; }
+    void setConditions(const Conditions &conditions);
+
+    /// The status code to inject for the next request, 0 for none
+    int injectedError();
+
+    /**
+     * Calls respond once the reply got a connection and its request and response were transferred.
+     *
+     * The connection is released when the reply finishes or is destroyed.
+     */
+    void schedule(QNetworkReply *reply, qint64 uploadBytes, qint64 downloadBytes, std::function<void()> &&respond);
+
+    int activeConnections() const { return _activeConnections; }
+    int peakConnections() const { return _peakConnections; }
+    int injectedErrors() const { return _injectedErrors; }
+
+private:
+    struct Pending
+    {
+        QPointer<QNetworkReply> reply;
+        qint64 uploadBytes;
+        qint64 downloadBytes;
+        std::function<void()> respond;
+    };
+
+    void start(Pending &&pending);
+    void release();
+    std::chrono::steady_clock::time_point transfer(std::chrono::steady_clock::time_point from, qint64 bytes, qint64 bandwidth, std::chrono::steady_clock::time_point &busyUntil);
+
+    Conditions _conditions;
+    std::mt19937 _random;
+    std::deque<Pending> _pending;
+    int _activeConnections = 0;
+    int _peakConnections = 0;
+    int _injectedErrors = 0;
+    std::chrono::steady_clock::time_point _uplinkBusyUntil;
+    std::chrono::steady_clock::time_point _downlinkBusyUntil;
+};
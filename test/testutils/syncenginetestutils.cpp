@@ -607,6 +607,17 @@ std::pair<qint64, qint64> FakeGetReply::parseRange(const QNetworkRequest &reques
     return { 0, 0 };
 }
 
+qint64 FakeGetReply::responseSize() const
+{
+    if (state != State::Ok) {
+        return 0;
+    }
+    if (_range.second > 0) {
+        return _range.second - _range.first;
+    }
+    return fileInfo->contentSize - _range.first;
+}
+
 void FakeGetReply::respond()
 {
     switch (state) {
@@ -890,26 +901,36 @@ QNetworkReply *FakeAM::createRequest(QNetworkAccessManager::Operation op, const
             reply = new FakeErrorReply { op, newRequest, this, _errorPaths[fileName] };
         }
     }
+    if (!reply) {
+        if (const int code = _networkEmulator.injectedError()) {
+            auto *errorReply = makeReply<FakeErrorReply>(0, op, newRequest, this, code);
+            errorReply->setRawHeader("Retry-After", QByteArray::number(_networkEmulator.conditions().retryAfter.count()));
+            reply = errorReply;
+        }
+    }
     if (!reply) {
         const bool isUpload = newRequest.url().path().startsWith(sUploadUrl.path());
         FileInfo &info = isUpload ? _uploadFileInfo : _remoteRootFileInfo;
+        // the headers are not accounted for
+        const qint64 requestSize = outgoingData ? outgoingData->size() : 0;
 
         auto verb = newRequest.attribute(QNetworkRequest::CustomVerbAttribute);
         if (verb == QLatin1String("PROPFIND"))
             // Ignore outgoingData always returning somethign good enough, works for now.
-            reply = new FakePropfindReply { info, op, newRequest, this };
+            reply = makeReply<FakePropfindReply>(requestSize, info, op, newRequest, this);
         else if (verb == QLatin1String("GET") || op == QNetworkAccessManager::GetOperation)
-            reply = new FakeGetReply { info, op, newRequest, this };
-        else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation)
-            reply = new FakePutReply { info, op, newRequest, outgoingData->readAll(), this };
-        else if (verb == QLatin1String("MKCOL"))
-            reply = new FakeMkcolReply { info, op, newRequest, this };
+            reply = makeReply<FakeGetReply>(0, info, op, newRequest, this);
+        else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation) {
+            const QByteArray payload = outgoingData->readAll();
+            reply = makeReply<FakePutReply>(payload.size(), info, op, newRequest, payload, this);
+        } else if (verb == QLatin1String("MKCOL"))
+            reply = makeReply<FakeMkcolReply>(0, info, op, newRequest, this);
         else if (verb == QLatin1String("DELETE") || op == QNetworkAccessManager::DeleteOperation)
-            reply = new FakeDeleteReply { info, op, newRequest, this };
+            reply = makeReply<FakeDeleteReply>(0, info, op, newRequest, this);
         else if (verb == QLatin1String("MOVE") && !isUpload)
-            reply = new FakeMoveReply { info, op, newRequest, this };
+            reply = makeReply<FakeMoveReply>(0, info, op, newRequest, this);
         else if (verb == QLatin1String("MOVE") && isUpload)
-            reply = new FakeChunkMoveReply { info, _remoteRootFileInfo, op, newRequest, this };
+            reply = makeReply<FakeChunkMoveReply>(0, info, _remoteRootFileInfo, op, newRequest, this);
         else {
             qDebug() << verb << outgoingData;
             Q_UNREACHABLE();
@@ -16,6 +16,7 @@
 #include "filesystem.h"
 #include "folder.h"
 #include "logger.h"
+#include "networkemulator.h"
 #include "syncengine.h"
 #include "testutils.h"
 #include <cstring>
@@ -322,6 +323,9 @@ public:
 
     // useful to be public for testing
     using QNetworkReply::setRawHeader;
+
+    /// The size of the response body, for the network emulation
+    virtual qint64 responseSize() const { return 0; }
 };
 
 class FakePropfindReply : public FakeReply
@@ -333,12 +337,13 @@ public:
 
     FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     Q_INVOKABLE void respond404();
 
     void abort() override { }
 
+    qint64 responseSize() const override { return payload.size(); }
     qint64 bytesAvailable() const override;
     qint64 readData(char *data, qint64 maxlen) override;
 };
@@ -368,7 +373,7 @@ class FakeMkcolReply : public FakeReply
 public:
     FakeMkcolReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     void abort() override { }
     qint64 readData(char *, qint64) override { return 0; }
@@ -384,7 +389,7 @@ class FakeDeleteReply : public FakeReply
 public:
     FakeDeleteReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     void abort() override { }
     qint64 readData(char *, qint64) override { return 0; }
@@ -397,7 +402,7 @@ class FakeMoveReply : public FakeReply
 public:
     FakeMoveReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     void abort() override { }
     qint64 readData(char *, qint64) override { return 0; }
@@ -422,9 +427,10 @@ public:
 
     FakeGetReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent);
 
-    Q_INVOKABLE void respond();
+    Q_INVOKABLE virtual void respond();
 
     void abort() override;
+    qint64 responseSize() const override;
     virtual qint64 bytesAvailable() const override;
 
     virtual qint64 readData(char *data, qint64 maxlen) override;
@@ -526,6 +532,32 @@ public:
     }
 };
 
+// A reply that is delayed by the network emulation
+template <class OriginalReply>
+class EmulatedReply : public OriginalReply
+{
+public:
+    template <typename... Args>
+    explicit EmulatedReply(NetworkEmulator *emulator, qint64 uploadBytes, Args &&...args)
+        : OriginalReply(std::forward<Args>(args)...)
+        , _emulator(emulator)
+        , _uploadBytes(uploadBytes)
+    {
+    }
+
+    void respond() override
+    {
+        _emulator->schedule(this, _uploadBytes, this->responseSize(), [this] {
+            // Explicit call to bases's respond();
+            this->OriginalReply::respond();
+        });
+    }
+
+private:
+    NetworkEmulator *_emulator;
+    qint64 _uploadBytes;
+};
+
 class FakeAM : public OCC::AccessManager
 {
 public:
@@ -538,6 +570,7 @@ private:
     QHash<QString, int> _errorPaths;
     // monitor requests and optionally provide custom replies
     Override _override;
+    NetworkEmulator _networkEmulator;
 
 public:
     FakeAM(FileInfo initialRoot);
@@ -548,9 +581,22 @@ public:
 
     void setOverride(const Override &override) { _override = override; }
 
+    /// Emulates the network for the replies of the fake server, not for the ones of an override
+    NetworkEmulator &networkEmulator() { return _networkEmulator; }
+
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
         QIODevice *outgoingData = nullptr) override;
+
+private:
+    template <class Reply, typename... Args>
+    Reply *makeReply(qint64 uploadBytes, Args &&...args)
+    {
+        if (!_networkEmulator.conditions().isIdeal()) {
+            return new EmulatedReply<Reply>(&_networkEmulator, uploadBytes, std::forward<Args>(args)...);
+        }
+        return new Reply(std::forward<Args>(args)...);
+    }
 };
 
 class FakeCredentials : public OCC::AbstractCredentials
@@ -614,6 +660,7 @@ public:
     };
     ErrorList serverErrorPaths() { return { _fakeAm }; }
     void setServerOverride(const FakeAM::Override &override) { _fakeAm->setOverride(override); }
+    NetworkEmulator &networkEmulator() { return _fakeAm->networkEmulator(); }
 
     QString localPath() const;
 